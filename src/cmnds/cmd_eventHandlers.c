@@ -253,104 +253,187 @@ typedef struct eventHandler_s {
 	short requiredArgument2;
 	// command to execute when it happens
 	char *command;
+	// command resolved when handler is added (or later, if it
+	// was not registered yet), so firing does not parse the string again
+	command_t *cmd;
+	// first word of command, as passed to the handler
+	char *cmdName;
+	// points into command, after the first word
+	const char *cmdArgs;
+	// compiled condition, if command is "if"
+	cmdExpression_t *condition;
 	// for UART event handlers?
 	char *requiredArgumentText;
 
+	// next handler with the same eventCode
 	struct eventHandler_s *next;
+	// next handler in the same g_eventHandlersByArg bucket
+	struct eventHandler_s *nextByArg;
 } eventHandler_t;
 
-static eventHandler_t *g_eventHandlers = 0;
+// all handlers, by event code
+static eventHandler_t *g_eventHandlers[CMD_EVENT_MAX_TYPES] = { 0 };
+// all handlers again, by event code and requiredArgument,
+// for FireEvent/FireEvent2 which only look for equal argument
+#define EVENT_ARG_HASH_SIZE 64
+static eventHandler_t *g_eventHandlersByArg[EVENT_ARG_HASH_SIZE] = { 0 };
 
+static int EVENT_HashArgument(byte eventCode, short argument) {
+	unsigned int hash;
+
+	hash = eventCode * 31 + (unsigned short)argument;
+	hash ^= hash >> 6;
+	return hash & (EVENT_ARG_HASH_SIZE - 1);
+}
+
+static void EVENT_ExecuteHandler(eventHandler_t *ev) {
+	if(ev->condition) {
+		CMD_If_Execute(ev->cmdArgs, ev->condition);
+		return;
+	}
+	if(ev->cmd == 0) {
+		// maybe it was registered after adding the handler (startDriver, alias)
+		ev->cmd = CMD_FindStrippingNumbers(ev->cmdName);
+		if(ev->cmd == 0) {
+			// let it report unknown command
+			CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+			return;
+		}
+	}
+	if(ev->cmd->handler) {
+		ev->cmd->handler(ev->cmd->context, ev->cmdName, ev->cmdArgs, COMMAND_FLAG_SOURCE_SCRIPT);
+	}
+}
 
 void EventHandlers_ProcessVariableChange_Integer(byte eventCode, int oldValue, int newValue) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	if(eventCode >= CMD_EVENT_MAX_TYPES)
+		return;
+	ev = g_eventHandlers[eventCode];
 
 	while(ev) {
-		if(eventCode==ev->eventCode) {
-			if(EVENT_EvaluateChangeCondition(ev->eventType, ev->requiredArgument, oldValue, newValue)) {
-				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_ProcessVariableChange_Integer: executing command %s",ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
-			}
+		if(EVENT_EvaluateChangeCondition(ev->eventType, ev->requiredArgument, oldValue, newValue)) {
+			ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_ProcessVariableChange_Integer: executing command %s",ev->command);
+			EVENT_ExecuteHandler(ev);
 		}
 		ev = ev->next;
 	}
 }
 
-void EventHandlers_AddEventHandler_Integer(byte eventCode, int type, int requiredArgument, int requiredArgument2, const char *commandToRun)
-{
-	eventHandler_t *ev = malloc(sizeof(eventHandler_t));
-	memset(ev,0,sizeof(eventHandler_t));
+static eventHandler_t *EventHandlers_Alloc(byte eventCode, int type, int requiredArgument, int requiredArgument2, const char *commandToRun) {
+	eventHandler_t *ev;
+	const char *p;
+	int len, bucket;
 
-	ev->next = g_eventHandlers;
-	g_eventHandlers = ev;
+	if(eventCode >= CMD_EVENT_MAX_TYPES) {
+		return 0;
+	}
+	ev = malloc(sizeof(eventHandler_t));
+	if(ev == 0) {
+		return 0;
+	}
+	memset(ev,0,sizeof(eventHandler_t));
 
-	ev->requiredArgumentText = NULL;
 	ev->eventType = type;
 	ev->command = strdup(commandToRun);
 	ev->eventCode = eventCode;
 	ev->requiredArgument = requiredArgument;
 	ev->requiredArgument2 = requiredArgument2;
+
+	// split "cmd args" once, the same way CMD_ExecuteCommand does
+	p = ev->command;
+	while(isWhiteSpace(*p)) {
+		p++;
+	}
+	len = 0;
+	while(p[len] && isWhiteSpace(p[len]) == false) {
+		len++;
+	}
+	ev->cmdName = malloc(len + 1);
+	memcpy(ev->cmdName, p, len);
+	ev->cmdName[len] = 0;
+	p += len;
+	while(isWhiteSpace(*p)) {
+		p++;
+	}
+	ev->cmdArgs = p;
+	ev->cmd = CMD_FindStrippingNumbers(ev->cmdName);
+	if(!stricmp(ev->cmdName, "if")) {
+		ev->condition = CMD_If_CompileCondition(ev->cmdArgs);
+	}
+
+	ev->next = g_eventHandlers[eventCode];
+	g_eventHandlers[eventCode] = ev;
+
+	bucket = EVENT_HashArgument(eventCode, ev->requiredArgument);
+	ev->nextByArg = g_eventHandlersByArg[bucket];
+	g_eventHandlersByArg[bucket] = ev;
+
+	return ev;
 }
 
-void EventHandlers_AddEventHandler_String(byte eventCode, int type, const char *requiredArgument, const char *commandToRun)
+void EventHandlers_AddEventHandler_Integer(byte eventCode, int type, int requiredArgument, int requiredArgument2, const char *commandToRun)
 {
-	eventHandler_t *ev = malloc(sizeof(eventHandler_t));
-	memset(ev,0,sizeof(eventHandler_t));
+	EventHandlers_Alloc(eventCode, type, requiredArgument, requiredArgument2, commandToRun);
+}
 
-	ev->next = g_eventHandlers;
-	g_eventHandlers = ev;
+void EventHandlers_AddEventHandler_String(byte eventCode, int type, const char *requiredArgument, const char *commandToRun)
+{
+	eventHandler_t *ev = EventHandlers_Alloc(eventCode, type, 0, 0, commandToRun);
 
+	if(ev == 0)
+		return;
 	ev->requiredArgumentText = strdup(requiredArgument);
-	ev->eventType = type;
-	ev->command = strdup(commandToRun);
-	ev->eventCode = eventCode;
-	ev->requiredArgument = 0;
-	ev->requiredArgument2 = 0;
 }
 void EventHandlers_FireEvent2(byte eventCode, int argument, int argument2) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EVENT_HashArgument(eventCode, argument)];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
 			if(argument == ev->requiredArgument && argument2 == ev->requiredArgument2) {
 				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent2: executing command %s",ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+				EVENT_ExecuteHandler(ev);
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextByArg;
 	}
 }
 void EventHandlers_FireEvent(byte eventCode, int argument) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EVENT_HashArgument(eventCode, argument)];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
 			if(argument == ev->requiredArgument) {
 				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent: executing command %s",ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+				EVENT_ExecuteHandler(ev);
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextByArg;
 	}
 }
+// lets callers skip preparing an event argument nobody waits for
+bool EventHandlers_HasEventHandler(byte eventCode) {
+	if(eventCode >= CMD_EVENT_MAX_TYPES)
+		return false;
+	return g_eventHandlers[eventCode] != 0;
+}
 void EventHandlers_FireEvent_String(byte eventCode, const char *argument) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	if(eventCode >= CMD_EVENT_MAX_TYPES)
+		return;
+	ev = g_eventHandlers[eventCode];
 
 	while(ev) {
-		if(eventCode==ev->eventCode) {
-			if(ev->requiredArgumentText != 0) {
-				if(!stricmp(argument,ev->requiredArgumentText)) {
-					ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent_String: executing command %s",ev->command);
-					CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
-				}
+		if(ev->requiredArgumentText != 0) {
+			if(!stricmp(argument,ev->requiredArgumentText)) {
+				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent_String: executing command %s",ev->command);
+				EVENT_ExecuteHandler(ev);
 			}
 		}
 		ev = ev->next;
@@ -424,22 +507,31 @@ static commandResult_t CMD_AddEventHandler(const void *context, const char *cmd,
 commandResult_t CMD_ClearAllHandlers(const void *context, const char *cmd, const char *args, int cmdFlags){
 
 	int c = 0;
+	int i;
 	eventHandler_t *ev, *next;
 
-	ev = g_eventHandlers;
+	for(i = 0; i < CMD_EVENT_MAX_TYPES; i++) {
+		ev = g_eventHandlers[i];
 
-	while(ev != 0) {
-		next = ev->next;
+		while(ev != 0) {
+			next = ev->next;
 
-		free(ev->command);
-		free(ev);
+			free(ev->command);
+			free(ev->cmdName);
+			free(ev->condition);
+			free(ev->requiredArgumentText);
+			free(ev);
 
-		ev = next;
-		c++;
+			ev = next;
+			c++;
+		}
+		g_eventHandlers[i] = 0;
+	}
+	for(i = 0; i < EVENT_ARG_HASH_SIZE; i++) {
+		g_eventHandlersByArg[i] = 0;
 	}
 
 	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Fried %i handlers\n", c);
-	g_eventHandlers = 0;
 
 	return CMD_RES_OK;
 }
@@ -488,15 +580,19 @@ static commandResult_t CMD_AddChangeHandler(const void *context, const char *cmd
 static commandResult_t CMD_ListEventHandlers(const void *context, const char *cmd, const char *args, int cmdFlags){
 	struct eventHandler_s *ev;
 	int c;
+	int i;
 
-	ev = g_eventHandlers;
 	c = 0;
 
-	while(ev) {
+	for(i = 0; i < CMD_EVENT_MAX_TYPES; i++) {
+		ev = g_eventHandlers[i];
 
-		ADDLOG_INFO(LOG_FEATURE_EVENT, "Event %i has code %i and command %s",c,ev->eventCode,ev->command);
-		ev = ev->next;
-		c++;
+		while(ev) {
+
+			ADDLOG_INFO(LOG_FEATURE_EVENT, "Event %i has code %i and command %s",c,ev->eventCode,ev->command);
+			ev = ev->next;
+			c++;
+		}
 	}
 
 	return CMD_RES_OK;
@@ -144,107 +144,169 @@ const char *strCompareBound(const char *s, const char *templ, const char *stoppe
 char *g_expDebugBuffer = 0;
 #define EXPRESSION_DEBUG_BUFFER_SIZE 128
 
-// tries to expand a given string into a constant
-// So, for $CH1 it will set out to given channel value
-// For $led_dimmer it will set out to current led_dimmer value
-// Etc etc
-// Returns true if constant matches
-// Returns false if no constants found
-const char *CMD_ExpandConstant(const char *s, const char *stop, float *out) {
-	int idx;
+typedef enum {
+	CONST_MQTTON,
+	CONST_CHANNEL,
+	CONST_LED_DIMMER,
+	CONST_LED_ENABLEALL,
+	CONST_LED_HUE,
+	CONST_LED_RED,
+	CONST_LED_GREEN,
+	CONST_LED_BLUE,
+	CONST_LED_SATURATION,
+	CONST_LED_TEMPERATURE,
+	CONST_VOLTAGE,
+	CONST_CURRENT,
+	CONST_POWER,
+} constCode_t;
+
+// tries to match a given string with a known constant, without reading its value
+// Returns pointer after the constant if it matches, or 0
+static const char *CMD_MatchConstant(const char *s, const char *stop, byte *code, int *idx) {
 	const char *ret;
 
+	*idx = 0;
 	ret = strCompareBound(s, "MQTTOn", stop, false);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: MQTTOn");
-		*out = Main_HasMQTTConnected();
+		*code = CONST_MQTTON;
 		return ret;
 	}
 	ret = strCompareBound(s, "$CH**", stop, 1);
 	if (ret) {
-		idx = atoi(s + 3);
-		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: channel value of idx %i", idx);
-		*out = CHANNEL_Get(idx);
+		*idx = atoi(s + 3);
+		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: channel value of idx %i", *idx);
+		*code = CONST_CHANNEL;
 		return ret;
 	}
 	ret = strCompareBound(s, "$CH*", stop, 1);
 	if (ret) {
-		idx = atoi(s + 3);
-		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: channel value of idx %i", idx);
-		*out = CHANNEL_Get(idx);
+		*idx = atoi(s + 3);
+		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: channel value of idx %i", *idx);
+		*code = CONST_CHANNEL;
 		return ret;
 	}
 	ret = strCompareBound(s, "$led_dimmer", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: led_dimmer");
-		*out = LED_GetDimmer();
+		*code = CONST_LED_DIMMER;
 		return ret;
 	}
 	ret = strCompareBound(s, "$led_enableAll", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: led_enableAll");
-		*out = LED_GetEnableAll();
+		*code = CONST_LED_ENABLEALL;
 		return ret;
 	}
 	ret = strCompareBound(s, "$led_hue", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: led_hue");
-		*out = LED_GetHue();
+		*code = CONST_LED_HUE;
 		return ret;
 	}
 	ret = strCompareBound(s, "$led_red", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: led_red");
-		*out = LED_GetRed255();
+		*code = CONST_LED_RED;
 		return ret;
 	}
 	ret = strCompareBound(s, "$led_green", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: $led_green");
-		*out = LED_GetGreen255();
+		*code = CONST_LED_GREEN;
 		return ret;
 	}
 	ret = strCompareBound(s, "$led_blue", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: $led_blue");
-		*out = LED_GetBlue255();
+		*code = CONST_LED_BLUE;
 		return ret;
 	}
 	ret = strCompareBound(s, "$led_saturation", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: led_saturation");
-		*out = LED_GetSaturation();
+		*code = CONST_LED_SATURATION;
 		return ret;
 	}
 	ret = strCompareBound(s, "$led_temperature", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: led_temperature");
-		*out = LED_GetTemperature();
+		*code = CONST_LED_TEMPERATURE;
 		return ret;
 	}
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	ret = strCompareBound(s, "$voltage", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: voltage");
-		*out = DRV_GetReading(OBK_VOLTAGE);
+		*code = CONST_VOLTAGE;
 		return ret;
 	}
 	ret = strCompareBound(s, "$current", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: $current");
-		*out = DRV_GetReading(OBK_CURRENT);
+		*code = CONST_CURRENT;
 		return ret;
 	}
 	ret = strCompareBound(s, "$power", stop, 0);
 	if (ret) {
 		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_ExpandConstant: $power");
-		*out = DRV_GetReading(OBK_POWER);
+		*code = CONST_POWER;
 		return ret;
 	}
 #endif
 
-	
-	return false;
+	return 0;
+}
+static float CMD_GetConstantValue(byte code, int idx) {
+	switch (code) {
+	case CONST_MQTTON:
+		return Main_HasMQTTConnected();
+	case CONST_CHANNEL:
+		return CHANNEL_Get(idx);
+	case CONST_LED_DIMMER:
+		return LED_GetDimmer();
+	case CONST_LED_ENABLEALL:
+		return LED_GetEnableAll();
+	case CONST_LED_HUE:
+		return LED_GetHue();
+	case CONST_LED_RED:
+		return LED_GetRed255();
+	case CONST_LED_GREEN:
+		return LED_GetGreen255();
+	case CONST_LED_BLUE:
+		return LED_GetBlue255();
+	case CONST_LED_SATURATION:
+		return LED_GetSaturation();
+	case CONST_LED_TEMPERATURE:
+		return LED_GetTemperature();
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	case CONST_VOLTAGE:
+		return DRV_GetReading(OBK_VOLTAGE);
+	case CONST_CURRENT:
+		return DRV_GetReading(OBK_CURRENT);
+	case CONST_POWER:
+		return DRV_GetReading(OBK_POWER);
+#endif
+	}
+	return 0;
+}
+
+// tries to expand a given string into a constant
+// So, for $CH1 it will set out to given channel value
+// For $led_dimmer it will set out to current led_dimmer value
+// Etc etc
+// Returns true if constant matches
+// Returns false if no constants found
+const char *CMD_ExpandConstant(const char *s, const char *stop, float *out) {
+	const char *ret;
+	byte code;
+	int idx;
+
+	ret = CMD_MatchConstant(s, stop, &code, &idx);
+	if (ret) {
+		*out = CMD_GetConstantValue(code, idx);
+	}
+	return ret;
 }
 #if WINDOWS
 
@@ -432,6 +494,36 @@ char *CMD_ExpandingStrdup(const char *in) {
 	CMD_ExpandConstantsWithinString(in, ret, realLen);
 	return ret;
 }
+static float CMD_ApplyOperator(byte opCode, float a, float b) {
+	switch(opCode)
+	{
+	case OP_EQUAL:
+		return a == b;
+	case OP_EQUAL_OR_GREATER:
+		return a >= b;
+	case OP_EQUAL_OR_LESS:
+		return a <= b;
+	case OP_NOT_EQUAL:
+		return a != b;
+	case OP_GREATER:
+		return a > b;
+	case OP_LESS:
+		return a < b;
+	case OP_AND:
+		return ((int)a) && ((int)b);
+	case OP_OR:
+		return ((int)a) || ((int)b);
+	case OP_ADD:
+		return a + b;
+	case OP_SUB:
+		return a - b;
+	case OP_MUL:
+		return a * b;
+	case OP_DIV:
+		return a / b;
+	}
+	return 0;
+}
 float CMD_EvaluateExpression(const char *s, const char *stop) {
 	byte opCode;
 	const char *op;
@@ -485,49 +577,7 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 		//sprintf(g_expDebugBuffer,"CMD_EvaluateExpression: a = %f, b = %f", a, b);
 		//ADDLOG_INFO(LOG_FEATURE_EVENT, g_expDebugBuffer);
 
-		switch(opCode)
-		{
-		case OP_EQUAL:
-			c = a == b;
-			break;
-		case OP_EQUAL_OR_GREATER:
-			c = a >= b;
-			break;
-		case OP_EQUAL_OR_LESS:
-			c = a <= b;
-			break;
-		case OP_NOT_EQUAL:
-			c = a != b;
-			break;
-		case OP_GREATER:
-			c = a > b;
-			break;
-		case OP_LESS:
-			c = a < b;
-			break;
-		case OP_AND:
-			c = ((int)a) && ((int)b);
-			break;
-		case OP_OR:
-			c = ((int)a) || ((int)b);
-			break;
-		case OP_ADD:
-			c = a + b;
-			break;
-		case OP_SUB:
-			c = a - b;
-			break;
-		case OP_MUL:
-			c = a * b;
-			break;
-		case OP_DIV:
-			c = a / b;
-			break;
-		default:
-			c = 0;
-			break;
-		}
-		return c;
+		return CMD_ApplyOperator(opCode, a, b);
 	}
 	if(s[0] == '!') {
 		return !CMD_EvaluateExpression(s+1,stop);
@@ -545,65 +595,288 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 	return atof(g_expDebugBuffer);
 }
 
+// Expressions compiled to postfix form. Parsing is done exactly like in
+// CMD_EvaluateExpression, so both always give the same result, but
+// operators are found and numbers are parsed only once.
+typedef enum {
+	EXP_PUSH_VALUE,
+	EXP_PUSH_CONSTANT,
+	EXP_NOT,
+	EXP_OPERATOR,
+} expInstrType_t;
+
+typedef struct expInstr_s {
+	byte type;
+	// opCode_t for EXP_OPERATOR, constCode_t for EXP_PUSH_CONSTANT
+	byte code;
+	// channel index for CONST_CHANNEL
+	short idx;
+	float value;
+} expInstr_t;
+
+#define EXP_MAX_INSTRUCTIONS 32
+#define EXP_MAX_STACK 16
+
+struct cmdExpression_s {
+	int numInstructions;
+	expInstr_t instructions[1];
+};
+
+typedef struct expCompiler_s {
+	expInstr_t code[EXP_MAX_INSTRUCTIONS];
+	int count;
+	bool bFailed;
+} expCompiler_t;
+
+static void EXP_Emit(expCompiler_t *c, int depth, byte type, byte code, int idx, float value) {
+	expInstr_t *i;
+
+	if (c->count >= EXP_MAX_INSTRUCTIONS || depth >= EXP_MAX_STACK) {
+		c->bFailed = true;
+		return;
+	}
+	i = &c->code[c->count++];
+	i->type = type;
+	i->code = code;
+	i->idx = idx;
+	i->value = value;
+}
+// depth is the number of values already on the stack when this part runs
+static void EXP_Compile_r(expCompiler_t *c, const char *s, const char *stop, int depth) {
+	byte opCode;
+	const char *op;
+	char tmp[32];
+	int idx;
+	byte constCode;
+
+	if (c->bFailed)
+		return;
+	if (s == 0 || *s == 0) {
+		EXP_Emit(c, depth, EXP_PUSH_VALUE, 0, 0, 0);
+		return;
+	}
+	if (stop == 0) {
+		stop = s + strlen(s);
+	}
+	while (stop > s && isspace(((int)stop[-1]))) {
+		stop--;
+	}
+	while (isspace(((int)*s))) {
+		s++;
+		if (s >= stop) {
+			EXP_Emit(c, depth, EXP_PUSH_VALUE, 0, 0, 0);
+			return;
+		}
+	}
+	op = CMD_FindOperator(s, stop, &opCode);
+	if (op) {
+		EXP_Compile_r(c, s, op, depth);
+		EXP_Compile_r(c, op + g_operators[opCode].len, stop, depth + 1);
+		EXP_Emit(c, depth, EXP_OPERATOR, opCode, 0, 0);
+		return;
+	}
+	if (s[0] == '!') {
+		EXP_Compile_r(c, s + 1, stop, depth);
+		EXP_Emit(c, depth, EXP_NOT, 0, 0, 0);
+		return;
+	}
+	if (CMD_MatchConstant(s, stop, &constCode, &idx)) {
+		EXP_Emit(c, depth, EXP_PUSH_CONSTANT, constCode, idx, 0);
+		return;
+	}
+	idx = stop - s;
+	if (idx >= sizeof(tmp)) {
+		idx = sizeof(tmp) - 1;
+	}
+	memcpy(tmp, s, idx);
+	tmp[idx] = 0;
+	EXP_Emit(c, depth, EXP_PUSH_VALUE, 0, 0, atof(tmp));
+}
+// Returns 0 if expression is too complex, then CMD_EvaluateExpression must be used.
+// Free the result with free().
+cmdExpression_t *CMD_CompileExpression(const char *s, const char *stop) {
+	expCompiler_t c;
+	cmdExpression_t *r;
+
+	c.count = 0;
+	c.bFailed = false;
+	EXP_Compile_r(&c, s, stop, 0);
+	if (c.bFailed) {
+		return 0;
+	}
+	r = (cmdExpression_t*)malloc(sizeof(cmdExpression_t) + (c.count - 1) * sizeof(expInstr_t));
+	if (r == 0) {
+		return 0;
+	}
+	r->numInstructions = c.count;
+	memcpy(r->instructions, c.code, c.count * sizeof(expInstr_t));
+	return r;
+}
+float CMD_EvaluateCompiledExpression(const cmdExpression_t *e) {
+	float stack[EXP_MAX_STACK];
+	const expInstr_t *i, *end;
+	int sp;
+
+	sp = 0;
+	i = e->instructions;
+	end = i + e->numInstructions;
+	for (; i < end; i++) {
+		switch (i->type) {
+		case EXP_PUSH_VALUE:
+			stack[sp++] = i->value;
+			break;
+		case EXP_PUSH_CONSTANT:
+			stack[sp++] = CMD_GetConstantValue(i->code, i->idx);
+			break;
+		case EXP_NOT:
+			stack[sp - 1] = !stack[sp - 1];
+			break;
+		case EXP_OPERATOR:
+			sp--;
+			stack[sp - 1] = CMD_ApplyOperator(i->code, stack[sp - 1], stack[sp]);
+			break;
+		}
+	}
+	return stack[0];
+}
+
+// One argument of "if", split the same way the tokenizer would do it
+// (quotes, whitespace or comma), without copying it anywhere.
+typedef struct ifArg_s {
+	// where it starts, after opening quote if quoted
+	const char *start;
+	const char *stop;
+} ifArg_t;
+
+#define IF_MAX_ARGS 5
+
+// Returns number of arguments found, up to maxArgs
+static int CMD_If_SplitArgs(const char *s, ifArg_t *out, int maxArgs) {
+	int n;
+
+	for (n = 0; n < maxArgs; n++) {
+		while (isWhiteSpace(*s) || (n > 0 && *s == ',')) {
+			s++;
+		}
+		if (*s == 0) {
+			break;
+		}
+		if (*s == '"') {
+			s++;
+			out[n].start = s;
+			while (*s && *s != '"') {
+				s++;
+			}
+			out[n].stop = s;
+			if (*s) {
+				s++;
+			}
+		} else {
+			out[n].start = s;
+			while (*s && isWhiteSpace(*s) == false && *s != ',') {
+				s++;
+			}
+			out[n].stop = s;
+		}
+	}
+	return n;
+}
+// Compiles condition of "if" command arguments. Event handlers and script lines
+// call it once, when they are created, and keep the result for CMD_If_Execute.
+// Returns 0 if condition is empty or too complex; caller frees the result.
+cmdExpression_t *CMD_If_CompileCondition(const char *args) {
+	ifArg_t cond;
+
+	if (args == 0 || CMD_If_SplitArgs(args, &cond, 1) < 1) {
+		return 0;
+	}
+	if (cond.start == cond.stop) {
+		return 0;
+	}
+	return CMD_CompileExpression(cond.start, cond.stop);
+}
+static bool CMD_If_ArgIs(const ifArg_t *a, const char *word) {
+	int len;
+
+	len = strlen(word);
+	return a->stop - a->start == len && !wal_strnicmp(a->start, word, len);
+}
+
 // if MQTTOnline then "qq" else "qq"
-commandResult_t CMD_If(const void *context, const char *cmd, const char *args, int cmdFlags){
-	const char *cmdA;
-	const char *cmdB;
-	const char *condition;
-	//char buffer[256];
-	int value;
+// condition is optional, if given, it's the compiled first argument.
+// Nested ifs (through backlog, aliases or then/else) recurse here,
+// so only the chosen command is copied, and only if it is short enough for the stack.
+commandResult_t CMD_If_Execute(const char *args, const cmdExpression_t *compiledCondition) {
+	ifArg_t a[IF_MAX_ARGS];
+	const ifArg_t *chosen;
+	char buffer[96];
+	char *cmd;
 	int argsCount;
+	int len;
+	int value;
 
 	if(args==0||*args==0) {
 		ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_If: command require at least 3 args");
 		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
-	Tokenizer_TokenizeString(args, TOKENIZER_ALLOW_QUOTES | TOKENIZER_DONT_EXPAND);
-	if(Tokenizer_GetArgsCount() < 3) {
-		ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_If: command require at least 3 args, you gave %i",Tokenizer_GetArgsCount());
+	argsCount = CMD_If_SplitArgs(args, a, IF_MAX_ARGS);
+	if(argsCount < 3) {
+		ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_If: command require at least 3 args, you gave %i",argsCount);
 		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
-	condition = Tokenizer_GetArg(0);
-	if(stricmp(Tokenizer_GetArg(1),"then")) {
-		ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_If: second argument always must be 'then', but it's '%s'",Tokenizer_GetArg(1));
+	if(CMD_If_ArgIs(&a[1], "then") == false) {
+		ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_If: second argument always must be 'then', in '%s'",args);
 		return CMD_RES_BAD_ARGUMENT;
 	}
-	argsCount = Tokenizer_GetArgsCount();
 	if(argsCount >= 5) {
-		cmdA = Tokenizer_GetArg(2);
-		if(stricmp(Tokenizer_GetArg(3),"else")) {
-			ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_If: fourth argument always must be 'else', but it's '%s'",Tokenizer_GetArg(3));
+		if(CMD_If_ArgIs(&a[3], "else") == false) {
+			ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_If: fourth argument always must be 'else', in '%s'",args);
 			return CMD_RES_BAD_ARGUMENT;
 		}
-		cmdB = Tokenizer_GetArg(4);
 	} else {
-		cmdA = Tokenizer_GetArgFrom(2);
-		cmdB = 0;
+		// no else, then-command is all the rest
+		a[2].stop = a[2].start + strlen(a[2].start);
 	}
 
-	ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_If: cmdA is '%s'",cmdA);
-	if(cmdB) {
-		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_If: cmdB is '%s'",cmdB);
+	if(compiledCondition) {
+		value = CMD_EvaluateCompiledExpression(compiledCondition);
+	} else {
+		value = CMD_EvaluateExpression(a[0].start, a[0].stop);
 	}
-	ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_If: condition is '%s'",condition);
 
-	value = CMD_EvaluateExpression(condition, 0);
-
-	// This buffer is here because we may need to exec commands recursively
-	// and the Tokenizer_ etc is global?
-	//if(value)
-	//	strcpy_safe(buffer,cmdA);
-	//else
-	//	strcpy_safe(buffer,cmdB);
-	//CMD_ExecuteCommand(buffer,0);
-	if(value)
-		CMD_ExecuteCommand(cmdA,0);
-	else {
-		if(cmdB) {
-			CMD_ExecuteCommand(cmdB,0);
+	if(value) {
+		chosen = &a[2];
+	} else if(argsCount >= 5) {
+		chosen = &a[4];
+	} else {
+		return CMD_RES_OK;
+	}
+	if(*chosen->stop == 0) {
+		// already terminated
+		ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_If: running '%s'",chosen->start);
+		CMD_ExecuteCommand(chosen->start,0);
+		return CMD_RES_OK;
+	}
+	len = chosen->stop - chosen->start;
+	if(len < sizeof(buffer)) {
+		cmd = buffer;
+	} else {
+		cmd = malloc(len + 1);
+		if(cmd == 0) {
+			return CMD_RES_ERROR;
 		}
 	}
+	memcpy(cmd, chosen->start, len);
+	cmd[len] = 0;
+	ADDLOG_EXTRADEBUG(LOG_FEATURE_EVENT, "CMD_If: running '%s'",cmd);
+	CMD_ExecuteCommand(cmd,0);
+	if(cmd != buffer) {
+		free(cmd);
+	}
 
 	return CMD_RES_OK;
 }
 
+commandResult_t CMD_If(const void *context, const char *cmd, const char *args, int cmdFlags){
+	return CMD_If_Execute(args, 0);
+}
@@ -9,16 +9,24 @@ typedef struct command_s {
 	commandHandler_t handler;
 	const char *userDesc;
 	const void *context;
+	// case-folded hash of name
+	unsigned int hash;
 	struct command_s *next;
 } command_t;
 
 command_t *CMD_Find(const char *name);
+command_t *CMD_FindStrippingNumbers(const char *name);
 // for autocompletion?
 void CMD_ListAllCommands(void *userData, void (*callback)(command_t *cmd, void *userData));
 int get_cmd(const char *s, char *dest, int maxlen, int stripnum);
 
 
 float CMD_EvaluateExpression(const char *s, const char *stop);
+typedef struct cmdExpression_s cmdExpression_t;
+cmdExpression_t *CMD_CompileExpression(const char *s, const char *stop);
+float CMD_EvaluateCompiledExpression(const cmdExpression_t *e);
+cmdExpression_t *CMD_If_CompileCondition(const char *args);
+commandResult_t CMD_If_Execute(const char *args, const cmdExpression_t *compiledCondition);
 commandResult_t CMD_If(const void *context, const char *cmd, const char *args, int cmdFlags);
 void CMD_ExpandConstantsWithinString(const char *in, char *out, int outLen);
 const char *CMD_ExpandConstant(const char *s, const char *stop, float *out);
@@ -7,32 +7,36 @@
 #include "../driver/drv_ir.h"
 #include "../driver/drv_uart.h"
 #include "../driver/drv_public.h"
+#include "../hal/hal_flashVars.h"
 
 #ifdef BK_LITTLEFS
 #include "../littlefs/our_lfs.h"
 #endif
 
-#define HASH_SIZE 128
+// ASCII-only case folding, cheaper than tolower() and locale independent
+#define CMD_FOLD(c) (((c) >= 'A' && (c) <= 'Z') ? ((c) + ('a' - 'A')) : (c))
+#define CMD_HASH_INIT 2166136261u
+// FNV-1a over case-folded characters
+#define CMD_HASH_STEP(h, c) (((h) ^ (unsigned char)CMD_FOLD(c)) * 16777619u)
+#define CMD_BUCKET(h) (((h) ^ ((h) >> 16)) & (g_numCommandBuckets - 1))
 
-static int generateHashValue(const char* fname) {
-	int		i;
-	int		hash;
-	int		letter;
-	unsigned char* f = (unsigned char*)fname;
+static unsigned int generateHashValue(const char* fname) {
+	unsigned int hash;
 
-	hash = 0;
-	i = 0;
-	while (f[i]) {
-		letter = tolower(f[i]);
-		hash += (letter) * (i + 119);
-		i++;
+	hash = CMD_HASH_INIT;
+	while (*fname) {
+		hash = CMD_HASH_STEP(hash, *fname);
+		fname++;
 	}
-	hash = (hash ^ (hash >> 10) ^ (hash >> 20));
-	hash &= (HASH_SIZE - 1);
 	return hash;
 }
 
-command_t* g_commands[HASH_SIZE] = { NULL };
+// buckets are grown so that there is at most one command per bucket
+// on average; full hash is kept in every command, so a lookup
+// usually does a single string compare
+command_t** g_commands = 0;
+int g_numCommandBuckets = 0;
+int g_numCommands = 0;
 bool g_powersave;
 
 static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const char* args, int cmdFlags) {
@@ -219,7 +223,7 @@ static commandResult_t CMD_ClearConfig(const void* context, const char* cmd, con
 static commandResult_t CMD_Echo(const void* context, const char* cmd, const char* args, int cmdFlags) {
 
 
-	ADDLOG_INFO(LOG_FEATURE_CMD, args);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "%s", args);
 
 	return CMD_RES_OK;
 }
@@ -240,6 +244,29 @@ static commandResult_t CMD_SetStartValue(const void* context, const char* cmd, c
 
 	return CMD_RES_OK;
 }
+static commandResult_t CMD_FlashVarsFlushInterval(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() >= 1) {
+		HAL_FlashVars_SetFlushInterval(Tokenizer_GetArgInteger(0));
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Flash vars flush interval %i s", HAL_FlashVars_GetFlushInterval());
+
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_FlashVarsStats(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	flashVarsStats_t st;
+	int erasesPerSector;
+
+	HAL_FlashVars_GetStats(&st);
+	erasesPerSector = st.sectorCount > 0 ? st.sectorErases / st.sectorCount : st.sectorErases;
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Flash vars: %i saves, %i writes, %i bytes, %i erases, %s",
+		st.saveRequests, st.writes, st.bytesWritten, st.sectorErases, st.pending ? "pending" : "clean");
+	// typical NOR flash is rated for about 100000 erase cycles per sector
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Flash vars wear since boot: %i of ~100000 erase cycles per sector", erasesPerSector);
+
+	return CMD_RES_OK;
+}
 
 
 int cmd_uartInitIndex = 0;
@@ -371,6 +398,16 @@ void CMD_Init_Early() {
 	//cmddetail:"fn":"CMD_SetStartValue","file":"cmnds/cmd_main.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("SetStartValue", "", CMD_SetStartValue, NULL, NULL);
+	//cmddetail:{"name":"flashVars_flushInterval","args":"[Seconds]",
+	//cmddetail:"descr":"Sets how long remembered channel and energy values are kept in RAM before being written to flash. 0 writes at once. Without argument, prints current value",
+	//cmddetail:"fn":"CMD_FlashVarsFlushInterval","file":"cmnds/cmd_main.c","requires":"",
+	//cmddetail:"examples":"flashVars_flushInterval 30"}
+	CMD_RegisterCommand("flashVars_flushInterval", "", CMD_FlashVarsFlushInterval, NULL, NULL);
+	//cmddetail:{"name":"flashVars_stats","args":"",
+	//cmddetail:"descr":"Prints flash vars write and erase counters since boot, with estimated sector wear",
+	//cmddetail:"fn":"CMD_FlashVarsStats","file":"cmnds/cmd_main.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("flashVars_stats", "", CMD_FlashVarsStats, NULL, NULL);
 
 #if (defined WINDOWS) || (defined PLATFORM_BEKEN)
 	CMD_InitScripting();
@@ -393,7 +430,7 @@ void CMD_ListAllCommands(void* userData, void (*callback)(command_t* cmd, void*
 	int i;
 	command_t* newCmd;
 
-	for (i = 0; i < HASH_SIZE; i++) {
+	for (i = 0; i < g_numCommandBuckets; i++) {
 		newCmd = g_commands[i];
 		while (newCmd) {
 			callback(newCmd, userData);
@@ -406,7 +443,14 @@ void CMD_FreeAllCommands() {
 	int i;
 	command_t* cmd, * next;
 
-	for (i = 0; i < HASH_SIZE; i++) {
+#if defined(WINDOWS) || defined(PLATFORM_BL602) || defined(PLATFORM_BEKEN)
+	// compiled scripts keep pointers to commands
+	CMD_resetSVM(0, 0, 0, 0);
+#endif
+	// so do event handlers
+	CMD_ClearAllHandlers(0, 0, 0, 0);
+
+	for (i = 0; i < g_numCommandBuckets; i++) {
 		cmd = g_commands[i];
 		while (cmd) {
 			next = cmd->next;
@@ -415,10 +459,40 @@ void CMD_FreeAllCommands() {
 		}
 		g_commands[i] = 0;
 	}
+	g_numCommands = 0;
 
 }
+static bool CMD_GrowBuckets() {
+	int i, newCount, oldCount;
+	command_t** old;
+	command_t* cmd, * next;
+	int bucket;
+
+	newCount = g_numCommandBuckets ? g_numCommandBuckets * 2 : 64;
+	old = g_commands;
+	g_commands = (command_t**)malloc(newCount * sizeof(command_t*));
+	if (g_commands == 0) {
+		g_commands = old;
+		return false;
+	}
+	memset(g_commands, 0, newCount * sizeof(command_t*));
+	oldCount = g_numCommandBuckets;
+	g_numCommandBuckets = newCount;
+	for (i = 0; i < oldCount; i++) {
+		cmd = old[i];
+		while (cmd) {
+			next = cmd->next;
+			bucket = CMD_BUCKET(cmd->hash);
+			cmd->next = g_commands[bucket];
+			g_commands[bucket] = cmd;
+			cmd = next;
+		}
+	}
+	free(old);
+	return true;
+}
 void CMD_RegisterCommand(const char* name, const char* args, commandHandler_t handler, const char* userDesc, void* context) {
-	int hash;
+	int bucket;
 	command_t* newCmd;
 
 	// check
@@ -429,32 +503,85 @@ void CMD_RegisterCommand(const char* name, const char* args, commandHandler_t ha
 	}
 	ADDLOG_DEBUG(LOG_FEATURE_CMD, "Adding command %s", name);
 
-	hash = generateHashValue(name);
+	if (g_numCommands >= g_numCommandBuckets) {
+		if (CMD_GrowBuckets() == false && g_numCommandBuckets == 0) {
+			ADDLOG_ERROR(LOG_FEATURE_CMD, "failed to alloc command table for %s", name);
+			return;
+		}
+	}
 	newCmd = (command_t*)malloc(sizeof(command_t));
 	newCmd->argsFormat = args;
 	newCmd->handler = handler;
 	newCmd->name = name;
-	newCmd->next = g_commands[hash];
+	newCmd->hash = generateHashValue(name);
 	newCmd->userDesc = userDesc;
 	newCmd->context = context;
-	g_commands[hash] = newCmd;
+	bucket = CMD_BUCKET(newCmd->hash);
+	newCmd->next = g_commands[bucket];
+	g_commands[bucket] = newCmd;
+	g_numCommands++;
 }
 
-command_t* CMD_Find(const char* name) {
-	int hash;
+static command_t* CMD_FindHashed(const char* name, int len, unsigned int hash) {
 	command_t* newCmd;
+	const char* a, * b;
+	int i;
 
-	hash = generateHashValue(name);
-
-	newCmd = g_commands[hash];
+	if (g_numCommandBuckets == 0) {
+		return 0;
+	}
+	newCmd = g_commands[CMD_BUCKET(hash)];
 	while (newCmd != 0) {
-		if (!stricmp(newCmd->name, name)) {
-			return newCmd;
+		if (newCmd->hash == hash) {
+			a = newCmd->name;
+			b = name;
+			for (i = 0; i < len; i++) {
+				if (CMD_FOLD(a[i]) != CMD_FOLD(b[i])) {
+					break;
+				}
+			}
+			if (i == len && a[len] == 0) {
+				return newCmd;
+			}
 		}
 		newCmd = newCmd->next;
 	}
 	return 0;
 }
+command_t* CMD_Find(const char* name) {
+	unsigned int hash;
+	int len;
+
+	hash = CMD_HASH_INIT;
+	for (len = 0; name[len]; len++) {
+		hash = CMD_HASH_STEP(hash, name[len]);
+	}
+	return CMD_FindHashed(name, len, hash);
+}
+// Finds command by full name, or, if there is none, by the name
+// cut at first digit, so POWER1 finds POWER. Hashes of both are
+// computed in the same pass over the string.
+command_t* CMD_FindStrippingNumbers(const char* name) {
+	unsigned int hash, prefixHash;
+	int len, prefixLen;
+	command_t* newCmd;
+
+	hash = CMD_HASH_INIT;
+	prefixHash = 0;
+	prefixLen = -1;
+	for (len = 0; name[len]; len++) {
+		if (prefixLen < 0 && ((name[len] >= '0' && name[len] <= '9') || isWhiteSpace(name[len]))) {
+			prefixLen = len;
+			prefixHash = hash;
+		}
+		hash = CMD_HASH_STEP(hash, name[len]);
+	}
+	newCmd = CMD_FindHashed(name, len, hash);
+	if (newCmd == 0 && prefixLen > 0) {
+		newCmd = CMD_FindHashed(name, prefixLen, prefixHash);
+	}
+	return newCmd;
+}
 
 // get a string up to whitespace.
 // if stripnum is set, stop at numbers.
@@ -484,22 +611,11 @@ commandResult_t CMD_ExecuteCommandArgs(const char* cmd, const char* args, int cm
 	command_t* newCmd;
 	//int len;
 
-	// look for complete commmand
-	newCmd = CMD_Find(cmd);
+	// look for complete commmand, then for one without numeric suffix
+	newCmd = CMD_FindStrippingNumbers(cmd);
 	if (!newCmd) {
-		// not found, so...
-		char nonums[32];
-		// get the complete string up to numbers.
-		//len =
-		get_cmd(cmd, nonums, 32, 1);
-		newCmd = CMD_Find(nonums);
-		if (!newCmd) {
-			// if still not found, then error
-			ADDLOG_ERROR(LOG_FEATURE_CMD, "cmd %s NOT found (args %s)", cmd, args);
-			return CMD_RES_UNKNOWN_COMMAND;
-		}
-	}
-	else {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "cmd %s NOT found (args %s)", cmd, args);
+		return CMD_RES_UNKNOWN_COMMAND;
 	}
 
 	if (newCmd->handler) {
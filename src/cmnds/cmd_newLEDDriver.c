@@ -62,7 +62,6 @@ float g_hsv_v = 1; // 0 to 1
 float g_cfg_colorScaleToChannel = 100.0f/255.0f;
 int g_numBaseColors = 5;
 float g_brightness0to100 = 100.0f;
-float rgb_used_corr[3];   // RGB correction currently used
 
 // NOTE: in this system, enabling/disabling whole led light bulb
 // is not changing the stored channel and brightness values.
@@ -76,6 +75,8 @@ float led_temperature_min = HASS_TEMPERATURE_MIN;
 float led_temperature_max = HASS_TEMPERATURE_MAX;
 float led_temperature_current = HASS_TEMPERATURE_MIN;
 
+static void LED_ResetLerpQ16();
+
 void LED_ResetGlobalVariablesToDefaults() {
 	int i;
 
@@ -94,6 +95,7 @@ void LED_ResetGlobalVariablesToDefaults() {
 	led_temperature_min = HASS_TEMPERATURE_MIN;
 	led_temperature_max = HASS_TEMPERATURE_MAX;
 	led_temperature_current = HASS_TEMPERATURE_MIN;
+	LED_ResetLerpQ16();
 }
 
 bool LED_IsLedDriverChipRunning()
@@ -167,26 +169,154 @@ static void sendFullRGBCW_IfEnabled() {
 	MQTT_PublishMain_StringString_DeDuped(DEDUP_LED_FINALCOLOR_RGBCW,DEDUP_EXPIRE_TIME,"led_finalcolor_rgbcw",s, 0);
 }
 
-float led_rawLerpCurrent[5] = { 0 };
-float Mathf_MoveTowards(float cur, float tg, float dt) {
-	float rem = tg - cur;
-	if(abs(rem) < dt) {
-		return tg;
+// Colour math below is in Q16 fixed point (1.0 is 65536), colours in 0-255 range like baseColors.
+// Most BK7231 have no FPU, so powf per channel and float lerp every quick tick were all soft-float.
+// Gamma curve is a table over brightness, rebuilt only when g_cfg.led_corr changes.
+#define LED_Q16_ONE			65536
+#define LED_GAMMA_LUT_BITS	8
+#define LED_GAMMA_LUT_SIZE	(1 << LED_GAMMA_LUT_BITS)
+
+// pow(brightness, gamma) with minimum brightness applied, [0] is for RGB, [1] for CW
+static int led_gammaLUT[2][LED_GAMMA_LUT_SIZE + 1];
+// settings the table was built for
+static led_corr_t led_gammaLUTCorr;
+static bool led_gammaLUTValid = false;
+static int led_rgbCalQ16[3];
+// RGB correction currently used, also adjusts lerp speed
+static int led_rgbUsedCorrQ16[3] = { LED_Q16_ONE, LED_Q16_ONE, LED_Q16_ONE };
+
+static int LED_FloatToQ16(float f) {
+	return (int)(f * LED_Q16_ONE + 0.5f);
+}
+static void LED_RebuildGammaLUTIfNeeded() {
+	int i;
+	float x, p, rgbMin, cwMin;
+
+	if (led_gammaLUTValid && !memcmp(&led_gammaLUTCorr, &g_cfg.led_corr, sizeof(led_gammaLUTCorr))) {
+		return;
 	}
-	if(rem < 0) {
-		return cur - dt;
+	led_gammaLUTCorr = g_cfg.led_corr;
+	led_gammaLUTValid = true;
+
+	rgbMin = g_cfg.led_corr.rgb_bright_min / 100;
+	cwMin = g_cfg.led_corr.cw_bright_min / 100;
+	for (i = 0; i <= LED_GAMMA_LUT_SIZE; i++) {
+		x = (float)i / LED_GAMMA_LUT_SIZE;
+		p = powf(x, g_cfg.led_corr.led_gamma);
+		led_gammaLUT[0][i] = LED_FloatToQ16(p * (1 - rgbMin) + rgbMin);
+		led_gammaLUT[1][i] = LED_FloatToQ16(p * (1 - cwMin) + cwMin);
+	}
+	for (i = 0; i < 3; i++) {
+		led_rgbCalQ16[i] = LED_FloatToQ16(g_cfg.led_corr.rgb_cal[i]);
 	}
-	return cur + dt;
 }
+// linear interpolation between table entries, brightness is 0 to LED_Q16_ONE
+static int LED_GammaScaleQ16(const int *lut, int brightnessQ16) {
+	int idx, frac;
+
+	if (brightnessQ16 <= 0)
+		return lut[0];
+	if (brightnessQ16 >= LED_Q16_ONE)
+		return lut[LED_GAMMA_LUT_SIZE];
+	idx = brightnessQ16 >> (16 - LED_GAMMA_LUT_BITS);
+	frac = brightnessQ16 & ((1 << (16 - LED_GAMMA_LUT_BITS)) - 1);
+	return lut[idx] + (((lut[idx + 1] - lut[idx]) * frac) >> (16 - LED_GAMMA_LUT_BITS));
+}
+// converts current base colors and brightness, returns brightness in Q16
+static int LED_PrepareGammaQ16(int *baseQ16) {
+	int i;
+
+	LED_RebuildGammaLUTIfNeeded();
+	for (i = 0; i < 5; i++) {
+		baseQ16[i] = LED_FloatToQ16(baseColors[i]);
+	}
+	return LED_FloatToQ16(g_brightness0to100 * 0.01f);
+}
+
+int led_gamma_enable_channel_messages = 0;
+
+// apply LED gamma and RGB correction
+static int LED_GammaCorrectQ16(int color, int iValQ16, int brightnessQ16, const int *baseQ16) {
+	int oVal, corr, sum_other_colors;
+
+	if ((color < 0) || (color > 4)) {
+		return iValQ16;
+	}
+
+	// apply LED gamma correction:
+	oVal = (int)(((long long)iValQ16 * LED_GammaScaleQ16(led_gammaLUT[color > 2], brightnessQ16)) >> 16);
+
+	// apply RGB level correction:
+	if (color < 3) {
+		corr = led_rgbCalQ16[color];
+		// boost gain to get full brightness when one RGB base color is dominant:
+		sum_other_colors = baseQ16[0] + baseQ16[1] + baseQ16[2] - baseQ16[color];
+		if (baseQ16[color] > sum_other_colors) {
+			corr += (int)((long long)(LED_Q16_ONE - corr) * (baseQ16[color] - sum_other_colors) / baseQ16[color]);
+		}
+		led_rgbUsedCorrQ16[color] = corr;
+		oVal = (int)(((long long)oVal * corr) >> 16);
+	}
+
+	if (led_gamma_enable_channel_messages &&
+			(((g_lightMode == Light_RGB) && (color < 3)) || ((g_lightMode != Light_RGB) && (color >= 3)))) {
+		addLogAdv (LOG_INFO, LOG_FEATURE_CMD, "channel %i set to %.2f%%\r\n", color, oVal / (LED_Q16_ONE * 2.55f));
+	}
+	if (oVal > 255 * LED_Q16_ONE) {
+		oVal = 255 * LED_Q16_ONE;
+	}
+	return oVal;
+}
+float led_gamma_correction (int color, float iVal) { // apply LED gamma and RGB correction
+	int baseQ16[5];
+	int brightnessQ16;
+
+	brightnessQ16 = LED_PrepareGammaQ16(baseQ16);
+	return LED_GammaCorrectQ16(color, LED_FloatToQ16(iVal), brightnessQ16, baseQ16) * (1.0f / LED_Q16_ONE);
+} //
+
+float led_rawLerpCurrent[5] = { 0 };
 // Colors are in 0-255 range.
 // This value determines how fast color can change.
 // 100 means that in one second color will go from 0 to 100
 // 200 means that in one second color will go from 0 to 200
 float led_lerpSpeedUnitsPerSecond = 200.f;
+static int led_lerpSpeedQ16 = 200 * LED_Q16_ONE;
 
 float led_current_value_brightness = 0;
 float led_current_value_cold_or_warm = 0;
 
+// lerp state, 0-255 for colors and 0-100 for brightness and temperature,
+// targets are set by apply_smart_light
+static int led_lerpCurrentQ16[5];
+static int led_lerpTargetQ16[5];
+static int led_lerpBrightnessQ16;
+static int led_lerpBrightnessTargetQ16;
+static int led_lerpColdOrWarmQ16;
+static int led_lerpColdOrWarmTargetQ16;
+// set when outputs match lerp state, so settled lerp is not written again every tick
+static bool led_lerpSettled;
+
+static void LED_ResetLerpQ16() {
+	memset(led_lerpCurrentQ16, 0, sizeof(led_lerpCurrentQ16));
+	memset(led_lerpTargetQ16, 0, sizeof(led_lerpTargetQ16));
+	led_lerpBrightnessQ16 = 0;
+	led_lerpBrightnessTargetQ16 = 0;
+	led_lerpColdOrWarmQ16 = 0;
+	led_lerpColdOrWarmTargetQ16 = 0;
+	led_lerpSettled = false;
+}
+static int LED_MoveTowardsQ16(int cur, int tg, int step) {
+	if (tg > cur) {
+		if (tg - cur <= step)
+			return tg;
+		return cur + step;
+	}
+	if (cur - tg <= step)
+		return tg;
+	return cur - step;
+}
+
 void led_Save_finalRGBCW(float* finalRGBCW) {
 #ifdef ENABLE_DRIVER_LED
 	if (DRV_IsRunning("SM2135")) {
@@ -207,12 +337,46 @@ void led_Save_finalRGBCW(float* finalRGBCW) {
 void LED_RunQuickColorLerp(int deltaMS) {
 	int i;
 	int firstChannelIndex;
-	float deltaSeconds;
+	int step, chStep, v;
+	bool bMoved;
 	byte finalRGBCW[5];
 	int maxPossibleIndexToSet;
 	int emulatedCool = -1;
-	int target_value_brightness = 0;
-	int target_value_cold_or_warm = 0;
+
+	step = (int)(((long long)deltaMS * led_lerpSpeedQ16) / 1000);
+	bMoved = false;
+	for(i = 0; i < 5; i++) {
+		// adjust change rate with RGB correction in use
+		chStep = (i < 3) ? (int)(((long long)step * led_rgbUsedCorrQ16[i]) >> 16) : step;
+		// This is the most silly and primitive approach, but it works
+		// In future we might implement better lerp algorithms, use HUE, etc
+		v = LED_MoveTowardsQ16(led_lerpCurrentQ16[i], led_lerpTargetQ16[i], chStep);
+		if (v != led_lerpCurrentQ16[i]) {
+			led_lerpCurrentQ16[i] = v;
+			bMoved = true;
+		}
+	}
+	v = LED_MoveTowardsQ16(led_lerpBrightnessQ16, led_lerpBrightnessTargetQ16, step);
+	if (v != led_lerpBrightnessQ16) {
+		led_lerpBrightnessQ16 = v;
+		bMoved = true;
+	}
+	v = LED_MoveTowardsQ16(led_lerpColdOrWarmQ16, led_lerpColdOrWarmTargetQ16, step);
+	if (v != led_lerpColdOrWarmQ16) {
+		led_lerpColdOrWarmQ16 = v;
+		bMoved = true;
+	}
+	// nothing to do until next apply_smart_light
+	if (bMoved == false && led_lerpSettled) {
+		return;
+	}
+	led_lerpSettled = true;
+
+	for(i = 0; i < 5; i++) {
+		led_rawLerpCurrent[i] = led_lerpCurrentQ16[i] * (1.0f / LED_Q16_ONE);
+	}
+	led_current_value_brightness = led_lerpBrightnessQ16 * (1.0f / LED_Q16_ONE);
+	led_current_value_cold_or_warm = led_lerpColdOrWarmQ16 * (1.0f / LED_Q16_ONE);
 
 	if (CFG_HasFlag(OBK_FLAG_LED_FORCE_MODE_RGB)) {
 		// only allow setting pwm 0, 1 and 2, force-skip 3 and 4
@@ -222,9 +386,6 @@ void LED_RunQuickColorLerp(int deltaMS) {
 		maxPossibleIndexToSet = 5;
 	}
 
-
-	deltaSeconds = deltaMS * 0.001f;
-
 	// The color order is RGBCW.
 	// some people set RED to channel 0, and some of them set RED to channel 1
 	// Let's detect if there is a PWM on channel 0
@@ -237,23 +398,6 @@ void LED_RunQuickColorLerp(int deltaMS) {
 		emulatedCool = firstChannelIndex + 3;
 	}
 
-	for(i = 0; i < 5; i++) {
-		float ch_rgb_cal = (i < 3)? rgb_used_corr[i] : 1.0f; // adjust change rate with RGB correction in use
-		// This is the most silly and primitive approach, but it works
-		// In future we might implement better lerp algorithms, use HUE, etc
-		led_rawLerpCurrent[i] = Mathf_MoveTowards(led_rawLerpCurrent[i],finalColors[i], deltaSeconds * led_lerpSpeedUnitsPerSecond * ch_rgb_cal);
-	}
-
-	target_value_cold_or_warm = LED_GetTemperature0to1Range() * 100.0f;
-	if (g_lightEnableAll) {
-		if (g_lightMode == Light_Temperature) {
-			target_value_brightness = g_brightness0to100;
-		}
-	}
-
-	led_current_value_brightness = Mathf_MoveTowards(led_current_value_brightness, target_value_brightness, deltaSeconds * led_lerpSpeedUnitsPerSecond);
-	led_current_value_cold_or_warm = Mathf_MoveTowards(led_current_value_cold_or_warm, target_value_cold_or_warm, deltaSeconds * led_lerpSpeedUnitsPerSecond );
-
 	// OBK_FLAG_LED_ALTERNATE_CW_MODE means we have a driver that takes one PWM for brightness and second for temperature
 	if(isCWMode() && CFG_HasFlag(OBK_FLAG_LED_ALTERNATE_CW_MODE)) {
 		CHANNEL_Set_FloatPWM(firstChannelIndex, led_current_value_cold_or_warm, CHANNEL_SET_FLAG_SKIP_MQTT | CHANNEL_SET_FLAG_SILENT);
@@ -297,43 +441,6 @@ void LED_RunQuickColorLerp(int deltaMS) {
 	led_Save_finalRGBCW(led_rawLerpCurrent);
 }
 
-
-int led_gamma_enable_channel_messages = 0;
-
-float led_gamma_correction (int color, float iVal) { // apply LED gamma and RGB correction
-	if ((color < 0) || (color > 4)) {
-		return iVal;
-	}
-
-	// apply LED gamma correction:
-	float ch_bright_min = g_cfg.led_corr.rgb_bright_min / 100;
-	if (color > 2) {
-		ch_bright_min = g_cfg.led_corr.cw_bright_min / 100;
-	}
-	float brightnessNormalized0to1 = g_brightness0to100 * 0.01f;
-	float oVal = (powf (brightnessNormalized0to1, g_cfg.led_corr.led_gamma) * (1 - ch_bright_min) + ch_bright_min) * iVal;
-
-	// apply RGB level correction:
-	if (color < 3) {
-		rgb_used_corr[color] = g_cfg.led_corr.rgb_cal[color];
-		// boost gain to get full brightness when one RGB base color is dominant:
-		float sum_other_colors = baseColors[0] + baseColors[1] + baseColors[2] - baseColors[color];
-		if (baseColors[color] > sum_other_colors) {
-			rgb_used_corr[color] += (1.0f - rgb_used_corr[color]) * (1.0f - sum_other_colors / baseColors[color]);
-		}
-		oVal *= rgb_used_corr[color];
-	}
-
-	if (led_gamma_enable_channel_messages &&
-			(((g_lightMode == Light_RGB) && (color < 3)) || ((g_lightMode != Light_RGB) && (color >= 3)))) {
-		addLogAdv (LOG_INFO, LOG_FEATURE_CMD, "channel %i set to %.2f%%\r\n", color, oVal / 2.55);
-	}
-	if (oVal > 255.0f) {
-		oVal = 255.0f;
-	}
-	return oVal;
-} //
-
 void apply_smart_light() {
 	int i;
 	int firstChannelIndex;
@@ -344,6 +451,11 @@ void apply_smart_light() {
 	int emulatedCool = -1;
 	int value_brightness = 0;
 	int value_cold_or_warm = 0;
+	int baseQ16[5];
+	int brightnessQ16;
+	int finalQ16;
+
+	brightnessQ16 = LED_PrepareGammaQ16(baseQ16);
 
 	// The color order is RGBCW.
 	// some people set RED to channel 0, and some of them set RED to channel 1
@@ -366,14 +478,20 @@ void apply_smart_light() {
 		maxPossibleIndexToSet = 5;
 	}
 
-	if (CFG_HasFlag(OBK_FLAG_LED_ALTERNATE_CW_MODE)) {
-		value_cold_or_warm = LED_GetTemperature0to1Range() * 100.0f;
-		if (g_lightEnableAll) {
-			if (g_lightMode == Light_Temperature) {
-				value_brightness = g_brightness0to100;
-			}
+	value_cold_or_warm = LED_GetTemperature0to1Range() * 100.0f;
+	if (g_lightEnableAll) {
+		if (g_lightMode == Light_Temperature) {
+			value_brightness = g_brightness0to100;
 		}
 	}
+	// smooth transitions move towards these
+	led_lerpColdOrWarmTargetQ16 = value_cold_or_warm * LED_Q16_ONE;
+	led_lerpBrightnessTargetQ16 = value_brightness * LED_Q16_ONE;
+	led_lerpSettled = false;
+	if (CFG_HasFlag(OBK_FLAG_LED_ALTERNATE_CW_MODE) == false) {
+		value_cold_or_warm = 0;
+		value_brightness = 0;
+	}
 
 	if(isCWMode() && CFG_HasFlag(OBK_FLAG_LED_ALTERNATE_CW_MODE)) {
 		for(i = 0; i < 5; i++) {
@@ -389,17 +507,21 @@ void apply_smart_light() {
 				baseRGBCW[i] = baseColors[i];
 			}
 		}
+		for(i = 0; i < 5; i++) {
+			led_lerpTargetQ16[i] = LED_FloatToQ16(finalColors[i]);
+		}
 		if(CFG_HasFlag(OBK_FLAG_LED_SMOOTH_TRANSITIONS) == false) {
 			CHANNEL_Set_FloatPWM(firstChannelIndex, value_cold_or_warm, CHANNEL_SET_FLAG_SKIP_MQTT | CHANNEL_SET_FLAG_SILENT);
 			CHANNEL_Set_FloatPWM(firstChannelIndex+1, value_brightness, CHANNEL_SET_FLAG_SKIP_MQTT | CHANNEL_SET_FLAG_SILENT);
 		}
 	} else {
 		for(i = 0; i < maxPossibleIndexToSet; i++) {
-			float final = 0.0f;
+			float final;
 
+			finalQ16 = 0;
 			baseRGBCW[i] = baseColors[i];
 			if(g_lightEnableAll) {
-				final = led_gamma_correction (i, baseColors[i]);
+				finalQ16 = LED_GammaCorrectQ16(i, baseQ16[i], brightnessQ16, baseQ16);
 			}
 			if(g_lightMode == Light_Temperature) {
 				// skip channels 0, 1, 2
@@ -407,18 +529,20 @@ void apply_smart_light() {
 				if(i < 3)
 				{
 					baseRGBCW[i] = 0;
-					final = 0;
+					finalQ16 = 0;
 				}
 			} else if(g_lightMode == Light_RGB) {
 				// skip channels 3, 4
 				if(i >= 3)
 				{
 					baseRGBCW[i] = 0;
-					final = 0;
+					finalQ16 = 0;
 				}
 			} else {
 
 			}
+			led_lerpTargetQ16[i] = finalQ16;
+			final = finalQ16 * (1.0f / LED_Q16_ONE);
 			finalColors[i] = final;
 			finalRGBCW[i] = final;
 			
@@ -701,6 +825,10 @@ static commandResult_t temperature(const void *context, const char *cmd, const c
         ADDLOG_DEBUG(LOG_FEATURE_CMD, " temperature (%s) received with args %s",cmd,args);
 
 		Tokenizer_TokenizeString(args, 0);
+		// no argument is just a query (Tasmota style), don't change anything
+		if (Tokenizer_GetArgsCount() == 0) {
+			return CMD_RES_OK;
+		}
 
 		tmp = Tokenizer_GetArgInteger(0);
 
@@ -987,6 +1115,10 @@ static commandResult_t dimmer(const void *context, const char *cmd, const char *
 			}
 		} else {
 			Tokenizer_TokenizeString(args, 0);
+			// no argument is just a query (Tasmota style), don't change anything
+			if (Tokenizer_GetArgsCount() == 0) {
+				return 1;
+			}
 
 			iVal = Tokenizer_GetArgInteger(0);
 
@@ -1275,6 +1407,7 @@ static commandResult_t lerpSpeed(const void *context, const char *cmd, const cha
 	Tokenizer_TokenizeString(args, 0);
 
 	led_lerpSpeedUnitsPerSecond = Tokenizer_GetArgFloat(0);
+	led_lerpSpeedQ16 = LED_FloatToQ16(led_lerpSpeedUnitsPerSecond);
 
 	return CMD_RES_OK;
 }
@@ -140,7 +140,30 @@ enum LightMode {
 // expand constants within whole command and not per-argumenet
 #define TOKENIZER_ALTERNATE_EXPAND_AT_START		4
 
+#define TOKENIZER_MAX_CMD_LEN 512
+#define TOKENIZER_MAX_ARGS 32
+
+// Tokenizer state owned by caller, so nested commands and other threads
+// can't overwrite it. Tokenizer_* functions below use a global one.
+typedef struct tokenizer_s {
+	char buffer[TOKENIZER_MAX_CMD_LEN];
+	const char *args[TOKENIZER_MAX_ARGS];
+	const char *argsFrom[TOKENIZER_MAX_ARGS];
+	char argsExpanded[TOKENIZER_MAX_ARGS][8];
+	int numArgs;
+	int flags;
+} tokenizer_t;
+
 // cmd_tokenizer.c
+void TokenizerCtx_TokenizeString(tokenizer_t *t, const char* s, int flags);
+int TokenizerCtx_GetArgsCount(tokenizer_t *t);
+const char* TokenizerCtx_GetArg(tokenizer_t *t, int i);
+const char* TokenizerCtx_GetArgFrom(tokenizer_t *t, int i);
+int TokenizerCtx_GetArgInteger(tokenizer_t *t, int i);
+bool TokenizerCtx_IsArgInteger(tokenizer_t *t, int i);
+float TokenizerCtx_GetArgFloat(tokenizer_t *t, int i);
+int TokenizerCtx_GetArgIntegerRange(tokenizer_t *t, int i, int rangeMin, int rangeMax);
+
 int Tokenizer_GetArgsCount();
 const char* Tokenizer_GetArg(int i);
 const char* Tokenizer_GetArgFrom(int i);
@@ -158,6 +181,7 @@ void EventHandlers_Init();
 // This is useful to fire an event when a certain UART string command is received.
 // For example, you can fire an event while getting 55 AA 01 02 00 03 FF 01 01 06  on UART..
 void EventHandlers_FireEvent_String(byte eventCode, const char* argument);
+bool EventHandlers_HasEventHandler(byte eventCode);
 // This is useful to fire an event when, for example, a button is pressed.
 // Then eventCode is a BUTTON_PRESS and argument is a button index.
 void EventHandlers_FireEvent(byte eventCode, int argument);
@@ -223,6 +247,7 @@ void CMD_StartTCPCommandLine();
 int CMD_GetCountActiveScriptThreads();
 
 void SVM_RunThreads(int deltaMS);
+int SVM_GetNextWakeUpMS();
 void CMD_InitScripting();
 byte* LFS_ReadFile(const char* fname);
 
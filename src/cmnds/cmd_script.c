@@ -225,9 +225,37 @@ addEventHandler OnHold 20 backlog AddChannel 10 2 0 255; DGR_SendBrightness room
 
 */
 
+// Script files are compiled once, when loaded, into a line table.
+// Each executable line keeps its resolved command and the offsets
+// of command name and arguments within file data (both are zero-terminated in place),
+// so running a line does not need to skip whitespace, copy or hash anything.
+typedef struct scriptLine_s {
+	// resolved at load time, or on first run if command was registered later (eg. by startDriver)
+	command_t *cmd;
+	int cmdOfs;
+	int argsOfs;
+	// compiled condition, if command is "if"
+	cmdExpression_t *condition;
+} scriptLine_t;
+
+typedef struct scriptLabel_s {
+	int nameOfs;
+	// index of first line after label
+	int line;
+	// next label in the same hash bucket, or -1
+	int nextInBucket;
+} scriptLabel_t;
+
 typedef struct scriptFile_s {
 	char *fname;
 	char *data;
+	scriptLine_t *lines;
+	int numLines;
+	scriptLabel_t *labels;
+	int numLabels;
+	// label index by name, built on load, so goto does not scan the file
+	int *labelBuckets;
+	int labelBucketsMask;
 
 	struct scriptFile_s *next;
 } scriptFile_t;
@@ -235,19 +263,128 @@ typedef struct scriptFile_s {
 typedef struct scriptInstance_s {
 	scriptFile_t *curFile;
 	int uniqueID;
-	const char *curLine;
+	// index in curFile->lines, only valid if curFile is set
+	int curLine;
+	// delay requested by delay_s/delay_ms during the current run
 	int currentDelayMS;
+	// absolute SVM time at which a sleeping thread is due
+	unsigned int wakeTime;
+	// position in g_sleepHeap, -1 if not sleeping
+	int heapIndex;
+	// set while the thread is on the run queue
+	int bQueued;
+	struct scriptInstance_s *nextQueued;
 
 	struct scriptInstance_s *next;
 } scriptInstance_t;
 
-#define MAX_SCRIPT_LINE 512
-
-char *g_scrBuffer = 0;
 int svm_deltaMS;
+// SVM clock, advanced by SVM_RunThreads
+unsigned int svm_timeMS;
 scriptFile_t *g_scriptFiles = 0;
 scriptInstance_t *g_scriptThreads = 0;
 scriptInstance_t *g_activeThread = 0;
+// sleeping threads, min-heap on wakeTime
+scriptInstance_t **g_sleepHeap = 0;
+int g_sleepHeapCount = 0;
+int g_sleepHeapSize = 0;
+// threads that want to run on the next tick
+scriptInstance_t *g_runQueue = 0;
+scriptInstance_t *g_runQueueTail = 0;
+
+// wrap-safe "a is due before b"
+#define SVM_TIME_BEFORE(a,b) ((int)((a)-(b)) < 0)
+
+static void SVM_HeapSet(int i, scriptInstance_t *t) {
+	g_sleepHeap[i] = t;
+	t->heapIndex = i;
+}
+static void SVM_HeapUp(int i) {
+	scriptInstance_t *t;
+	int parent;
+
+	t = g_sleepHeap[i];
+	while(i > 0) {
+		parent = (i - 1) / 2;
+		if(!SVM_TIME_BEFORE(t->wakeTime, g_sleepHeap[parent]->wakeTime))
+			break;
+		SVM_HeapSet(i, g_sleepHeap[parent]);
+		i = parent;
+	}
+	SVM_HeapSet(i, t);
+}
+static void SVM_HeapDown(int i) {
+	scriptInstance_t *t;
+	int child;
+
+	t = g_sleepHeap[i];
+	while(1) {
+		child = i * 2 + 1;
+		if(child >= g_sleepHeapCount)
+			break;
+		if(child + 1 < g_sleepHeapCount && SVM_TIME_BEFORE(g_sleepHeap[child+1]->wakeTime, g_sleepHeap[child]->wakeTime))
+			child++;
+		if(!SVM_TIME_BEFORE(g_sleepHeap[child]->wakeTime, t->wakeTime))
+			break;
+		SVM_HeapSet(i, g_sleepHeap[child]);
+		i = child;
+	}
+	SVM_HeapSet(i, t);
+}
+static void SVM_Sleep(scriptInstance_t *t, int delayMS) {
+	scriptInstance_t **n;
+	int newSize;
+
+	if(g_sleepHeapCount >= g_sleepHeapSize) {
+		newSize = g_sleepHeapSize ? g_sleepHeapSize * 2 : 8;
+		n = realloc(g_sleepHeap, newSize * sizeof(scriptInstance_t*));
+		if(n == 0) {
+			ADDLOG_ERROR(LOG_FEATURE_CMD, "SVM_Sleep: failed to grow sleep heap");
+			// drop the delay rather than losing the thread
+			t->currentDelayMS = 0;
+			return;
+		}
+		g_sleepHeap = n;
+		g_sleepHeapSize = newSize;
+	}
+	t->wakeTime = svm_timeMS + delayMS;
+	g_sleepHeap[g_sleepHeapCount] = t;
+	g_sleepHeapCount++;
+	SVM_HeapUp(g_sleepHeapCount-1);
+}
+static void SVM_Unsleep(scriptInstance_t *t) {
+	int i;
+
+	i = t->heapIndex;
+	if(i < 0)
+		return;
+	t->heapIndex = -1;
+	g_sleepHeapCount--;
+	if(i != g_sleepHeapCount) {
+		SVM_HeapSet(i, g_sleepHeap[g_sleepHeapCount]);
+		SVM_HeapUp(i);
+		SVM_HeapDown(g_sleepHeap[i]->heapIndex);
+	}
+}
+static void SVM_QueueThread(scriptInstance_t *t) {
+	if(t->bQueued)
+		return;
+	t->bQueued = 1;
+	t->nextQueued = 0;
+	if(g_runQueueTail) {
+		g_runQueueTail->nextQueued = t;
+	} else {
+		g_runQueue = t;
+	}
+	g_runQueueTail = t;
+}
+static void SVM_ResetThread(scriptInstance_t *t) {
+	SVM_Unsleep(t);
+	t->curLine = 0;
+	t->curFile = 0;
+	t->uniqueID = 0;
+	t->currentDelayMS = 0;
+}
 
 scriptInstance_t *SVM_RegisterThread() {
 	scriptInstance_t *r;
@@ -255,7 +392,7 @@ scriptInstance_t *SVM_RegisterThread() {
 	r = g_scriptThreads;
 
 	while(r) {
-		if(r->curLine == 0) {
+		if(r->curFile == 0) {
 			break;
 		}
 		r = r->next;
@@ -263,6 +400,7 @@ scriptInstance_t *SVM_RegisterThread() {
 	if(r == 0) {
 		r = malloc(sizeof(scriptInstance_t));
 		memset(r,0,sizeof(scriptInstance_t));
+		r->heapIndex = -1;
 		r->next = g_scriptThreads;
 		g_scriptThreads = r;
 	}
@@ -272,7 +410,127 @@ scriptInstance_t *SVM_RegisterThread() {
 	r->currentDelayMS = 0;
 	return r;
 }
+const char *SVM_SkipWS(const char *p) {
+	if(p==0)
+		return 0;
+	// skip also whitespaces
+	while(*p == ' ' || *p == '\r' || *p == '\t') {
+		p++;
+	}
+	return p;
+}
+const char *SVM_SkipLine(const char *p) {
+	if(p==0)
+		return 0;
+	while(*p) {
+		if(*p == '\n') {
+			p++;
+			return p;
+		}
+		p++;
+	}
+	return p;
+}
+// Walks the script text. If bStore is 0, only counts lines and labels,
+// otherwise fills already allocated tables and terminates strings in place.
+static void SVM_CompileFile_Internal(scriptFile_t *f, int bStore) {
+	char *p, *start, *end, *next;
+	scriptLine_t *l;
+	int len;
+
+	f->numLines = 0;
+	f->numLabels = 0;
+
+	p = f->data;
+	while(*p) {
+		start = (char*)SVM_SkipWS(p);
+		next = (char*)SVM_SkipLine(start);
+		end = next;
+		while(end > start && (end[-1]==' '||end[-1]=='\r'||end[-1]=='\n'||end[-1]=='\t')) {
+			end--;
+		}
+		p = next;
+		len = end - start;
+
+		// skip empty lines and comments
+		if(len <= 0) {
+			continue;
+		}
+		if(start[0] == '/' && start[1] == '/') {
+			continue;
+		}
+		if(start[len-1] == ':') {
+			if(bStore) {
+				start[len-1] = 0;
+				f->labels[f->numLabels].nameOfs = start - f->data;
+				f->labels[f->numLabels].line = f->numLines;
+			}
+			f->numLabels++;
+			continue;
+		}
+		if(bStore) {
+			*end = 0;
+			l = &f->lines[f->numLines];
+			l->cmdOfs = start - f->data;
+			while(*start && isWhiteSpace(*start) == false) {
+				start++;
+			}
+			if(*start) {
+				*start = 0;
+				start++;
+				while(isWhiteSpace(*start)) {
+					start++;
+				}
+			}
+			l->argsOfs = start - f->data;
+			l->cmd = CMD_FindStrippingNumbers(f->data + l->cmdOfs);
+			l->condition = 0;
+			if(!stricmp(f->data + l->cmdOfs, "if")) {
+				l->condition = CMD_If_CompileCondition(f->data + l->argsOfs);
+			}
+		}
+		f->numLines++;
+	}
+}
+static unsigned int SVM_HashLabel(const char *s) {
+	unsigned int hash;
 
+	hash = 0;
+	while(*s) {
+		hash = hash * 31 + (unsigned char)*s;
+		s++;
+	}
+	return hash ^ (hash >> 16);
+}
+static void SVM_BuildLabelIndex(scriptFile_t *f) {
+	int i, size;
+	unsigned int bucket;
+
+	// keep load factor at most 0.5
+	size = 8;
+	while(size < f->numLabels * 2) {
+		size *= 2;
+	}
+	f->labelBuckets = malloc(sizeof(int) * size);
+	f->labelBucketsMask = size - 1;
+	for(i = 0; i < size; i++) {
+		f->labelBuckets[i] = -1;
+	}
+	// walk backwards so that, like before, first label with given name wins
+	for(i = f->numLabels - 1; i >= 0; i--) {
+		bucket = SVM_HashLabel(f->data + f->labels[i].nameOfs) & f->labelBucketsMask;
+		f->labels[i].nextInBucket = f->labelBuckets[bucket];
+		f->labelBuckets[bucket] = i;
+	}
+}
+static void SVM_CompileFile(scriptFile_t *f) {
+	SVM_CompileFile_Internal(f, 0);
+	f->lines = malloc(sizeof(scriptLine_t) * (f->numLines + 1));
+	f->labels = malloc(sizeof(scriptLabel_t) * (f->numLabels + 1));
+	SVM_CompileFile_Internal(f, 1);
+	SVM_BuildLabelIndex(f);
+	ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "SVM: compiled %s - %i lines, %i labels",f->fname,f->numLines,f->numLabels);
+}
 scriptFile_t *SVM_RegisterFile(const char *fname) {
 	scriptFile_t *r;
 
@@ -301,143 +559,145 @@ scriptFile_t *SVM_RegisterFile(const char *fname) {
 	g_scriptFiles = r;
 	if(r->data == 0)
 		return 0;
+	SVM_CompileFile(r);
 	return r;
 }
-const char *SVM_SkipWS(const char *p) {
-	if(p==0)
-		return 0;
-	// skip also whitespaces
-	while(*p == ' ' || *p == '\r' || *p == '\t') {
-		p++;
-	}
-	return p;
-}
-const char *SVM_SkipLine(const char *p) {
-	if(p==0)
-		return 0;
-	while(*p) {
-		if(*p == '\n') {
-			p++;
-			return p;
-		}
-		p++;
-	}
-	return p;
-}
 
-const char *SVM_FindLabel(const char *text, const char *label, const char *fname) {
-	int labLen;
+int SVM_FindLabel(scriptFile_t *f, const char *label) {
+	int i;
 
 	if(label == 0)
-		return text;
+		return 0;
 	if (!strcmp(label, "*"))
-		return text;
+		return 0;
 	if (*label == 0)
-		return text;
-
-	labLen = strlen(label);
+		return 0;
 
-	while(*text) {
-		text = SVM_SkipWS(text); 
-		if(strncmp(text,label,labLen) == 0 && text[labLen] == ':') {
-			return text;
+	i = f->labelBuckets[SVM_HashLabel(label) & f->labelBucketsMask];
+	while(i != -1) {
+		if(!strcmp(f->data + f->labels[i].nameOfs, label)) {
+			return f->labels[i].line;
 		}
-		if(text[0] == '/' && text[1] == '/') {
-			text = SVM_SkipLine(text); 
-			text = SVM_SkipWS(text); 
-		} else {
-			text = SVM_SkipLine(text); 
-			text = SVM_SkipWS(text); 
+		i = f->labels[i].nextInBucket;
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Label %s not found in %s - will go to the start of file",label,f->fname);
+	// past the last line, so thread will finish
+	return f->numLines;
+}
+static commandResult_t SVM_ExecuteLine(scriptFile_t *f, scriptLine_t *l) {
+	const char *cmd, *args;
+
+	cmd = f->data + l->cmdOfs;
+	args = f->data + l->argsOfs;
+	if(l->condition) {
+		return CMD_If_Execute(args, l->condition);
+	}
+	if(l->cmd == 0) {
+		// command might have been registered after script was loaded
+		l->cmd = CMD_FindStrippingNumbers(cmd);
+		if(l->cmd == 0) {
+			// let it report unknown command
+			return CMD_ExecuteCommandArgs(cmd, args, 0);
 		}
 	}
-	ADDLOG_INFO(LOG_FEATURE_CMD, "Label %s not found in %s - will go to the start of file",label,fname);
-	return text;
+	if(l->cmd->handler == 0) {
+		return CMD_RES_UNKNOWN_COMMAND;
+	}
+	return l->cmd->handler(l->cmd->context, cmd, args, 0);
 }
 void SVM_RunThread(scriptInstance_t *t) {
 	int maxLoops = 10;
 	int loop = 0;
-	const char *start, *end;
-	int len, p;
+	scriptFile_t *f;
 
 	while(1) {
 		loop++;
-		if(t->curLine == 0) {
-			t->curLine = 0;
-			t->curFile = 0;
+		f = t->curFile;
+		if(f == 0) {
 			return;
 		}
 		if (loop > maxLoops) {
 			return;
 		}
-		t->curLine = SVM_SkipWS(t->curLine); 
-		if(t->curLine[0] == 0) {
+		if(t->curLine >= f->numLines) {
 			t->curLine = 0;
 			t->curFile = 0;
 			return;
 		}
-		if(t->curLine[0] == '/' && t->curLine[1] == '/') {
-			t->curLine = SVM_SkipLine(t->curLine); 
-			t->curLine = SVM_SkipWS(t->curLine); 
-		} else {
-			start = t->curLine;
-			end = SVM_SkipLine(start);
-			t->curLine = SVM_SkipWS(end); 
-
-			while(end > start && (end[-1]==' '||end[-1]=='\r'||end[-1]=='\n'||end[-1]=='\t')) {
-				end--;
-			}
-			len = (end - start);
-			//ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "Script len: %i",len);
-
-			// skip empty lines and skip labels
-			if(len > 0 && start[len-1] != ':') {
-				if(len >= MAX_SCRIPT_LINE) {
-					len = MAX_SCRIPT_LINE-1;
-				}
-				memcpy(g_scrBuffer,start,len);
-				g_scrBuffer[len] = 0;
-
-				p = start-t->curFile->data;
-				///ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "[Loop %i] Script line: %s, char index %i",loop,g_scrBuffer,p);
-				CMD_ExecuteCommand(g_scrBuffer,0);
+		// advance first, so goto can overwrite it
+		t->curLine++;
+		SVM_ExecuteLine(f, &f->lines[t->curLine-1]);
 
-				// did we get a sleep?
-				if(t->currentDelayMS > 0) {
-					return;
-				}	
-			}
-		}
+		// did we get a sleep?
+		if(t->currentDelayMS > 0) {
+			return;
+		}	
 	}
 }
 
 void SVM_RunThreads(int deltaMS) {
-	int c_sleep, c_run;
+	scriptInstance_t *t, *list;
+	int c_woken, c_run;
 
-	c_sleep = 0;
+	c_woken = 0;
 	c_run = 0;
 	svm_deltaMS = deltaMS;
+	svm_timeMS += deltaMS;
 
-	if(g_scrBuffer == 0) {
-		g_scrBuffer = malloc(MAX_SCRIPT_LINE);
+	// move every thread that is due from the sleep heap to the run queue;
+	// threads that are still sleeping are not touched at all
+	while(g_sleepHeapCount > 0 && !SVM_TIME_BEFORE(svm_timeMS, g_sleepHeap[0]->wakeTime)) {
+		t = g_sleepHeap[0];
+		SVM_Unsleep(t);
+		t->currentDelayMS = 0;
+		SVM_QueueThread(t);
+		c_woken++;
 	}
 
-	g_activeThread = g_scriptThreads;
-	while(g_activeThread) {
-		if(g_activeThread->currentDelayMS > 0) {
-			g_activeThread->currentDelayMS -= deltaMS;
-			// the following block is needed to handle with long freezes on simulator
-			if (g_activeThread->currentDelayMS < 0) {
-				g_activeThread->currentDelayMS = 0;
-			}
-			c_sleep++;
+	// threads queued while running (startScript) will run on next tick
+	list = g_runQueue;
+	g_runQueue = 0;
+	g_runQueueTail = 0;
+	while(list) {
+		t = list;
+		list = t->nextQueued;
+		t->bQueued = 0;
+		if(t->curFile == 0) {
+			// stopped while waiting in queue
+			continue;
+		}
+		g_activeThread = t;
+		SVM_RunThread(t);
+		c_run++;
+		if(t->curFile == 0) {
+			continue;
+		}
+		if(t->currentDelayMS > 0) {
+			SVM_Sleep(t, t->currentDelayMS);
 		} else {
-			SVM_RunThread(g_activeThread);
-			c_run++;
+			// line budget exhausted, continue on next tick
+			SVM_QueueThread(t);
 		}
-		g_activeThread = g_activeThread->next;
 	}
+	g_activeThread = 0;
+
+	//ADDLOG_INFO(LOG_FEATURE_CMD, "SCR woken %i, ran %i",c_woken,c_run);
+}
+// Returns how many ms can pass before SVM_RunThreads has anything to do,
+// 0 if some thread wants to run now, -1 if there are no threads at all
+int SVM_GetNextWakeUpMS() {
+	int left;
 
-	//ADDLOG_INFO(LOG_FEATURE_CMD, "SCR sleep %i, ran %i",c_sleep,c_run);
+	if(g_runQueue) {
+		return 0;
+	}
+	if(g_sleepHeapCount == 0) {
+		return -1;
+	}
+	left = (int)(g_sleepHeap[0]->wakeTime - svm_timeMS);
+	if(left < 0)
+		return 0;
+	return left;
 }
 void SVM_GoTo(scriptInstance_t *th, const char *fname, const char *label) {
 	scriptFile_t *f;
@@ -456,12 +716,13 @@ void SVM_GoTo(scriptInstance_t *th, const char *fname, const char *label) {
 		return;
 	}
 	th->curFile = f;
-	th->curLine = SVM_FindLabel(f->data,label,f->fname);
+	th->curLine = SVM_FindLabel(f,label);
 
 	return;
 }
 void SVM_FreeAllFiles() {
 	scriptFile_t *f; 
+	int i;
 
 	f = g_scriptFiles;
 	while(f) {
@@ -469,8 +730,14 @@ void SVM_FreeAllFiles() {
 
 		n = f->next;
 
+		for(i = 0; i < f->numLines; i++) {
+			free(f->lines[i].condition);
+		}
 		free(f->data);
 		free(f->fname);
+		free(f->lines);
+		free(f->labels);
+		free(f->labelBuckets);
 		free(f);
 
 		f = n;
@@ -482,10 +749,7 @@ void SVM_StopAllScripts() {
 
 	t = g_scriptThreads;
 	while(t) {
-		t->curLine = 0;
-		t->curFile = 0;
-		t->uniqueID = 0;
-		t->currentDelayMS = 0;
+		SVM_ResetThread(t);
 
 		t = t->next;
 	}
@@ -499,10 +763,7 @@ void SVM_StopScripts(int id, int bExcludeSelf) {
 			// excluded
 		} else {
 			if(t->uniqueID == id) {
-				t->curLine = 0;
-				t->curFile = 0;
-				t->uniqueID = 0;
-				t->currentDelayMS = 0;
+				SVM_ResetThread(t);
 			} 
 		}
 		t = t->next;
@@ -510,11 +771,11 @@ void SVM_StopScripts(int id, int bExcludeSelf) {
 }
 void SVM_GoToLocal(scriptInstance_t *th, const char *label) {
 
-	if(th == 0) {
+	if(th == 0 || th->curFile == 0) {
 
 		return;
 	}
-	th->curLine = SVM_FindLabel(th->curFile->data,label,th->curFile->fname);
+	th->curLine = SVM_FindLabel(th->curFile,label);
 
 	return;
 }
@@ -541,7 +802,8 @@ void SVM_StartScript(const char *fname, const char *label, int uniqueID) {
 	}
 	th->uniqueID = uniqueID;
 	th->curFile = f;
-	th->curLine = SVM_FindLabel(f->data,label,f->fname);
+	th->curLine = SVM_FindLabel(f,label);
+	SVM_QueueThread(th);
 
 	if(label==0) {
 		ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_StartScript: started %s at the beginning",fname);
@@ -718,7 +980,10 @@ static commandResult_t CMD_ListScripts(const void *context, const char *cmd, con
 	cnt = 0;
 	t = g_scriptThreads;
 	while(t) {
-		if(t->curFile) {
+		if(t->curFile && t->heapIndex >= 0) {
+			ADDLOG_INFO(LOG_FEATURE_CMD, "[%i] Thread UID %i - at file %s, sleeping %i ms",cnt,t->uniqueID,t->curFile->fname,
+				(int)(t->wakeTime - svm_timeMS));
+		} else if(t->curFile) {
 			ADDLOG_INFO(LOG_FEATURE_CMD, "[%i] Thread UID %i - at file %s",cnt,t->uniqueID,t->curFile->fname);
 		} else {
 			ADDLOG_INFO(LOG_FEATURE_CMD, "[%i] Empty thread.",cnt);
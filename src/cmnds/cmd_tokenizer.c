@@ -7,18 +7,11 @@
 #include "../new_cfg.h"
 #include "../logging/logging.h"
 
-#define MAX_CMD_LEN 512
-#define MAX_ARGS 32
+// global context for the old API, not reentrant
+static tokenizer_t g_tokenizer;
 
-static char g_buffer[MAX_CMD_LEN];
-static const char *g_args[MAX_ARGS];
-static char g_argsExpanded[MAX_ARGS][8];
-static const char *g_argsFrom[MAX_ARGS];
-static int g_numArgs = 0;
-static int tok_flags = 0;
-
-#define g_bAllowQuotes (tok_flags&TOKENIZER_ALLOW_QUOTES)
-#define g_bAllowExpand (!(tok_flags&TOKENIZER_DONT_EXPAND))
+#define t_bAllowQuotes (t->flags&TOKENIZER_ALLOW_QUOTES)
+#define t_bAllowExpand (!(t->flags&TOKENIZER_DONT_EXPAND))
 
 bool isWhiteSpace(char ch) {
 	if(ch == ' ')
@@ -31,41 +24,43 @@ bool isWhiteSpace(char ch) {
 		return true;
 	return false;
 }
-int Tokenizer_GetArgsCount() {
-	return g_numArgs;
+int TokenizerCtx_GetArgsCount(tokenizer_t *t) {
+	return t->numArgs;
 }
-bool Tokenizer_IsArgInteger(int i) {
-	if(i >= g_numArgs)
+bool TokenizerCtx_IsArgInteger(tokenizer_t *t, int i) {
+	if(i >= t->numArgs)
 		return false;
-	return strIsInteger(g_args[i]);
+	return strIsInteger(t->args[i]);
 }
-const char *Tokenizer_GetArg(int i) {
+const char *TokenizerCtx_GetArg(tokenizer_t *t, int i) {
 	const char *s;
 
-	if(i >= g_numArgs)
+	if(i >= t->numArgs)
 		return 0;
 
-	s = g_args[i];
+	s = t->args[i];
 
-	if(g_bAllowExpand && s[0] == '$' && s[1] == 'C' && s[2] == 'H') {
+	if(t_bAllowExpand && s[0] == '$' && s[1] == 'C' && s[2] == 'H') {
 		int channelIndex;
 		int value;
 
 		channelIndex = atoi(s+3);
 		value = CHANNEL_Get(channelIndex);
 		
-		sprintf(g_argsExpanded[i],"%i",value);
+		sprintf(t->argsExpanded[i],"%i",value);
 
-		return g_argsExpanded[i];
+		return t->argsExpanded[i];
 	}
 
-	return g_args[i];
+	return t->args[i];
 }
-const char *Tokenizer_GetArgFrom(int i) {
-	return g_argsFrom[i];
+const char *TokenizerCtx_GetArgFrom(tokenizer_t *t, int i) {
+	if(i >= t->numArgs)
+		return 0;
+	return t->argsFrom[i];
 }
-int Tokenizer_GetArgIntegerRange(int i, int rangeMin, int rangeMax) {
-	int ret = Tokenizer_GetArgInteger(i);
+int TokenizerCtx_GetArgIntegerRange(tokenizer_t *t, int i, int rangeMin, int rangeMax) {
+	int ret = TokenizerCtx_GetArgInteger(t, i);
 	if(ret < rangeMin) {
 		ret = rangeMin;
 		ADDLOG_ERROR(LOG_FEATURE_CMD, "Argument %i (val=%i) was out of range [%i,%i], clamped",i,ret,rangeMax,rangeMin);
@@ -76,11 +71,13 @@ int Tokenizer_GetArgIntegerRange(int i, int rangeMin, int rangeMax) {
 	}
 	return ret;
 }
-int Tokenizer_GetArgInteger(int i) {
+int TokenizerCtx_GetArgInteger(tokenizer_t *t, int i) {
 	const char *s;
 	int ret;
 
-	s = g_args[i];
+	if(i >= t->numArgs)
+		return 0;
+	s = t->args[i];
 	if (s == 0)
 		return 0;
 	if(s[0] == '0' && s[1] == 'x') {
@@ -88,7 +85,7 @@ int Tokenizer_GetArgInteger(int i) {
 		return ret;
 	}
 #if (!PLATFORM_BEKEN && !WINDOWS)
-	if(g_bAllowExpand && s[0] == '$') {
+	if(t_bAllowExpand && s[0] == '$') {
 		// constant
 		int channelIndex;
 		if(s[1] == 'C' && s[2] == 'H') {
@@ -102,21 +99,24 @@ int Tokenizer_GetArgInteger(int i) {
 	// - 5*10
 	// - $CH5+$CH11
 	// - $CH8*10
-	if(g_bAllowExpand) {
+	if(t_bAllowExpand) {
 		ret = CMD_EvaluateExpression(s,0);
 		return ret;
 	}
 #endif
 	return atoi(s);
 }
-float Tokenizer_GetArgFloat(int i) {
+float TokenizerCtx_GetArgFloat(tokenizer_t *t, int i) {
 #if !PLATFORM_BEKEN
 	int channelIndex;
 #endif
 	const char *s;
-	s = g_args[i];
+
+	if(i >= t->numArgs)
+		return 0;
+	s = t->args[i];
 #if (!PLATFORM_BEKEN && !WINDOWS)
-	if(g_bAllowExpand && s[0] == '$') {
+	if(t_bAllowExpand && s[0] == '$') {
 		// constant
 		if(s[1] == 'C' && s[2] == 'H') {
 			channelIndex = atoi(s+3);
@@ -129,17 +129,17 @@ float Tokenizer_GetArgFloat(int i) {
 	// - 5*10
 	// - $CH5+$CH11
 	// - $CH8*10
-	if(g_bAllowExpand) {
+	if(t_bAllowExpand) {
 		return CMD_EvaluateExpression(s,0);
 	}
 #endif
 	return atof(s);
 }
-void Tokenizer_TokenizeString(const char *s, int flags) {
+void TokenizerCtx_TokenizeString(tokenizer_t *t, const char *s, int flags) {
 	char *p;
 
-	tok_flags = flags;
-	g_numArgs = 0;
+	t->flags = flags;
+	t->numArgs = 0;
 
 	if(s == 0) {
 		return;
@@ -153,50 +153,48 @@ void Tokenizer_TokenizeString(const char *s, int flags) {
 		return;
 	}
 
-	// not really needed, but nice for testing
-	memset(g_args, 0, sizeof(g_args));
-	memset(g_argsFrom, 0, sizeof(g_argsFrom));
+	// args past numArgs are never read, so no need to clear them
 
 	if (flags & TOKENIZER_ALTERNATE_EXPAND_AT_START) {
-		CMD_ExpandConstantsWithinString(s, g_buffer, sizeof(g_buffer));
+		CMD_ExpandConstantsWithinString(s, t->buffer, sizeof(t->buffer));
 	} else {
-		strcpy_safe(g_buffer, s, sizeof(g_buffer));
+		strcpy_safe(t->buffer, s, sizeof(t->buffer));
 	}
-	p = g_buffer;
+	p = t->buffer;
 	// we need to rewrite this function and check it well with unit tests
 	if (*p == '"') {
 		goto quote;
 	}
-	g_args[g_numArgs] = p;
-	g_argsFrom[g_numArgs] = (s+(p-g_buffer));
-	g_numArgs++;
+	t->args[t->numArgs] = p;
+	t->argsFrom[t->numArgs] = (s+(p-t->buffer));
+	t->numArgs++;
 	while(*p != 0) {
 		if(isWhiteSpace(*p)) {
 			*p = 0;
 			if(p[1] != 0 && isWhiteSpace(p[1])==false) {
 				// we need to rewrite this function and check it well with unit tests
-				if(g_bAllowQuotes && p[1] == '"') { 
+				if(t_bAllowQuotes && p[1] == '"') { 
 					p++;
 					goto quote;
 				}
-				g_args[g_numArgs] = p+1;
-				g_argsFrom[g_numArgs] = (s+((p+1)-g_buffer));
-				g_numArgs++;
+				t->args[t->numArgs] = p+1;
+				t->argsFrom[t->numArgs] = (s+((p+1)-t->buffer));
+				t->numArgs++;
 			}
 		}
 		if(*p == ',') {
 			*p = 0;
-			g_args[g_numArgs] = p+1;
-			g_argsFrom[g_numArgs] = (s+((p+1)-g_buffer));
-			g_numArgs++;
+			t->args[t->numArgs] = p+1;
+			t->argsFrom[t->numArgs] = (s+((p+1)-t->buffer));
+			t->numArgs++;
 		}
-		if(g_bAllowQuotes && *p == '"') {
+		if(t_bAllowQuotes && *p == '"') {
 quote:
 			*p = 0;
-			g_argsFrom[g_numArgs] = (s+((p+1)-g_buffer));
+			t->argsFrom[t->numArgs] = (s+((p+1)-t->buffer));
 			p++;
-			g_args[g_numArgs] = p;
-			g_numArgs++;
+			t->args[t->numArgs] = p;
+			t->numArgs++;
 			while(*p != 0) {
 				if(*p == '"') {
 					*p = 0;
@@ -205,7 +203,7 @@ quote:
 				p++;
 			}
 		}
-		if(g_numArgs>=MAX_ARGS) {
+		if(t->numArgs>=TOKENIZER_MAX_ARGS) {
 			ADDLOG_ERROR(LOG_FEATURE_CMD, "Too many args, skipped all after 32nd.");
 			break;
 		}
@@ -214,3 +212,28 @@ quote:
 
 
 }
+
+int Tokenizer_GetArgsCount() {
+	return TokenizerCtx_GetArgsCount(&g_tokenizer);
+}
+bool Tokenizer_IsArgInteger(int i) {
+	return TokenizerCtx_IsArgInteger(&g_tokenizer, i);
+}
+const char *Tokenizer_GetArg(int i) {
+	return TokenizerCtx_GetArg(&g_tokenizer, i);
+}
+const char *Tokenizer_GetArgFrom(int i) {
+	return TokenizerCtx_GetArgFrom(&g_tokenizer, i);
+}
+int Tokenizer_GetArgIntegerRange(int i, int rangeMin, int rangeMax) {
+	return TokenizerCtx_GetArgIntegerRange(&g_tokenizer, i, rangeMin, rangeMax);
+}
+int Tokenizer_GetArgInteger(int i) {
+	return TokenizerCtx_GetArgInteger(&g_tokenizer, i);
+}
+float Tokenizer_GetArgFloat(int i) {
+	return TokenizerCtx_GetArgFloat(&g_tokenizer, i);
+}
+void Tokenizer_TokenizeString(const char *s, int flags) {
+	TokenizerCtx_TokenizeString(&g_tokenizer, s, flags);
+}
@@ -89,7 +89,7 @@ commandResult_t BL0937_PowerSet(const void* context, const char* cmd, const char
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"PowerSet: you gave %f, set ref to %f\n", realPower, BL0937_PREF);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 	return CMD_RES_OK;
 }
@@ -110,7 +110,7 @@ commandResult_t BL0937_PowerMax(const void *context, const char *cmd, const char
         {
             char dbg[128];
             snprintf(dbg, sizeof(dbg),"PowerMax: set max to %f\n", BL0937_PMAX);
-            addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+            addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
         }
     }
     return CMD_RES_OK;
@@ -171,7 +171,7 @@ commandResult_t BL0937_VoltageSet(const void *context, const char *cmd, const ch
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"VoltageSet: you gave %f, set ref to %f\n", realV, BL0937_VREF);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 
 	return CMD_RES_OK;
@@ -192,7 +192,7 @@ commandResult_t BL0937_CurrentSet(const void *context, const char *cmd, const ch
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"CurrentSet: you gave %f, set ref to %f\n", realI, BL0937_CREF);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 	return CMD_RES_OK;
 }
@@ -379,7 +379,7 @@ void BL0937_RunFrame()
         {
             char dbg[128];
             snprintf(dbg, sizeof(dbg),"Power reading: %f exceeded MAX limit: %f, Last: %f\n", final_p, BL0937_PMAX, last_p);
-            addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, dbg);
+            addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
         }
         final_p = last_p;
     } else {
@@ -390,7 +390,7 @@ void BL0937_RunFrame()
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"Voltage %f, current %f, power %f\n", final_v, final_c, final_p);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 #endif
 	BL_ProcessUpdate(final_v,final_c,final_p);
@@ -24,15 +24,16 @@ static int raw_unscaled_freq;
 #define BL0942_BAUD_RATE 4800
 
 #define BL0942_READ_COMMAND 0x58
+#define BL0942_PACKET_LEN 23
 
 
 int BL0942_TryToGetNextBL0942Packet() {
 	int cs;
 	int i;
-	int c_garbage_consumed = 0;
-	byte a;
+	int c_garbage_consumed;
 	byte checksum;
-	int BL0942_PACKET_LEN = 23;
+	const byte *p;
+	byte scratch[BL0942_PACKET_LEN];
 
 	cs = UART_GetDataSize();
 
@@ -41,57 +42,40 @@ int BL0942_TryToGetNextBL0942Packet() {
 		return 0;
 	}
 	// skip garbage data (should not happen)
-	while(cs > 0) {
-		a = UART_GetNextByte(0);
-		if(a != 0x55) {
-			UART_ConsumeBytes(1);
-			c_garbage_consumed++;
-			cs--;
-		} else {
-			break;
-		}
+	c_garbage_consumed = UART_FindByte(0x55, 0);
+	if(c_garbage_consumed < 0) {
+		c_garbage_consumed = cs;
 	}
 	if(c_garbage_consumed > 0){
+		UART_ConsumeBytes(c_garbage_consumed);
+		cs -= c_garbage_consumed;
 		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"Consumed %i unwanted non-header byte in BL0942 buffer\n", c_garbage_consumed);
 	}
 	if(cs < BL0942_PACKET_LEN) {
 		return 0;
 	}
-	a = UART_GetNextByte(0);
-	if(a != 0x55) {
-		return 0;
-	}
+	// whole packet in one piece, usually straight from the ring
+	p = UART_GetContiguousBytes(scratch, BL0942_PACKET_LEN);
 	checksum = BL0942_READ_COMMAND;
 
 	for(i = 0; i < BL0942_PACKET_LEN-1; i++) {
-		checksum += UART_GetNextByte(i);
+		checksum += p[i];
 	}
 	checksum ^= 0xFF;
 
-#if 1
-    {
-		char buffer_for_log[128];
-		char buffer2[32];
-		buffer_for_log[0] = 0;
-		for(i = 0; i < BL0942_PACKET_LEN; i++) {
-			snprintf(buffer2, sizeof(buffer2), "%02X ",UART_GetNextByte(i));
-			strcat_safe(buffer_for_log,buffer2,sizeof(buffer_for_log));
-		}
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"BL0942 received: %s\n", buffer_for_log);
-	}
-#endif
-	if(checksum != UART_GetNextByte(BL0942_PACKET_LEN-1)) {
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"Skipping packet with bad checksum %02X wanted %02X\n",checksum,UART_GetNextByte(BL0942_PACKET_LEN-1));
+	addLogPacketAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "BL0942 received: ", p, BL0942_PACKET_LEN);
+	if(checksum != p[BL0942_PACKET_LEN-1]) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"Skipping packet with bad checksum %02X wanted %02X\n",checksum,p[BL0942_PACKET_LEN-1]);
 		UART_ConsumeBytes(BL0942_PACKET_LEN);
 		return 1;
 	}
 	//startDriver BL0942
-	raw_unscaled_current = (UART_GetNextByte(3) << 16) | (UART_GetNextByte(2) << 8) | UART_GetNextByte(1);
-	raw_unscaled_voltage = (UART_GetNextByte(6) << 16) | (UART_GetNextByte(5) << 8) | UART_GetNextByte(4);
-	raw_unscaled_power = (UART_GetNextByte(12) << 24) | (UART_GetNextByte(11) << 16) | (UART_GetNextByte(10) << 8);
+	raw_unscaled_current = (p[3] << 16) | (p[2] << 8) | p[1];
+	raw_unscaled_voltage = (p[6] << 16) | (p[5] << 8) | p[4];
+	raw_unscaled_power = (p[12] << 24) | (p[11] << 16) | (p[10] << 8);
 	raw_unscaled_power = (raw_unscaled_power >> 8);
 
-	raw_unscaled_freq = (UART_GetNextByte(17) << 8) | UART_GetNextByte(16);
+	raw_unscaled_freq = (p[17] << 8) | p[16];
 
 	// those are not values like 230V, but unscaled
 	addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"Unscaled current %d, voltage %d, power %d, freq %d\n", raw_unscaled_current, raw_unscaled_voltage,raw_unscaled_power,raw_unscaled_freq);
@@ -112,7 +96,7 @@ int BL0942_TryToGetNextBL0942Packet() {
 		char res[128];
 		// V=245.107925,I=109.921143,P=0.035618
 		snprintf(res, sizeof(res),"V=%f,I=%f,P=%f\n",lastReadings[OBK_VOLTAGE],lastReadings[OBK_CURRENT],lastReadings[OBK_POWER]);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,res );
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", res);
 	}
 #endif
 
@@ -142,7 +126,7 @@ commandResult_t BL0942_PowerSet(const void *context, const char *cmd, const char
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"PowerSet: you gave %f, set ref to %f\n", realPower, BL0942_PREF);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 	return CMD_RES_OK;
 }
@@ -201,7 +185,7 @@ commandResult_t BL0942_VoltageSet(const void *context, const char *cmd, const ch
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"VoltageSet: you gave %f, set ref to %f\n", realV, BL0942_UREF);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 
 	return CMD_RES_OK;
@@ -222,7 +206,7 @@ commandResult_t BL0942_CurrentSet(const void *context, const char *cmd, const ch
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"CurrentSet: you gave %f, set ref to %f\n", realI, BL0942_IREF);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 	return CMD_RES_OK;
 }
@@ -21,17 +21,18 @@ static int raw_unscaled_power;
 
 
 #define CSE7766_BAUD_RATE 4800
+#define CSE7766_PACKET_LEN 24
 
 
 // startDriver CSE7766
 int CSE7766_TryToGetNextCSE7766Packet() {
 	int cs;
 	int i;
-	int c_garbage_consumed = 0;
-	byte a;
+	int c_garbage_consumed;
 	byte checksum;
-	int CSE7766_PACKET_LEN = 24;
 	byte header;
+	const byte *p;
+	byte scratch[CSE7766_PACKET_LEN];
 
 	cs = UART_GetDataSize();
 
@@ -39,48 +40,34 @@ int CSE7766_TryToGetNextCSE7766Packet() {
 	if(cs < CSE7766_PACKET_LEN) {
 		return 0;
 	}
-	header = UART_GetNextByte(0);
 	// skip garbage data (should not happen)
-	while(cs > 0) {
-		a = UART_GetNextByte(1);
-		if(a != 0x5A) {
-			UART_ConsumeBytes(1);
-			c_garbage_consumed++;
-			cs--;
-		} else {
-			break;
-		}
+	// second byte is 0x5A, first one is a header with state flags
+	c_garbage_consumed = UART_FindByte(0x5A, 1);
+	if(c_garbage_consumed < 0) {
+		// keep last byte, it may be the header
+		c_garbage_consumed = cs;
 	}
+	c_garbage_consumed--;
 	if(c_garbage_consumed > 0){
+		UART_ConsumeBytes(c_garbage_consumed);
+		cs -= c_garbage_consumed;
 		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"Consumed %i unwanted non-header byte in CSE7766 buffer\n", c_garbage_consumed);
 	}
 	if(cs < CSE7766_PACKET_LEN) {
 		return 0;
 	}
-	a = UART_GetNextByte(1);
-	if(a != 0x5A) {
-		return 0;
-	}
+	// whole packet in one piece, usually straight from the ring
+	p = UART_GetContiguousBytes(scratch, CSE7766_PACKET_LEN);
+	header = p[0];
 	checksum = 0;
 
 	for(i = 2; i < CSE7766_PACKET_LEN-1; i++) {
-		checksum += UART_GetNextByte(i);
+		checksum += p[i];
 	}
 
-#if 1
-	{
-		char buffer_for_log[128];
-		char buffer2[32];
-		buffer_for_log[0] = 0;
-		for(i = 0; i < CSE7766_PACKET_LEN; i++) {
-			snprintf(buffer2, sizeof(buffer2), "%02X ",UART_GetNextByte(i));
-			strcat_safe(buffer_for_log,buffer2,sizeof(buffer_for_log));
-		}
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"CSE7766 received: %s\n", buffer_for_log);
-	}
-#endif
-	if(checksum != UART_GetNextByte(CSE7766_PACKET_LEN-1)) {
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"Skipping packet with bad checksum %02X wanted %02X\n",checksum,UART_GetNextByte(CSE7766_PACKET_LEN-1));
+	addLogPacketAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "CSE7766 received: ", p, CSE7766_PACKET_LEN);
+	if(checksum != p[CSE7766_PACKET_LEN-1]) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"Skipping packet with bad checksum %02X wanted %02X\n",checksum,p[CSE7766_PACKET_LEN-1]);
 		UART_ConsumeBytes(CSE7766_PACKET_LEN);
 		return 1;
 	}
@@ -131,11 +118,11 @@ int CSE7766_TryToGetNextCSE7766Packet() {
 		
 		
 
-		adjustement = UART_GetNextByte(20);
-		raw_unscaled_voltage = UART_GetNextByte(5) << 16 | UART_GetNextByte(6) << 8 | UART_GetNextByte(7);
-		raw_unscaled_current = UART_GetNextByte(11) << 16 | UART_GetNextByte(12) << 8 | UART_GetNextByte(13);
-		raw_unscaled_power = UART_GetNextByte(17) << 16 | UART_GetNextByte(18) << 8 | UART_GetNextByte(19);
-		cf_pulses = UART_GetNextByte(21) << 8 | UART_GetNextByte(22);
+		adjustement = p[20];
+		raw_unscaled_voltage = p[5] << 16 | p[6] << 8 | p[7];
+		raw_unscaled_current = p[11] << 16 | p[12] << 8 | p[13];
+		raw_unscaled_power = p[17] << 16 | p[18] << 8 | p[19];
+		cf_pulses = p[21] << 8 | p[22];
 
 		// i am not sure about these flags
 		if (adjustement & 0x40) {  // Voltage valid
@@ -189,7 +176,7 @@ int CSE7766_TryToGetNextCSE7766Packet() {
 		char res[128];
 		// V=245.107925,I=109.921143,P=0.035618
 		snprintf(res, sizeof(res), "V=%f,I=%f,P=%f\n",lastReadings[OBK_VOLTAGE],lastReadings[OBK_CURRENT],lastReadings[OBK_POWER]);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,res );
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", res);
 	}
 #endif
 
@@ -214,7 +201,7 @@ commandResult_t CSE7766_PowerSet(const void *context, const char *cmd, const cha
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"PowerSet: you gave %f, set ref to %f\n", realPower, CSE7766_PREF);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 	return CMD_RES_OK;
 }
@@ -273,7 +260,7 @@ commandResult_t CSE7766_VoltageSet(const void *context, const char *cmd, const c
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"VoltageSet: you gave %f, set ref to %f\n", realV, CSE7766_UREF);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 
 	return CMD_RES_OK;
@@ -294,7 +281,7 @@ commandResult_t CSE7766_CurrentSet(const void *context, const char *cmd, const c
 	{
 		char dbg[128];
 		snprintf(dbg, sizeof(dbg),"CurrentSet: you gave %f, set ref to %f\n", realI, CSE7766_IREF);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,dbg);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "%s", dbg);
 	}
 	return CMD_RES_OK;
 }
@@ -101,7 +101,7 @@ void DRV_HTTPButtons_ProcessChanges(http_request_t *request) {
 	char tmpA[8];
 	httpButton_t *bt;
 
-	if (http_getArg(request->url, "act", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "act", tmpA, sizeof(tmpA))) {
 		j = atoi(tmpA);
 		bt = getSafe(j);
 		hprintf255(request, "<h3>Will do action %s!</h3>", bt->label);
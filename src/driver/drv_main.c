@@ -51,6 +51,13 @@ const char* counter_devClasses[OBK_NUM_COUNTERS] = {
 	"timestamp"
 };
 
+typedef struct driverStats_s {
+	unsigned int calls;
+	unsigned int totalUs;
+	unsigned int minUs;
+	unsigned int maxUs;
+} driverStats_t;
+
 typedef struct driver_s {
 	const char* name;
 	void (*initFunc)();
@@ -59,63 +66,72 @@ typedef struct driver_s {
 	void (*runQuickTick)();
 	void (*stopFunc)();
 	void (*onChannelChanged)(int ch, int val);
+	// runQuickTick is called at most once per period (ms), 0 means every quick tick,
+	// phase (ms) offsets first call so drivers with the same period don't run in the same tick
+	int period;
+	int phase;
 	bool bLoaded;
+	// runtime state, not set in table
+	uint32_t nextRun;
+	driverStats_t quick;
+	driverStats_t second;
 } driver_t;
 
 
 // startDriver BL0937
+// name, init, every second, http index, quick tick, stop, channel changed, period, phase, loaded
 static driver_t g_drivers[] = {
 
 #ifdef ENABLE_DRIVER_TUYAMCU
-	{ "TuyaMCU",	TuyaMCU_Init,		TuyaMCU_RunFrame,			NULL, NULL, NULL, NULL, false },
-	{ "tmSensor",	TuyaMCU_Sensor_Init, TuyaMCU_Sensor_RunFrame,	NULL, NULL, NULL, NULL, false },
+	{ "TuyaMCU",	TuyaMCU_Init,		TuyaMCU_RunFrame,			NULL, TuyaMCU_RunReceive, NULL, NULL, 0, 0, false },
+	{ "tmSensor",	TuyaMCU_Sensor_Init, TuyaMCU_Sensor_RunFrame,	NULL, NULL, NULL, NULL, 0, 0, false },
 #endif
 
 #ifdef ENABLE_BASIC_DRIVERS
-	{ "NTP",		NTP_Init,			NTP_OnEverySecond,			NTP_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, false },
-	{ "TESTPOWER",	Test_Power_Init,	 Test_Power_RunFrame,		BL09XX_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, false },
-	{ "TESTLED",	Test_LED_Driver_Init, Test_LED_Driver_RunFrame, NULL, NULL, NULL, Test_LED_Driver_OnChannelChanged, false },
-	{ "HTTPButtons",	DRV_InitHTTPButtons, NULL, NULL, NULL, NULL, NULL, false },
+	{ "NTP",		NTP_Init,			NTP_OnEverySecond,			NTP_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, 0, 0, false },
+	{ "TESTPOWER",	Test_Power_Init,	 Test_Power_RunFrame,		BL09XX_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, 0, 0, false },
+	{ "TESTLED",	Test_LED_Driver_Init, Test_LED_Driver_RunFrame, NULL, NULL, NULL, Test_LED_Driver_OnChannelChanged, 0, 0, false },
+	{ "HTTPButtons",	DRV_InitHTTPButtons, NULL, NULL, NULL, NULL, NULL, 0, 0, false },
 #endif
 
 #if ENABLE_I2C
-	{ "I2C",		DRV_I2C_Init,		DRV_I2C_EverySecond,		NULL, NULL, NULL, NULL, false },
+	{ "I2C",		DRV_I2C_Init,		DRV_I2C_EverySecond,		NULL, NULL, NULL, NULL, 0, 0, false },
 #endif
 
 #ifdef ENABLE_DRIVER_BL0942
-	{ "BL0942",		BL0942_Init,		BL0942_RunFrame,			BL09XX_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, false },
+	{ "BL0942",		BL0942_Init,		BL0942_RunFrame,			BL09XX_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, 0, 0, false },
 #endif
 
 #ifdef ENABLE_DRIVER_BL0937	
-	{ "BL0937",		BL0937_Init,		BL0937_RunFrame,			BL09XX_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, false },
+	{ "BL0937",		BL0937_Init,		BL0937_RunFrame,			BL09XX_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, 0, 0, false },
 #endif
 
 #ifdef ENABLE_DRIVER_CSE7766
-	{ "CSE7766",	CSE7766_Init,		CSE7766_RunFrame,			BL09XX_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, false },
+	{ "CSE7766",	CSE7766_Init,		CSE7766_RunFrame,			BL09XX_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, 0, 0, false },
 #endif
 
 #if PLATFORM_BEKEN	
-	{ "SM16703P",	SM16703P_Init,		NULL,						NULL, NULL, NULL, NULL, false },
-	{ "IR",			DRV_IR_Init,		 NULL,						NULL, DRV_IR_RunFrame, NULL, NULL, false },
+	{ "SM16703P",	SM16703P_Init,		NULL,						NULL, NULL, NULL, NULL, 0, 0, false },
+	{ "IR",			DRV_IR_Init,		 NULL,						NULL, DRV_IR_RunFrame, NULL, NULL, 0, 0, false },
 #endif
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)	
-	{ "DDP",		DRV_DDP_Init,		NULL,						NULL, DRV_DDP_RunFrame, DRV_DDP_Shutdown, NULL, false },
-	{ "SSDP",		DRV_SSDP_Init,		DRV_SSDP_RunEverySecond,	NULL, DRV_SSDP_RunQuickTick, DRV_SSDP_Shutdown, NULL, false },
-	{ "Wemo",		WEMO_Init,		NULL,		WEMO_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, false },
-	{ "PWMToggler",	DRV_InitPWMToggler, NULL, DRV_Toggler_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, false },
-	{ "DGR",		DRV_DGR_Init,		DRV_DGR_RunEverySecond,		NULL, DRV_DGR_RunQuickTick, DRV_DGR_Shutdown, DRV_DGR_OnChannelChanged, false },
+	{ "DDP",		DRV_DDP_Init,		NULL,						NULL, DRV_DDP_RunFrame, DRV_DDP_Shutdown, NULL, 0, 0, false },
+	{ "SSDP",		DRV_SSDP_Init,		DRV_SSDP_RunEverySecond,	NULL, DRV_SSDP_RunQuickTick, DRV_SSDP_Shutdown, NULL, 100, 50, false },
+	{ "Wemo",		WEMO_Init,		NULL,		WEMO_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, 0, 0, false },
+	{ "PWMToggler",	DRV_InitPWMToggler, NULL, DRV_Toggler_AppendInformationToHTTPIndexPage, NULL, NULL, NULL, 0, 0, false },
+	{ "DGR",		DRV_DGR_Init,		DRV_DGR_RunEverySecond,		NULL, DRV_DGR_RunQuickTick, DRV_DGR_Shutdown, DRV_DGR_OnChannelChanged, 0, 0, false },
 #endif
 
 #ifdef ENABLE_DRIVER_LED
-	{ "SM2135",		SM2135_Init,		SM2135_RunFrame,			NULL, NULL, NULL, SM2135_OnChannelChanged, false },
-	{ "BP5758D",	BP5758D_Init,		BP5758D_RunFrame,			NULL, NULL, NULL, BP5758D_OnChannelChanged, false },
-	{ "BP1658CJ",	BP1658CJ_Init,		BP1658CJ_RunFrame,			NULL, NULL, NULL, BP1658CJ_OnChannelChanged, false },
-	{ "SM2235",		SM2235_Init,		SM2235_RunFrame,			NULL, NULL, NULL, NULL, false },
+	{ "SM2135",		SM2135_Init,		SM2135_RunFrame,			NULL, NULL, NULL, SM2135_OnChannelChanged, 0, 0, false },
+	{ "BP5758D",	BP5758D_Init,		BP5758D_RunFrame,			NULL, NULL, NULL, BP5758D_OnChannelChanged, 0, 0, false },
+	{ "BP1658CJ",	BP1658CJ_Init,		BP1658CJ_RunFrame,			NULL, NULL, NULL, BP1658CJ_OnChannelChanged, 0, 0, false },
+	{ "SM2235",		SM2235_Init,		SM2235_RunFrame,			NULL, NULL, NULL, NULL, 0, 0, false },
 #endif	
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
-	{ "CHT8305",	CHT8305_Init,		CHT8305_OnEverySecond,		CHT8305_AppendInformationToHTTPIndexPage, NULL, NULL, CHT8305_OnChannelChanged, false },
-	{ "MAX72XX",	DRV_MAX72XX_Init,		NULL,		NULL, NULL, NULL, NULL, false },
-	{ "SHT3X",	SHT3X_Init,		SHT3X_OnEverySecond,		SHT3X_AppendInformationToHTTPIndexPage, NULL, SHT3X_StopDriver, SHT3X_OnChannelChanged, false },
+	{ "CHT8305",	CHT8305_Init,		CHT8305_OnEverySecond,		CHT8305_AppendInformationToHTTPIndexPage, NULL, NULL, CHT8305_OnChannelChanged, 0, 0, false },
+	{ "MAX72XX",	DRV_MAX72XX_Init,		NULL,		NULL, NULL, NULL, NULL, 0, 0, false },
+	{ "SHT3X",	SHT3X_Init,		SHT3X_OnEverySecond,		SHT3X_AppendInformationToHTTPIndexPage, NULL, SHT3X_StopDriver, SHT3X_OnChannelChanged, 0, 0, false },
 #endif
 };
 
@@ -152,6 +168,45 @@ bool DRV_Mutex_Take(int del) {
 void DRV_Mutex_Free() {
 	xSemaphoreGive(g_mutex);
 }
+
+#ifndef portTICK_RATE_MS
+#define portTICK_RATE_MS ((portTickType)1000/configTICK_RATE_HZ)
+#endif
+
+static uint32_t DRV_GetTimeMs() {
+#if defined(PLATFORM_BEKEN) || defined(WINDOWS)
+	return rtos_get_time();
+#else
+	return xTaskGetTickCount() * portTICK_RATE_MS;
+#endif
+}
+// simulator has its own time, so use real CPU time there;
+// on device this has only tick resolution, but average over many calls is still right
+static uint32_t DRV_GetTimeUs() {
+#ifdef WINDOWS
+	return (uint32_t)((double)clock() * 1000000.0 / CLOCKS_PER_SEC);
+#else
+	return DRV_GetTimeMs() * 1000;
+#endif
+}
+static void DRV_RunTimed(driverStats_t *st, void (*func)()) {
+	uint32_t start, took;
+
+	start = DRV_GetTimeUs();
+	func();
+	took = DRV_GetTimeUs() - start;
+	if (st->calls == 0 || took < st->minUs)
+		st->minUs = took;
+	if (took > st->maxUs)
+		st->maxUs = took;
+	st->totalUs += took;
+	st->calls++;
+}
+static void DRV_ResetStats(driver_t *d) {
+	memset(&d->quick, 0, sizeof(d->quick));
+	memset(&d->second, 0, sizeof(d->second));
+	d->nextRun = DRV_GetTimeMs() + d->phase;
+}
 void DRV_OnEverySecond() {
 	int i;
 
@@ -161,7 +216,7 @@ void DRV_OnEverySecond() {
 	for (i = 0; i < g_numDrivers; i++) {
 		if (g_drivers[i].bLoaded) {
 			if (g_drivers[i].onEverySecond != 0) {
-				g_drivers[i].onEverySecond();
+				DRV_RunTimed(&g_drivers[i].second, g_drivers[i].onEverySecond);
 			}
 		}
 	}
@@ -169,16 +224,30 @@ void DRV_OnEverySecond() {
 }
 void DRV_RunQuickTick() {
 	int i;
+	uint32_t now;
+	driver_t *d;
 
 	if (DRV_Mutex_Take(0) == false) {
 		return;
 	}
+	now = DRV_GetTimeMs();
 	for (i = 0; i < g_numDrivers; i++) {
-		if (g_drivers[i].bLoaded) {
-			if (g_drivers[i].runQuickTick != 0) {
-				g_drivers[i].runQuickTick();
+		d = &g_drivers[i];
+		if (d->bLoaded == false || d->runQuickTick == 0) {
+			continue;
+		}
+		if (d->period > 0) {
+			// not due yet (wrap safe)
+			if ((int)(now - d->nextRun) < 0) {
+				continue;
+			}
+			d->nextRun += d->period;
+			// fell behind by more than a period, don't try to catch up
+			if ((int)(now - d->nextRun) >= 0) {
+				d->nextRun = now + d->period;
 			}
 		}
+		DRV_RunTimed(&d->quick, d->runQuickTick);
 	}
 	DRV_Mutex_Free();
 }
@@ -247,6 +316,7 @@ void DRV_StartDriver(const char* name) {
 
 			}
 			else {
+				DRV_ResetStats(&g_drivers[i]);
 				g_drivers[i].initFunc();
 				g_drivers[i].bLoaded = true;
 				addLogAdv(LOG_INFO, LOG_FEATURE_MAIN, "Started %s.\n", name);
@@ -294,6 +364,94 @@ static commandResult_t DRV_Stop(const void* context, const char* cmd, const char
 	DRV_StopDriver(Tokenizer_GetArg(0));
 	return CMD_RES_OK;
 }
+static void DRV_PrintStats(const char *name, const char *what, driverStats_t *st) {
+	if (st->calls == 0)
+		return;
+	ADDLOG_INFO(LOG_FEATURE_MAIN, "%s %s: %u calls, min %u us, avg %u us, max %u us",
+		name, what, st->calls, st->minUs, st->totalUs / st->calls, st->maxUs);
+}
+// driverStats
+// driverStats reset
+static commandResult_t DRV_Stats(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	int i;
+	bool bReset;
+
+	Tokenizer_TokenizeString(args, 0);
+	bReset = Tokenizer_GetArgsCount() >= 1 && !stricmp(Tokenizer_GetArg(0), "reset");
+
+	if (DRV_Mutex_Take(100) == false) {
+		return CMD_RES_ERROR;
+	}
+	for (i = 0; i < g_numDrivers; i++) {
+		if (g_drivers[i].bLoaded == false)
+			continue;
+		if (bReset) {
+			DRV_ResetStats(&g_drivers[i]);
+			continue;
+		}
+		ADDLOG_INFO(LOG_FEATURE_MAIN, "%s: period %i ms, phase %i ms", g_drivers[i].name,
+			g_drivers[i].period, g_drivers[i].phase);
+		DRV_PrintStats(g_drivers[i].name, "quick tick", &g_drivers[i].quick);
+		DRV_PrintStats(g_drivers[i].name, "every second", &g_drivers[i].second);
+	}
+	DRV_Mutex_Free();
+	return CMD_RES_OK;
+}
+// driverPeriod SSDP 500
+// driverPeriod TuyaMCU 50 10
+static commandResult_t DRV_SetPeriod(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	int i;
+	const char *name;
+
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() < 2) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Requires driver name and period\n");
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	name = Tokenizer_GetArg(0);
+	for (i = 0; i < g_numDrivers; i++) {
+		if (!stricmp(g_drivers[i].name, name)) {
+			g_drivers[i].period = Tokenizer_GetArgInteger(1);
+			if (Tokenizer_GetArgsCount() >= 3) {
+				g_drivers[i].phase = Tokenizer_GetArgInteger(2);
+			}
+			g_drivers[i].nextRun = DRV_GetTimeMs() + g_drivers[i].phase;
+			return CMD_RES_OK;
+		}
+	}
+	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Driver %s is not known in this build.\n", name);
+	return CMD_RES_BAD_ARGUMENT;
+}
+static void DRV_AppendStatsJSONPart(http_request_t* request, const char *what, driverStats_t *st) {
+	hprintf255(request, "\"%s\":{\"calls\":%u,\"minUs\":%u,\"avgUs\":%u,\"maxUs\":%u}", what,
+		st->calls, st->minUs, st->calls ? st->totalUs / st->calls : 0, st->maxUs);
+}
+void DRV_AppendStatsJSON(http_request_t* request) {
+	int i;
+	bool bFirst;
+
+	hprintf255(request, "{");
+	if (DRV_Mutex_Take(100)) {
+		bFirst = true;
+		for (i = 0; i < g_numDrivers; i++) {
+			if (g_drivers[i].bLoaded == false)
+				continue;
+			if (bFirst == false) {
+				hprintf255(request, ",");
+			}
+			bFirst = false;
+			hprintf255(request, "\"%s\":{\"period\":%i,\"phase\":%i,", g_drivers[i].name,
+				g_drivers[i].period, g_drivers[i].phase);
+			DRV_AppendStatsJSONPart(request, "quick", &g_drivers[i].quick);
+			hprintf255(request, ",");
+			DRV_AppendStatsJSONPart(request, "second", &g_drivers[i].second);
+			hprintf255(request, "}");
+		}
+		DRV_Mutex_Free();
+	}
+	hprintf255(request, "}");
+}
 
 void DRV_Generic_Init() {
 	//cmddetail:{"name":"startDriver","args":"[DriverName]",
@@ -306,6 +464,16 @@ void DRV_Generic_Init() {
 	//cmddetail:"fn":"DRV_Stop","file":"driver/drv_main.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("stopDriver", "", DRV_Stop, NULL, NULL);
+	//cmddetail:{"name":"driverStats","args":"[reset]",
+	//cmddetail:"descr":"Prints period, phase, call count and min/avg/max execution time of running drivers, or resets the counters. Same data is on /api/drivers",
+	//cmddetail:"fn":"DRV_Stats","file":"driver/drv_main.c","requires":"",
+	//cmddetail:"examples":"driverStats"}
+	CMD_RegisterCommand("driverStats", "", DRV_Stats, NULL, NULL);
+	//cmddetail:{"name":"driverPeriod","args":"[DriverName][PeriodMs][OptionalPhaseMs]",
+	//cmddetail:"descr":"Sets how often driver quick tick is called, 0 is every quick tick",
+	//cmddetail:"fn":"DRV_SetPeriod","file":"driver/drv_main.c","requires":"",
+	//cmddetail:"examples":"driverPeriod SSDP 500"}
+	CMD_RegisterCommand("driverPeriod", "", DRV_SetPeriod, NULL, NULL);
 }
 void DRV_AppendInformationToHTTPIndexPage(http_request_t* request) {
 	int i, j;
@@ -43,6 +43,8 @@ void DRV_StopDriver(const char* name);
 void DRV_ShutdownAllDrivers();
 bool DRV_IsRunning(const char* name);
 void DRV_OnChannelChanged(int channel, int iVal);
+// per driver period, phase and call timings as JSON object, for /api/drivers
+void DRV_AppendStatsJSON(http_request_t* request);
 void SM2135_Write(float* rgbcw);
 void BP5758D_Write(float* rgbcw);
 void BP1658CJ_Write(float* rgbcw);
@@ -219,16 +219,16 @@ void DRV_Toggler_ProcessChanges(http_request_t *request) {
 	int val;
 	char tmpA[8];
 
-	if (http_getArg(request->url, "togglerOn", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "togglerOn", tmpA, sizeof(tmpA))) {
 		j = atoi(tmpA);
 		const char *name = Toggler_GetName(j);
 		hprintf255(request, "<h3>Toggled %s!</h3>", name);
 		Toggler_Toggle(j);
 	}
-	if (http_getArg(request->url, "togglerValueID", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "togglerValueID", tmpA, sizeof(tmpA))) {
 		j = atoi(tmpA);
 		const char *name = Toggler_GetName(j);
-		http_getArg(request->url, "togglerValue", tmpA, sizeof(tmpA));
+		http_getRequestArg(request, "togglerValue", tmpA, sizeof(tmpA));
 		val = atoi(tmpA);
 		Toggler_Set(j, val);
 		hprintf255(request, "<h3>Set value %i for %s!</h3>", val, name);
@@ -132,6 +132,10 @@ typedef struct tuyaMCUMapping_s {
 } tuyaMCUMapping_t;
 
 tuyaMCUMapping_t *g_tuyaMappings = 0;
+// dpId is a byte, so incoming states look mappings up directly here
+// instead of walking the list; allocated with the first mapping
+#define TUYAMCU_DPID_COUNT 256
+static tuyaMCUMapping_t **g_tuyaMappingsByDpId = 0;
 
 /**
  * Dimmer range
@@ -167,15 +171,9 @@ static int g_sendQueryStatePackets = 0;
 static byte g_defaultTuyaMCUWiFiState = 0x00;
 
 tuyaMCUMapping_t *TuyaMCU_FindDefForID(int fnId) {
-    tuyaMCUMapping_t *cur;
-
-    cur = g_tuyaMappings;
-    while(cur) {
-        if(cur->fnId == fnId)
-            return cur;
-        cur = cur->next;
-    }
-    return 0;
+    if(g_tuyaMappingsByDpId == 0 || fnId < 0 || fnId >= TUYAMCU_DPID_COUNT)
+        return 0;
+    return g_tuyaMappingsByDpId[fnId];
 }
 
 tuyaMCUMapping_t *TuyaMCU_FindDefForChannel(int channel) {
@@ -193,6 +191,14 @@ tuyaMCUMapping_t *TuyaMCU_FindDefForChannel(int channel) {
 void TuyaMCU_MapIDToChannel(int fnId, int dpType, int channel) {
     tuyaMCUMapping_t *cur;
 
+    if(fnId < 0 || fnId >= TUYAMCU_DPID_COUNT) {
+        addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"TuyaMCU_MapIDToChannel: dpId %i out of range\n", fnId);
+        return;
+    }
+    if(g_tuyaMappingsByDpId == 0) {
+        g_tuyaMappingsByDpId = (tuyaMCUMapping_t**)malloc(sizeof(tuyaMCUMapping_t*) * TUYAMCU_DPID_COUNT);
+        memset(g_tuyaMappingsByDpId, 0, sizeof(tuyaMCUMapping_t*) * TUYAMCU_DPID_COUNT);
+    }
     cur = TuyaMCU_FindDefForID(fnId);
 
     if(cur == 0) {
@@ -202,6 +208,7 @@ void TuyaMCU_MapIDToChannel(int fnId, int dpType, int channel) {
         cur->prevValue = 0;
         cur->next = g_tuyaMappings;
         g_tuyaMappings = cur;
+        g_tuyaMappingsByDpId[fnId] = cur;
     }
 
     cur->channel = channel;
@@ -212,11 +219,13 @@ void TuyaMCU_MapIDToChannel(int fnId, int dpType, int channel) {
 // 55AA     00      00      0000   xx   00
 
 #define MIN_TUYAMCU_PACKET_SIZE (2+1+1+2+1)
+// bytes the UART ring must hold before framing is tried again - a whole packet
+// once its header is seen, so partial packets are not re-parsed every tick
+static int g_tuyaMCU_bytesNeeded = MIN_TUYAMCU_PACKET_SIZE;
 int UART_TryToGetNextTuyaPacket(byte *out, int maxSize) {
     int cs;
-    int len, i;
+    int len, i, skip, ret;
     int c_garbage_consumed = 0;
-    byte a, b, version, command, lena, lenb;
     char printfSkipDebug[256];
     char buffer2[8];
 
@@ -227,21 +236,25 @@ int UART_TryToGetNextTuyaPacket(byte *out, int maxSize) {
     if(cs < MIN_TUYAMCU_PACKET_SIZE) {
         return 0;
     }
+resync:
     // skip garbage data (should not happen)
     while(cs > 0) {
-        a = UART_GetNextByte(0);
-        b = UART_GetNextByte(1);
-        if(a != 0x55 || b != 0xAA) {
-            UART_ConsumeBytes(1);
-            if(c_garbage_consumed + 2 < sizeof(printfSkipDebug)) {
-                snprintf(buffer2, sizeof(buffer2),"%02X ",a);
-                strcat_safe(printfSkipDebug,buffer2,sizeof(printfSkipDebug));
-            }
-            c_garbage_consumed++;
-            cs--;
-        } else {
+        skip = UART_FindByte(0x55, 0);
+        if(skip < 0) {
+            skip = cs;
+        } else if(skip + 1 < cs && UART_GetNextByte(skip + 1) != 0xAA) {
+            // 0x55 without 0xAA, not a header
+            skip++;
+        } else if(skip == 0) {
             break;
         }
+        for(i = 0; i < skip && c_garbage_consumed + i < (sizeof(printfSkipDebug) - 1) / 3; i++) {
+            snprintf(buffer2, sizeof(buffer2),"%02X ",UART_GetNextByte(i));
+            strcat_safe(printfSkipDebug,buffer2,sizeof(printfSkipDebug));
+        }
+        UART_ConsumeBytes(skip);
+        c_garbage_consumed += skip;
+        cs -= skip;
     }
     if(c_garbage_consumed > 0){
         addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"Consumed %i unwanted non-header byte in Tuya MCU buffer\n", c_garbage_consumed);
@@ -250,35 +263,28 @@ int UART_TryToGetNextTuyaPacket(byte *out, int maxSize) {
     if(cs < MIN_TUYAMCU_PACKET_SIZE) {
         return 0;
     }
-    a = UART_GetNextByte(0);
-    b = UART_GetNextByte(1);
-    if(a != 0x55 || b != 0xAA) {
-        return 0;
-    }
-    version = UART_GetNextByte(2);
-    command = UART_GetNextByte(3);
-    lena = UART_GetNextByte(4); // hi
-    lenb = UART_GetNextByte(5); // lo
-    len = lenb | lena >> 8;
+    // header 55 AA is there, length is big endian at 4
+    len = UART_GetNextByte(5) | UART_GetNextByte(4) << 8;
     // now check if we have received whole packet
     len += 2 + 1 + 1 + 2 + 1; // header 2 bytes, version, command, lenght, chekcusm
-    if(cs >= len) {
-        int ret;
-        // can packet fit into the buffer?
-        if(len <= maxSize) {
-            for(i = 0; i < len; i++) {
-                out[i] = UART_GetNextByte(i);
-            }
-            ret = len;
-        } else {
-            addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"TuyaMCU packet too large, %i > %i\n", len, maxSize);
-            ret = 0;
-        }
-        // consume whole packet (but don't touch next one, if any)
-        UART_ConsumeBytes(len);
-        return ret;
+    // corrupted length, or a packet that could never be stored - waiting for it
+    // would stall the receiver forever, so drop this header and look for the next one
+    if(len > maxSize || len >= UART_GetBufferSize()) {
+        addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"TuyaMCU packet too large, %i > %i, skipping header\n", len, maxSize);
+        UART_ConsumeBytes(2);
+        cs -= 2;
+        g_tuyaMCU_bytesNeeded = MIN_TUYAMCU_PACKET_SIZE;
+        goto resync;
     }
-    return 0;
+    if(cs < len) {
+        g_tuyaMCU_bytesNeeded = len;
+        return 0;
+    }
+    g_tuyaMCU_bytesNeeded = MIN_TUYAMCU_PACKET_SIZE;
+    ret = UART_CopyBytes(out, 0, len);
+    // consume whole packet (but don't touch next one, if any)
+    UART_ConsumeBytes(len);
+    return ret;
 }
 
 
@@ -1103,7 +1109,7 @@ void TuyaMCU_ProcessIncoming(const byte *data, int len) {
         return;
     }
     version = data[2];
-    checkLen = data[5] | data[4] >> 8;
+    checkLen = data[5] | data[4] << 8;
     checkLen = checkLen + 2 + 1 + 1 + 2 + 1;
     if(checkLen != len) {
         addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"TuyaMCU_ProcessIncoming: discarding packet bad expected len, expected %i and got len %i\n",checkLen,len);
@@ -1265,47 +1271,46 @@ void TuyaMCU_RunWiFiUpdateAndPackets() {
 		//addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"TuyaMCU_Wifi_State timer");
 	}
 }
-void TuyaMCU_RunFrame() {
-    byte data[128];
-    char buffer_for_log[256];
-    char buffer2[4];
-    int len, i;
+// frames and processes all complete packets waiting in the UART ring,
+// runs every quick tick so MCU reports are applied as soon as they arrive
+void TuyaMCU_RunReceive() {
+    // static - this runs from the quick tick timer, keep its stack small
+    static byte data[128];
+    static char buffer_for_event[sizeof(data) * 2 + 1];
+    int len;
 
     //addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"UART ring buffer state: %i %i\n",g_recvBufIn,g_recvBufOut);
-
-	// extraDebug log level
-	addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_TUYAMCU,"TuyaMCU heartbeat_valid = %i, product_information_valid=%i,"
-		" self_processing_mode = %i, wifi_state_valid = %i, wifi_state_timer=%i\n",
-		(int)heartbeat_valid,(int)product_information_valid,(int)self_processing_mode,
-		(int)wifi_state_valid,(int)wifi_state_timer);
-	
+    if(UART_GetDataSize() < g_tuyaMCU_bytesNeeded) {
+        return;
+    }
     while (1)
     {
         len = UART_TryToGetNextTuyaPacket(data,sizeof(data));
         if(len > 0) {
-            buffer_for_log[0] = 0;
-            for(i = 0; i < len; i++) {
-                snprintf(buffer2, sizeof(buffer2),"%02X ",data[i]);
-                strcat_safe(buffer_for_log,buffer2,sizeof(buffer_for_log));
-            }
-            addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU,"TUYAMCU received: %s\n", buffer_for_log);
-#if 1
-			// redo sprintf without spaces
-            buffer_for_log[0] = 0;
-            for(i = 0; i < len; i++) {
-                snprintf(buffer2, sizeof(buffer2),"%02X",data[i]);
-                strcat_safe(buffer_for_log,buffer2,sizeof(buffer_for_log));
-            }
-			// fire string event, as we already have it sprintfed
+            // hex is only printed when log is read
+            addLogPacketAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TUYAMCU received: ", data, len);
+			// fire string event (hex without spaces), made only if someone listens.
 			// This is so we can have event handlers that fire
 			// when an UART string is received...
-			EventHandlers_FireEvent_String(CMD_EVENT_ON_UART,buffer_for_log);
-#endif
+			if(EventHandlers_HasEventHandler(CMD_EVENT_ON_UART)) {
+				LOG_FormatHex(buffer_for_event, sizeof(buffer_for_event), data, len, 0);
+				EventHandlers_FireEvent_String(CMD_EVENT_ON_UART,buffer_for_event);
+			}
             TuyaMCU_ProcessIncoming(data,len);
         } else {
             break;
         }
     }
+}
+void TuyaMCU_RunFrame() {
+	// extraDebug log level
+	addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_TUYAMCU,"TuyaMCU heartbeat_valid = %i, product_information_valid=%i,"
+		" self_processing_mode = %i, wifi_state_valid = %i, wifi_state_timer=%i\n",
+		(int)heartbeat_valid,(int)product_information_valid,(int)self_processing_mode,
+		(int)wifi_state_valid,(int)wifi_state_timer);
+
+    // normally already done by quick tick
+    TuyaMCU_RunReceive();
 
     /* Command controll */
     if (heartbeat_timer == 0)
@@ -1399,6 +1404,7 @@ void TuyaMCU_Init()
 {
     UART_InitUART(g_baudRate);
     UART_InitReceiveRingBuffer(256);
+    g_tuyaMCU_bytesNeeded = MIN_TUYAMCU_PACKET_SIZE;
     // uartSendHex 55AA0008000007
 	//cmddetail:{"name":"tuyaMcu_testSendTime","args":"",
 	//cmddetail:"descr":"Sends a example date by TuyaMCU to clock/callendar MCU",
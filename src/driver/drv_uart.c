@@ -4,6 +4,7 @@
 // Commands register, execution API and cmd tokenizer
 #include "../cmnds/cmd_public.h"
 #include "../logging/logging.h"
+#include "drv_uart.h"
 
 
 #if PLATFORM_BK7231T | PLATFORM_BK7231N
@@ -107,6 +108,7 @@ void UART_InitReceiveRingBuffer(int size){
 	memset(g_recvBuf,0,size);
 	g_recvBufSize = size;
 	g_recvBufIn = 0;
+	g_recvBufOut = 0;
 }
 int UART_GetDataSize()
 {
@@ -120,19 +122,100 @@ int UART_GetDataSize()
 
     return remain_buf_size;
 }
+// ring capacity, it never holds more than size - 1 bytes
+int UART_GetBufferSize() {
+	return g_recvBufSize;
+}
 byte UART_GetNextByte(int index) {
 	int realIndex = g_recvBufOut + index;
-	if(realIndex > g_recvBufSize)
+	if(realIndex >= g_recvBufSize)
 		realIndex -= g_recvBufSize;
 
 	return g_recvBuf[realIndex];
 }
 void UART_ConsumeBytes(int idx) {
 	g_recvBufOut += idx;
-	if(g_recvBufOut > g_recvBufSize)
+	if(g_recvBufOut >= g_recvBufSize)
 		g_recvBufOut -= g_recvBufSize;
 }
 
+// Received data as (at most) two contiguous parts, without copying.
+// Second part is only set when data wraps around the end of the ring.
+// Returns total size; parts stay valid until bytes are consumed.
+int UART_GetSpans(uartSpans_t *s) {
+	// read once, ISR can append meanwhile
+	int in = g_recvBufIn;
+	int out = g_recvBufOut;
+
+	s->first = g_recvBuf + out;
+	if(in >= out) {
+		s->firstLen = in - out;
+		s->second = 0;
+		s->secondLen = 0;
+	} else {
+		s->firstLen = g_recvBufSize - out;
+		s->second = g_recvBuf;
+		s->secondLen = in;
+	}
+	return s->firstLen + s->secondLen;
+}
+// index (from current read position) of first given byte at or after start, -1 if none
+int UART_FindByte(byte b, int start) {
+	uartSpans_t s;
+	const byte *p;
+
+	UART_GetSpans(&s);
+	if(start < s.firstLen) {
+		p = memchr(s.first + start, b, s.firstLen - start);
+		if(p)
+			return p - s.first;
+		start = s.firstLen;
+	}
+	start -= s.firstLen;
+	if(start < s.secondLen) {
+		p = memchr(s.second + start, b, s.secondLen - start);
+		if(p)
+			return s.firstLen + (p - s.second);
+	}
+	return -1;
+}
+// copies len bytes starting at index, returns number of bytes copied
+int UART_CopyBytes(byte *out, int index, int len) {
+	uartSpans_t s;
+	int total, n;
+
+	total = UART_GetSpans(&s);
+	if(index >= total)
+		return 0;
+	if(len > total - index)
+		len = total - index;
+	n = 0;
+	if(index < s.firstLen) {
+		n = s.firstLen - index;
+		if(n > len)
+			n = len;
+		memcpy(out, s.first + index, n);
+		index = 0;
+	} else {
+		index -= s.firstLen;
+	}
+	if(n < len) {
+		memcpy(out + n, s.second + index, len - n);
+	}
+	return len;
+}
+// Returns pointer to first len bytes in one piece - directly into the ring
+// when they don't wrap, otherwise copied to scratch. Caller checks data size.
+const byte *UART_GetContiguousBytes(byte *scratch, int len) {
+	uartSpans_t s;
+
+	UART_GetSpans(&s);
+	if(s.firstLen >= len)
+		return s.first;
+	UART_CopyBytes(scratch, 0, len);
+	return scratch;
+}
+
 void UART_AppendByteToCircularBuffer(int rc) {
     if(UART_GetDataSize() < (g_recvBufSize-1))
     {
@@ -142,16 +225,44 @@ void UART_AppendByteToCircularBuffer(int rc) {
         }
    }
 }
+// bulk version for HAL callbacks, returns number of bytes stored (rest is dropped if ring is full)
+int UART_AppendBytesToCircularBuffer(const byte *data, int len) {
+	int in, n;
+	int space = g_recvBufSize - 1 - UART_GetDataSize();
+
+	if(len > space)
+		len = space;
+	if(len <= 0)
+		return 0;
+	in = g_recvBufIn;
+	n = g_recvBufSize - in;
+	if(n > len)
+		n = len;
+	memcpy(g_recvBuf + in, data, n);
+	memcpy(g_recvBuf, data + n, len - n);
+	in += len;
+	if(in >= g_recvBufSize)
+		in -= g_recvBufSize;
+	// publish all bytes at once
+	g_recvBufIn = in;
+	return len;
+}
 #if PLATFORM_BK7231T | PLATFORM_BK7231N
 void test_ty_read_uart_data_to_buffer(int port, void* param)
 {
     int rc = 0;
+    int cnt = 0;
+    byte tmp[32];
 
     while((rc = uart_read_byte(port)) != -1)
     {
-		UART_AppendByteToCircularBuffer(rc);
+		tmp[cnt++] = rc;
+		if(cnt == sizeof(tmp)) {
+			UART_AppendBytesToCircularBuffer(tmp, cnt);
+			cnt = 0;
+		}
     }
-
+	UART_AppendBytesToCircularBuffer(tmp, cnt);
 }
 #endif
 
@@ -177,7 +288,6 @@ static void console_cb_read(int fd, void *param)
 {
 	char buffer[64];  /* adapt to usb cdc since usb fifo is 64 bytes */
 	int ret;
-	int i;
 
 	ret = aos_read(fd, buffer, sizeof(buffer));
 	if (ret > 0) {
@@ -185,9 +295,7 @@ static void console_cb_read(int fd, void *param)
 			fd_console = fd;
 			buffer[ret] = 0;
 			addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "BL602 received: %s\n", buffer);
-			for (i = 0; i < ret; i++) {
-				UART_AppendByteToCircularBuffer(buffer[i]);
-			}
+			UART_AppendBytesToCircularBuffer((const byte*)buffer, ret);
 		}
 		else {
 			printf("-------------BUG from aos_read for ret\r\n");
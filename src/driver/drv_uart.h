@@ -1,13 +1,27 @@
 
 
 
+// received data in the ring, second part is set when it wraps around
+typedef struct uartSpans_s {
+	const byte *first;
+	int firstLen;
+	const byte *second;
+	int secondLen;
+} uartSpans_t;
+
 void UART_InitReceiveRingBuffer(int size);
 int UART_GetDataSize();
+int UART_GetBufferSize();
 byte UART_GetNextByte(int index);
 void UART_ConsumeBytes(int idx);
+int UART_GetSpans(uartSpans_t *s);
+int UART_FindByte(byte b, int start);
+int UART_CopyBytes(byte *out, int index, int len);
+const byte *UART_GetContiguousBytes(byte *scratch, int len);
 void UART_AppendByteToCircularBuffer(int rc);
+int UART_AppendBytesToCircularBuffer(const byte *data, int len);
 void UART_SendByte(byte b);
-void UART_InitUART(int baud);
+int UART_InitUART(int baud);
 
 // used to detect uart reinit/takeover by driver
 extern int g_uart_init_counter;
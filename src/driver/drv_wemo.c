@@ -214,7 +214,7 @@ bool Main_GetFirstPowerState() {
 	return 0;
 }
 static int WEMO_BasicEvent1(http_request_t* request) {
-	const char* cmd = request->bodystart;
+	const char* cmd = http_getBody(request);
 
 
 	addLogAdv(LOG_INFO, LOG_FEATURE_HTTP, "Wemo post event %s", cmd);
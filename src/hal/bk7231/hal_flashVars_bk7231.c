@@ -3,24 +3,58 @@
 
 	Design:
 	variables to be small - we want as many writes between erases as possible.
-	sector will be all FF (erased), and data added into it.
-	reading consists of searching the first non FF byte from the end, then
-	reading the preceding bytes as the variables.
-	last byte of data is len (!== 0xFF!)
+	The area is two sectors used in turn (ping-pong). Active sector holds:
+
+	offset 0	magic, sequence number (higher one wins if both valid)
+	offset 8	used units bitmap, one bit per 8 byte unit of journal,
+				cleared when the unit is taken - this is the write cursor
+	offset 72	journal of records, each starting at an 8 byte unit:
+				tag, payload len, payload, CRC8 of all preceding bytes
+
+	First record is a snapshot of the whole structure, followed by small
+	deltas (one channel, rgb, boot counters, energy). Reading is: two
+	headers, bitmap to get cursor, then replay of records up to cursor,
+	records with bad CRC are skipped. Writing appends deltas of values that
+	differ from what journal already holds. When the journal is full, the
+	other sector is erased and gets a snapshot, and is then committed by
+	writing its header with sequence + 1.
+
+	Units are marked used before the record is written, so if power is lost
+	in between, the broken record is skipped and never overwritten.
+
+	Area in old format (magic 0xfefefefe, full structure appended, last byte
+	is len) is read once and converted into the sector not holding its last
+	record. If that is sector 1, the magic in sector 0 is erased first, so
+	the last record is copied whole into sector 1 beforehand if needed, and
+	old format without magic is accepted as long as sector 0 is blank.
+
+	Writes are cached in RAM. Save functions only update flash_vars and mark
+	it dirty, the record is written by HAL_FlashVars_RunEverySecond once the
+	flush interval has passed since the first unsaved change, so a burst of
+	channel changes costs one record. Energy total changes with every meter
+	sample, so it is only written along with other data or by an explicit
+	HAL_FlashVars_Flush (reboot, OTA). Boot counters are written at once.
+
+	On Windows this file is built with TEST_MODE (flash area in RAM).
 
 */
 
 #ifndef PLATFORM_XR809
 
+#if WINDOWS
+#include "../../new_common.h"
+#else
 #include "include.h"
 #include "mem_pub.h"
 #include "drv_model_pub.h"
 #include "net_param_pub.h"
 #include "flash_pub.h"
-#include "../hal_flashVars.h"
 
 #include "BkDriverFlash.h"
 #include "BkDriverUart.h"
+#endif
+#include <stddef.h>
+#include "../hal_flashVars.h"
 
 #include "../../logging/logging.h"
 
@@ -40,18 +74,46 @@ int flash_vars_read(FLASH_VARS_STRUCTURE* data);
 //#define debug_delay(x) rtos_delay_milliseconds(x)
 #define debug_delay(x)
 
+// old format
 #define FLASH_VARS_MAGIC 0xfefefefe
+#define FLASH_VARS_JOURNAL_MAGIC 0x4a565346
+// record ends with the len byte, trailing padding (64 bit time_t in
+// simulator) is not written
+#define FLASH_VARS_RECORD_LEN ((int)offsetof(FLASH_VARS_STRUCTURE, len) + 1)
+
+#define FLASH_VARS_UNIT 8
+#define FLASH_VARS_BITMAP_LEN 64
+#define FLASH_VARS_DATA_START (8 + FLASH_VARS_BITMAP_LEN)
+// tag, len, crc
+#define FLASH_VARS_REC_OVERHEAD 3
+// must fit the snapshot record
+#define FLASH_VARS_READ_CHUNK 128
+
+#define FV_REC_SNAPSHOT	1
+#define FV_REC_BOOT		2
+#define FV_REC_CHANNEL	3
+#define FV_REC_RGB		4
+#define FV_REC_ENERGY	5
+
 // NOTE: Changed below according to partitions in SDK!!!!
 static unsigned int flash_vars_start = 0x1e3000; //0x1e1000 + 0x1000 + 0x1000; // after netconfig and mystery SSID
 static unsigned int flash_vars_len = 0x2000; // two blocks in BK7231
 static unsigned int flash_vars_sector_len = 0x1000; // erase size in BK7231
 
 FLASH_VARS_STRUCTURE flash_vars;
-int flash_vars_offset = 0; // offset to first FF in our area
-static int flash_vars_initialised = 0; // offset to first FF in our area
+int flash_vars_offset = 0; // offset of journal cursor in our area
+static int flash_vars_initialised = 0;
+// active sector, its sequence number and used journal units
+static int flash_vars_sector = 1;
+static unsigned int flash_vars_seq = 0;
+static int flash_vars_usedUnits = 0;
+// 0 if there is no valid journal yet (blank or old format)
+static int flash_vars_hasJournal = 0;
+// what the journal replays to, writes only append what differs
+static FLASH_VARS_STRUCTURE flash_vars_onFlash;
+// end of last old format record until it is converted, else -1
+static int flash_vars_legacyEnd = -1;
 
-static int flash_vars_valid();
-static int flash_vars_write_magic();
 static int _flash_vars_write(void* data, unsigned int off_set, unsigned int size);
 static int flash_vars_erase(unsigned int off_set, unsigned int size);
 int flash_vars_read(FLASH_VARS_STRUCTURE* data);
@@ -67,17 +129,33 @@ int flash_vars_read(FLASH_VARS_STRUCTURE* data);
 #ifdef TEST_MODE
 
 static char test_flash_area[0x2000];
+// simulated power loss, number of writes/erases that still reach flash, -1 for no limit
+static int test_flash_opsLeft = -1;
+
+static int test_flash_powerLost() {
+	if (test_flash_opsLeft == 0)
+		return 1;
+	if (test_flash_opsLeft > 0)
+		test_flash_opsLeft--;
+	return 0;
+}
+
+#define os_memcpy memcpy
+#define os_memset memset
 
 #endif
 
+#define FLASH_VARS_DIRTY		1
+// only written along with other data or by HAL_FlashVars_Flush
+#define FLASH_VARS_DIRTY_LAZY	2
 
-static void alignOffset(int* offs) {
-	// do nothing - should work with any offsets
-	/*
-	if ((*offs) % 32){
-		(*offs) += (32- ((*offs)%32));
-	}*/
-}
+#define FLASH_VARS_DEFAULT_FLUSH_INTERVAL 10
+
+static int flash_vars_dirty = 0;
+// seconds since first unsaved FLASH_VARS_DIRTY change
+static int flash_vars_dirtyTime = 0;
+static int flash_vars_flushInterval = FLASH_VARS_DEFAULT_FLUSH_INTERVAL;
+static flashVarsStats_t flash_vars_stats;
 
 
 // initialise and read variables from flash
@@ -107,13 +185,9 @@ int flash_vars_init() {
 		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "got part info");
 		debug_delay(200);
 
-		os_memset(&flash_vars, 0, sizeof(flash_vars));
-		flash_vars.len = sizeof(flash_vars);
-
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "cleared structure");
-		debug_delay(200);
 		// read any existing
 		flash_vars_read(&flash_vars);
+		flash_vars_onFlash = flash_vars;
 		flash_vars_initialised = 1;
 		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "read structure");
 		debug_delay(200);
@@ -125,254 +199,352 @@ int flash_vars_init() {
 	return 0;
 }
 
-static int flash_vars_valid() {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
-#ifndef TEST_MODE
-	DD_HANDLE flash_hdl;
-#endif
-	uint32_t start_addr;
-	unsigned int tmp = 0xffffffff;
-	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_valid()");
-	debug_delay(200);
-
+// off_set is zero based.  size in bytes
+static int flash_vars_rawRead(unsigned int off_set, void* data, unsigned int size) {
 #ifndef TEST_MODE
-	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
-	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-#endif
-	start_addr = flash_vars_start;
-
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_valid() flash open");
-	debug_delay(200);
-
-#ifdef TEST_MODE
-	os_memcpy(&tmp, &test_flash_area[start_addr - flash_vars_start], sizeof(tmp));
-#else
-	GLOBAL_INT_DISABLE();
-	ddev_read(flash_hdl, (char*)&tmp, sizeof(tmp), start_addr);
-	GLOBAL_INT_RESTORE();
-	ddev_close(flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_valid() copied header 0x%x", tmp);
-	debug_delay(200);
-
-	// if not our magic, then erase and write magic
-	if (tmp != FLASH_VARS_MAGIC) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash_vars_valid - not our magic, erase");
-		debug_delay(200);
-		if (flash_vars_write_magic() >= 0) {
-			ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash initialised");
-		}
-		else {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash initialise failed");
-			return -1;
-		}
-		return 0;
-	}
-	return 1;
-}
-
-static int flash_vars_write_magic() {
-	//uint32_t i;
-	//uint32_t param;
 	UINT32 status;
-#ifndef TEST_MODE
 	DD_HANDLE flash_hdl;
-#endif
-	uint32_t start_addr;
-	unsigned int tmp = FLASH_VARS_MAGIC;
 	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_magic write");
-	debug_delay(200);
-
-	start_addr = flash_vars_start;
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash open");
-	debug_delay(200);
+#endif
 
-	if (flash_vars_erase(0, flash_vars_len) >= 0) {
-		ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash erased");
-		debug_delay(200);
-	}
-	else {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash erase failed");
-		debug_delay(200);
+	if (off_set + size > flash_vars_len) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars read invalid offset 0x%X len 0x%X", off_set, size);
+		os_memset(data, 0xff, size);
 		return -1;
 	}
+	flash_vars_stats.reads++;
+	flash_vars_stats.bytesRead += size;
 #ifdef TEST_MODE
-	os_memcpy(&test_flash_area[start_addr - flash_vars_start], &tmp, sizeof(tmp));
+	os_memcpy(data, &test_flash_area[off_set], size);
 #else
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-
 	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
 	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
 	GLOBAL_INT_DISABLE();
-	ddev_write(flash_hdl, (char*)&tmp, sizeof(tmp), start_addr);
+	ddev_read(flash_hdl, (char*)data, size, flash_vars_start + off_set);
 	GLOBAL_INT_RESTORE();
 	ddev_close(flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_ALL);
 #endif
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "header written");
-	// next write point
-	flash_vars_offset = sizeof(tmp);
-	alignOffset(&flash_vars_offset);
-
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "header written %d", flash_vars_offset);
-	debug_delay(200);
-
-	// write a new structure
-	flash_vars_write();
-
 	return 0;
 }
 
-
-// read data from flash vars area.
-// design:
-// search from end of flash until we find a non-zero byte.
-// this is length of existing data.
-// clear structure to 00
-// read existing data (excluding len) into structure.
-// set len to current structure defn len.
-// remember first FF byte offset
-int flash_vars_read(FLASH_VARS_STRUCTURE* data) {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
-#ifndef TEST_MODE
-	DD_HANDLE flash_hdl;
-#endif
-	uint32_t start_addr;
+// read old format area, as it was written up to now.
+// search from end of flash until we find a non-FF byte,
+// this is length of existing data, read the data preceding it.
+// Returns end of last record, or -1 if it's not old format.
+static int flash_vars_legacyRead(FLASH_VARS_STRUCTURE* data) {
+	unsigned int start_addr;
+	unsigned int lowest;
 	int loops = 0x2100 / 4;
 	unsigned int tmp = 0xffffffff;
-	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_read len %d", sizeof(*data));
+	int shifts = 0;
+	int len;
 
-	// check for magic, and reset sector(s) if not.
-	if (flash_vars_valid() >= 0) {
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars valid or initialised");
+	flash_vars_rawRead(0, &tmp, sizeof(tmp));
+	if (tmp == FLASH_VARS_MAGIC) {
+		lowest = sizeof(tmp);
+	}
+	else if (tmp == 0xffffffff) {
+		// conversion into sector 0 was interrupted after its erase,
+		// last record is then whole in sector 1
+		lowest = flash_vars_sector_len;
 	}
 	else {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash_vars_validity error");
-		os_memset(data, 0, sizeof(*data));
-		data->len = sizeof(*data);
-		debug_delay(200);
 		return -1;
 	}
-	debug_delay(200);
-
-#ifndef TEST_MODE
-	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
-	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-#endif
-	start_addr = flash_vars_start + flash_vars_len;
-
+	start_addr = flash_vars_len;
 	do {
 		start_addr -= sizeof(tmp);
-#ifdef TEST_MODE
-		os_memcpy(&tmp, &test_flash_area[start_addr - flash_vars_start], sizeof(tmp));
-#else
-		GLOBAL_INT_DISABLE();
-		ddev_read(flash_hdl, (char*)&tmp, sizeof(tmp), start_addr);
-		GLOBAL_INT_RESTORE();
-#endif
-	} while ((tmp == 0xFFFFFFFF) && (start_addr > flash_vars_start + 4) && (loops--));
-	if (!loops) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "loops over addr 0x%X", start_addr);
-	}
-
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "found at %u 0x%X", start_addr, tmp);
+		flash_vars_rawRead(start_addr, &tmp, sizeof(tmp));
+	} while ((tmp == 0xFFFFFFFF) && (start_addr > lowest) && (loops--));
 	start_addr += sizeof(tmp);
-	debug_delay(200);
 
 	if (tmp == 0xffffffff) {
-		// no data found, all erased
-		// clear result.
-		os_memset(data, 0, sizeof(*data));
-		// set the len to the latest revision's len
-		data->len = sizeof(*data);
-#ifndef TEST_MODE
-		ddev_close(flash_hdl);
-		bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-		ADDLOG_INFO(LOG_FEATURE_CFG, "new flash vars");
-		return 0;
+		if (lowest != sizeof(tmp)) {
+			// blank
+			return -1;
+		}
+		// magic only
+		return start_addr;
 	}
-	else {
-		int shifts = 0;
-		int len = 0;
-		while ((tmp & 0xFF000000) == 0xFF000000) {
-			tmp <<= 8;
-			shifts++;
+	while ((tmp & 0xFF000000) == 0xFF000000) {
+		tmp <<= 8;
+		shifts++;
+	}
+	len = (tmp >> 24) & 0xff;
+	start_addr -= shifts;
+	if (len <= 1 || len > FLASH_VARS_RECORD_LEN || start_addr < len + lowest) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars old format len %d invalid", len);
+		return start_addr;
+	}
+	flash_vars_rawRead(start_addr - len, data, len - 1);
+	ADDLOG_INFO(LOG_FEATURE_CFG, "flash vars in old format, boot_count %d, will convert", data->boot_count);
+	return start_addr;
+}
+
+// number of bits cleared from the bottom of bitmap
+static int flash_vars_countUsedUnits(const byte* bitmap) {
+	int i, units;
+	byte b;
+
+	units = 0;
+	for (i = 0; i < FLASH_VARS_BITMAP_LEN; i++) {
+		b = bitmap[i];
+		if (b == 0) {
+			units += 8;
+			continue;
+		}
+		while ((b & 1) == 0) {
+			b >>= 1;
+			units++;
 		}
-		len = (tmp >> 24) & 0xff;
-		start_addr -= shifts;
-		start_addr -= len;
+		break;
+	}
+	return units;
+}
 
-		if (len > sizeof(*data)) {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "len (%d) in flash_var greater than current structure len (%d)", len, sizeof(*data));
-#ifndef TEST_MODE
-			ddev_close(flash_hdl);
-			bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-			// erase it all and write a new one
-			flash_vars_write_magic();
+static void flash_vars_applyRecord(FLASH_VARS_STRUCTURE* data, int tag, const byte* p, int len) {
+	int index;
 
+	switch (tag) {
+	case FV_REC_SNAPSHOT:
+		os_memset(data, 0, sizeof(*data));
+		if (len > FLASH_VARS_RECORD_LEN - 1)
+			len = FLASH_VARS_RECORD_LEN - 1;
+		os_memcpy(data, p, len);
+		break;
+	case FV_REC_BOOT:
+		if (len >= 4) {
+			data->boot_count = p[0] | (p[1] << 8);
+			data->boot_success_count = p[2] | (p[3] << 8);
 		}
-		else {
-			// clear result.
-			os_memset(data, 0, sizeof(*data));
-			// read the DATA portion into the structure
-#ifdef TEST_MODE
-			os_memcpy(data, &test_flash_area[start_addr - flash_vars_start], len - 1);
-#else
-			GLOBAL_INT_DISABLE();
-			ddev_read(flash_hdl, (char*)data, len - 1, start_addr);
-			GLOBAL_INT_RESTORE();
-			ddev_close(flash_hdl);
-			bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-			// set the len to the latest revision's len
-			data->len = sizeof(*data);
-			flash_vars_offset = (start_addr - flash_vars_start) + len;
-			alignOffset(&flash_vars_offset);
-
-			ADDLOG_DEBUG(LOG_FEATURE_CFG, "new offset after read %d, boot_count %d, success count %d",
-				flash_vars_offset,
-				data->boot_count,
-				data->boot_success_count
-			);
+		break;
+	case FV_REC_CHANNEL:
+		index = p[0];
+		if (len >= 3 && index < MAX_RETAIN_CHANNELS) {
+			data->savedValues[index] = (short)(p[1] | (p[2] << 8));
+		}
+		break;
+	case FV_REC_RGB:
+		if (len >= 3) {
+			os_memcpy(data->rgb, p, 3);
+		}
+		break;
+	case FV_REC_ENERGY:
+		if (len > sizeof(ENERGY_METERING_DATA))
+			len = sizeof(ENERGY_METERING_DATA);
+		os_memcpy(&data->emetering, p, len);
+		break;
+	default:
+		// unknown (newer) record, skip it
+		break;
+	}
+}
 
+// read data from flash vars area.
+// design:
+// pick the valid sector with higher sequence, take cursor from its bitmap,
+// clear structure to 00 and replay the journal up to cursor.
+// set len to current structure defn len.
+int flash_vars_read(FLASH_VARS_STRUCTURE* data) {
+	unsigned int hdr[2][2];
+	byte bitmap[FLASH_VARS_BITMAP_LEN];
+	byte buf[FLASH_VARS_READ_CHUNK];
+	int sector, base, pos, end, winStart, winEnd, tag, len, recLen, legacyEnd;
+
+	os_memset(data, 0, sizeof(*data));
+
+	flash_vars_rawRead(0, hdr[0], sizeof(hdr[0]));
+	flash_vars_rawRead(flash_vars_sector_len, hdr[1], sizeof(hdr[1]));
+	sector = -1;
+	if (hdr[0][0] == FLASH_VARS_JOURNAL_MAGIC)
+		sector = 0;
+	if (hdr[1][0] == FLASH_VARS_JOURNAL_MAGIC) {
+		if (sector == -1 || (int)(hdr[1][1] - hdr[0][1]) > 0)
+			sector = 1;
+	}
+	if (sector == -1) {
+		flash_vars_hasJournal = 0;
+		flash_vars_usedUnits = 0;
+		flash_vars_offset = 0;
+		legacyEnd = flash_vars_legacyRead(data);
+		flash_vars_legacyEnd = legacyEnd;
+		// keep the sector with last old format record until converted
+		flash_vars_sector = (legacyEnd > (int)flash_vars_sector_len) ? 1 : 0;
+		if (legacyEnd < 0) {
+			ADDLOG_INFO(LOG_FEATURE_CFG, "new flash vars");
+			// blank, compaction will start at sector 0
+			flash_vars_sector = 1;
 		}
-		return 1;
+		data->len = FLASH_VARS_RECORD_LEN;
+		return 0;
+	}
+	base = sector * flash_vars_sector_len;
+	flash_vars_rawRead(base + 8, bitmap, sizeof(bitmap));
+	flash_vars_sector = sector;
+	flash_vars_seq = hdr[sector][1];
+	flash_vars_usedUnits = flash_vars_countUsedUnits(bitmap);
+	flash_vars_hasJournal = 1;
+
+	end = FLASH_VARS_DATA_START + flash_vars_usedUnits * FLASH_VARS_UNIT;
+	if (end > flash_vars_sector_len)
+		end = flash_vars_sector_len;
+	flash_vars_offset = base + end;
+
+	pos = FLASH_VARS_DATA_START;
+	winStart = winEnd = pos;
+	while (pos < end) {
+		if (pos + 2 > winEnd) {
+			winStart = pos;
+			winEnd = pos + FLASH_VARS_READ_CHUNK;
+			if (winEnd > end)
+				winEnd = end;
+			flash_vars_rawRead(base + winStart, buf, winEnd - winStart);
+		}
+		tag = buf[pos - winStart];
+		len = buf[pos - winStart + 1];
+		recLen = len + FLASH_VARS_REC_OVERHEAD;
+		if (tag == 0xFF || tag == 0 || pos + recLen > end || recLen > FLASH_VARS_READ_CHUNK) {
+			// erased or broken unit, try the next one
+			pos += FLASH_VARS_UNIT;
+			continue;
+		}
+		if (pos + recLen > winEnd) {
+			winStart = pos;
+			winEnd = pos + FLASH_VARS_READ_CHUNK;
+			if (winEnd > end)
+				winEnd = end;
+			flash_vars_rawRead(base + winStart, buf, winEnd - winStart);
+		}
+		if ((byte)Tiny_CRC8((const char*)&buf[pos - winStart], recLen - 1) != buf[pos - winStart + recLen - 1]) {
+			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars record at 0x%X bad crc", base + pos);
+			pos += FLASH_VARS_UNIT;
+			continue;
+		}
+		flash_vars_applyRecord(data, tag, &buf[pos - winStart + 2], len);
+		pos += (recLen + FLASH_VARS_UNIT - 1) / FLASH_VARS_UNIT * FLASH_VARS_UNIT;
 	}
+	// set the len to the latest revision's len
+	data->len = FLASH_VARS_RECORD_LEN;
+
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars sector %d seq %u cursor %d, boot_count %d, success count %d",
+		sector, flash_vars_seq, end, data->boot_count, data->boot_success_count);
+	return 1;
 }
 
+// appends a record to active sector, units are marked used first.
+// Returns -1 if it does not fit.
+static int flash_vars_appendRecord(int tag, const void* payload, int len) {
+	byte rec[FLASH_VARS_READ_CHUNK];
+	byte bitmap[FLASH_VARS_BITMAP_LEN];
+	int base, pos, recLen, units, first, last, i;
+
+	recLen = len + FLASH_VARS_REC_OVERHEAD;
+	units = (recLen + FLASH_VARS_UNIT - 1) / FLASH_VARS_UNIT;
+	pos = FLASH_VARS_DATA_START + flash_vars_usedUnits * FLASH_VARS_UNIT;
+	if (recLen > sizeof(rec) || pos + units * FLASH_VARS_UNIT > flash_vars_sector_len
+		|| flash_vars_usedUnits + units > FLASH_VARS_BITMAP_LEN * 8) {
+		return -1;
+	}
+	base = flash_vars_sector * flash_vars_sector_len;
+
+	// bitmap bytes covering new units, with all units so far cleared
+	first = flash_vars_usedUnits / 8;
+	flash_vars_usedUnits += units;
+	last = (flash_vars_usedUnits - 1) / 8;
+	for (i = first; i <= last; i++) {
+		if (flash_vars_usedUnits >= (i + 1) * 8)
+			bitmap[i] = 0;
+		else
+			bitmap[i] = 0xFF << (flash_vars_usedUnits - i * 8);
+	}
+	_flash_vars_write(&bitmap[first], base + 8 + first, last - first + 1);
+
+	rec[0] = tag;
+	rec[1] = len;
+	os_memcpy(rec + 2, payload, len);
+	rec[recLen - 1] = Tiny_CRC8((const char*)rec, recLen - 1);
+	_flash_vars_write(rec, base + pos, recLen);
+
+	flash_vars_offset = base + pos + units * FLASH_VARS_UNIT;
+	return 0;
+}
 
+// erase the other sector, start it with a snapshot and commit its header
+static int flash_vars_compact() {
+	unsigned int hdr[2];
+	int target;
+
+	target = flash_vars_sector ^ 1;
+	if (!flash_vars_hasJournal && target == 0 && flash_vars_legacyEnd >= 0
+		&& flash_vars_legacyEnd - FLASH_VARS_RECORD_LEN < (int)flash_vars_sector_len) {
+		// last old format record may reach into sector 0, which is erased below
+		// together with the magic; append its copy so it is whole in sector 1
+		flash_vars_onFlash.len = FLASH_VARS_RECORD_LEN;
+		_flash_vars_write(&flash_vars_onFlash, flash_vars_legacyEnd, FLASH_VARS_RECORD_LEN);
+	}
+	if (flash_vars_erase(target * flash_vars_sector_len, flash_vars_sector_len) < 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars compaction erase failed");
+		return -1;
+	}
+	flash_vars_sector = target;
+	flash_vars_usedUnits = 0;
+	flash_vars_appendRecord(FV_REC_SNAPSHOT, &flash_vars, FLASH_VARS_RECORD_LEN - 1);
+
+	flash_vars_seq++;
+	hdr[0] = FLASH_VARS_JOURNAL_MAGIC;
+	hdr[1] = flash_vars_seq;
+	_flash_vars_write(hdr, target * flash_vars_sector_len, sizeof(hdr));
+	flash_vars_hasJournal = 1;
+	flash_vars_legacyEnd = -1;
+	flash_vars_onFlash = flash_vars;
+
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars compacted into sector %d seq %u", target, flash_vars_seq);
+	return 0;
+}
+
+// appends deltas between flash_vars and what is in the journal
 int flash_vars_write() {
+	FLASH_VARS_STRUCTURE* data = &flash_vars;
+	FLASH_VARS_STRUCTURE* old = &flash_vars_onFlash;
+	byte p[4];
+	int i;
+
 	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars write");
 	flash_vars_init();
-	alignOffset(&flash_vars_offset);
-
-	FLASH_VARS_STRUCTURE* data = &flash_vars;
-	if (flash_vars_offset + data->len > flash_vars_len) {
-		if (flash_vars_write_magic() >= 0) {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash reinitialised");
-		}
-		else {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash reinitialise failed");
-			return -1;
-		}
+	if (!flash_vars_hasJournal) {
+		return flash_vars_compact();
 	}
 
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars write at offset %d len %d", flash_vars_offset, data->len);
-	_flash_vars_write(data, flash_vars_offset, data->len);
-	flash_vars_offset += data->len;
-	alignOffset(&flash_vars_offset);
+	if (data->boot_count != old->boot_count || data->boot_success_count != old->boot_success_count) {
+		p[0] = data->boot_count & 0xff;
+		p[1] = data->boot_count >> 8;
+		p[2] = data->boot_success_count & 0xff;
+		p[3] = data->boot_success_count >> 8;
+		if (flash_vars_appendRecord(FV_REC_BOOT, p, 4) < 0)
+			return flash_vars_compact();
+		old->boot_count = data->boot_count;
+		old->boot_success_count = data->boot_success_count;
+	}
+	for (i = 0; i < MAX_RETAIN_CHANNELS; i++) {
+		if (data->savedValues[i] == old->savedValues[i])
+			continue;
+		p[0] = i;
+		p[1] = data->savedValues[i] & 0xff;
+		p[2] = (data->savedValues[i] >> 8) & 0xff;
+		if (flash_vars_appendRecord(FV_REC_CHANNEL, p, 3) < 0)
+			return flash_vars_compact();
+		old->savedValues[i] = data->savedValues[i];
+	}
+	if (memcmp(data->rgb, old->rgb, sizeof(data->rgb))) {
+		if (flash_vars_appendRecord(FV_REC_RGB, data->rgb, sizeof(data->rgb)) < 0)
+			return flash_vars_compact();
+		os_memcpy(old->rgb, data->rgb, sizeof(data->rgb));
+	}
+	if (memcmp(&data->emetering, &old->emetering, sizeof(data->emetering))) {
+		if (flash_vars_appendRecord(FV_REC_ENERGY, &data->emetering, sizeof(data->emetering)) < 0)
+			return flash_vars_compact();
+		old->emetering = data->emetering;
+	}
 
 	ADDLOG_DEBUG(LOG_FEATURE_CFG, "new offset %d, boot_count %d, success count %d",
 		flash_vars_offset,
@@ -389,48 +561,39 @@ int flash_vars_write() {
 // answer - the flash driver in theroy deals with than... writes are always in chunks of 32 bytes
 // on 32 byte boundaries.
 int _flash_vars_write(void* data, unsigned int off_set, unsigned int size) {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
 #ifndef TEST_MODE
+	UINT32 status;
 	DD_HANDLE flash_hdl;
-#endif
-	uint32_t start_addr;
 	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "_flash vars write offset %d, size %d", off_set, size);
-
-#ifndef TEST_MODE
-	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
-	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
+#else
+	unsigned int i;
 #endif
-	start_addr = flash_vars_start + off_set;
+	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "_flash vars write offset %d, size %d", off_set, size);
 
-	if (start_addr <= flash_vars_start) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "_flash vars write invalid addr 0x%X", start_addr);
-		ddev_close(flash_hdl);
-		bk_flash_enable_security(FLASH_PROTECT_ALL);
-		return -1;
-	}
-	if (start_addr + size > flash_vars_start + flash_vars_len) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "_flash vars write invalid addr 0x%X len 0x%X", start_addr, size);
-		ddev_close(flash_hdl);
-		bk_flash_enable_security(FLASH_PROTECT_ALL);
+	if (off_set + size > flash_vars_len) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "_flash vars write invalid offset 0x%X len 0x%X", off_set, size);
 		return -1;
 	}
+	flash_vars_stats.writes++;
+	flash_vars_stats.bytesWritten += size;
 
 #ifdef TEST_MODE
-	os_memcpy(&test_flash_area[start_addr - flash_vars_start], data, size);
+	if (test_flash_powerLost())
+		return 0;
+	// like NOR flash, writing can only clear bits
+	for (i = 0; i < size; i++) {
+		test_flash_area[off_set + i] &= ((char*)data)[i];
+	}
 #else
+	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
+	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
+	bk_flash_enable_security(FLASH_PROTECT_NONE);
 	GLOBAL_INT_DISABLE();
-	ddev_write(flash_hdl, data, size, start_addr);
+	ddev_write(flash_hdl, data, size, flash_vars_start + off_set);
 	GLOBAL_INT_RESTORE();
 	ddev_close(flash_hdl);
 	bk_flash_enable_security(FLASH_PROTECT_ALL);
 #endif
-
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "_flash vars write wrote offset %d, size %d", off_set, size);
-
 	return 0;
 }
 
@@ -440,12 +603,12 @@ int _flash_vars_write(void* data, unsigned int off_set, unsigned int size) {
 int flash_vars_erase(unsigned int off_set, unsigned int size) {
 	uint32_t i;
 	uint32_t param;
-	UINT32 status;
 #ifndef TEST_MODE
+	UINT32 status;
 	DD_HANDLE flash_hdl;
+	GLOBAL_INT_DECLARATION();
 #endif
 	uint32_t start_sector, end_sector;
-	GLOBAL_INT_DECLARATION();
 	ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars erase at offset %d len %d", off_set, size);
 
 #ifndef TEST_MODE
@@ -476,7 +639,10 @@ int flash_vars_erase(unsigned int off_set, unsigned int size) {
 			return -1;
 		}
 		ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars erase block at addr 0x%X", param);
+		flash_vars_stats.sectorErases++;
 #ifdef TEST_MODE
+		if (test_flash_powerLost())
+			continue;
 		os_memset(&test_flash_area[param - flash_vars_start], 0xff, 0x1000);
 #else
 		GLOBAL_INT_DISABLE();
@@ -497,46 +663,118 @@ int flash_vars_erase(unsigned int off_set, unsigned int size) {
 
 //#define DISABLE_FLASH_VARS_VARS
 
+// writes cached changes, if any
+void HAL_FlashVars_Flush() {
+#ifndef DISABLE_FLASH_VARS_VARS
+	if (flash_vars_dirty == 0)
+		return;
+	flash_vars_dirty = 0;
+	flash_vars_dirtyTime = 0;
+	flash_vars_write();
+#endif
+}
+static void flash_vars_markDirty(int flags) {
+	flash_vars_stats.saveRequests++;
+	flash_vars_dirty |= flags;
+	if (flash_vars_flushInterval <= 0 && (flags & FLASH_VARS_DIRTY)) {
+		// write-through
+		HAL_FlashVars_Flush();
+	}
+}
+void HAL_FlashVars_RunEverySecond() {
+	if ((flash_vars_dirty & FLASH_VARS_DIRTY) == 0)
+		return;
+	flash_vars_dirtyTime++;
+	if (flash_vars_dirtyTime >= flash_vars_flushInterval) {
+		HAL_FlashVars_Flush();
+	}
+}
+void HAL_FlashVars_SetFlushInterval(int seconds) {
+	flash_vars_flushInterval = seconds;
+	if (flash_vars_flushInterval <= 0) {
+		HAL_FlashVars_Flush();
+	}
+}
+int HAL_FlashVars_GetFlushInterval() {
+	return flash_vars_flushInterval;
+}
+void HAL_FlashVars_GetStats(flashVarsStats_t* stats) {
+	*stats = flash_vars_stats;
+	stats->pending = flash_vars_dirty != 0;
+	// sectors are used in turn, both wear the same
+	stats->sectorCount = flash_vars_len / flash_vars_sector_len;
+}
+
+#ifdef TEST_MODE
+// back to erased flash, like a new device
+void SIM_ClearFlashVars() {
+	os_memset(test_flash_area, 0xff, sizeof(test_flash_area));
+	os_memset(&flash_vars_stats, 0, sizeof(flash_vars_stats));
+	flash_vars_initialised = 0;
+	flash_vars_offset = 0;
+	flash_vars_sector = 1;
+	flash_vars_seq = 0;
+	flash_vars_usedUnits = 0;
+	flash_vars_hasJournal = 0;
+	flash_vars_legacyEnd = -1;
+	flash_vars_dirty = 0;
+	flash_vars_dirtyTime = 0;
+	flash_vars_flushInterval = FLASH_VARS_DEFAULT_FLUSH_INTERVAL;
+	test_flash_opsLeft = -1;
+}
+// writes and erases after given count are lost, -1 to restore power
+void SIM_FlashVars_CutPowerAfter(int ops) {
+	test_flash_opsLeft = ops;
+}
+// appends structure in old format, like older builds did
+void SIM_FlashVars_WriteLegacy(FLASH_VARS_STRUCTURE* data) {
+	FLASH_VARS_STRUCTURE tmp;
+	unsigned int magic = FLASH_VARS_MAGIC;
+	int end;
+
+	end = flash_vars_legacyRead(&tmp);
+	if (end < 0 || end + FLASH_VARS_RECORD_LEN > flash_vars_len) {
+		flash_vars_erase(0, flash_vars_len);
+		_flash_vars_write(&magic, 0, sizeof(magic));
+		end = sizeof(magic);
+	}
+	data->len = FLASH_VARS_RECORD_LEN;
+	_flash_vars_write(data, end, FLASH_VARS_RECORD_LEN);
+}
+// forget RAM state, next access reads flash like after reboot
+void SIM_FlashVars_Reload() {
+	flash_vars_initialised = 0;
+	flash_vars_dirty = 0;
+	flash_vars_dirtyTime = 0;
+}
+#endif
 
 // call at startup
 void HAL_FlashVars_IncreaseBootCount() {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
 	flash_vars_init();
 	flash_vars.boot_count++;
 	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Boot Count %d #######", flash_vars.boot_count);
+	// written at once, cached changes go with it
+	flash_vars_dirty = 0;
+	flash_vars_dirtyTime = 0;
 	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
 #endif
 }
 void HAL_FlashVars_SaveChannel(int index, int value) {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
-
 	if (index < 0 || index >= MAX_RETAIN_CHANNELS) {
 		ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Can't Save Channel %d as %d (not enough space in array) #######", index, value);
 		return;
 	}
 
 	flash_vars_init();
+	if (flash_vars.savedValues[index] == value) {
+		return;
+	}
 	flash_vars.savedValues[index] = value;
-	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Channel %d as %d #######", index, value);
-	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "Flash Save Channel %d as %d (cached)", index, value);
+	flash_vars_markDirty(FLASH_VARS_DIRTY);
 #endif
 }
 void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, byte* rgb, byte* bEnableAll) {
@@ -552,9 +790,6 @@ void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, by
 }
 void HAL_FlashVars_SaveLED(byte mode, short brightness, short temperature, byte r, byte g, byte b, byte bEnableAll) {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
-
 	flash_vars_init();
 	flash_vars.savedValues[MAX_RETAIN_CHANNELS - 1] = brightness;
 	flash_vars.savedValues[MAX_RETAIN_CHANNELS - 2] = temperature;
@@ -563,15 +798,8 @@ void HAL_FlashVars_SaveLED(byte mode, short brightness, short temperature, byte
 	flash_vars.rgb[0] = r;
 	flash_vars.rgb[1] = g;
 	flash_vars.rgb[2] = b;
-	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save LED #######");
-	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "Flash Save LED (cached)");
+	flash_vars_markDirty(FLASH_VARS_DIRTY);
 #endif
 }
 
@@ -582,38 +810,23 @@ short HAL_FlashVars_ReadUsage() {
 }
 void HAL_FlashVars_SaveTotalUsage(short usage) {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
-
 	flash_vars_init();
 	flash_vars.savedValues[MAX_RETAIN_CHANNELS - 1] = usage;
-	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Usage #######");
-	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "Flash Save Usage (cached)");
+	flash_vars_markDirty(FLASH_VARS_DIRTY);
 #endif
 }
 // call once started (>30s?)
 void HAL_FlashVars_SaveBootComplete() {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
 	// mark that we have completed a boot.
 	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Set Boot Complete #######");
 
 	flash_vars.boot_success_count = flash_vars.boot_count;
+	// written at once, cached changes go with it
+	flash_vars_dirty = 0;
+	flash_vars_dirtyTime = 0;
 	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
 #endif
 }
 
@@ -655,13 +868,11 @@ int HAL_GetEnergyMeterStatus(ENERGY_METERING_DATA* data)
 int HAL_SetEnergyMeterStatus(ENERGY_METERING_DATA* data)
 {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE tmp;
-	// mark that we have completed a boot.
 	if (data != NULL)
 	{
+		flash_vars_init();
 		memcpy(&flash_vars.emetering, data, sizeof(ENERGY_METERING_DATA));
-		flash_vars_write();
-		flash_vars_read(&tmp);
+		flash_vars_markDirty(FLASH_VARS_DIRTY);
 	}
 #endif
 	return 0;
@@ -670,7 +881,10 @@ int HAL_SetEnergyMeterStatus(ENERGY_METERING_DATA* data)
 void HAL_FlashVars_SaveTotalConsumption(float total_consumption)
 {
 #ifndef DISABLE_FLASH_VARS_VARS
+	if (flash_vars.emetering.TotalConsumption == total_consumption)
+		return;
 	flash_vars.emetering.TotalConsumption = total_consumption;
+	flash_vars_markDirty(FLASH_VARS_DIRTY_LAZY);
 #endif
 }
 
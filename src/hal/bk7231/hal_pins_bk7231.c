@@ -3,7 +3,8 @@
 #include "../../logging/logging.h"
 #include "../../new_cfg.h"
 #include "../../new_pins.h"
-//#include "../../new_pins.h"
+#include "../../quicktick.h"
+#include "../hal_pins.h"
 #include <gpio_pub.h>
 
 #include "../../beken378/func/include/net_param_pub.h"
@@ -145,3 +146,30 @@ void HAL_PIN_PWM_Update(int index, float value) {
 unsigned int HAL_GetGPIOPin(int index) {
 	return index;
 }
+
+#ifdef BEKEN_PIN_GPI_INTERRUPTS
+static HAL_PinInterruptCallback g_pinInterruptCallbacks[PLATFORM_GPIO_MAX];
+
+// NOTE: ISR
+static void HAL_PinInterruptHandler(unsigned char index) {
+	if (index < PLATFORM_GPIO_MAX && g_pinInterruptCallbacks[index]) {
+		g_pinInterruptCallbacks[index](index);
+	}
+}
+#endif
+
+int HAL_AttachInterrupt(int index, int falling, HAL_PinInterruptCallback cb) {
+#ifdef BEKEN_PIN_GPI_INTERRUPTS
+	g_pinInterruptCallbacks[index] = cb;
+	gpio_int_enable(index, falling ? IRQ_TRIGGER_FALLING_EDGE : IRQ_TRIGGER_RISING_EDGE, HAL_PinInterruptHandler);
+	return 1;
+#else
+	return 0;
+#endif
+}
+void HAL_DetachInterrupt(int index) {
+#ifdef BEKEN_PIN_GPI_INTERRUPTS
+	gpio_int_disable(index);
+	g_pinInterruptCallbacks[index] = 0;
+#endif
+}
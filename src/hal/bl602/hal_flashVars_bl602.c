@@ -136,5 +136,24 @@ void HAL_FlashVars_SaveTotalConsumption(float total_consumption)
     g_bootCounts.emetering.TotalConsumption = total_consumption;
 }
 
+// writes are not cached on this platform
+void HAL_FlashVars_RunEverySecond()
+{
+}
+void HAL_FlashVars_Flush()
+{
+}
+void HAL_FlashVars_SetFlushInterval(int seconds)
+{
+}
+int HAL_FlashVars_GetFlushInterval()
+{
+	return 0;
+}
+void HAL_FlashVars_GetStats(flashVarsStats_t* stats)
+{
+	memset(stats, 0, sizeof(flashVarsStats_t));
+}
+
 #endif // PLATFORM_BL602
 
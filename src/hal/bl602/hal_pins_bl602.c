@@ -3,6 +3,7 @@
 #include "../../new_pins.h"
 #include "../../new_common.h"
 #include "../../logging/logging.h"
+#include "../hal_pins.h"
 
 
 #include "bl_gpio.h"
@@ -96,4 +97,11 @@ unsigned int HAL_GetGPIOPin(int index) {
 	return index;
 }
 
+int HAL_AttachInterrupt(int index, int falling, HAL_PinInterruptCallback cb) {
+	// not supported yet, pin is polled
+	return 0;
+}
+void HAL_DetachInterrupt(int index) {
+}
+
 #endif
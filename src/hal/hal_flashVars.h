@@ -50,5 +50,27 @@ int HAL_GetEnergyMeterStatus(ENERGY_METERING_DATA* data);
 int HAL_SetEnergyMeterStatus(ENERGY_METERING_DATA* data);
 void HAL_FlashVars_SaveTotalConsumption(float total_consumption);
 
+typedef struct flashVarsStats_s {
+	// save calls, flash writes and bytes written since boot
+	int saveRequests;
+	int writes;
+	int bytesWritten;
+	// flash reads and bytes read since boot
+	int reads;
+	int bytesRead;
+	// sector erases since boot, and sectors in flash vars area
+	int sectorErases;
+	int sectorCount;
+	// there are cached changes not written yet
+	int pending;
+} flashVarsStats_t;
+
+// flash vars writes are cached, flushed every N seconds after first change (0 - write at once)
+void HAL_FlashVars_RunEverySecond();
+void HAL_FlashVars_Flush();
+void HAL_FlashVars_SetFlushInterval(int seconds);
+int HAL_FlashVars_GetFlushInterval();
+void HAL_FlashVars_GetStats(flashVarsStats_t* stats);
+
 #endif /* __HALK_FLASH_VARS_H__ */
 
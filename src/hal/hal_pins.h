@@ -11,6 +11,12 @@ void HAL_PIN_PWM_Update(int index, float value);
 int HAL_PIN_CanThisPinBePWM(int index);
 const char* HAL_PIN_GetPinNameAlias(int index);
 
+// Edge interrupt for input pins, callback is called from ISR context.
+// Returns 0 if pin (or platform) has no edge interrupts, caller must poll then.
+typedef void (*HAL_PinInterruptCallback)(int index);
+int HAL_AttachInterrupt(int index, int falling, HAL_PinInterruptCallback cb);
+void HAL_DetachInterrupt(int index);
+
 /// @brief Get the actual GPIO pin for the pin index.
 /// @param index 
 /// @return 
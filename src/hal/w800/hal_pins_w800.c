@@ -2,6 +2,7 @@
 
 #include "../../new_common.h"
 #include "../../logging/logging.h"
+#include "../hal_pins.h"
 
 #include "wm_include.h"
 
@@ -188,4 +189,11 @@ void HAL_PIN_PWM_Update(int index, float value) {
 unsigned int HAL_GetGPIOPin(int index) {
 	return g_pins[index].code;
 }
+
+int HAL_AttachInterrupt(int index, int falling, HAL_PinInterruptCallback cb) {
+	// not supported yet, pin is polled
+	return 0;
+}
+void HAL_DetachInterrupt(int index) {
+}
 #endif
@@ -1,5 +1,8 @@
 #ifdef WINDOWS
 
+// Stubs for the script only build, simulator uses hal_flashVars_bk7231.c
+// with TEST_MODE flash area
+
 #include "../hal_flashConfig.h"
 #include "../hal_flashVars.h"
 #include "../../logging/logging.h"
@@ -50,6 +53,24 @@ void HAL_FlashVars_SaveTotalConsumption(float total_consumption)
 {
 }
 
+void HAL_FlashVars_RunEverySecond()
+{
+}
+void HAL_FlashVars_Flush()
+{
+}
+void HAL_FlashVars_SetFlushInterval(int seconds)
+{
+}
+int HAL_FlashVars_GetFlushInterval()
+{
+	return 0;
+}
+void HAL_FlashVars_GetStats(flashVarsStats_t* stats)
+{
+	memset(stats, 0, sizeof(flashVarsStats_t));
+}
+
 #endif // WINDOWS
 
 
@@ -18,12 +18,19 @@ int g_simulatedPinStates[PLATFORM_GPIO_MAX];
 int g_simulatedPWMs[PLATFORM_GPIO_MAX];
 simulatedPinMode_t g_pinModes[PLATFORM_GPIO_MAX];
 int g_simulatedADCValues[PLATFORM_GPIO_MAX];
+// edge interrupts, fired from SIM_SetSimulatedPinValue
+HAL_PinInterruptCallback g_simulatedInterrupts[PLATFORM_GPIO_MAX];
+byte g_simulatedInterruptFalling[PLATFORM_GPIO_MAX];
+bool g_simulatedInterruptsEnabled = true;
+int g_simulatedPinReads;
 
 void SIM_Hack_ClearSimulatedPinRoles() {
 	memset(g_simulatedPinStates, 0, sizeof(g_simulatedPinStates));
 	memset(g_simulatedPWMs, 0, sizeof(g_simulatedPWMs));
 	memset(g_pinModes, 0, sizeof(g_pinModes));
 	memset(g_simulatedADCValues, 0, sizeof(g_simulatedADCValues));
+	memset(g_simulatedInterrupts, 0, sizeof(g_simulatedInterrupts));
+	g_simulatedInterruptsEnabled = true;
 }
 
 static int adcToGpio[] = {
@@ -58,7 +65,22 @@ int HAL_ADC_Read(int pinNumber) {
 	return g_simulatedADCValues[pinNumber];
 }
 void SIM_SetSimulatedPinValue(int pinIndex, bool bHigh) {
+	bool bFire;
+
+	bFire = g_simulatedPinStates[pinIndex] != bHigh
+		&& g_simulatedInterrupts[pinIndex]
+		&& g_simulatedInterruptFalling[pinIndex] != bHigh;
 	g_simulatedPinStates[pinIndex] = bHigh;
+	if (bFire) {
+		g_simulatedInterrupts[pinIndex](pinIndex);
+	}
+}
+// when disabled, HAL_AttachInterrupt fails like on platforms without it
+void SIM_SetPinInterruptsEnabled(bool bEnabled) {
+	g_simulatedInterruptsEnabled = bEnabled;
+}
+int SIM_GetPinReadCount() {
+	return g_simulatedPinReads;
 }
 bool SIM_GetSimulatedPinValue(int pinIndex) {
 	return g_simulatedPinStates[pinIndex];
@@ -186,6 +208,7 @@ void HAL_PIN_SetOutputValue(int index, int iVal) {
 }
 
 int HAL_PIN_ReadDigitalInput(int index) {
+	g_simulatedPinReads++;
 	return g_simulatedPinStates[index];
 }
 void HAL_PIN_Setup_Input_Pullup(int index) {
@@ -218,5 +241,16 @@ unsigned int HAL_GetGPIOPin(int index) {
 	return index;
 }
 
+int HAL_AttachInterrupt(int index, int falling, HAL_PinInterruptCallback cb) {
+	if (g_simulatedInterruptsEnabled == false)
+		return 0;
+	g_simulatedInterrupts[index] = cb;
+	g_simulatedInterruptFalling[index] = falling;
+	return 1;
+}
+void HAL_DetachInterrupt(int index) {
+	g_simulatedInterrupts[index] = 0;
+}
+
 #endif
 
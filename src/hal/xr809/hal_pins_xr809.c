@@ -2,6 +2,7 @@
 
 #include "../../new_common.h"
 #include "../../logging/logging.h"
+#include "../hal_pins.h"
 
 #include "driver/chip/hal_gpio.h"
 
@@ -133,5 +134,12 @@ unsigned int HAL_GetGPIOPin(int index) {
 	return xr_pin;
 }
 
+int HAL_AttachInterrupt(int index, int falling, HAL_PinInterruptCallback cb) {
+	// not supported yet, pin is polled
+	return 0;
+}
+void HAL_DetachInterrupt(int index) {
+}
+
 #endif
 
@@ -12,7 +12,7 @@ Switch - https://www.home-assistant.io/integrations/switch.mqtt/
 Sensor - https://www.home-assistant.io/integrations/sensor.mqtt/
 */
 
-//Buffer used to populate values in cJSON_Add* calls. The values are based on
+//Buffer used to format values written by hass_add_stringf. The values are based on
 //CFG_GetShortDeviceName and clientId so it needs to be bigger than them. +64 for light/switch/etc.
 static char g_hassBuffer[CGF_MQTT_CLIENT_ID_SIZE + 64];
 
@@ -99,52 +99,122 @@ void hass_populate_device_config_channel(ENTITY_TYPE type, char* uniq_id, HassDe
 	}
 }
 
-/// @brief Builds HomeAssistant device discovery info. The caller needs to free the returned pointer.
-/// @param ids 
-cJSON* hass_build_device_node(cJSON* ids) {
-	cJSON* dev = cJSON_CreateObject();
-	cJSON_AddItemToObject(dev, "ids", ids);     //identifiers
-	cJSON_AddStringToObject(dev, "name", CFG_GetShortDeviceName());
+/// @brief Appends text to the discovery JSON. Once something does not fit, jsonLen is moved past jsonSize and all further output is dropped.
+/// @param info 
+/// @param s 
+/// @param len 
+static void hass_json_append(HassDeviceInfo* info, const char* s, int len) {
+	if (info->jsonLen + len >= info->jsonSize) {
+		info->jsonLen = info->jsonSize;
+		return;
+	}
+	memcpy(info->json + info->jsonLen, s, len);
+	info->jsonLen += len;
+}
 
-#ifdef USER_SW_VER
-	cJSON_AddStringToObject(dev, "sw", USER_SW_VER);   //sw_version
-#endif
+/// @brief Appends a quoted JSON string, escaped the same way as cJSON does it.
+/// @param info 
+/// @param s 
+static void hass_json_append_string(HassDeviceInfo* info, const char* s) {
+	const unsigned char* p;
+	char esc[8];
+
+	hass_json_append(info, "\"", 1);
+	while (*s) {
+		//copy the run of characters that need no escaping at once
+		p = (const unsigned char*)s;
+		while (*p >= 32 && *p != '\"' && *p != '\\') {
+			p++;
+		}
+		if (p != (const unsigned char*)s) {
+			hass_json_append(info, s, (const char*)p - s);
+			s = (const char*)p;
+			continue;
+		}
+		switch (*p) {
+		case '\"': strcpy(esc, "\\\""); break;
+		case '\\': strcpy(esc, "\\\\"); break;
+		case '\b': strcpy(esc, "\\b"); break;
+		case '\f': strcpy(esc, "\\f"); break;
+		case '\n': strcpy(esc, "\\n"); break;
+		case '\r': strcpy(esc, "\\r"); break;
+		case '\t': strcpy(esc, "\\t"); break;
+		default: sprintf(esc, "\\u%04x", *p); break;
+		}
+		hass_json_append(info, esc, strlen(esc));
+		s++;
+	}
+	hass_json_append(info, "\"", 1);
+}
 
-	cJSON_AddStringToObject(dev, "mf", MANUFACTURER);   //manufacturer
-	cJSON_AddStringToObject(dev, "mdl", PLATFORM_MCU_NAME);  //Using chipset for model
+/// @brief Starts a new member in the current object, e.g. ,"key":
+/// @param info 
+/// @param key 
+static void hass_json_key(HassDeviceInfo* info, const char* key) {
+	if (info->jsonLen > 0 && info->jsonLen < info->jsonSize) {
+		char last = info->json[info->jsonLen - 1];
+		if (last != '{' && last != '[') {
+			hass_json_append(info, ",", 1);
+		}
+	}
+	hass_json_append_string(info, key);
+	hass_json_append(info, ":", 1);
+}
 
-	sprintf(g_hassBuffer, "http://%s/index", HAL_GetMyIPString());
-	cJSON_AddStringToObject(dev, "cu", g_hassBuffer);  //configuration_url
+static void hass_add_string(HassDeviceInfo* info, const char* key, const char* value) {
+	hass_json_key(info, key);
+	hass_json_append_string(info, value);
+}
 
-	return dev;
+/// @brief Adds a string member with printf-style formatted value.
+/// @param info 
+/// @param key 
+/// @param fmt 
+static void hass_add_stringf(HassDeviceInfo* info, const char* key, const char* fmt, ...) {
+	va_list argList;
+
+	va_start(argList, fmt);
+	vsnprintf(g_hassBuffer, sizeof(g_hassBuffer), fmt, argList);
+	va_end(argList);
+	hass_add_string(info, key, g_hassBuffer);
 }
 
-/// @brief Initializes HomeAssistant device discovery storage with common values.
-/// @param type 
-/// @param index This is used to generate generate unique_id and name. 
-/// It is ignored for RGB. For power sensors, index corresponds to sensor_mqttNames. For regular sensor, index can be be the channel.
-/// @param payload_on The payload that represents enabled state. This is not added for POWER_SENSOR.
-/// @param payload_off The payload that represents disabled state. This is not added for POWER_SENSOR.
-/// @return 
-HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, char* payload_on, char* payload_off) {
-	HassDeviceInfo* info = os_malloc(sizeof(HassDeviceInfo));
-	addLogAdv(LOG_DEBUG, LOG_FEATURE_HASS, "hass_init_device_info=%p", info);
+static void hass_add_number(HassDeviceInfo* info, const char* key, int value) {
+	char tmp[16];
 
-	hass_populate_unique_id(type, index, info->unique_id);
-	hass_populate_device_config_channel(type, info->unique_id, info);
+	hass_json_key(info, key);
+	sprintf(tmp, "%d", value);
+	hass_json_append(info, tmp, strlen(tmp));
+}
 
-	info->ids = cJSON_CreateArray();
-	cJSON_AddItemToArray(info->ids, cJSON_CreateString(CFG_GetDeviceName()));
+/// @brief Writes HomeAssistant device node and the values common to all entities.
+/// @param info 
+/// @param payload_on The payload that represents enabled state. This is not added for sensors.
+/// @param payload_off The payload that represents disabled state. This is not added for sensors.
+static void hass_write_common(HassDeviceInfo* info, const char* payload_on, const char* payload_off) {
+	bool isSensor = false;	//This does not count binary_sensor
+	int index = info->index;
 
-	info->device = hass_build_device_node(info->ids);
+	hass_json_append(info, "{", 1);
+	hass_json_key(info, "dev");    //device
+	hass_json_append(info, "{", 1);
+	hass_json_key(info, "ids");     //identifiers
+	hass_json_append(info, "[", 1);
+	hass_json_append_string(info, CFG_GetDeviceName());
+	hass_json_append(info, "]", 1);
+	hass_add_string(info, "name", CFG_GetShortDeviceName());
 
-	info->root = cJSON_CreateObject();
-	cJSON_AddItemToObject(info->root, "dev", info->device);    //device
+#ifdef USER_SW_VER
+	hass_add_string(info, "sw", USER_SW_VER);   //sw_version
+#endif
 
-	bool isSensor = false;	//This does not count binary_sensor
+	hass_add_string(info, "mf", MANUFACTURER);   //manufacturer
+	hass_add_string(info, "mdl", PLATFORM_MCU_NAME);  //Using chipset for model
+	hass_add_stringf(info, "cu", "http://%s/index", HAL_GetMyIPString());  //configuration_url
+	hass_json_append(info, "}", 1);
 
 	//Build the `name`
-	switch (type) {
+	switch (info->type) {
 	case LIGHT_PWM:
 	case RELAY:
 	case BINARY_SENSOR:
@@ -176,57 +246,61 @@ HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, char* payload
 		sprintf(g_hassBuffer, "%s Humidity", CFG_GetShortDeviceName());
 		break;
 	}
-	cJSON_AddStringToObject(info->root, "name", g_hassBuffer);
-	cJSON_AddStringToObject(info->root, "~", CFG_GetMQTTClientId());      //base topic
-	cJSON_AddStringToObject(info->root, "avty_t", "~/connected");   //availability_topic, `online` value is broadcasted
+	hass_add_string(info, "name", g_hassBuffer);
+	hass_add_string(info, "~", CFG_GetMQTTClientId());      //base topic
+	hass_add_string(info, "avty_t", "~/connected");   //availability_topic, `online` value is broadcasted
 
 	if (!isSensor) {	//Sensors (except binary_sensor) don't use payload 
-		cJSON_AddStringToObject(info->root, "pl_on", payload_on);    //payload_on
-		cJSON_AddStringToObject(info->root, "pl_off", payload_off);   //payload_off
+		hass_add_string(info, "pl_on", payload_on);    //payload_on
+		hass_add_string(info, "pl_off", payload_off);   //payload_off
 	}
 
-	cJSON_AddStringToObject(info->root, "uniq_id", info->unique_id);  //unique_id
-	cJSON_AddNumberToObject(info->root, "qos", 1);
-
-	addLogAdv(LOG_DEBUG, LOG_FEATURE_HASS, "root=%p", info->root);
-	return info;
+	hass_add_string(info, "uniq_id", info->unique_id);  //unique_id
+	hass_add_number(info, "qos", 1);
 }
 
-/// @brief Initializes HomeAssistant relay device discovery storage.
-/// @param index
-/// @return 
-HassDeviceInfo* hass_init_relay_device_info(int index) {
-	HassDeviceInfo* info = hass_init_device_info(RELAY, index, "1", "0");
+/// @brief Initializes HomeAssistant device discovery info for an entity.
+/// @param info 
+/// @param type 
+/// @param index This is used to generate generate unique_id and name. 
+/// It is ignored for RGB. For power sensors, index corresponds to sensor_mqttNames. For regular sensor, index can be be the channel.
+void hass_init_device_info(HassDeviceInfo* info, ENTITY_TYPE type, int index) {
+	info->type = type;
+	info->index = index;
+	hass_populate_unique_id(type, index, info->unique_id);
+	hass_populate_device_config_channel(type, info->unique_id, info);
+	info->json = NULL;
+	info->jsonSize = 0;
+	info->jsonLen = 0;
+}
 
-	sprintf(g_hassBuffer, "~/%i/get", index);
-	cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);   //state_topic
-	sprintf(g_hassBuffer, "~/%i/set", index);
-	cJSON_AddStringToObject(info->root, COMMAND_TOPIC_KEY, g_hassBuffer);    //command_topic
+/// @brief Writes HomeAssistant relay discovery values.
+/// @param info
+static void hass_write_relay(HassDeviceInfo* info) {
+	hass_write_common(info, "1", "0");
 
-	return info;
+	hass_add_stringf(info, STATE_TOPIC_KEY, "~/%i/get", info->index);   //state_topic
+	hass_add_stringf(info, COMMAND_TOPIC_KEY, "~/%i/set", info->index);    //command_topic
 }
 
-/// @brief Initializes HomeAssistant light device discovery storage.
-/// @param type 
-/// @return 
-HassDeviceInfo* hass_init_light_device_info(ENTITY_TYPE type) {
+/// @brief Writes HomeAssistant light discovery values.
+/// @param info
+static void hass_write_light(HassDeviceInfo* info) {
 	const char* clientId = CFG_GetMQTTClientId();
-	HassDeviceInfo* info = NULL;
-	double brightness_scale = 100;
+	ENTITY_TYPE type = info->type;
+	int brightness_scale = 100;
 
-	//We can just use 1 to generate unique_id and name for single PWM.
 	//The payload_on/payload_off have to match the state_topic/command_topic values.
-	info = hass_init_device_info(type, 1, "1", "0");
+	hass_write_common(info, "1", "0");
 
 	switch (type) {
 	case LIGHT_RGBCW:
 	case LIGHT_RGB:
-		cJSON_AddStringToObject(info->root, "rgb_cmd_tpl", "{{'#%02x%02x%02x0000'|format(red,green,blue)}}");  //rgb_command_template
-		cJSON_AddStringToObject(info->root, "rgb_val_tpl", "{{ value[0:2]|int(base=16) }},{{ value[2:4]|int(base=16) }},{{ value[4:6]|int(base=16) }}");  //rgb_value_template
+		hass_add_string(info, "rgb_cmd_tpl", "{{'#%02x%02x%02x0000'|format(red,green,blue)}}");  //rgb_command_template
+		hass_add_string(info, "rgb_val_tpl", "{{ value[0:2]|int(base=16) }},{{ value[2:4]|int(base=16) }},{{ value[4:6]|int(base=16) }}");  //rgb_value_template
 
-		cJSON_AddStringToObject(info->root, "rgb_stat_t", "~/led_basecolor_rgb/get"); //rgb_state_topic
-		sprintf(g_hassBuffer, "cmnd/%s/led_basecolor_rgb", clientId);
-		cJSON_AddStringToObject(info->root, "rgb_cmd_t", g_hassBuffer);  //rgb_command_topic
+		hass_add_string(info, "rgb_stat_t", "~/led_basecolor_rgb/get"); //rgb_state_topic
+		hass_add_stringf(info, "rgb_cmd_t", "cmnd/%s/led_basecolor_rgb", clientId);  //rgb_command_topic
 		break;
 
 	case LIGHT_PWM:
@@ -239,140 +313,141 @@ HassDeviceInfo* hass_init_light_device_info(ENTITY_TYPE type) {
 		//Using `last` (the default) will send any style (brightness, color, etc) topics first and then a payload_on to the command_topic. 
 		//Using `first` will send the payload_on and then any style topics. 
 		//Using `brightness` will only send brightness commands instead of the payload_on to turn the light on.
-		cJSON_AddStringToObject(info->root, "on_cmd_type", "first");	//on_command_type
+		hass_add_string(info, "on_cmd_type", "first");	//on_command_type
 		break;
 
 	default:
-		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "Unsupported light type %s", type);
+		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "Unsupported light type %i", type);
 	}
 
 	if ((type == LIGHT_PWMCW) || (type == LIGHT_RGBCW)) {
-		sprintf(g_hassBuffer, "cmnd/%s/led_temperature", clientId);
-		cJSON_AddStringToObject(info->root, "clr_temp_cmd_t", g_hassBuffer);    //color_temp_command_topic
+		hass_add_stringf(info, "clr_temp_cmd_t", "cmnd/%s/led_temperature", clientId);    //color_temp_command_topic
 
-		cJSON_AddStringToObject(info->root, "clr_temp_stat_t", "~/led_temperature/get");    //color_temp_state_topic
+		hass_add_string(info, "clr_temp_stat_t", "~/led_temperature/get");    //color_temp_state_topic
 	}
 
-	cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, "~/led_enableAll/get");  //state_topic
-	sprintf(g_hassBuffer, "cmnd/%s/led_enableAll", clientId);
-	cJSON_AddStringToObject(info->root, COMMAND_TOPIC_KEY, g_hassBuffer);  //command_topic
-
-	cJSON_AddStringToObject(info->root, "bri_stat_t", "~/led_dimmer/get");  //brightness_state_topic
-	sprintf(g_hassBuffer, "cmnd/%s/led_dimmer", clientId);
-	cJSON_AddStringToObject(info->root, "bri_cmd_t", g_hassBuffer);  //brightness_command_topic
+	hass_add_string(info, STATE_TOPIC_KEY, "~/led_enableAll/get");  //state_topic
+	hass_add_stringf(info, COMMAND_TOPIC_KEY, "cmnd/%s/led_enableAll", clientId);  //command_topic
 
-	cJSON_AddNumberToObject(info->root, "bri_scl", brightness_scale);	//brightness_scale
+	hass_add_string(info, "bri_stat_t", "~/led_dimmer/get");  //brightness_state_topic
+	hass_add_stringf(info, "bri_cmd_t", "cmnd/%s/led_dimmer", clientId);  //brightness_command_topic
 
-	return info;
+	hass_add_number(info, "bri_scl", brightness_scale);	//brightness_scale
 }
 
-/// @brief Initializes HomeAssistant binary sensor device discovery storage.
-/// @param index
-/// @return
-HassDeviceInfo* hass_init_binary_sensor_device_info(int index) {
-	HassDeviceInfo* info = hass_init_device_info(BINARY_SENSOR, index, "1", "0");
+/// @brief Writes HomeAssistant binary sensor discovery values.
+/// @param info
+static void hass_write_binary_sensor(HassDeviceInfo* info) {
+	hass_write_common(info, "1", "0");
 
-	sprintf(g_hassBuffer, "~/%i/get", index);
-	cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);   //state_topic
-
-	return info;
+	hass_add_stringf(info, STATE_TOPIC_KEY, "~/%i/get", info->index);   //state_topic
 }
 
 #ifndef OBK_DISABLE_ALL_DRIVERS
 
-/// @brief Initializes HomeAssistant power sensor device discovery storage.
-/// @param index Index corresponding to sensor_mqttNames.
-/// @return 
-HassDeviceInfo* hass_init_power_sensor_device_info(int index) {
-	HassDeviceInfo* info = hass_init_device_info(POWER_SENSOR, index, NULL, NULL);
+/// @brief Writes HomeAssistant power sensor discovery values.
+/// @param info Index corresponds to sensor_mqttNames.
+static void hass_write_power_sensor(HassDeviceInfo* info) {
+	int index = info->index;
+
+	hass_write_common(info, NULL, NULL);
 
 	//https://developers.home-assistant.io/docs/core/entity/sensor/#available-device-classes
 	//device_class automatically assigns unit,icon
 	if ((index >= OBK_VOLTAGE) && (index <= OBK_POWER))
 	{
-		cJSON_AddStringToObject(info->root, "dev_cla", sensor_mqtt_device_classes[index]);   //device_class=voltage,current,power
-		cJSON_AddStringToObject(info->root, "unit_of_meas", sensor_mqtt_device_units[index]);   //unit_of_measurement
+		hass_add_string(info, "dev_cla", sensor_mqtt_device_classes[index]);   //device_class=voltage,current,power
+		hass_add_string(info, "unit_of_meas", sensor_mqtt_device_units[index]);   //unit_of_measurement
 
-		sprintf(g_hassBuffer, "~/%s/get", sensor_mqttNames[index]);
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+		hass_add_stringf(info, STATE_TOPIC_KEY, "~/%s/get", sensor_mqttNames[index]);
 
-		cJSON_AddStringToObject(info->root, "stat_cla", "measurement");
+		hass_add_string(info, "stat_cla", "measurement");
 	}
 	else if ((index >= OBK_CONSUMPTION_TOTAL) && (index <= OBK_CONSUMPTION_STATS))
 	{
 		const char* device_class_value = counter_devClasses[index - OBK_CONSUMPTION_TOTAL];
 		if (strlen(device_class_value) > 0) {
-			cJSON_AddStringToObject(info->root, "dev_cla", device_class_value);  //device_class=energy
-			cJSON_AddStringToObject(info->root, "unit_of_meas", "Wh");   //unit_of_measurement
+			hass_add_string(info, "dev_cla", device_class_value);  //device_class=energy
+			hass_add_string(info, "unit_of_meas", "Wh");   //unit_of_measurement
 
 			//state_class can be measurement, total or total_increasing. Energy values should be total_increasing.
-			cJSON_AddStringToObject(info->root, "stat_cla", "total_increasing");
+			hass_add_string(info, "stat_cla", "total_increasing");
 		}
 
-		sprintf(g_hassBuffer, "~/%s/get", counter_mqttNames[index - OBK_CONSUMPTION_TOTAL]);
-		cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+		hass_add_stringf(info, STATE_TOPIC_KEY, "~/%s/get", counter_mqttNames[index - OBK_CONSUMPTION_TOTAL]);
 	}
-
-	return info;
 }
 
 #endif
 
-/// @brief Initializes HomeAssistant sensor device discovery storage.
-/// @param type
-/// @param channel
-/// @return 
-HassDeviceInfo* hass_init_sensor_device_info(ENTITY_TYPE type, int channel) {
+/// @brief Writes HomeAssistant sensor discovery values.
+/// @param info Index is the channel.
+static void hass_write_sensor(HassDeviceInfo* info) {
 	//Assuming that there is only one DHT setup per device which keeps uniqueid/names simpler
-	HassDeviceInfo* info = hass_init_device_info(type, channel, NULL, NULL);	//using channel as index to generate uniqueId
+	hass_write_common(info, NULL, NULL);
 
 	//https://developers.home-assistant.io/docs/core/entity/sensor/#available-device-classes
-	switch (type) {
+	switch (info->type) {
 	case TEMPERATURE_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "temperature");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "°C");
+		hass_add_string(info, "dev_cla", "temperature");
+		hass_add_string(info, "unit_of_meas", "°C");
 
 		//https://www.home-assistant.io/integrations/sensor.mqtt/ refers to value_template (val_tpl)
 		//{{ float(value)*0.1 }} for value=12 give 1.2000000000000002, using round() to limit the decimal places
-		cJSON_AddStringToObject(info->root, "val_tpl", "{{ float(value)*0.1|round(2) }}");
+		hass_add_string(info, "val_tpl", "{{ float(value)*0.1|round(2) }}");
 		break;
 	case HUMIDITY_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "humidity");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "%");
+		hass_add_string(info, "dev_cla", "humidity");
+		hass_add_string(info, "unit_of_meas", "%");
 		break;
-
 	default:
-		return NULL;
+		break;
 	}
 
-	sprintf(g_hassBuffer, "~/%d/get", channel);
-	cJSON_AddStringToObject(info->root, STATE_TOPIC_KEY, g_hassBuffer);
+	hass_add_stringf(info, STATE_TOPIC_KEY, "~/%d/get", info->index);
 
-	cJSON_AddStringToObject(info->root, "stat_cla", "measurement");
-	return info;
+	hass_add_string(info, "stat_cla", "measurement");
 }
 
-/// @brief Returns the discovery JSON.
+/// @brief Writes the discovery JSON for the entity straight into the given buffer, no JSON tree is built.
 /// @param info 
-/// @return 
-const char* hass_build_discovery_json(HassDeviceInfo* info) {
-	if (info == NULL) {
-		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "ERROR: someone passed NULL pointer to hass_build_discovery_json\r\n");
-		return "";
+/// @param out 
+/// @param outSize 
+/// @return Length of JSON (without terminator), or -1 if it did not fit
+int hass_build_discovery_json(HassDeviceInfo* info, char* out, int outSize) {
+	info->json = out;
+	info->jsonSize = outSize;
+	info->jsonLen = 0;
+
+	switch (info->type) {
+	case RELAY:
+		hass_write_relay(info);
+		break;
+	case LIGHT_PWM:
+	case LIGHT_PWMCW:
+	case LIGHT_RGB:
+	case LIGHT_RGBCW:
+		hass_write_light(info);
+		break;
+	case BINARY_SENSOR:
+		hass_write_binary_sensor(info);
+		break;
+	case POWER_SENSOR:
+#ifndef OBK_DISABLE_ALL_DRIVERS
+		hass_write_power_sensor(info);
+#endif
+		break;
+	case TEMPERATURE_SENSOR:
+	case HUMIDITY_SENSOR:
+		hass_write_sensor(info);
+		break;
 	}
-	cJSON_PrintPreallocated(info->root, info->json, HASS_JSON_SIZE, 0);
-	return info->json;
-}
-
-/// @brief Release allocated memory.
-/// @param info 
-void hass_free_device_info(HassDeviceInfo* info) {
-	if (info == NULL) return;
-	addLogAdv(LOG_DEBUG, LOG_FEATURE_HASS, "hass_free_device_info \r\n");
+	hass_json_append(info, "}", 1);
 
-	if (info->root != NULL) {
-		cJSON_Delete(info->root);
+	if (info->jsonLen >= info->jsonSize) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "Discovery JSON for %s does not fit in %i bytes\r\n", info->unique_id, outSize);
+		return -1;
 	}
-
-	os_free(info);
+	out[info->jsonLen] = 0;
+	return info->jsonLen;
 }
@@ -1,6 +1,5 @@
 
 #include "new_http.h"
-#include "../cJSON/cJSON.h"
 #include "../new_pins.h"
 #include "../mqtt/new_mqtt.h"
 
@@ -45,20 +44,17 @@ typedef enum {
 
 /// @brief HomeAssistant device discovery information
 typedef struct HassDeviceInfo_s {
+	ENTITY_TYPE type;
+	int index;
 	char unique_id[HASS_UNIQUE_ID_SIZE];
 	char channel[HASS_CHANNEL_SIZE];
-	char json[HASS_JSON_SIZE];
 
-	cJSON* root;
-	cJSON* device;
-	cJSON* ids;
+	//JSON is written straight into this buffer (usually the MQTT publish queue)
+	char* json;
+	int jsonSize;
+	int jsonLen;
 } HassDeviceInfo;
 
 void hass_print_unique_id(http_request_t* request, const char* fmt, ENTITY_TYPE type, int index);
-HassDeviceInfo* hass_init_relay_device_info(int index);
-HassDeviceInfo* hass_init_light_device_info(ENTITY_TYPE type);
-HassDeviceInfo* hass_init_power_sensor_device_info(int index);
-HassDeviceInfo* hass_init_binary_sensor_device_info(int index);
-HassDeviceInfo* hass_init_sensor_device_info(ENTITY_TYPE type, int channel);
-const char* hass_build_discovery_json(HassDeviceInfo* info);
-void hass_free_device_info(HassDeviceInfo* info);
+void hass_init_device_info(HassDeviceInfo* info, ENTITY_TYPE type, int index);
+int hass_build_discovery_json(HassDeviceInfo* info, char* out, int outSize);
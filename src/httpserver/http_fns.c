@@ -226,7 +226,7 @@ int http_fn_index(http_request_t* request) {
 	http_setup(request, httpMimeTypeHTML);	//Add mimetype regardless of the request
 
 	// use ?state URL parameter to only request current state
-	if (!http_getArg(request->url, "state", tmpA, sizeof(tmpA))) {
+	if (!http_getRequestArg(request, "state", tmpA, sizeof(tmpA))) {
 		http_html_start(request, NULL);
 
 		poststr(request, "<div id=\"changed\">");
@@ -240,7 +240,7 @@ int http_fn_index(http_request_t* request) {
 			DRV_HTTPButtons_ProcessChanges(request);
 		}
 #endif
-		if (http_getArg(request->url, "tgl", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "tgl", tmpA, sizeof(tmpA))) {
 			j = atoi(tmpA);
 			if (j == SPECIAL_CHANNEL_LEDPOWER) {
 				hprintf255(request, "<h3>Toggled LED power!</h3>", j);
@@ -250,12 +250,12 @@ int http_fn_index(http_request_t* request) {
 			}
 			CHANNEL_Toggle(j);
 		}
-		if (http_getArg(request->url, "on", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "on", tmpA, sizeof(tmpA))) {
 			j = atoi(tmpA);
 			hprintf255(request, "<h3>Enabled %s!</h3>", CHANNEL_GetLabel(j));
 			CHANNEL_Set(j, 255, 1);
 		}
-		if (http_getArg(request->url, "rgb", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "rgb", tmpA, sizeof(tmpA))) {
 			hprintf255(request, "<h3>Set RGB to %s!</h3>", tmpA);
 			LED_SetBaseColor(0, "led_basecolor", tmpA, 0);
 			// auto enable - but only for changes made from WWW panel
@@ -265,14 +265,14 @@ int http_fn_index(http_request_t* request) {
 			}
 		}
 
-		if (http_getArg(request->url, "off", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "off", tmpA, sizeof(tmpA))) {
 			j = atoi(tmpA);
 			hprintf255(request, "<h3>Disabled %s!</h3>", CHANNEL_GetLabel(j));
 			CHANNEL_Set(j, 0, 1);
 		}
-		if (http_getArg(request->url, "pwm", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "pwm", tmpA, sizeof(tmpA))) {
 			int newPWMValue = atoi(tmpA);
-			http_getArg(request->url, "pwmIndex", tmpA, sizeof(tmpA));
+			http_getRequestArg(request, "pwmIndex", tmpA, sizeof(tmpA));
 			j = atoi(tmpA);
 			if (j == SPECIAL_CHANNEL_TEMPERATURE) {
 				hprintf255(request, "<h3>Changed Temperature to %i!</h3>", newPWMValue);
@@ -290,9 +290,9 @@ int http_fn_index(http_request_t* request) {
 				}
 			}
 		}
-		if (http_getArg(request->url, "dim", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "dim", tmpA, sizeof(tmpA))) {
 			int newDimmerValue = atoi(tmpA);
-			http_getArg(request->url, "dimIndex", tmpA, sizeof(tmpA));
+			http_getRequestArg(request, "dimIndex", tmpA, sizeof(tmpA));
 			j = atoi(tmpA);
 			if (j == SPECIAL_CHANNEL_BRIGHTNESS) {
 				hprintf255(request, "<h3>Changed LED brightness to %i!</h3>", newDimmerValue);
@@ -310,18 +310,18 @@ int http_fn_index(http_request_t* request) {
 				}
 			}
 		}
-		if (http_getArg(request->url, "set", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "set", tmpA, sizeof(tmpA))) {
 			int newSetValue = atoi(tmpA);
-			http_getArg(request->url, "setIndex", tmpA, sizeof(tmpA));
+			http_getRequestArg(request, "setIndex", tmpA, sizeof(tmpA));
 			j = atoi(tmpA);
 			hprintf255(request, "<h3>Changed channel %s to %i!</h3>", CHANNEL_GetLabel(j), newSetValue);
 			CHANNEL_Set(j, newSetValue, 1);
 		}
-		if (http_getArg(request->url, "restart", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "restart", tmpA, sizeof(tmpA))) {
 			poststr(request, "<h5> Module will restart soon</h5>");
 			RESET_ScheduleModuleReset(3);
 		}
-		if (http_getArg(request->url, "unsafe", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "unsafe", tmpA, sizeof(tmpA))) {
 			poststr(request, "<h5> Will try to do unsafe init in few seconds</h5>");
 			MAIN_ScheduleUnsafeInit(3);
 		}
@@ -884,7 +884,7 @@ int http_fn_index(http_request_t* request) {
 
 	}
 	// for normal page loads, show the rest of the HTML
-	if (!http_getArg(request->url, "state", tmpA, sizeof(tmpA))) {
+	if (!http_getRequestArg(request, "state", tmpA, sizeof(tmpA))) {
 		poststr(request, "</div>"); // end div#state
 
 		// Shared UI elements 
@@ -953,22 +953,22 @@ int http_fn_cfg_mqtt_set(http_request_t* request) {
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "Saving MQTT");
 
-	if (http_getArg(request->url, "host", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "host", tmpA, sizeof(tmpA))) {
 		CFG_SetMQTTHost(tmpA);
 	}
-	if (http_getArg(request->url, "port", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "port", tmpA, sizeof(tmpA))) {
 		CFG_SetMQTTPort(atoi(tmpA));
 	}
-	if (http_getArg(request->url, "user", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "user", tmpA, sizeof(tmpA))) {
 		CFG_SetMQTTUserName(tmpA);
 	}
-	if (http_getArg(request->url, "password", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "password", tmpA, sizeof(tmpA))) {
 		CFG_SetMQTTPass(tmpA);
 	}
-	if (http_getArg(request->url, "client", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "client", tmpA, sizeof(tmpA))) {
 		CFG_SetMQTTClientId(tmpA);
 	}
-	if (http_getArg(request->url, "group", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "group", tmpA, sizeof(tmpA))) {
 		CFG_SetMQTTGroupTopic(tmpA);
 	}
 
@@ -1006,7 +1006,7 @@ int http_fn_cfg_webapp_set(http_request_t* request) {
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "Saving Webapp");
 
-	if (http_getArg(request->url, "url", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "url", tmpA, sizeof(tmpA))) {
 		CFG_SetWebappRoot(tmpA);
 		CFG_Save_IfThereArePendingChanges();
 		hprintf255(request, "Webapp url set to %s", tmpA);
@@ -1040,7 +1040,7 @@ int http_fn_cfg_ping(http_request_t* request) {
 	poststr(request, " This is why <b>this mechanism</b> has been added.</p>");
 	poststr(request, "<p> This mechanism keeps pinging certain host and reconnects to WiFi if it doesn't respond at all for a certain amount of seconds.</p>");
 	poststr(request, "<p> USAGE: For a host, choose the main address of your router and make sure it responds to a pings. Interval is 1 second or so, timeout can be set by user, to eg. 60 sec</p>");
-	if (http_getArg(request->url, "host", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "host", tmpA, sizeof(tmpA))) {
 		CFG_SetPingHost(tmpA);
 		poststr(request, "<h4> New ping host set!</h4>");
 		bChanged = 1;
@@ -1050,12 +1050,12 @@ int http_fn_cfg_ping(http_request_t* request) {
 		 poststr(request,"<h4> New ping interval set!</h4>");
 		 bChanged = 1;
 	 }*/
-	if (http_getArg(request->url, "disconnectTime", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "disconnectTime", tmpA, sizeof(tmpA))) {
 		CFG_SetPingDisconnectedSecondsToRestart(atoi(tmpA));
 		poststr(request, "<h4> New ping disconnectTime set!</h4>");
 		bChanged = 1;
 	}
-	if (http_getArg(request->url, "clear", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "clear", tmpA, sizeof(tmpA))) {
 		CFG_SetPingDisconnectedSecondsToRestart(0);
 		CFG_SetPingIntervalSeconds(0);
 		CFG_SetPingHost("");
@@ -1103,7 +1103,7 @@ int http_fn_cfg_wifi(http_request_t* request) {
 		poststr(request,"<h4> Device will reconnect after restarting</h4>");
 	}*/
 	poststr(request, "<h2> Check networks reachable by module</h2> This will lag few seconds.<br>");
-	if (http_getArg(request->url, "scan", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "scan", tmpA, sizeof(tmpA))) {
 #ifdef WINDOWS
 
 		poststr(request, "Not available on Windows<br>");
@@ -1174,10 +1174,10 @@ int http_fn_cfg_name(http_request_t* request) {
 	http_html_start(request, "Set name");
 
 	poststr(request, "<h2> Change device names for display. </h2>");
-	if (http_getArg(request->url, "shortName", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "shortName", tmpA, sizeof(tmpA))) {
 		CFG_SetShortDeviceName(tmpA);
 	}
-	if (http_getArg(request->url, "name", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "name", tmpA, sizeof(tmpA))) {
 		CFG_SetDeviceName(tmpA);
 	}
 	CFG_Save_IfThereArePendingChanges();
@@ -1207,16 +1207,16 @@ int http_fn_cfg_wifi_set(http_request_t* request) {
 
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "Saving Wifi");
-	if (http_getArg(request->url, "open", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "open", tmpA, sizeof(tmpA))) {
 		CFG_SetWiFiSSID("");
 		CFG_SetWiFiPass("");
 		poststr(request, "WiFi mode set: open access point.");
 	}
 	else {
-		if (http_getArg(request->url, "ssid", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "ssid", tmpA, sizeof(tmpA))) {
 			CFG_SetWiFiSSID(tmpA);
 		}
-		if (http_getArg(request->url, "pass", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "pass", tmpA, sizeof(tmpA))) {
 			CFG_SetWiFiPass(tmpA);
 		}
 		poststr(request, "WiFi mode set: connect to WLAN.");
@@ -1241,7 +1241,7 @@ int http_fn_cfg_loglevel_set(http_request_t* request) {
 
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "Set log level");
-	if (http_getArg(request->url, "loglevel", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "loglevel", tmpA, sizeof(tmpA))) {
 #if WINDOWS
 #else
 		loglevel = atoi(tmpA);
@@ -1279,7 +1279,7 @@ int http_fn_cfg_mac(http_request_t* request) {
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "Set MAC address");
 
-	if (http_getArg(request->url, "mac", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "mac", tmpA, sizeof(tmpA))) {
 		for (i = 0; i < 6; i++)
 		{
 			mac[i] = hexbyte(&tmpA[i * 2]);
@@ -1324,15 +1324,15 @@ int http_fn_flash_read_tool(http_request_t* request) {
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "Flash read");
 	poststr(request, "<h4>Flash Read Tool</h4>");
-	if (http_getArg(request->url, "hex", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "hex", tmpA, sizeof(tmpA))) {
 		hex = atoi(tmpA);
 	}
 	else {
 		hex = 0;
 	}
 
-	if (http_getArg(request->url, "offset", tmpA, sizeof(tmpA)) &&
-		http_getArg(request->url, "len", tmpB, sizeof(tmpB))) {
+	if (http_getRequestArg(request, "offset", tmpA, sizeof(tmpA)) &&
+		http_getRequestArg(request, "len", tmpB, sizeof(tmpB))) {
 		unsigned char buffer[128];
 		len = atoi(tmpB);
 		ofs = atoi(tmpA);
@@ -1433,7 +1433,7 @@ int http_fn_cmd_tool(http_request_t* request) {
 	poststr(request, "Please consider using 'Web Application' console with more options and real time log view. <br>");
 	poststr(request, "Remember that some commands are added after a restart when a driver is activated... <br>");
 
-	commandLen = http_getArg(request->url, "cmd", tmpA, sizeof(tmpA));
+	commandLen = http_getRequestArg(request, "cmd", tmpA, sizeof(tmpA));
 	if (commandLen) {
 		poststr(request, "<br>");
 		// all log printfs made by command will be sent also to request
@@ -1442,7 +1442,7 @@ int http_fn_cmd_tool(http_request_t* request) {
 			commandLen += 8;
 			long_str_alloced = (char*)malloc(commandLen);
 			if (long_str_alloced) {
-				http_getArg(request->url, "cmd", long_str_alloced, commandLen);
+				http_getRequestArg(request, "cmd", long_str_alloced, commandLen);
 				res = CMD_ExecuteCommand(long_str_alloced, COMMAND_FLAG_SOURCE_CONSOLE);
 				free(long_str_alloced);
 			}
@@ -1479,7 +1479,7 @@ int http_fn_startup_command(http_request_t* request) {
 		"You can use them to init peripherals and drivers, like BL0942 energy sensor. "
 		"Use backlog cmd1; cmd2; cmd3; etc to enter multiple commands</p>");
 
-	if (http_getArg(request->url, "data", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "data", tmpA, sizeof(tmpA))) {
 		//  hprintf255(request,"<h3>Set command to  %s!</h3>",tmpA);
 		  // tmpA can be longer than 128 bytes and this would crash
 		hprintf255(request, "<h3>Command changed!</h3>");
@@ -1507,7 +1507,7 @@ int http_fn_uart_tool(http_request_t* request) {
 	http_html_start(request, "UART tool");
 	poststr(request, "<h4>UART Tool</h4>");
 
-	if (http_getArg(request->url, "data", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "data", tmpA, sizeof(tmpA))) {
 #ifdef ENABLE_DRIVER_TUYAMCU
 		byte results[128];
 
@@ -1574,7 +1574,7 @@ int http_fn_cfg_quick(http_request_t* request) {
 	poststr(request, "<h3><a href=\"https://openbekeniot.github.io/webapp/devicesList.html\">Also please see here</a></h3>");
 
 
-	/*if (http_getArg(request->url, "dev", tmpA, sizeof(tmpA))) {
+	/*if (http_getRequestArg(request, "dev", tmpA, sizeof(tmpA))) {
 		j = atoi(tmpA);
 		hprintf255(request, "<h3>Set dev %i!</h3>", j);
 		g_templates[j].setter();
@@ -1593,120 +1593,182 @@ int http_fn_cfg_quick(http_request_t* request) {
 	return 0;
 }
 
-void doHomeAssistantDiscovery(const char *topic, http_request_t *request) {
-	int i;
-	int relayCount;
+// HomeAssistant discovery is not queued all at once. Entities are walked by an iterator
+// and each one is written straight into the MQTT publish queue. When the queue is full,
+// discovery resumes on the next tick.
+typedef enum {
+	HASS_DISCOVERY_RELAYS,
+	HASS_DISCOVERY_INPUTS,
+	HASS_DISCOVERY_LIGHT,
+	HASS_DISCOVERY_POWER,
+	HASS_DISCOVERY_SENSORS,
+	HASS_DISCOVERY_DONE
+} hassDiscoveryStage_t;
+
+typedef struct hassDiscoveryIterator_s {
+	char topic[32];
+	hassDiscoveryStage_t stage;
+	int index;
 	int pwmCount;
-	int dInputCount;
 	bool ledDriverChipRunning;
-	HassDeviceInfo* dev_info = NULL;
-	bool measuringPower = false;
-	struct cJSON_Hooks hooks;
-	bool discoveryQueued = false;
-
-	if (topic == 0 || *topic == 0) {
-		topic = "homeassistant";
-	}
+	bool measuringPower;
+	// entity that goes next
+	ENTITY_TYPE type;
+	int entityIndex;
+} hassDiscoveryIterator_t;
+
+static hassDiscoveryIterator_t g_hassDiscovery;
+static bool g_hassDiscoveryActive = false;
+
+/// @brief Moves the iterator to the next entity to be discovered.
+/// @param it 
+/// @return false if there are no more entities
+static bool HassDiscovery_Next(hassDiscoveryIterator_t* it) {
+	int i;
 
+	while (it->stage != HASS_DISCOVERY_DONE) {
+		switch (it->stage) {
+		case HASS_DISCOVERY_RELAYS:
+			while (it->index < CHANNEL_MAX) {
+				i = it->index++;
+				if (h_isChannelRelay(i)) {
+					it->type = RELAY;
+					it->entityIndex = i;
+					return true;
+				}
+			}
+			break;
+		case HASS_DISCOVERY_INPUTS:
+			while (it->index < CHANNEL_MAX) {
+				i = it->index++;
+				if (h_isChannelDigitalInput(i)) {
+					it->type = BINARY_SENSOR;
+					it->entityIndex = i;
+					return true;
+				}
+			}
+			break;
+		case HASS_DISCOVERY_LIGHT:
+			// there is at most one light, we can just use 1 to generate unique_id and name
+			it->stage++;
+			it->index = 0;
+			it->entityIndex = 1;
+			if (it->pwmCount == 5 || it->ledDriverChipRunning) {
+				// Enable + RGB control + CW control
+				it->type = LIGHT_RGBCW;
+				return true;
+			}
+			if (it->pwmCount == 4) {
+				addLogAdv(LOG_ERROR, LOG_FEATURE_HTTP, "4 PWM device not yet handled\r\n");
+				continue;
+			}
+			if (it->pwmCount == 3) {
+				// Enable + RGB control
+				it->type = LIGHT_RGB;
+				return true;
+			}
+			if (it->pwmCount == 2) {
+				// PWM + Temperature (https://github.com/openshwprojects/OpenBK7231T_App/issues/279)
+				it->type = LIGHT_PWMCW;
+				return true;
+			}
+			if (it->pwmCount > 0) {
+				it->type = LIGHT_PWM;
+				return true;
+			}
+			continue;
+		case HASS_DISCOVERY_POWER:
 #ifndef OBK_DISABLE_ALL_DRIVERS
-	measuringPower = DRV_IsMeasuringPower();
+			if (it->measuringPower && it->index < OBK_NUM_SENSOR_COUNT) {
+				it->type = POWER_SENSOR;
+				it->entityIndex = it->index++;
+				return true;
+			}
 #endif
-
-	get_Relay_PWM_Count(&relayCount, &pwmCount, &dInputCount);
-
-	ledDriverChipRunning = LED_IsLedDriverChipRunning();
-
-	hooks.malloc_fn = os_malloc;
-	hooks.free_fn = os_free;
-	cJSON_InitHooks(&hooks);
-
-	if (relayCount > 0) {
-		for (i = 0; i < CHANNEL_MAX; i++) {
-			if (h_isChannelRelay(i)) {
-				dev_info = hass_init_relay_device_info(i);
-				MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-				hass_free_device_info(dev_info);
-				dev_info = NULL;
-				discoveryQueued = true;
+			break;
+		case HASS_DISCOVERY_SENSORS:
+			// every sensor pin gives two entities, temperature and humidity
+			while (it->index < PLATFORM_GPIO_MAX * 2) {
+				i = it->index++;
+				if (IS_PIN_DHT_ROLE(g_cfg.pins.roles[i / 2]) || IS_PIN_TEMP_HUM_SENSOR_ROLE(g_cfg.pins.roles[i / 2])) {
+					if (i & 1) {
+						it->type = HUMIDITY_SENSOR;
+						it->entityIndex = PIN_GetPinChannel2ForPinIndex(i / 2);
+					}
+					else {
+						it->type = TEMPERATURE_SENSOR;
+						it->entityIndex = PIN_GetPinChannelForPinIndex(i / 2);
+					}
+					return true;
+				}
 			}
+			break;
+		default:
+			break;
 		}
+		it->stage++;
+		it->index = 0;
 	}
+	return false;
+}
 
-	if (dInputCount > 0) {
-		for (i = 0; i < CHANNEL_MAX; i++) {
-			if (h_isChannelDigitalInput(i)) {
-				dev_info = hass_init_binary_sensor_device_info(i);
-				MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-				hass_free_device_info(dev_info);
-				dev_info = NULL;
-				discoveryQueued = true;
-			}
-		}
-	}
+/// @brief Queues as many discovery entities as the MQTT publish queue can take now.
+void doHomeAssistantDiscoveryStep() {
+	HassDeviceInfo info;
+	char* json;
+	int len;
 
-	if (pwmCount == 5 || ledDriverChipRunning) {
-		if (dev_info == NULL) {
-			dev_info = hass_init_light_device_info(LIGHT_RGBCW);
+	while (g_hassDiscoveryActive) {
+		if (MQTT_IsReady() == false) {
+			return;
 		}
-		// Enable + RGB control + CW control
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-		hass_free_device_info(dev_info);
-		dev_info = NULL;
-		discoveryQueued = true;
-	}
-	else if (pwmCount > 0) {
-		if (pwmCount == 4) {
-			addLogAdv(LOG_ERROR, LOG_FEATURE_HTTP, "4 PWM device not yet handled\r\n");
-		}
-		else if (pwmCount == 3) {
-			// Enable + RGB control
-			dev_info = hass_init_light_device_info(LIGHT_RGB);
-		}
-		else if (pwmCount == 2) {
-			// PWM + Temperature (https://github.com/openshwprojects/OpenBK7231T_App/issues/279)
-			dev_info = hass_init_light_device_info(LIGHT_PWMCW);
-		}
-		else {
-			dev_info = hass_init_light_device_info(LIGHT_PWM);
+		hass_init_device_info(&info, g_hassDiscovery.type, g_hassDiscovery.entityIndex);
+		json = MQTT_QueuePublish_Begin(g_hassDiscovery.topic, info.channel, HASS_JSON_SIZE, OBK_PUBLISH_FLAG_RETAIN);
+		if (json == NULL) {
+			// queue is full, continue on next tick
+			return;
 		}
+		len = hass_build_discovery_json(&info, json, HASS_JSON_SIZE + 1);
+		MQTT_QueuePublish_End(len);
 
-		if (dev_info != NULL) {
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-			dev_info = NULL;
-			discoveryQueued = true;
+		if (HassDiscovery_Next(&g_hassDiscovery) == false) {
+			g_hassDiscoveryActive = false;
+			if (len >= 0) {
+				MQTT_InvokeCommandAtEnd(PublishChannels);
+			}
+			addLogAdv(LOG_INFO, LOG_FEATURE_HTTP, "HA discovery queued\r\n");
 		}
 	}
+}
 
-#ifndef OBK_DISABLE_ALL_DRIVERS
-	if (measuringPower == true) {
-		for (i = 0; i < OBK_NUM_SENSOR_COUNT; i++)
-		{
-			dev_info = hass_init_power_sensor_device_info(i);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
-			discoveryQueued = true;
-		}
+void doHomeAssistantDiscovery(const char *topic, http_request_t *request) {
+	int relayCount;
+	int dInputCount;
+	hassDiscoveryIterator_t* it = &g_hassDiscovery;
+
+	if (topic == 0 || *topic == 0) {
+		topic = "homeassistant";
 	}
+
+	g_hassDiscoveryActive = false;
+	memset(it, 0, sizeof(*it));
+	strcpy_safe(it->topic, topic, sizeof(it->topic));
+
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	it->measuringPower = DRV_IsMeasuringPower();
 #endif
 
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (IS_PIN_DHT_ROLE(g_cfg.pins.roles[i]) || IS_PIN_TEMP_HUM_SENSOR_ROLE(g_cfg.pins.roles[i])) {
-			dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, PIN_GetPinChannelForPinIndex(i));
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
+	get_Relay_PWM_Count(&relayCount, &it->pwmCount, &dInputCount);
 
-			dev_info = hass_init_sensor_device_info(HUMIDITY_SENSOR, PIN_GetPinChannel2ForPinIndex(i));
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
-			hass_free_device_info(dev_info);
+	it->ledDriverChipRunning = LED_IsLedDriverChipRunning();
 
-			discoveryQueued = true;
+	if (HassDiscovery_Next(it)) {
+		g_hassDiscoveryActive = true;
+		// the HTTP handler only starts it, main loop does the rest
+		if (request == 0) {
+			doHomeAssistantDiscoveryStep();
 		}
 	}
-
-	if (discoveryQueued) {
-		MQTT_InvokeCommandAtEnd(PublishChannels);
-	}
 	else {
 		const char *msg = "No relay, PWM, sensor or power driver running.";
 		if (request) {
@@ -1735,7 +1797,7 @@ int http_fn_ha_discovery(http_request_t* request) {
 
 	// even if it returns the empty HA topic,
 	// the function call below will set default
-	http_getArg(request->url, "prefix", topic, sizeof(topic));
+	http_getRequestArg(request, "prefix", topic, sizeof(topic));
 	doHomeAssistantDiscovery(topic, request);
 
 	poststr(request, "MQTT discovery queued.");
@@ -1983,13 +2045,13 @@ int http_fn_cm(http_request_t* request) {
 
 	http_setup(request, httpMimeTypeJson);
 	// exec command
-	commandLen = http_getArg(request->url, "cmnd", tmpA, sizeof(tmpA));
+	commandLen = http_getRequestArg(request, "cmnd", tmpA, sizeof(tmpA));
 	if (commandLen) {
 		if (commandLen > (sizeof(tmpA) - 5)) {
 			commandLen += 8;
 			long_str_alloced = (char*)malloc(commandLen);
 			if (long_str_alloced) {
-				http_getArg(request->url, "cmnd", long_str_alloced, commandLen);
+				http_getRequestArg(request, "cmnd", long_str_alloced, commandLen);
 				CMD_ExecuteCommand(long_str_alloced, COMMAND_FLAG_SOURCE_HTTP);
 				JSON_ProcessCommandReply(long_str_alloced, skipToNextWord(long_str_alloced), request, (jsonCb_t)hprintf255, COMMAND_FLAG_SOURCE_HTTP);
 				free(long_str_alloced);
@@ -2065,7 +2127,7 @@ int http_fn_cfg_pins(http_request_t* request) {
 #endif
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
 		sprintf(tmpA, "%i", i);
-		if (http_getArg(request->url, tmpA, tmpB, sizeof(tmpB))) {
+		if (http_getRequestArg(request, tmpA, tmpB, sizeof(tmpB))) {
 			int role;
 			int pr;
 
@@ -2080,7 +2142,7 @@ int http_fn_cfg_pins(http_request_t* request) {
 			}
 		}
 		sprintf(tmpA, "r%i", i);
-		if (http_getArg(request->url, tmpA, tmpB, sizeof(tmpB))) {
+		if (http_getRequestArg(request, tmpA, tmpB, sizeof(tmpB))) {
 			int rel;
 			int prevRel;
 
@@ -2095,7 +2157,7 @@ int http_fn_cfg_pins(http_request_t* request) {
 			}
 		}
 		sprintf(tmpA, "e%i", i);
-		if (http_getArg(request->url, tmpA, tmpB, sizeof(tmpB))) {
+		if (http_getRequestArg(request, tmpA, tmpB, sizeof(tmpB))) {
 			int rel;
 			int prevRel;
 
@@ -2255,7 +2317,7 @@ int http_fn_cfg_generic(http_request_t* request) {
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "Generic config");
 
-	if (http_getArg(request->url, "boot_ok_delay", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "boot_ok_delay", tmpA, sizeof(tmpA))) {
 		i = atoi(tmpA);
 		if (i <= 0) {
 			poststr(request, "<h5>Boot ok delay must be at least 1 second<h5>");
@@ -2265,12 +2327,12 @@ int http_fn_cfg_generic(http_request_t* request) {
 		CFG_SetBootOkSeconds(i);
 	}
 
-	if (http_getArg(request->url, "setFlags", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "setFlags", tmpA, sizeof(tmpA))) {
 		for (i = 0; i < OBK_TOTAL_FLAGS; i++) {
 			int ni;
 			sprintf(tmpB, "flag%i", i);
 
-			if (http_getArg(request->url, tmpB, tmpA, sizeof(tmpA))) {
+			if (http_getRequestArg(request, tmpB, tmpA, sizeof(tmpA))) {
 				ni = atoi(tmpA);
 			}
 			else {
@@ -2330,9 +2392,9 @@ int http_fn_cfg_startup(http_request_t* request) {
 	hprintf255(request, "<a href='cfg_generic'>Flag 12 - %s</a>", g_obk_flagNames[12]);
 	poststr(request, "</li></ul>");
 
-	if (http_getArg(request->url, "idx", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "idx", tmpA, sizeof(tmpA))) {
 		channelIndex = atoi(tmpA);
-		if (http_getArg(request->url, "value", tmpA, sizeof(tmpA))) {
+		if (http_getRequestArg(request, "value", tmpA, sizeof(tmpA))) {
 			newValue = atoi(tmpA);
 
 
@@ -2376,31 +2438,31 @@ int http_fn_cfg_dgr(http_request_t* request) {
 
 	hprintf255(request, "<h5>Here you can configure Tasmota Device Groups<h5>");
 
-	if (http_getArg(request->url, "bSet", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "bSet", tmpA, sizeof(tmpA))) {
 		bForceSet = true;
 	}
 	else {
 		bForceSet = false;
 	}
 
-	if (http_getArg(request->url, "name", tmpA, sizeof(tmpA)) || bForceSet) {
+	if (http_getRequestArg(request, "name", tmpA, sizeof(tmpA)) || bForceSet) {
 		int newSendFlags;
 		int newRecvFlags;
 
 		newSendFlags = 0;
 		newRecvFlags = 0;
 
-		if (http_getArgInteger(request->url, "s_pwr"))
+		if (http_getRequestArgInteger(request, "s_pwr"))
 			newSendFlags |= DGR_SHARE_POWER;
-		if (http_getArgInteger(request->url, "r_pwr"))
+		if (http_getRequestArgInteger(request, "r_pwr"))
 			newRecvFlags |= DGR_SHARE_POWER;
-		if (http_getArgInteger(request->url, "s_lbr"))
+		if (http_getRequestArgInteger(request, "s_lbr"))
 			newSendFlags |= DGR_SHARE_LIGHT_BRI;
-		if (http_getArgInteger(request->url, "r_lbr"))
+		if (http_getRequestArgInteger(request, "r_lbr"))
 			newRecvFlags |= DGR_SHARE_LIGHT_BRI;
-		if (http_getArgInteger(request->url, "s_lcl"))
+		if (http_getRequestArgInteger(request, "s_lcl"))
 			newSendFlags |= DGR_SHARE_LIGHT_COLOR;
-		if (http_getArgInteger(request->url, "r_lcl"))
+		if (http_getRequestArgInteger(request, "r_lcl"))
 			newRecvFlags |= DGR_SHARE_LIGHT_COLOR;
 
 		CFG_DeviceGroups_SetName(tmpA);
@@ -2485,7 +2547,7 @@ int http_fn_ota_exec(http_request_t* request) {
 
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "OTA request");
-	if (http_getArg(request->url, "host", tmpA, sizeof(tmpA))) {
+	if (http_getRequestArg(request, "host", tmpA, sizeof(tmpA))) {
 		hprintf255(request, "<h3>OTA requested for %s!</h3>", tmpA);
 		addLogAdv(LOG_INFO, LOG_FEATURE_HTTP, "http_fn_ota_exec: will try to do OTA for %s \r\n", tmpA);
 		OTA_RequestDownloadFromHTTP(tmpA);
@@ -3,6 +3,7 @@
 
 // TODO: move it out 
 void doHomeAssistantDiscovery(const char *topic, http_request_t *request);
+void doHomeAssistantDiscoveryStep();
 
 int http_fn_about(http_request_t* request);
 int http_fn_cfg_mqtt(http_request_t* request);
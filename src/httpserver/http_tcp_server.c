@@ -22,26 +22,71 @@
 #define HTTP_CLIENT_STACK_SIZE 2048
 #endif
 
-#define CREATE_THREAD_PER_EACH_HTTP_CLIENT
+// fixed pool of workers, each with buffers allocated once, fed with accepted
+// sockets by the server thread - instead of a new thread and two mallocs per
+// request, which fragmented the heap and made every request pay for a thread
+#define HTTP_WORKER_POOL
 
-#ifdef CREATE_THREAD_PER_EACH_HTTP_CLIENT
+#if PLATFORM_XR809
+// right now, I am getting OS_ThreadCreate failures everytime on XR809 platform,
+// so use main server thread there (blocking all other clients)
+#undef HTTP_WORKER_POOL
+#endif
 
+// no recv on a client socket blocks for longer than HTTP_CLIENT_RECV_TIMEOUT_MS
+static void tcp_client_setRecvTimeout(int fd)
+{
+	struct timeval tv;
 
-#if PLATFORM_XR809
+	tv.tv_sec = HTTP_CLIENT_RECV_TIMEOUT_MS / 1000;
+	tv.tv_usec = (HTTP_CLIENT_RECV_TIMEOUT_MS % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
 
-#define DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT 1
+#ifdef HTTP_WORKER_POOL
 
-#endif
+#define HTTP_WORKER_COUNT				2
+// accepted sockets waiting for a free worker
+#define HTTP_PENDING_CLIENTS			4
+// how long the server waits for a free worker before dropping a socket
+#define HTTP_PENDING_TIMEOUT_MS			2000
+// keep-alive connection is closed after this much idle time...
+#define HTTP_KEEPALIVE_IDLE_MS			5000
+// ...checked in slices, so a waiting client doesn't wait for the whole idle time
+#define HTTP_KEEPALIVE_POLL_MS			250
+// ...or after this many requests
+#define HTTP_KEEPALIVE_MAX_REQUESTS		100
 
 static void tcp_server_thread(beken_thread_arg_t arg);
-static void tcp_client_thread(beken_thread_arg_t arg);
+static void tcp_worker_thread(beken_thread_arg_t arg);
 
 
 xTaskHandle g_http_thread = NULL;
+static xQueueHandle g_http_clients = NULL;
 
 void HTTPServer_Start()
 {
 	OSStatus err = kNoErr;
+	int i;
+
+	g_http_clients = xQueueCreate(HTTP_PENDING_CLIENTS, sizeof(int));
+	if (g_http_clients == NULL)
+	{
+		ADDLOG_ERROR(LOG_FEATURE_HTTP, "create HTTP client queue failed!\r\n");
+		return;
+	}
+	for (i = 0; i < HTTP_WORKER_COUNT; i++)
+	{
+		err = rtos_create_thread(NULL, BEKEN_APPLICATION_PRIORITY,
+			"HTTP Client",
+			(beken_thread_function_t)tcp_worker_thread,
+			HTTP_CLIENT_STACK_SIZE,
+			(beken_thread_arg_t)i);
+		if (err != kNoErr)
+		{
+			ADDLOG_ERROR(LOG_FEATURE_HTTP, "create \"HTTP Client\" thread %i failed with %i!\r\n", i, err);
+		}
+	}
 
 	err = rtos_create_thread(&g_http_thread, BEKEN_APPLICATION_PRIORITY,
 		"TCP_server",
@@ -62,76 +107,114 @@ int sendfn(int fd, char* data, int len) {
 	return -1;
 }
 
-static void tcp_client_thread(beken_thread_arg_t arg)
+// waits for the first request, or the next one on a keep-alive connection
+static int tcp_client_waitForRequest(int fd, int timeoutMs, int bYieldToWaiting)
 {
-	OSStatus err = kNoErr;
-	int fd = (int)arg;
-	//fd_set readfds, errfds, readfds2;
-	char* buf = NULL;
-	char* reply = NULL;
-	int replyBufferSize = REPLY_BUFFER_SIZE;
-	//int res;
-	//char reply[8192];
-
-  //my_fd = fd;
-	rtos_delay_milliseconds(20);
-
-	reply = (char*)os_malloc(replyBufferSize);
-	buf = (char*)os_malloc(INCOMING_BUFFER_SIZE);
+	fd_set readfds;
+	struct timeval tv;
+	int waited;
 
-	if (buf == 0 || reply == 0)
+	for (waited = 0; waited < timeoutMs; waited += HTTP_KEEPALIVE_POLL_MS)
 	{
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP Client failed to malloc buffer");
-		goto exit;
+		// someone else is waiting for a worker, let them in
+		if (bYieldToWaiting && uxQueueMessagesWaiting(g_http_clients) > 0)
+			return 0;
+		FD_ZERO(&readfds);
+		FD_SET(fd, &readfds);
+		tv.tv_sec = 0;
+		tv.tv_usec = HTTP_KEEPALIVE_POLL_MS * 1000;
+		if (select(fd + 1, &readfds, NULL, NULL, &tv) != 0)
+			return FD_ISSET(fd, &readfds);
 	}
+	return 0;
+}
+
+// returns true if the connection can be kept open for the next request
+static int tcp_client_serveRequest(int fd, char* buf, char* reply, int requestIndex, int bAllowKeepAlive)
+{
 	http_request_t request;
+	int lenret;
+
 	os_memset(&request, 0, sizeof(request));
 
 	request.fd = fd;
 	request.received = buf;
 	request.receivedLenmax = INCOMING_BUFFER_SIZE - 2;
 	request.responseCode = HTTP_RESPONSE_OK;
-	request.receivedLen = recv(fd, request.received, request.receivedLenmax, 0);
-	request.received[request.receivedLen] = 0;
+	request.receivedLen = HTTP_ReadRequest(&request);
 
 	request.reply = reply;
 	request.replylen = 0;
 	reply[0] = '\0';
 
-	request.replymaxlen = replyBufferSize - 1;
+	request.replymaxlen = REPLY_BUFFER_SIZE - 1;
+	request.keepAlive = bAllowKeepAlive;
 
 	if (request.receivedLen <= 0)
 	{
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP Client is disconnected, fd: %d", fd);
-		goto exit;
+		// closing an idle keep-alive connection is normal
+		if (requestIndex == 0)
+			ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP Client is disconnected, fd: %d", fd);
+		return 0;
 	}
 
-	//addLog( "TCP received string %s\n",buf );
 	// returns length to be sent if any
-	 // ADDLOG_DEBUG(LOG_FEATURE_HTTP,  "TCP will process packet of len %i\n", request.receivedLen );
-	int lenret = HTTP_ProcessPacket(&request);
+	lenret = HTTP_ProcessPacket(&request);
+	if (request.chunked) {
+		return http_endReply(&request);
+	}
 	if (lenret > 0) {
 		ADDLOG_DEBUG(LOG_FEATURE_HTTP, "TCP sending reply len %i\n", lenret);
 		send(fd, reply, lenret, 0);
 	}
+	return 0;
+}
 
-	//rtos_delay_milliseconds(10);
-
-exit:
-	if (err != kNoErr)
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP client thread exit with err: %d", err);
+static void tcp_worker_thread(beken_thread_arg_t arg)
+{
+	char* buf;
+	char* reply;
+	int fd;
+	int i;
 
-	if (buf != NULL)
-		os_free(buf);
-	if (reply != NULL)
-		os_free(reply);
+	(void)(arg);
 
-	lwip_close(fd);;
-#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
+	// allocated once and reused by all requests served by this worker
+	reply = (char*)os_malloc(REPLY_BUFFER_SIZE);
+	buf = (char*)os_malloc(INCOMING_BUFFER_SIZE);
+	if (buf == 0 || reply == 0)
+	{
+		ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP worker failed to malloc buffer");
+		if (buf != NULL)
+			os_free(buf);
+		if (reply != NULL)
+			os_free(reply);
+		rtos_delete_thread(NULL);
+		return;
+	}
 
-#else
-	rtos_delete_thread(NULL);
-#endif
+	while (1)
+	{
+		if (xQueueReceive(g_http_clients, &fd, portMAX_DELAY) != pdTRUE)
+			continue;
+		for (i = 0; i < HTTP_KEEPALIVE_MAX_REQUESTS; i++)
+		{
+			// also bounds the wait for the first request, in case lwIP is built without SO_RCVTIMEO
+			if (i == 0) {
+				if (!tcp_client_waitForRequest(fd, HTTP_CLIENT_RECV_TIMEOUT_MS, 0)) {
+					ADDLOG_DEBUG(LOG_FEATURE_HTTP, "TCP Client sent nothing, closing, fd: %d", fd);
+					break;
+				}
+			}
+			else if (!tcp_client_waitForRequest(fd, HTTP_KEEPALIVE_IDLE_MS, 1)) {
+				break;
+			}
+			if (!tcp_client_serveRequest(fd, buf, reply, i,
+				i + 1 < HTTP_KEEPALIVE_MAX_REQUESTS && uxQueueMessagesWaiting(g_http_clients) == 0))
+				break;
+		}
+		lwip_close(fd);
+	}
 }
 
 /* TCP server listener thread */
@@ -141,7 +224,6 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 	OSStatus err = kNoErr;
 	struct sockaddr_in server_addr, client_addr;
 	socklen_t sockaddr_t_size = sizeof(client_addr);
-	char client_ip_str[16];
 	int tcp_listen_fd = -1, client_fd = -1;
 	fd_set readfds;
 
@@ -166,51 +248,15 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 			client_fd = accept(tcp_listen_fd, (struct sockaddr*)&client_addr, &sockaddr_t_size);
 			if (client_fd >= 0)
 			{
-#if PLATFORM_XR809
-#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
-
-#else
-				OS_Thread_t clientThreadUnused;
-#endif
-#endif
-				os_strcpy(client_ip_str, inet_ntoa(client_addr.sin_addr));
-				//  ADDLOG_DEBUG(LOG_FEATURE_HTTP,  "TCP Client %s:%d connected, fd: %d", client_ip_str, client_addr.sin_port, client_fd );
-#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
-				// Use main server thread (blocking all other clients)
-				// right now, I am getting OS_ThreadCreate everytime on XR809 platform
-				tcp_client_thread((beken_thread_arg_t)client_fd);
-#else
-				// delay each accept by 20ms
-				// this allows previous to finish if
-				// in a loop of sends from the browser, e.g. OTA
-				// and we MUST get some IDLE thread time, else
-				// thread resources are not deleted.
-				rtos_delay_milliseconds(20);
-				// Create separate thread for client
-				if (kNoErr !=
-#if PLATFORM_XR809
-					OS_ThreadCreate(&clientThreadUnused,
-						"HTTP Client",
-						tcp_client_thread,
-						client_fd,
-						OS_THREAD_PRIO_CONSOLE,
-						0x400)
-
-#else
-					rtos_create_thread(NULL, BEKEN_APPLICATION_PRIORITY,
-						"HTTP Client",
-						(beken_thread_function_t)tcp_client_thread,
-						HTTP_CLIENT_STACK_SIZE,
-						(beken_thread_arg_t)client_fd)
-
-#endif
-					)
+				//  ADDLOG_DEBUG(LOG_FEATURE_HTTP,  "TCP Client %s:%d connected, fd: %d", inet_ntoa(client_addr.sin_addr), client_addr.sin_port, client_fd );
+				tcp_client_setRecvTimeout(client_fd);
+				// hand it to the first free worker
+				if (xQueueSend(g_http_clients, &client_fd, HTTP_PENDING_TIMEOUT_MS / portTICK_PERIOD_MS) != pdTRUE)
 				{
-					ADDLOG_DEBUG(LOG_FEATURE_HTTP, "TCP Client %s:%d thread creation failed! fd: %d", client_ip_str, client_addr.sin_port, client_fd);
+					ADDLOG_DEBUG(LOG_FEATURE_HTTP, "TCP Client %s:%d dropped, all workers busy! fd: %d", inet_ntoa(client_addr.sin_addr), client_addr.sin_port, client_fd);
 					lwip_close(client_fd);
 					client_fd = -1;
 				}
-#endif
 			}
 		}
 	}
@@ -247,8 +293,7 @@ static void tcp_client_thread(int fd, char* buf, char* reply)
 	request.received = buf;
 	request.receivedLenmax = INCOMING_BUFFER_SIZE - 1;
 	request.responseCode = HTTP_RESPONSE_OK;
-	request.receivedLen = recv(fd, request.received, request.receivedLenmax, 0);
-	request.received[request.receivedLen] = 0;
+	request.receivedLen = HTTP_ReadRequest(&request);
 
 	request.reply = reply;
 	request.replylen = 0;
@@ -309,7 +354,9 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 				os_strcpy(client_ip_str, inet_ntoa(client_addr.sin_addr));
 				//  ADDLOG_DEBUG(LOG_FEATURE_HTTP,  "TCP Client %s:%d connected, fd: %d", client_ip_str, client_addr.sin_port, client_fd );
 
-				tcp_client_thread(client_fd, reply, buf);
+				// this one blocks the whole server, so even more important
+				tcp_client_setRecvTimeout(client_fd);
+				tcp_client_thread(client_fd, buf, reply);
 
 				lwip_close(client_fd);
 			}
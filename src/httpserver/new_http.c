@@ -83,7 +83,47 @@ typedef struct http_callback_tag {
 static http_callback_t* callbacks[MAX_HTTP_CALLBACKS];
 static int numCallbacks = 0;
 
+typedef struct http_route_tag {
+	const char* url;
+	http_callback_fn callback;
+} http_route_t;
+
+// built-in pages, MUST be sorted by url (strcmp order)
+static const http_route_t builtinRoutes[] = {
+	{ "", http_fn_empty_url },
+	{ "about", http_fn_about },
+	{ "cfg", http_fn_cfg },
+	{ "cfg_dgr", http_fn_cfg_dgr },
+	{ "cfg_generic", http_fn_cfg_generic },
+	{ "cfg_loglevel_set", http_fn_cfg_loglevel_set },
+	{ "cfg_mac", http_fn_cfg_mac },
+	{ "cfg_mqtt", http_fn_cfg_mqtt },
+	{ "cfg_mqtt_set", http_fn_cfg_mqtt_set },
+	{ "cfg_name", http_fn_cfg_name },
+	{ "cfg_ping", http_fn_cfg_ping },
+	{ "cfg_pins", http_fn_cfg_pins },
+	{ "cfg_quick", http_fn_cfg_quick },
+	{ "cfg_startup", http_fn_cfg_startup },
+	{ "cfg_webapp", http_fn_cfg_webapp },
+	{ "cfg_webapp_set", http_fn_cfg_webapp_set },
+	{ "cfg_wifi", http_fn_cfg_wifi },
+	{ "cfg_wifi_set", http_fn_cfg_wifi_set },
+	{ "cm", http_fn_cm },
+	{ "cmd_tool", http_fn_cmd_tool },
+	{ "flash_read_tool", http_fn_flash_read_tool },
+	{ "ha_cfg", http_fn_ha_cfg },
+	{ "ha_discovery", http_fn_ha_discovery },
+	{ "index", http_fn_index },
+	{ "ota", http_fn_ota },
+	{ "ota_exec", http_fn_ota_exec },
+	{ "startup_command", http_fn_startup_command },
+	{ "testmsg", http_fn_testmsg },
+	{ "uart_tool", http_fn_uart_tool },
+};
+#define NUM_BUILTIN_ROUTES (sizeof(builtinRoutes) / sizeof(builtinRoutes[0]))
+
 int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback) {
+	http_callback_t* newCallback;
 	int i;
 
 	if (!url || !callback) {
@@ -92,7 +132,7 @@ int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback
 	if (numCallbacks >= MAX_HTTP_CALLBACKS) {
 		return -4;
 	}
-	for (i = 0; i < MAX_HTTP_CALLBACKS; i++) {
+	for (i = 0; i < numCallbacks; i++) {
 		if (callbacks[i]) {
 			if (callbacks[i]->callback == callback && !strcmp(callbacks[i]->url, url)
 				&& callbacks[i]->method == method) {
@@ -100,24 +140,42 @@ int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback
 			}
 		}
 	}
-	callbacks[numCallbacks] = (http_callback_t*)os_malloc(sizeof(http_callback_t));
-	if (!callbacks[numCallbacks]) {
+	newCallback = (http_callback_t*)os_malloc(sizeof(http_callback_t));
+	if (!newCallback) {
 		return -2;
 	}
-	callbacks[numCallbacks]->url = (char*)os_malloc(strlen(url) + 1);
-	if (!callbacks[numCallbacks]->url) {
-		os_free(callbacks[numCallbacks]);
+	newCallback->url = (char*)os_malloc(strlen(url) + 1);
+	if (!newCallback->url) {
+		os_free(newCallback);
 		return -3;
 	}
-	strcpy(callbacks[numCallbacks]->url, url);
-	callbacks[numCallbacks]->callback = callback;
-	callbacks[numCallbacks]->method = method;
+	strcpy(newCallback->url, url);
+	newCallback->callback = callback;
+	newCallback->method = method;
 
+	callbacks[numCallbacks] = newCallback;
 	numCallbacks++;
 
 	// success
 	return 0;
 }
+int HTTP_UnregisterCallback(const char* url, int method, http_callback_fn callback) {
+	int i;
+
+	for (i = 0; i < numCallbacks; i++) {
+		if (callbacks[i]->callback == callback && !strcmp(callbacks[i]->url, url)
+			&& callbacks[i]->method == method) {
+			os_free(callbacks[i]->url);
+			os_free(callbacks[i]);
+			numCallbacks--;
+			// keep registration order, first match wins
+			memmove(&callbacks[i], &callbacks[i + 1], (numCallbacks - i) * sizeof(callbacks[0]));
+			callbacks[numCallbacks] = 0;
+			return 0;
+		}
+	}
+	return -1;
+}
 
 int my_strnicmp(const char* a, const char* b, int len) {
 	int i;
@@ -216,6 +274,48 @@ bool http_checkUrlBase(const char* base, const char* fileName) {
 	return true;
 }
 
+// chunk size goes into a fixed width placeholder before the body,
+// so the buffer never has to be moved when the chunk is sent
+#define HTTP_CHUNK_HEADER_LEN	6 // "%04x\r\n"
+#define HTTP_CHUNK_TRAILER_LEN	2 // "\r\n"
+#define HTTP_LAST_CHUNK			"0\r\n\r\n"
+#define HTTP_LAST_CHUNK_LEN		5
+
+static void http_startChunk(http_request_t* request) {
+	request->replylen += HTTP_CHUNK_HEADER_LEN;
+	request->chunkStart = request->replylen;
+}
+
+// fills in the chunk size and adds the trailer
+static void http_finishChunk(http_request_t* request) {
+	char hdr[HTTP_CHUNK_HEADER_LEN + 1];
+	int len = request->replylen - request->chunkStart;
+
+	if (len == 0) {
+		// empty chunk would end the reply, drop the placeholder instead
+		request->replylen -= HTTP_CHUNK_HEADER_LEN;
+		return;
+	}
+	snprintf(hdr, sizeof(hdr), "%04x\r\n", len);
+	memcpy(request->reply + request->chunkStart - HTTP_CHUNK_HEADER_LEN, hdr, HTTP_CHUNK_HEADER_LEN);
+	memcpy(request->reply + request->replylen, "\r\n", HTTP_CHUNK_TRAILER_LEN);
+	request->replylen += HTTP_CHUNK_TRAILER_LEN;
+}
+
+static void http_sendReply(http_request_t* request) {
+	if (request->chunked) {
+		http_finishChunk(request);
+	}
+	if (request->replylen > 0) {
+		send(request->fd, request->reply, request->replylen, 0);
+	}
+	request->reply[0] = 0;
+	request->replylen = 0;
+	if (request->chunked) {
+		http_startChunk(request);
+	}
+}
+
 void http_setup(http_request_t* request, const char* type) {
 	hprintf255(request, httpHeader, request->responseCode, type);
 	poststr(request, "\r\n"); // next header
@@ -234,9 +334,23 @@ void http_setup(http_request_t* request, const char* type) {
 	poststr(request, "Transfer-Encoding: chunked");
 #endif
 	poststr(request, "\r\n");
-	poststr(request, "Connection: close");
+#if PLATFORM_BL602
+	// postany sends directly there, there is no buffer to frame chunks in
+	request->keepAlive = 0;
+#endif
+	if (request->keepAlive) {
+		// length is not known up front, so keep-alive needs chunks
+		poststr(request, "Connection: keep-alive\r\nTransfer-Encoding: chunked");
+	}
+	else {
+		poststr(request, "Connection: close");
+	}
 	poststr(request, "\r\n"); // end headers with double CRLF
 	poststr(request, "\r\n");
+	if (request->keepAlive) {
+		request->chunked = 1;
+		http_startChunk(request);
+	}
 }
 
 void http_html_start(http_request_t* request, const char* pagename) {
@@ -382,6 +496,54 @@ int http_getArgInteger(const char* base, const char* name) {
 	return atoi(tmp);
 }
 
+// records where query arguments of request->url start, url is not modified
+static void http_tokenizeQuery(http_request_t* request) {
+	const char* p;
+
+	request->numqueryitems = 0;
+	p = strchr(request->url, '?');
+	if (p == 0)
+		return;
+	p++;
+	while (*p && request->numqueryitems < MAX_QUERY) {
+		request->querynames[request->numqueryitems] = (char*)p;
+		while (*p && *p != '=' && *p != '&')
+			p++;
+		if (*p == '=')
+			p++;
+		// points at '&' or end if there is no value
+		request->queryvalues[request->numqueryitems] = (char*)p;
+		request->numqueryitems++;
+		while (*p && *p != '&')
+			p++;
+		if (*p == '&')
+			p++;
+	}
+}
+
+// like http_getArg on request->url, using offsets from http_tokenizeQuery
+int http_getRequestArg(http_request_t* request, const char* name, char* o, int maxSize) {
+	int i;
+
+	for (i = 0; i < request->numqueryitems; i++) {
+		if (http_checkArg(request->querynames[i], name)) {
+			return http_copyCarg(request->queryvalues[i], o, maxSize);
+		}
+	}
+	if (request->numqueryitems == MAX_QUERY) {
+		// there may be more than we have recorded
+		return http_getArg(request->url, name, o, maxSize);
+	}
+	*o = '\0';
+	return 0;
+}
+int http_getRequestArgInteger(http_request_t* request, const char* name) {
+	char tmp[16];
+	if (http_getRequestArg(request, name, tmp, sizeof(tmp)) == 0)
+		return 0;
+	return atoi(tmp);
+}
+
 const char* htmlPinRoleNames[] = {
 	" ",
 	"Rel",
@@ -488,47 +650,297 @@ int postany(http_request_t* request, const char* str, int len) {
 	send(request->fd, str, len, 0);
 	return 0;
 #else
-	int currentlen;
-	int addlen = len;
+	int space;
+	int sends = 0;
 
 	if (NULL == str) {
 		// fd will be NULL for unit tests where HTTP packet is faked locally
 		if (request->fd == 0) {
+			if (request->chunked) {
+				// frame it in place, so test sees the same bytes as the client would
+				http_finishChunk(request);
+				http_startChunk(request);
+			}
 			return request->replylen;
 		}
-		if (request->replylen > 0) {
-			send(request->fd, request->reply, request->replylen, 0);
-		}
-		request->reply[0] = 0;
-		request->replylen = 0;
+		http_sendReply(request);
 		return 0;
 	}
 
-	currentlen = request->replylen;
-	if (currentlen + addlen >= request->replymaxlen) {
-		send(request->fd, request->reply, request->replylen, 0);
-		request->reply[0] = 0;
-		request->replylen = 0;
-		currentlen = 0;
-	}
-	while (addlen >= request->replymaxlen) {
-		if (request->replylen > 0) {
-			send(request->fd, request->reply, request->replylen, 0);
-			request->replylen = 0;
+	while (len > 0) {
+		space = request->replymaxlen - request->replylen - 1;
+		if (request->chunked) {
+			space -= HTTP_CHUNK_TRAILER_LEN + HTTP_LAST_CHUNK_LEN;
+		}
+		if (space <= 0) {
+			http_sendReply(request);
+			// large writes (files, OTA pages) - give lwIP some time between sends
+			if (sends++) {
+				rtos_delay_milliseconds(1);
+			}
+			continue;
 		}
-		send(request->fd, str, (request->replymaxlen - 1), 0);
-		addlen -= (request->replymaxlen - 1);
-		str += (request->replymaxlen - 1);
+		if (space > len) {
+			space = len;
+		}
+		memcpy(request->reply + request->replylen, str, space);
+		request->replylen += space;
+		str += space;
+		len -= space;
+	}
+	return request->replylen;
+#endif
+}
 
-		rtos_delay_milliseconds(1);
+#ifdef WINDOWS
+// unit tests fake the rest of the request arriving in segments, see http_recv
+static const char* sim_recvData = 0;
+static int sim_recvLeft = 0;
+static int sim_recvSegment = 0;
+static int sim_recvCalls = 0;
+// client keeps the connection open but sends nothing more
+static int sim_recvStalled = 0;
+// simulated time it takes each segment to arrive
+static int sim_recvSegmentDelay = 0;
+extern int g_simulatedTimeNow;
+
+void SIM_HTTP_SetPendingData(const char* data, int len, int segmentSize) {
+	sim_recvData = data;
+	sim_recvLeft = len;
+	sim_recvSegment = segmentSize;
+	if (data) {
+		sim_recvCalls = 0;
 	}
+}
+void SIM_HTTP_SetStalled(int bStalled) {
+	sim_recvStalled = bStalled;
+}
+void SIM_HTTP_SetSegmentDelay(int ms) {
+	sim_recvSegmentDelay = ms;
+}
+int SIM_HTTP_GetRecvCalls() {
+	return sim_recvCalls;
+}
+#endif
 
-	memcpy(request->reply + request->replylen, str, addlen);
-	request->replylen += addlen;
-	return (currentlen + addlen);
+static int http_recv(http_request_t* request, char* o, int maxLen) {
+	if (request->fd) {
+		return recv(request->fd, o, maxLen, 0);
+	}
+#ifdef WINDOWS
+	sim_recvCalls++;
+	if (maxLen > sim_recvLeft)
+		maxLen = sim_recvLeft;
+	if (maxLen > sim_recvSegment)
+		maxLen = sim_recvSegment;
+	if (maxLen > 0) {
+		memcpy(o, sim_recvData, maxLen);
+		sim_recvData += maxLen;
+		sim_recvLeft -= maxLen;
+		g_simulatedTimeNow += sim_recvSegmentDelay;
+	}
+	else if (sim_recvStalled) {
+		// as the socket would, after its receive timeout
+		g_simulatedTimeNow += HTTP_CLIENT_RECV_TIMEOUT_MS;
+		return -1;
+	}
+	return maxLen;
+#else
+	return 0;
 #endif
 }
 
+#ifndef portTICK_RATE_MS
+#define portTICK_RATE_MS ((portTickType)1000/configTICK_RATE_HZ)
+#endif
+
+static unsigned int http_getTimeMs() {
+#if defined(PLATFORM_BEKEN) || defined(WINDOWS)
+	return rtos_get_time();
+#else
+	return xTaskGetTickCount() * portTICK_RATE_MS;
+#endif
+}
+
+int HTTP_ReadRequest(http_request_t* request) {
+	int len;
+	int searchFrom;
+	unsigned int start;
+
+	request->receivedLen = 0;
+	request->received[0] = 0;
+	start = http_getTimeMs();
+	do {
+		len = http_recv(request, request->received + request->receivedLen,
+			request->receivedLenmax - request->receivedLen);
+		if (len <= 0) {
+			break;
+		}
+		// end of headers may be split between segments
+		searchFrom = request->receivedLen - 3;
+		if (searchFrom < 0)
+			searchFrom = 0;
+		request->receivedLen += len;
+		request->received[request->receivedLen] = 0;
+		if (strstr(request->received + searchFrom, "\r\n\r\n")) {
+			break;
+		}
+		// each recv is bounded by the socket timeout, but the whole header must be too
+		if (http_getTimeMs() - start >= HTTP_HEADER_TIMEOUT_MS) {
+			ADDLOG_ERROR(LOG_FEATURE_HTTP, "HTTP headers not complete after %i ms, dropping client", HTTP_HEADER_TIMEOUT_MS);
+			return -1;
+		}
+	} while (request->receivedLen < request->receivedLenmax);
+
+	if (request->receivedLen > 0) {
+		return request->receivedLen;
+	}
+	return len;
+}
+
+// body bytes as they are on the wire - first what came with the headers, then socket
+static int http_readRaw(http_request_t* request, char* o, int maxLen) {
+	int len;
+
+	len = request->bodyNextLen;
+	if (len > 0) {
+		if (len > maxLen)
+			len = maxLen;
+		// may be read into the incoming buffer itself
+		memmove(o, request->bodyNext, len);
+		request->bodyNext += len;
+		request->bodyNextLen -= len;
+		return len;
+	}
+	return http_recv(request, o, maxLen);
+}
+
+// reads a CRLF terminated line, keeps as much as fits in o
+static int http_readLine(http_request_t* request, char* o, int maxLen) {
+	int len = 0;
+	char c;
+
+	while (1) {
+		if (request->bodyNextLen == 0) {
+			// a few bytes at once instead of a recv per character,
+			// what's past the line is returned as data later
+			request->bodyNext = request->bodyLookahead;
+			request->bodyNextLen = http_recv(request, request->bodyLookahead, sizeof(request->bodyLookahead));
+			if (request->bodyNextLen <= 0) {
+				request->bodyNextLen = 0;
+				return -1;
+			}
+		}
+		if (http_readRaw(request, &c, 1) != 1)
+			return -1;
+		if (c == '\n')
+			break;
+		if (c != '\r' && len < maxLen - 1)
+			o[len++] = c;
+	}
+	o[len] = 0;
+	return len;
+}
+
+int http_readBody(http_request_t* request, char* o, int maxLen) {
+	char line[16];
+	int len;
+
+	if (request->bodyDone) {
+		return 0;
+	}
+	if (request->bodyChunked && request->bodyLeft == 0) {
+		// size line, after the CRLF that ends previous chunk
+		do {
+			len = http_readLine(request, line, sizeof(line));
+		} while (len == 0);
+		if (len < 0) {
+			request->bodyDone = 1;
+			return -1;
+		}
+		request->bodyLeft = strtol(line, 0, 16);
+		if (request->bodyLeft <= 0) {
+			// last chunk, skip trailers up to the empty line
+			do {
+				len = http_readLine(request, line, sizeof(line));
+			} while (len > 0);
+			request->bodyLeft = 0;
+			request->bodyDone = 1;
+			return 0;
+		}
+	}
+	if (request->bodyLeft <= 0) {
+		request->bodyDone = 1;
+		return 0;
+	}
+	if (maxLen > request->bodyLeft) {
+		maxLen = request->bodyLeft;
+	}
+	len = http_readRaw(request, o, maxLen);
+	if (len <= 0) {
+		ADDLOGF_ERROR("HTTP body ended %i bytes early", request->bodyLeft);
+		request->bodyDone = 1;
+		return -1;
+	}
+	request->bodyLeft -= len;
+	return len;
+}
+
+char* http_getBody(http_request_t* request) {
+	int len, total, maxLen;
+
+	if (request->bodystart == 0) {
+		request->bodystart = request->received + request->receivedLen;
+		request->bodylen = 0;
+	}
+	// decoded body is never longer than raw, so it can be read in place
+	maxLen = request->received + request->receivedLenmax - request->bodystart;
+	total = 0;
+	while (total < maxLen) {
+		len = http_readBody(request, request->bodystart + total, maxLen - total);
+		if (len <= 0)
+			break;
+		total += len;
+	}
+	if (request->bodyDone == 0 && request->bodyLeft > 0) {
+		ADDLOGF_ERROR("HTTP body too long, kept %i bytes", total);
+	}
+	request->bodystart[total] = 0;
+	request->bodylen = total;
+	request->bodyNext = request->bodystart + total;
+	request->bodyNextLen = 0;
+	return request->bodystart;
+}
+
+// nothing of this request left unread on the socket
+static int http_isBodyConsumed(http_request_t* request) {
+	if (request->bodyChunked) {
+		return request->bodyDone;
+	}
+	return request->bodyLeft <= request->bodyNextLen;
+}
+
+int http_endReply(http_request_t* request) {
+	if (request->chunked == 0) {
+		return 0;
+	}
+	// next request would start in the middle of this body
+	if (!http_isBodyConsumed(request)) {
+		request->keepAlive = 0;
+	}
+	http_finishChunk(request);
+	// last chunk, no trailers
+	memcpy(request->reply + request->replylen, HTTP_LAST_CHUNK, HTTP_LAST_CHUNK_LEN);
+	request->replylen += HTTP_LAST_CHUNK_LEN;
+	if (request->fd) {
+		send(request->fd, request->reply, request->replylen, 0);
+		request->replylen = 0;
+	}
+	request->reply[request->replylen] = 0;
+	request->chunked = 0;
+	return request->keepAlive;
+}
+
 
 // add some more output safely, sending if necessary.
 // call with str == NULL to force send.
@@ -551,11 +963,58 @@ int hprintf255(http_request_t* request, const char* fmt, ...) {
 }
 
 
+// compares key with url up to '?', strcmp-like order
+static int http_compareUrlBase(const char* key, const char* url) {
+	while (*url != 0 && *url != '?' && *url != ' ') {
+		if (*key != *url)
+			return (unsigned char)*key - (unsigned char)*url;
+		key++;
+		url++;
+	}
+	return (unsigned char)*key;
+}
+
+// first registered callback whose url is a prefix of urlStr, with this method (or HTTP_ANY).
+// Prefixes may overlap (eg. "/api/" and "/api/extra"), so this is a plain scan;
+// there are only a few registered callbacks.
+static http_callback_fn HTTP_FindCallback(const char* urlStr, int method) {
+	int i;
+
+	for (i = 0; i < numCallbacks; i++) {
+		// skip leading '/'
+		if (http_startsWith(urlStr, callbacks[i]->url + 1)) {
+			if (callbacks[i]->method == HTTP_ANY || callbacks[i]->method == method)
+				return callbacks[i]->callback;
+		}
+	}
+	return 0;
+}
+
+static http_callback_fn HTTP_FindBuiltinPage(const char* urlStr) {
+	int lo, hi, mid, cmp;
+
+	lo = 0;
+	hi = NUM_BUILTIN_ROUTES - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		cmp = http_compareUrlBase(builtinRoutes[mid].url, urlStr);
+		if (cmp < 0)
+			lo = mid + 1;
+		else if (cmp > 0)
+			hi = mid - 1;
+		else
+			return builtinRoutes[mid].callback;
+	}
+	return 0;
+}
+
 int HTTP_ProcessPacket(http_request_t* request) {
+	http_callback_fn callback;
 	int i;
 	char* p;
 	char* headers;
 	char* protocol;
+	char* value;
 	//int bChanged = 0;
 	char* urlStr = "";
 	char* recvbuf;
@@ -590,6 +1049,8 @@ int HTTP_ProcessPacket(http_request_t* request) {
 
 	// if OPTIONS, return now - for CORS
 	if (request->method == HTTP_OPTIONS) {
+		// no body, nothing to frame in chunks
+		request->keepAlive = 0;
 		http_setup(request, httpMimeTypeHTML);
 		i = strlen(request->reply);
 		return i;
@@ -624,6 +1085,10 @@ int HTTP_ProcessPacket(http_request_t* request) {
 			return 0;
 		}
 	}
+	// chunked replies are HTTP/1.1 only
+	if (protocol == 0 || strcmp(protocol, "HTTP/1.1")) {
+		request->keepAlive = 0;
+	}
 	// i.e. not received
 	request->contentLength = -1;
 	headers = p;
@@ -640,6 +1105,22 @@ int HTTP_ProcessPacket(http_request_t* request) {
 					if (!my_strnicmp(headers, "Content-Length:", 15)) {
 						request->contentLength = atoi(headers + 15);
 					}
+					if (!my_strnicmp(headers, "Transfer-Encoding:", 18)) {
+						value = headers + 18;
+						while (*value == ' ')
+							value++;
+						if (!my_strnicmp(value, "chunked", 7)) {
+							request->bodyChunked = 1;
+						}
+					}
+					if (!my_strnicmp(headers, "Connection:", 11)) {
+						value = headers + 11;
+						while (*value == ' ')
+							value++;
+						if (!my_strnicmp(value, "close", 5)) {
+							request->keepAlive = 0;
+						}
+					}
 
 					*p = 0;
 					p++; // past \r
@@ -668,6 +1149,23 @@ int HTTP_ProcessPacket(http_request_t* request) {
 		request->bodystart = p;
 		request->bodylen = request->receivedLen - (p - request->received);
 	}
+	// rest of the body is read by handlers with http_readBody
+	request->bodyNext = request->bodystart;
+	request->bodyNextLen = request->bodylen;
+	request->bodyDone = 0;
+	if (request->bodyChunked) {
+		request->bodyLeft = 0;
+	}
+	else if (request->contentLength >= 0) {
+		request->bodyLeft = request->contentLength;
+	}
+	else {
+		// no length given, only what came with the headers
+		request->bodyLeft = request->bodylen;
+	}
+	if (request->receivedLenmax < request->receivedLen) {
+		request->receivedLenmax = request->receivedLen;
+	}
 #if 0
 	postany(request, "test", 4);
 	return 0;
@@ -675,55 +1173,14 @@ int HTTP_ProcessPacket(http_request_t* request) {
 	return http_fn_empty_url(request);
 #endif
 
-	// look for a callback with this URL and method, or HTTP_ANY
-	for (i = 0; i < numCallbacks; i++) {
-		char* url = callbacks[i]->url;
-		if (http_startsWith(urlStr, &url[1])) {
-			int method = callbacks[i]->method;
-			if (method == HTTP_ANY || method == request->method) {
-				return callbacks[i]->callback(request);
-			}
-		}
-	}
-	if (http_checkUrlBase(urlStr, "")) return http_fn_empty_url(request);
+	http_tokenizeQuery(request);
 
-	if (http_checkUrlBase(urlStr, "testmsg")) return http_fn_testmsg(request);
-	if (http_checkUrlBase(urlStr, "index")) return http_fn_index(request);
-
-	if (http_checkUrlBase(urlStr, "about")) return http_fn_about(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_mqtt")) return http_fn_cfg_mqtt(request);
-	if (http_checkUrlBase(urlStr, "cfg_mqtt_set")) return http_fn_cfg_mqtt_set(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_webapp")) return http_fn_cfg_webapp(request);
-	if (http_checkUrlBase(urlStr, "cfg_webapp_set")) return http_fn_cfg_webapp_set(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_wifi")) return http_fn_cfg_wifi(request);
-	if (http_checkUrlBase(urlStr, "cfg_name")) return http_fn_cfg_name(request);
-	if (http_checkUrlBase(urlStr, "cfg_wifi_set")) return http_fn_cfg_wifi_set(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_loglevel_set")) return http_fn_cfg_loglevel_set(request);
-	if (http_checkUrlBase(urlStr, "cfg_mac")) return http_fn_cfg_mac(request);
-
-	if (http_checkUrlBase(urlStr, "flash_read_tool")) return http_fn_flash_read_tool(request);
-	if (http_checkUrlBase(urlStr, "uart_tool")) return http_fn_uart_tool(request);
-	if (http_checkUrlBase(urlStr, "cmd_tool")) return http_fn_cmd_tool(request);
-	if (http_checkUrlBase(urlStr, "startup_command")) return http_fn_startup_command(request);
-	if (http_checkUrlBase(urlStr, "cfg_generic")) return http_fn_cfg_generic(request);
-	if (http_checkUrlBase(urlStr, "cfg_startup")) return http_fn_cfg_startup(request);
-	if (http_checkUrlBase(urlStr, "cfg_dgr")) return http_fn_cfg_dgr(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_quick")) return http_fn_cfg_quick(request);
-	if (http_checkUrlBase(urlStr, "ha_cfg")) return http_fn_ha_cfg(request);
-	if (http_checkUrlBase(urlStr, "ha_discovery")) return http_fn_ha_discovery(request);
-	if (http_checkUrlBase(urlStr, "cfg")) return http_fn_cfg(request);
-
-	if (http_checkUrlBase(urlStr, "cfg_pins")) return http_fn_cfg_pins(request);
-	if (http_checkUrlBase(urlStr, "cfg_ping")) return http_fn_cfg_ping(request);
-
-	if (http_checkUrlBase(urlStr, "ota")) return http_fn_ota(request);
-	if (http_checkUrlBase(urlStr, "ota_exec")) return http_fn_ota_exec(request);
-	if (http_checkUrlBase(urlStr, "cm")) return http_fn_cm(request);
+	// look for a callback with this URL and method, or HTTP_ANY
+	callback = HTTP_FindCallback(urlStr, request->method);
+	if (callback == 0)
+		callback = HTTP_FindBuiltinPage(urlStr);
+	if (callback)
+		return callback(request);
 
 	return http_fn_other(request);
 }
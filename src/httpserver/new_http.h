@@ -28,6 +28,12 @@ extern const char ha_discovery_script[];
 #define HTTP_RESPONSE_OK 200
 #define HTTP_RESPONSE_NOT_FOUND 404
 #define HTTP_RESPONSE_SERVER_ERROR 500
+// accepted client sockets get this receive timeout, so a client that connects
+// and sends nothing (preconnect, port scan, half-open connection) can't hold a worker
+#define HTTP_CLIENT_RECV_TIMEOUT_MS 5000
+// all request headers must arrive within this time, a client trickling
+// them in byte by byte (slowloris) would otherwise keep its worker forever
+#define HTTP_HEADER_TIMEOUT_MS 10000
 
 #define MAX_QUERY 16
 #define MAX_HEADERS 16
@@ -48,27 +54,56 @@ typedef struct http_request_tag {
 	int bodylen;
 	int contentLength;
 	int responseCode;
+	// body stream state, see http_readBody
+	int bodyChunked; // sent with Transfer-Encoding: chunked
+	// received but not yet read part - first what came with the headers,
+	// then chunk size lines are received ahead into bodyLookahead
+	char* bodyNext;
+	int bodyNextLen;
+	char bodyLookahead[16];
+	int bodyLeft; // of Content-Length, or of the current chunk
+	int bodyDone;
 
 	// used to respond
 	char* reply;
 	int replylen;
 	int replymaxlen;
 	int fd;
+
+	// set by the server if it can keep the connection open,
+	// cleared by HTTP_ProcessPacket if the client can't
+	int keepAlive;
+	// set by http_setup if the body is sent in chunks (keep-alive),
+	// chunkStart is where the body of the current chunk starts in reply
+	int chunked;
+	int chunkStart;
 } http_request_t;
 
 
+// receives until the end of headers, part of the body may follow
+int HTTP_ReadRequest(http_request_t* request);
 int HTTP_ProcessPacket(http_request_t* request);
+// reads next part of the body (Content-Length or chunked) into o,
+// returns 0 at the end and -1 if the client went away early
+int http_readBody(http_request_t* request, char* o, int maxLen);
+// whole body as a string, read into the incoming buffer (truncated to fit)
+char* http_getBody(http_request_t* request);
 void http_setup(http_request_t* request, const char* type);
 void http_html_start(http_request_t* request, const char* pagename);
 void http_html_end(http_request_t* request);
 int poststr(http_request_t* request, const char* str);
 void poststr_escaped(http_request_t* request, char* str);
 int postany(http_request_t* request, const char* str, int len);
+// ends the reply, returns true if the connection can be kept open
+int http_endReply(http_request_t* request);
 void misc_formatUpTimeString(int totalSeconds, char* o);
 // void HTTP_AddBuildFooter(http_request_t *request);
 // void HTTP_AddHeader(http_request_t *request);
 int http_getArg(const char* base, const char* name, char* o, int maxSize);
 int http_getArgInteger(const char* base, const char* name);
+// query of request->url, tokenized once by HTTP_ProcessPacket
+int http_getRequestArg(http_request_t* request, const char* name, char* o, int maxSize);
+int http_getRequestArgInteger(http_request_t* request, const char* name);
 
 // poststr with format - for results LESS THAN 128
 int hprintf255(http_request_t* request, const char* fmt, ...);
@@ -86,6 +121,7 @@ typedef int (*http_callback_fn)(http_request_t* request);
 // url MUST start with '/'
 // urls must be unique (i.e. you can't have /about and /aboutme or /about/me)
 int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback);
+int HTTP_UnregisterCallback(const char* url, int method, http_callback_fn callback);
 
 #endif
 
@@ -58,6 +58,7 @@ extern UINT32 flash_read(char* user_buf, UINT32 count, UINT32 address);
 #include "../cmnds/cmd_public.h"
 
 #ifndef OBK_DISABLE_ALL_DRIVERS
+#include "../driver/drv_public.h"
 #include "../driver/drv_local.h"
 #endif
 
@@ -91,6 +92,7 @@ static int http_rest_get_flash_advanced(http_request_t* request);
 static int http_rest_post_flash_advanced(http_request_t* request);
 
 static int http_rest_get_info(http_request_t* request);
+static int http_rest_get_drivers(http_request_t* request);
 
 static int http_rest_get_dumpconfig(http_request_t* request);
 static int http_rest_get_testconfig(http_request_t* request);
@@ -180,6 +182,10 @@ static int http_rest_get(http_request_t* request) {
 		return http_rest_get_info(request);
 	}
 
+	if (!strcmp(request->url, "api/drivers")) {
+		return http_rest_get_drivers(request);
+	}
+
 	if (!strncmp(request->url, "api/flash/", 10)) {
 		return http_rest_get_flash_advanced(request);
 	}
@@ -285,7 +291,7 @@ static int http_rest_post(http_request_t* request) {
 	sprintf(tmp, "%d", request->contentLength);
 	poststr(request, tmp);
 	poststr(request, "<br/>Content:[");
-	poststr(request, request->bodystart);
+	poststr(request, http_getBody(request));
 	poststr(request, "]<br/>");
 	http_html_end(request);
 	poststr(request, NULL);
@@ -538,39 +544,22 @@ static int http_rest_post_lfs_file(http_request_t* request) {
 	lfsres = lfs_file_open(&lfs, file, fpath, LFS_O_RDWR | LFS_O_CREAT);
 	if (lfsres >= 0) {
 		//ADDLOG_DEBUG(LOG_FEATURE_API, "opened %s");
-		int towrite = request->bodylen;
-		char* writebuf = request->bodystart;
-		int writelen = request->bodylen;
-		if (request->contentLength >= 0) {
-			towrite = request->contentLength;
-		}
-		//ADDLOG_DEBUG(LOG_FEATURE_API, "bodylen %d, contentlen %d", request->bodylen, request->contentLength);
-
-		if (writelen < 0) {
-			ADDLOG_DEBUG(LOG_FEATURE_API, "ABORTED: %d bytes to write", writelen);
-			lfs_file_close(&lfs, file);
-			request->responseCode = HTTP_RESPONSE_SERVER_ERROR;
-			http_setup(request, httpMimeTypeJson);
-			hprintf255(request, "{\"fname\":\"%s\",\"error\":%d}", fpath, -20);
-			goto exit;
-		}
-
+		// body is streamed through the incoming buffer, Content-Length or chunked
 		do {
-			//ADDLOG_DEBUG(LOG_FEATURE_API, "%d bytes to write", writelen);
-			len = lfs_file_write(&lfs, file, writebuf, writelen);
-			total += len;
-			if (len > 0) {
-				//ADDLOG_DEBUG(LOG_FEATURE_API, "%d bytes written", len);
+			len = http_readBody(request, request->received, request->receivedLenmax);
+			if (len < 0) {
+				ADDLOG_DEBUG(LOG_FEATURE_API, "end of data - %d bytes written", total);
 			}
-			towrite -= len;
-			if (towrite > 0) {
-				writebuf = request->received;
-				writelen = recv(request->fd, writebuf, request->receivedLenmax, 0);
-				if (writelen < 0) {
-					ADDLOG_DEBUG(LOG_FEATURE_API, "recv returned %d - end of data - remaining %d", writelen, towrite);
-				}
+			if (len <= 0) {
+				break;
 			}
-		} while ((towrite > 0) && (writelen >= 0));
+			len = lfs_file_write(&lfs, file, request->received, len);
+			if (len < 0) {
+				ADDLOG_DEBUG(LOG_FEATURE_API, "write error %d", len);
+				break;
+			}
+			total += len;
+		} while (1);
 
 		// no more data
 		lfs_file_truncate(&lfs, file, total);
@@ -587,7 +576,6 @@ static int http_rest_post_lfs_file(http_request_t* request) {
 		ADDLOG_DEBUG(LOG_FEATURE_API, "failed to open %s err %d", fpath, lfsres);
 		hprintf255(request, "{\"fname\":\"%s\",\"error\":%d}", fpath, lfsres);
 	}
-exit:
 	poststr(request, NULL);
 	if (folder) os_free(folder);
 	if (file) os_free(file);
@@ -707,7 +695,7 @@ static int http_rest_post_logconfig(http_request_t* request) {
 	//jsmntok_t t[128]; /* We expect no more than 128 tokens */
 #define TOKEN_COUNT 128
 	jsmntok_t* t = os_malloc(sizeof(jsmntok_t) * TOKEN_COUNT);
-	char* json_str = request->bodystart;
+	char* json_str = http_getBody(request);
 	int json_len = strlen(json_str);
 
 	http_setup(request, httpMimeTypeText);
@@ -795,6 +783,17 @@ static int http_rest_get_info(http_request_t* request) {
 	return 0;
 }
 
+static int http_rest_get_drivers(http_request_t* request) {
+	http_setup(request, httpMimeTypeJson);
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	DRV_AppendStatsJSON(request);
+#else
+	hprintf255(request, "{}");
+#endif
+	poststr(request, NULL);
+	return 0;
+}
+
 static int http_rest_post_pins(http_request_t* request) {
 	int i;
 	int r;
@@ -808,7 +807,7 @@ static int http_rest_post_pins(http_request_t* request) {
 	//jsmntok_t t[128]; /* We expect no more than 128 tokens */
 #define TOKEN_COUNT 128
 	jsmntok_t* t = os_malloc(sizeof(jsmntok_t) * TOKEN_COUNT);
-	char* json_str = request->bodystart;
+	char* json_str = http_getBody(request);
 	int json_len = strlen(json_str);
 
 	memset(p, 0, sizeof(jsmn_parser));
@@ -1006,6 +1005,8 @@ static int http_rest_post_flash(http_request_t* request, int startaddr, int maxa
 	return 0;	//Operation not supported yet
 #endif
 
+	// don't lose coalesced channel/energy values if OTA reboots us
+	HAL_FlashVars_Flush();
 
 	int total = 0;
 	int towrite = request->bodylen;
@@ -1117,7 +1118,7 @@ static int http_rest_post_flash(http_request_t* request, int startaddr, int maxa
 	tls_mem_free(Buffer);
 
 	if (nRetCode != 0) {
-		ADDLOG_ERROR(LOG_FEATURE_OTA, error_message);
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "%s", error_message);
 		socket_fwup_err(0, nRetCode);
 		return http_rest_error(request, nRetCode, error_message);
 	}
@@ -1517,7 +1518,7 @@ static int http_rest_post_channels(http_request_t* request) {
 	//jsmntok_t t[128]; /* We expect no more than 128 tokens */
 #define TOKEN_COUNT 128
 	jsmntok_t* t = os_malloc(sizeof(jsmntok_t) * TOKEN_COUNT);
-	char* json_str = request->bodystart;
+	char* json_str = http_getBody(request);
 	int json_len = strlen(json_str);
 
 	memset(p, 0, sizeof(jsmn_parser));
@@ -1560,7 +1561,7 @@ static int http_rest_post_channels(http_request_t* request) {
 
 
 static int http_rest_post_cmd(http_request_t* request) {
-	char* cmd = request->bodystart;
+	char* cmd = http_getBody(request);
 	CMD_ExecuteCommand(cmd, COMMAND_FLAG_SOURCE_CONSOLE);
 	return http_rest_error(request, 200, "OK");
 }
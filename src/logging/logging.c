@@ -39,6 +39,8 @@ unsigned int logfeatures = (
 	(1 << 24)
 	);
 static int log_delay = 0;
+// store lines as binary records, formatted only when a reader takes them
+static int log_binary = 0;
 
 // must match header definitions in logging.h
 char* loglevelnames[] = {
@@ -88,7 +90,6 @@ char* logfeaturenames[] = {
 volatile int direct_serial_log = DEFAULT_DIRECT_SERIAL_LOG;
 
 static int g_extraSocketToSendLOG = 0;
-static char g_loggingBuffer[LOGGING_BUFFER_SIZE];
 
 #define MAX_TCP_LOG_PORTS 2
 int tcp_log_ports[MAX_TCP_LOG_PORTS] = {-1};
@@ -110,17 +111,51 @@ static void log_serial_thread(beken_thread_arg_t arg);
 static void startSerialLog();
 static void startLogServer();
 
+// must be a power of two
 #define LOGSIZE 4096
+#define LOGSIZE_MASK (LOGSIZE - 1)
 #define LOGPORT 9000
 
 int logTcpPort = LOGPORT;
 
+// Each ring entry starts with a 2 byte little endian header holding
+// the payload length. Payload is either the text line or, if LOGENTRY_RECORD
+// is set, a binary record: level, feature, format pointer and captured args.
+// With LOGENTRY_PACKET also set, the record is level, feature, prefix pointer
+// and raw packet bytes, which readers print as hex.
+#define LOGENTRY_HEADER		2
+#define LOGENTRY_RECORD		0x8000
+#define LOGENTRY_PACKET		0x4000
+#define LOGENTRY_LENMASK	0x3fff
+// binary records larger than that are stored as text
+#define LOGRECORD_MAX		128
+// packet bytes kept per trace, that is already more hex than fits in a line
+#define LOGPACKET_MAX		340
+
+// every consumer keeps its own position, so readers never block
+// the writer or each other
+typedef struct logReader_s {
+	// start of the entry being read
+	unsigned int cursor;
+	// how many characters of that entry were already returned
+	int skip;
+	unsigned int overruns;
+} logReader_t;
+
 static struct tag_logMemory {
-	char log[LOGSIZE];
-	int head;
-	int tailserial;
-	int tailtcp;
-	int tailhttp;
+	// lines are formatted in place at head; the spare bytes past LOGSIZE
+	// take whatever does not fit before the end of the ring and that part
+	// is then copied to the ring start
+	char log[LOGSIZE + LOGENTRY_HEADER + LOGGING_BUFFER_SIZE];
+	// total number of bytes ever written, ring index is head & LOGSIZE_MASK
+	volatile unsigned int head;
+	// oldest entry that is still intact
+	volatile unsigned int tail;
+	// head plus the bytes a writer is currently allowed to overwrite
+	volatile unsigned int reserved;
+	logReader_t serial;
+	logReader_t tcp;
+	logReader_t http;
 	SemaphoreHandle_t mutex;
 } logMemory;
 
@@ -142,7 +177,10 @@ commandResult_t log_command(const void* context, const char* cmd, const char* ar
 static void initLog(void)
 {
 	bk_printf("Entering initLog()...\r\n");
-	logMemory.head = logMemory.tailserial = logMemory.tailtcp = logMemory.tailhttp = 0;
+	logMemory.head = logMemory.tail = logMemory.reserved = 0;
+	memset(&logMemory.serial, 0, sizeof(logMemory.serial));
+	memset(&logMemory.tcp, 0, sizeof(logMemory.tcp));
+	memset(&logMemory.http, 0, sizeof(logMemory.http));
 	logMemory.mutex = xSemaphoreCreateMutex();
 	initialised = 1;
 	startSerialLog();
@@ -169,6 +207,11 @@ static void initLog(void)
 	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("logdelay", "", log_command, NULL, NULL);
+	//cmddetail:{"name":"logbinary","args":"[0or1]",
+	//cmddetail:"descr":"When enabled, log lines are kept in memory as compact binary records (format pointer and arguments) and are printed only when the serial, TCP or HTTP log reads them. This saves CPU time on busy devices and keeps more history. Console redirects and direct serial logging still print at once.",
+	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
+	//cmddetail:"examples":"logbinary 1"}
+	CMD_RegisterCommand("logbinary", "", log_command, NULL, NULL);
 
 	bk_printf("Commands registered!\r\n");
 	bk_printf("initLog() done!\r\n");
@@ -227,27 +270,421 @@ void LOG_SetCommandHTTPRedirectReply(http_request_t* request) {
 	}
 #endif
 
+// kinds of arguments that a binary record can capture
+enum {
+	LOGARG_NONE,
+	LOGARG_INT,
+	LOGARG_LONG,
+	LOGARG_LONGLONG,
+	LOGARG_SIZE,
+	LOGARG_DOUBLE,
+	LOGARG_PTR,
+	LOGARG_STR,
+	LOGARG_UNSUPPORTED,
+};
+
+typedef struct logSpec_s {
+	// number of '*' width/precision ints before the value
+	int stars;
+	int type;
+	// true for a plain "%s", which is copied without snprintf
+	int plain;
+} logSpec_t;
+
+// parses a conversion, p points just after '%'.
+// Returns the pointer past the conversion character.
+static const char *LOG_ParseSpec(const char *p, logSpec_t *spec) {
+	const char *start = p;
+	int lng = 0;
+
+	spec->stars = 0;
+	while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+		p++;
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->stars++;
+			p++;
+		}
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+	if (*p == 'h') {
+		p++;
+		if (*p == 'h')
+			p++;
+	}
+	else if (*p == 'l') {
+		p++;
+		lng = 1;
+		if (*p == 'l') {
+			p++;
+			lng = 2;
+		}
+	}
+	else if (*p == 'z') {
+		p++;
+		lng = 3;
+	}
+	else if (*p == 'j' || *p == 't' || *p == 'L') {
+		spec->type = LOGARG_UNSUPPORTED;
+		return p;
+	}
+	spec->plain = (p == start && *p == 's');
+	switch (*p) {
+	case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+		if (lng == 0)
+			spec->type = LOGARG_INT;
+		else if (lng == 1)
+			spec->type = (*p == 'c') ? LOGARG_UNSUPPORTED : LOGARG_LONG;
+		else if (lng == 2)
+			spec->type = LOGARG_LONGLONG;
+		else
+			spec->type = LOGARG_SIZE;
+		break;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		spec->type = LOGARG_DOUBLE;
+		break;
+	case 'p':
+		spec->type = LOGARG_PTR;
+		break;
+	case 's':
+		spec->type = lng ? LOGARG_UNSUPPORTED : LOGARG_STR;
+		break;
+	case '%':
+		spec->type = LOGARG_NONE;
+		break;
+	default:
+		spec->type = LOGARG_UNSUPPORTED;
+		return p;
+	}
+	return p + 1;
+}
+
+static int LOG_ArgSize(int type) {
+	switch (type) {
+	case LOGARG_INT: return sizeof(int);
+	case LOGARG_LONG: return sizeof(long);
+	case LOGARG_LONGLONG: return sizeof(long long);
+	case LOGARG_SIZE: return sizeof(size_t);
+	case LOGARG_DOUBLE: return sizeof(double);
+	case LOGARG_PTR: return sizeof(void*);
+	}
+	return 0;
+}
+
+// Stores level, feature, format pointer and the arguments into rec.
+// Returns record size, or 0 if it should be stored as text instead
+// (no conversions at all, something unsupported, or too large).
+static int LOG_CaptureRecord(char *rec, int level, int feature, const char *fmt, va_list argList) {
+	const char *p;
+	const char *s;
+	logSpec_t spec;
+	int at, i, n, conversions;
+	int iv;
+	long lv;
+	long long llv;
+	size_t zv;
+	double dv;
+	void *pv;
+
+	rec[0] = level;
+	rec[1] = feature;
+	memcpy(rec + 2, &fmt, sizeof(fmt));
+	at = 2 + sizeof(fmt);
+	conversions = 0;
+	for (p = fmt; *p; ) {
+		if (*p++ != '%')
+			continue;
+		p = LOG_ParseSpec(p, &spec);
+		if (spec.type == LOGARG_UNSUPPORTED)
+			return 0;
+		if (spec.type == LOGARG_NONE)
+			continue;
+		conversions++;
+		for (i = 0; i < spec.stars; i++) {
+			if (at + (int)sizeof(int) > LOGRECORD_MAX)
+				return 0;
+			iv = va_arg(argList, int);
+			memcpy(rec + at, &iv, sizeof(iv));
+			at += sizeof(iv);
+		}
+		if (spec.type == LOGARG_STR) {
+			s = va_arg(argList, const char*);
+			if (s == 0)
+				s = "(null)";
+			n = strlen(s);
+			// text lines lose their trailing newline, so do the same here
+			if (*p == 0) {
+				if (n && s[n - 1] == '\n') n--;
+				if (n && s[n - 1] == '\r') n--;
+			}
+			if (at + n + 1 > LOGRECORD_MAX)
+				return 0;
+			memcpy(rec + at, s, n);
+			rec[at + n] = 0;
+			at += n + 1;
+			continue;
+		}
+		n = LOG_ArgSize(spec.type);
+		if (at + n > LOGRECORD_MAX)
+			return 0;
+		switch (spec.type) {
+		case LOGARG_INT: iv = va_arg(argList, int); memcpy(rec + at, &iv, n); break;
+		case LOGARG_LONG: lv = va_arg(argList, long); memcpy(rec + at, &lv, n); break;
+		case LOGARG_LONGLONG: llv = va_arg(argList, long long); memcpy(rec + at, &llv, n); break;
+		case LOGARG_SIZE: zv = va_arg(argList, size_t); memcpy(rec + at, &zv, n); break;
+		case LOGARG_DOUBLE: dv = va_arg(argList, double); memcpy(rec + at, &dv, n); break;
+		case LOGARG_PTR: pv = va_arg(argList, void*); memcpy(rec + at, &pv, n); break;
+		}
+		at += n;
+	}
+	if (conversions == 0)
+		return 0;
+	return at;
+}
+
+// output of a reader; the first 'skip' characters are dropped
+// because an earlier call has already returned them
+typedef struct logEmit_s {
+	char *out;
+	int room;
+	int skip;
+	int written;
+	// characters that did not fit into room
+	int lost;
+	// the line has been cut to LOGGING_BUFFER_SIZE like a text line
+	int limit;
+} logEmit_t;
+
+static void LOG_Emit(logEmit_t *e, const char *s, int n) {
+	if (n > e->limit)
+		n = e->limit;
+	e->limit -= n;
+	if (e->skip >= n) {
+		e->skip -= n;
+		return;
+	}
+	s += e->skip;
+	n -= e->skip;
+	e->skip = 0;
+	if (n > e->room - e->written) {
+		e->lost += n - (e->room - e->written);
+		n = e->room - e->written;
+	}
+	memcpy(e->out + e->written, s, n);
+	e->written += n;
+}
+
+// turns a binary record back into the same text that the text path stores
+static void LOG_RenderRecord(logEmit_t *e, const char *rec, int recLen) {
+	const char *fmt;
+	const char *p;
+	const char *lit;
+	const char *end;
+	logSpec_t spec;
+	char specStr[24];
+	char tmp[64];
+	int at, n, stars[2], i;
+	int iv;
+	long lv;
+	long long llv;
+	size_t zv;
+	double dv;
+	void *pv;
+	int level = (unsigned char)rec[0];
+	int feature = (unsigned char)rec[1];
+
+	memcpy(&fmt, rec + 2, sizeof(fmt));
+	at = 2 + sizeof(fmt);
+
+	// save 3 bytes at end for /r/n/0
+	e->limit = LOGGING_BUFFER_SIZE - 3;
+	if (feature != LOG_FEATURE_RAW) {
+		LOG_Emit(e, loglevelnames[level], strlen(loglevelnames[level]));
+		if (feature < sizeof(logfeaturenames) / sizeof(*logfeaturenames)) {
+			LOG_Emit(e, logfeaturenames[feature], strlen(logfeaturenames[feature]));
+		}
+	}
+	end = fmt + strlen(fmt);
+	if (end > fmt && end[-1] == '\n') end--;
+	if (end > fmt && end[-1] == '\r') end--;
+
+	lit = fmt;
+	for (p = fmt; p < end; ) {
+		if (*p != '%') {
+			p++;
+			continue;
+		}
+		LOG_Emit(e, lit, p - lit);
+		lit = p;
+		p = LOG_ParseSpec(p + 1, &spec);
+		if (spec.type == LOGARG_NONE) {
+			LOG_Emit(e, "%", 1);
+			lit = p;
+			continue;
+		}
+		n = p - lit;
+		if (n >= sizeof(specStr))
+			n = sizeof(specStr) - 1;
+		memcpy(specStr, lit, n);
+		specStr[n] = 0;
+		lit = p;
+		for (i = 0; i < spec.stars; i++) {
+			memcpy(&stars[i], rec + at, sizeof(int));
+			at += sizeof(int);
+		}
+		if (spec.type == LOGARG_STR) {
+			const char *s = rec + at;
+			n = strlen(s);
+			at += n + 1;
+			if (spec.plain) {
+				LOG_Emit(e, s, n);
+				continue;
+			}
+			if (spec.stars == 2)
+				n = snprintf(tmp, sizeof(tmp), specStr, stars[0], stars[1], s);
+			else if (spec.stars == 1)
+				n = snprintf(tmp, sizeof(tmp), specStr, stars[0], s);
+			else
+				n = snprintf(tmp, sizeof(tmp), specStr, s);
+		}
+		else {
+#define LOG_SNPRINTF_ARG(v) \
+			if (spec.stars == 2) n = snprintf(tmp, sizeof(tmp), specStr, stars[0], stars[1], v); \
+			else if (spec.stars == 1) n = snprintf(tmp, sizeof(tmp), specStr, stars[0], v); \
+			else n = snprintf(tmp, sizeof(tmp), specStr, v);
+			switch (spec.type) {
+			case LOGARG_INT: memcpy(&iv, rec + at, sizeof(iv)); LOG_SNPRINTF_ARG(iv); break;
+			case LOGARG_LONG: memcpy(&lv, rec + at, sizeof(lv)); LOG_SNPRINTF_ARG(lv); break;
+			case LOGARG_LONGLONG: memcpy(&llv, rec + at, sizeof(llv)); LOG_SNPRINTF_ARG(llv); break;
+			case LOGARG_SIZE: memcpy(&zv, rec + at, sizeof(zv)); LOG_SNPRINTF_ARG(zv); break;
+			case LOGARG_DOUBLE: memcpy(&dv, rec + at, sizeof(dv)); LOG_SNPRINTF_ARG(dv); break;
+			case LOGARG_PTR: memcpy(&pv, rec + at, sizeof(pv)); LOG_SNPRINTF_ARG(pv); break;
+			default: n = 0; break;
+			}
+#undef LOG_SNPRINTF_ARG
+			at += LOG_ArgSize(spec.type);
+		}
+		if (n < 0)
+			n = 0;
+		if (n >= sizeof(tmp))
+			n = sizeof(tmp) - 1;
+		LOG_Emit(e, tmp, n);
+		if (at > recLen)
+			break;
+	}
+	LOG_Emit(e, lit, end - lit);
+	e->limit = 2;
+	LOG_Emit(e, "\r\n", 2);
+}
+
+int LOG_FormatHex(char *out, int outSize, const byte *data, int len, int bSpaces) {
+	static const char digits[] = "0123456789ABCDEF";
+	int i, n;
+
+	if (outSize <= 0)
+		return 0;
+	n = 0;
+	for (i = 0; i < len && n < outSize - 1; i++) {
+		out[n++] = digits[data[i] >> 4];
+		if (n == outSize - 1)
+			break;
+		out[n++] = digits[data[i] & 15];
+		if (bSpaces && n < outSize - 1)
+			out[n++] = ' ';
+	}
+	out[n] = 0;
+	return n;
+}
+
+static int LOG_CapturePacket(char *rec, int level, int feature, const char *prefix, const byte *data, int len) {
+	int at;
+
+	if (len > LOGPACKET_MAX)
+		len = LOGPACKET_MAX;
+	rec[0] = level;
+	rec[1] = feature;
+	memcpy(rec + 2, &prefix, sizeof(prefix));
+	at = 2 + sizeof(prefix);
+	memcpy(rec + at, data, len);
+	return at + len;
+}
+
+static int LOG_EntryHeader(unsigned int at) {
+	return (unsigned char)logMemory.log[at & LOGSIZE_MASK]
+		| ((unsigned char)logMemory.log[(at + 1) & LOGSIZE_MASK] << 8);
+}
+
+static void LOG_CopyFromRing(char *dst, unsigned int at, int n) {
+	unsigned int pos = at & LOGSIZE_MASK;
+	int first = LOGSIZE - pos;
+	if (first > n) {
+		first = n;
+	}
+	memcpy(dst, logMemory.log + pos, first);
+	memcpy(dst + first, logMemory.log, n - first);
+}
+
+// prints a packet trace straight from the ring, in small pieces.
+// Returns 0 if the writer got to the entry meanwhile.
+static int LOG_RenderPacket(logEmit_t *e, unsigned int cursor, int recLen) {
+	char head[2 + sizeof(const char*)];
+	const char *prefix;
+	byte bin[16];
+	char hex[sizeof(bin) * 3 + 1];
+	int level, feature, at, n;
+
+	LOG_CopyFromRing(head, cursor + LOGENTRY_HEADER, sizeof(head));
+	if (logMemory.reserved - cursor > LOGSIZE)
+		return 0;
+	level = (unsigned char)head[0];
+	feature = (unsigned char)head[1];
+	memcpy(&prefix, head + 2, sizeof(prefix));
+
+	// save 3 bytes at end for /r/n/0
+	e->limit = LOGGING_BUFFER_SIZE - 3;
+	if (feature != LOG_FEATURE_RAW) {
+		LOG_Emit(e, loglevelnames[level], strlen(loglevelnames[level]));
+		if (feature < sizeof(logfeaturenames) / sizeof(*logfeaturenames)) {
+			LOG_Emit(e, logfeaturenames[feature], strlen(logfeaturenames[feature]));
+		}
+	}
+	LOG_Emit(e, prefix, strlen(prefix));
+	for (at = sizeof(head); at < recLen && e->limit > 0; at += n) {
+		n = recLen - at;
+		if (n > sizeof(bin))
+			n = sizeof(bin);
+		LOG_CopyFromRing((char*)bin, cursor + LOGENTRY_HEADER + at, n);
+		LOG_Emit(e, hex, LOG_FormatHex(hex, sizeof(hex), bin, n, 1));
+	}
+	e->limit = 2;
+	LOG_Emit(e, "\r\n", 2);
+	return logMemory.reserved - cursor <= LOGSIZE;
+}
+
 // adds a log to the log memory
-// if head collides with either tail, move the tails on.
-void addLogAdv(int level, int feature, const char* fmt, ...)
+// The line is formatted directly at the ring head, or, with logbinary, only
+// its arguments are stored there. Readers are not tracked here, each of them
+// notices by itself that the writer went past its cursor.
+// With packet set, fmt is a plain prefix and the packet is printed as hex.
+static void LOG_Add(int level, int feature, const char* fmt, va_list *argList, const byte *packet, int packetLen)
 {
 	char* tmp;
 	char* t;
+	char* entry;
 	int len;
-	va_list argList;
+	int max;
+	int n;
+	int header;
+	unsigned int pos;
 	BaseType_t taken;
-	int i;
-
-	if (fmt == 0)
-	{
-		return;
-	}
-	if (!((1 << feature) & logfeatures)) {
-		return;
-	}
-	if (level > loglevel) {
-		return;
-	}
 
 	// if not initialised, direct output
 	if (!initialised) {
@@ -259,68 +696,140 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 
 
 	taken = xSemaphoreTake(logMemory.mutex, 100);
-	tmp = g_loggingBuffer;
-	memset(tmp, 0, LOGGING_BUFFER_SIZE);
-	t = tmp;
-
-	if (feature == LOG_FEATURE_RAW)
-	{
-		// raw means no prefixes
+	// drop the oldest entries that the new one may overwrite
+	while (logMemory.head + LOGENTRY_HEADER + LOGGING_BUFFER_SIZE - logMemory.tail > LOGSIZE) {
+		logMemory.tail += LOGENTRY_HEADER + (LOG_EntryHeader(logMemory.tail) & LOGENTRY_LENMASK);
+	}
+	// announce which bytes are about to be overwritten before touching them
+	logMemory.reserved = logMemory.head + LOGENTRY_HEADER + LOGGING_BUFFER_SIZE;
+	pos = logMemory.head & LOGSIZE_MASK;
+	entry = logMemory.log + pos;
+	tmp = entry + LOGENTRY_HEADER;
+	len = 0;
+
+	// binary records are only useful if nobody needs the text right now,
+	// packets are always kept binary then, hex is only made for readers
+	if ((log_binary || packet) && direct_serial_log != LOGTYPE_DIRECT
+		&& g_log_alsoPrintToHTTP == 0 && g_extraSocketToSendLOG == 0) {
+		if (packet) {
+			len = LOG_CapturePacket(tmp, level, feature, fmt, packet, packetLen);
+		}
+		else {
+			va_list argCopy;
+			va_copy(argCopy, *argList);
+			len = LOG_CaptureRecord(tmp, level, feature, fmt, argCopy);
+			va_end(argCopy);
+		}
+	}
+	if (len) {
+		header = len | LOGENTRY_RECORD;
+		if (packet) {
+			header |= LOGENTRY_PACKET;
+		}
 	}
 	else {
-		strncpy(t, loglevelnames[level], (LOGGING_BUFFER_SIZE - (3 + t - tmp)));
-		t += strlen(t);
-		if (feature < sizeof(logfeaturenames) / sizeof(*logfeaturenames))
+		t = tmp;
+		if (feature == LOG_FEATURE_RAW)
 		{
-			strncpy(t, logfeaturenames[feature], (LOGGING_BUFFER_SIZE - (3 + t - tmp)));
-			t += strlen(t);
+			// raw means no prefixes
+		}
+		else {
+			n = strlen(loglevelnames[level]);
+			memcpy(t, loglevelnames[level], n);
+			t += n;
+			if (feature < sizeof(logfeaturenames) / sizeof(*logfeaturenames))
+			{
+				n = strlen(logfeaturenames[feature]);
+				memcpy(t, logfeaturenames[feature], n);
+				t += n;
+			}
+		}
+
+		// save 3 bytes at end for /r/n/0
+		max = LOGGING_BUFFER_SIZE - (3 + t - tmp);
+		if (packet) {
+			n = strlen(fmt);
+			if (n > max - 1)
+				n = max - 1;
+			memcpy(t, fmt, n);
+			n += LOG_FormatHex(t + n, max - n, packet, packetLen, 1);
+		}
+		else {
+			n = vsnprintf(t, max, fmt, *argList);
 		}
+		if (n < 0) {
+			n = 0;
+			*t = 0;
+		}
+		else if (n >= max) {
+			n = max - 1;
+		}
+		len = (t - tmp) + n;
+		if (len > 0 && tmp[len - 1] == '\n') len--;
+		if (len > 0 && tmp[len - 1] == '\r') len--;
+
+		tmp[len++] = '\r';
+		tmp[len++] = '\n';
+		tmp[len] = '\0';
+		header = len;
 	}
+	entry[0] = header & 0xff;
+	entry[1] = header >> 8;
 
-	va_start(argList, fmt);
-	//vsnprintf3(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	//vsnprintf2(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	vsnprintf(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	va_end(argList);
-	if (tmp[strlen(tmp) - 1] == '\n') tmp[strlen(tmp) - 1] = '\0';
-	if (tmp[strlen(tmp) - 1] == '\r') tmp[strlen(tmp) - 1] = '\0';
+	if (direct_serial_log == LOGTYPE_DIRECT) {
+		// line is not stored, keep the lock so that nobody formats over it
+		bk_printf("%s", tmp);
+	}
+	else {
+		if (pos + LOGENTRY_HEADER + len > LOGSIZE) {
+			memcpy(logMemory.log, logMemory.log + LOGSIZE, pos + LOGENTRY_HEADER + len - LOGSIZE);
+		}
+		logMemory.head += LOGENTRY_HEADER + len;
+	}
+	logMemory.reserved = logMemory.head;
+	// A stored line stays intact until the ring comes around again,
+	// so the remaining outputs do not need the lock
+	if (taken == pdTRUE && direct_serial_log != LOGTYPE_DIRECT) {
+		xSemaphoreGive(logMemory.mutex);
+		taken = pdFALSE;
+	}
 
-	len = strlen(tmp); // save 3 bytes at end for /r/n/0
-	tmp[len++] = '\r';
-	tmp[len++] = '\n';
-	tmp[len] = '\0';
+	if (header & LOGENTRY_RECORD) {
+		// nothing printed now, readers will format it
+	}
+	else {
 #if WINDOWS
-	printf(tmp);
+		printf("%s", tmp);
 #endif
 #if PLATFORM_XR809
-	printf(tmp);
+		printf("%s", tmp);
 #endif
 #if PLATFORM_W600 || PLATFORM_W800
-	//printf(tmp);
+		//printf(tmp);
 #endif
 //#if PLATFORM_BL602
-	//printf(tmp);
+		//printf(tmp);
 //#endif
-	// This is used by HTTP console
-	if (g_log_alsoPrintToHTTP) {
-		// guard here is used for the rare case when poststr attempts to do an addLogAdv as well
-		if (b_guard_recursivePrint == false) {
-			b_guard_recursivePrint = true;
-			poststr(g_log_alsoPrintToHTTP, tmp);
-			poststr(g_log_alsoPrintToHTTP, "<br>");
-			b_guard_recursivePrint = false;
+		// This is used by HTTP console
+		if (g_log_alsoPrintToHTTP) {
+			// guard here is used for the rare case when poststr attempts to do an addLogAdv as well
+			if (b_guard_recursivePrint == false) {
+				b_guard_recursivePrint = true;
+				poststr(g_log_alsoPrintToHTTP, tmp);
+				poststr(g_log_alsoPrintToHTTP, "<br>");
+				b_guard_recursivePrint = false;
+			}
+		}
+		if (g_extraSocketToSendLOG)
+		{
+			send(g_extraSocketToSendLOG, tmp, len, 0);
 		}
-	}
-	if (g_extraSocketToSendLOG)
-	{
-		send(g_extraSocketToSendLOG, tmp, strlen(tmp), 0);
 	}
 
+	if (taken == pdTRUE) {
+		xSemaphoreGive(logMemory.mutex);
+	}
 	if (direct_serial_log == LOGTYPE_DIRECT) {
-		bk_printf("%s", tmp);
-		if (taken == pdTRUE) {
-			xSemaphoreGive(logMemory.mutex);
-		}
 		/* no need to delay becasue bk_printf currently delays
 		if (log_delay){
 			if (log_delay < 0){
@@ -333,30 +842,9 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 		return;
 	}
 
-	for ( i = 0; i < len; i++)
-	{
-		logMemory.log[logMemory.head] = tmp[i];
-		logMemory.head = (logMemory.head + 1) % LOGSIZE;
-		if (logMemory.tailserial == logMemory.head)
-		{
-			logMemory.tailserial = (logMemory.tailserial + 1) % LOGSIZE;
-		}
-		if (logMemory.tailtcp == logMemory.head)
-		{
-			logMemory.tailtcp = (logMemory.tailtcp + 1) % LOGSIZE;
-		}
-		if (logMemory.tailhttp == logMemory.head)
-		{
-			logMemory.tailhttp = (logMemory.tailhttp + 1) % LOGSIZE;
-		}
-	}
-
-	if (taken == pdTRUE) {
-		xSemaphoreGive(logMemory.mutex);
-	}
 #ifdef PLATFORM_BEKEN
 	trigger_log_send();
-#endif	
+#endif
 	if (log_delay) {
 		int timems = log_delay;
 		// is log_delay set -ve, then calculate delay
@@ -370,33 +858,109 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 	}
 }
 
+void addLogAdv(int level, int feature, const char* fmt, ...)
+{
+	va_list argList;
 
-static int getData(char* buff, int buffsize, int* tail) {
-	BaseType_t taken;
-	int count;
-	char* p;
-	if (!initialised)
+	if (fmt == 0)
+	{
+		return;
+	}
+	if (!((1 << feature) & logfeatures)) {
+		return;
+	}
+	if (level > loglevel) {
+		return;
+	}
+	va_start(argList, fmt);
+	LOG_Add(level, feature, fmt, &argList, 0, 0);
+	va_end(argList);
+}
+
+// Logs prefix followed by the packet as "%02X " per byte. Only the bytes are
+// stored, the hex is made when a reader (serial, TCP, HTTP) takes the line.
+// prefix is not copied and must be a string constant.
+void addLogPacketAdv(int level, int feature, const char* prefix, const byte *data, int len)
+{
+	if (!((1 << feature) & logfeatures)) {
+		return;
+	}
+	if (level > loglevel) {
+		return;
+	}
+	LOG_Add(level, feature, prefix, 0, data, len);
+}
+
+
+// copies up to buffsize-1 characters of text for given reader, without
+// taking the log mutex. Binary records are formatted here.
+// If the writer has overtaken the reader, the reader skips to the oldest
+// entry that is still intact and counts an overrun.
+static int getData(char* buff, int buffsize, logReader_t* r) {
+	char rec[LOGRECORD_MAX];
+	logEmit_t e;
+	int header, len, start, n;
+
+	if (!initialised || buffsize < 1)
 		return 0;
-	taken = xSemaphoreTake(logMemory.mutex, 100);
 
-	count = 0;
-	p = buff;
-	while (buffsize > 1) {
-		if (*tail == logMemory.head) {
+	e.out = buff;
+	e.room = buffsize - 1;
+	e.written = 0;
+	while (e.written < e.room) {
+		if ((int)(logMemory.tail - r->cursor) > 0) {
+			r->cursor = logMemory.tail;
+			r->skip = 0;
+			r->overruns++;
+		}
+		if (r->cursor == logMemory.head) {
 			break;
 		}
-		*p = logMemory.log[*tail];
-		p++;
-		(*tail) = ((*tail) + 1) % LOGSIZE;
-		buffsize--;
-		count++;
-	}
-	*p = 0;
-
-	if (taken == pdTRUE) {
-		xSemaphoreGive(logMemory.mutex);
+		header = LOG_EntryHeader(r->cursor);
+		len = header & LOGENTRY_LENMASK;
+		start = e.written;
+		if (header & LOGENTRY_PACKET) {
+			e.skip = r->skip;
+			e.lost = 0;
+			if (!LOG_RenderPacket(&e, r->cursor, len)) {
+				e.written = start;
+				continue;
+			}
+		}
+		else if (header & LOGENTRY_RECORD) {
+			if (len > LOGRECORD_MAX)
+				len = LOGRECORD_MAX;
+			LOG_CopyFromRing(rec, r->cursor + LOGENTRY_HEADER, len);
+			// a writer may have started on the bytes we just copied
+			if (logMemory.reserved - r->cursor > LOGSIZE) {
+				continue;
+			}
+			e.skip = r->skip;
+			e.lost = 0;
+			LOG_RenderRecord(&e, rec, len);
+		}
+		else {
+			n = len - r->skip;
+			e.lost = 0;
+			if (n > e.room - e.written) {
+				e.lost = n - (e.room - e.written);
+				n = e.room - e.written;
+			}
+			LOG_CopyFromRing(buff + e.written, r->cursor + LOGENTRY_HEADER + r->skip, n);
+			if (logMemory.reserved - r->cursor > LOGSIZE) {
+				continue;
+			}
+			e.written += n;
+		}
+		if (e.lost) {
+			r->skip += e.written - start;
+			break;
+		}
+		r->cursor += LOGENTRY_HEADER + (header & LOGENTRY_LENMASK);
+		r->skip = 0;
 	}
-	return count;
+	buff[e.written] = 0;
+	return e.written;
 }
 
 #if PLATFORM_BEKEN
@@ -407,42 +971,38 @@ static int getData(char* buff, int buffsize, int* tail) {
 // H/W TX fifo seems to be 256 bytes!!!
 static int getSerial2() {
 	if (!initialised) return 0;
-	int* tail = &logMemory.tailserial;
-	char c;
-	BaseType_t taken = xSemaphoreTake(logMemory.mutex, 100);
-	char overflow = 0;
-
-	// if we hit overflow
-	if (logMemory.tailserial == (logMemory.head + 1) % LOGSIZE) {
-		overflow = 1;
-	}
-
-	while ((*tail != logMemory.head) && !uart_is_tx_fifo_full(UART_PORT)) {
-		c = logMemory.log[*tail];
-		if (overflow) {
-			c = '^'; // replace the first char with ^ if we overflowed....
-			overflow = 0;
+	static char pending[32];
+	static int pendingLen = 0;
+	static int pendingPos = 0;
+	static unsigned int overruns = 0;
+	logReader_t* r = &logMemory.serial;
+
+	while (!uart_is_tx_fifo_full(UART_PORT)) {
+		if (pendingPos == pendingLen) {
+			pendingPos = 0;
+			pendingLen = getData(pending, sizeof(pending), r);
+			if (pendingLen == 0) {
+				break;
+			}
+			if (overruns != r->overruns) {
+				pending[0] = '^'; // replace the first char with ^ if we overflowed....
+				overruns = r->overruns;
+			}
 		}
 
-		(*tail) = ((*tail) + 1) % LOGSIZE;
-
 		if (direct_serial_log == LOGTYPE_THREAD) {
-			UART_WRITE_BYTE(UART_PORT_INDEX, c);
+			UART_WRITE_BYTE(UART_PORT_INDEX, pending[pendingPos]);
 		}
+		pendingPos++;
 	}
 
-	int remains = (*tail != logMemory.head);
-
-	if (taken == pdTRUE) {
-		xSemaphoreGive(logMemory.mutex);
-	}
-	return remains;
+	return pendingPos != pendingLen || r->cursor != logMemory.head;
 }
 
 #else
 
 static int getSerial(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailserial);
+	int len = getData(buff, buffsize, &logMemory.serial);
 	//bk_printf("got serial: %d:%s\r\n", len, buff);
 	return len;
 }
@@ -451,13 +1011,13 @@ static int getSerial(char* buff, int buffsize) {
 
 
 static int getTcp(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailtcp);
+	int len = getData(buff, buffsize, &logMemory.tcp);
 	//bk_printf("got tcp: %d:%s\r\n", len,buff);
 	return len;
 }
 
 static int getHttp(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailhttp);
+	int len = getData(buff, buffsize, &logMemory.http);
 	//printf("got tcp: %d:%s\r\n", len,buff);
 	return len;
 }
@@ -765,6 +1325,11 @@ commandResult_t log_command(const void* context, const char* cmd, const char* ar
 			result = CMD_RES_OK;
 			break;
 		}
+		if (!stricmp(cmd, "logbinary")) {
+			log_binary = atoi(args);
+			result = CMD_RES_OK;
+			break;
+		}
 
 	} while (0);
 
@@ -15,6 +15,8 @@
 #define _OBK_LOGGING_H
 
 void addLogAdv(int level, int feature, const char *fmt, ...);
+void addLogPacketAdv(int level, int feature, const char *prefix, const unsigned char *data, int len);
+int LOG_FormatHex(char *out, int outSize, const unsigned char *data, int len, int bSpaces);
 void LOG_SetRawSocketCallback(int newFD);
 
 #define ADDLOG_ERROR(x, fmt, ...) addLogAdv(LOG_ERROR, x, fmt, ##__VA_ARGS__)
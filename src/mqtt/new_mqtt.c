@@ -49,64 +49,6 @@ static int g_intervalBetweenMQTTBroadcasts = 60;
 // per second in order not to overload LWIP
 static int g_maxBroadcastItemsPublishedPerSecond = 1;
 
-/////////////////////////////////////////////////////////////
-// mqtt receive buffer, so we can action in our threads, not
-// in tcp_thread
-//
-#define MQTT_RX_BUFFER_MAX 4096
-unsigned char mqtt_rx_buffer[MQTT_RX_BUFFER_MAX];
-int mqtt_rx_buffer_head;
-int mqtt_rx_buffer_tail;
-int mqtt_rx_buffer_count;
-unsigned char temp_topic[128];
-unsigned char temp_data[2048];
-
-int addLenData(int len, const unsigned char *data){
-	mqtt_rx_buffer[mqtt_rx_buffer_head] = (len >> 8) & 0xff;
-	mqtt_rx_buffer_head = (mqtt_rx_buffer_head + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count++;
-	mqtt_rx_buffer[mqtt_rx_buffer_head] = (len) & 0xff;
-	mqtt_rx_buffer_head = (mqtt_rx_buffer_head + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count++;
-	for (int i = 0; i < len; i++){
-		mqtt_rx_buffer[mqtt_rx_buffer_head] = data[i];
-		mqtt_rx_buffer_head = (mqtt_rx_buffer_head + 1) % MQTT_RX_BUFFER_MAX;
-		mqtt_rx_buffer_count++;
-	}
-	return len + 2;
-}
-
-int getLenData(int *len, unsigned char *data, int maxlen){
-	int l;
-	l = mqtt_rx_buffer[mqtt_rx_buffer_tail];
-	mqtt_rx_buffer_tail = (mqtt_rx_buffer_tail + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count--;
-	l = l<<8;
-	l |= mqtt_rx_buffer[mqtt_rx_buffer_tail];
-	mqtt_rx_buffer_tail = (mqtt_rx_buffer_tail + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count--;
-
-	for (int i = 0; i < l; i++){
-		if (i < maxlen){
-			data[i] = mqtt_rx_buffer[mqtt_rx_buffer_tail];
-		}
-		mqtt_rx_buffer_tail = (mqtt_rx_buffer_tail + 1) % MQTT_RX_BUFFER_MAX;
-		mqtt_rx_buffer_count--;
-	}
-	if (mqtt_rx_buffer_count < 0){
-		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_rx buffer underflow!!!");
-		mqtt_rx_buffer_count = 0;
-		mqtt_rx_buffer_tail = mqtt_rx_buffer_head = 0;
-	}
-
-	if (l > maxlen){
-		*len = maxlen;
-	} else {
-		*len = l;
-	}
-	return l + 2;
-}
-
 static SemaphoreHandle_t g_mutex = 0;
 
 static bool MQTT_Mutex_Take(int del) {
@@ -128,6 +70,53 @@ static void MQTT_Mutex_Free()
 	xSemaphoreGive(g_mutex);
 }
 
+/////////////////////////////////////////////////////////////
+// mqtt receive buffer, so we can action in our threads, not
+// in tcp_thread
+//
+// Single producer (tcp_thread) and single consumer (MQTT_process_received),
+// so no mutex is needed: producer only moves head, consumer only moves tail.
+// Every message is kept in one piece, so callbacks get topic and payload
+// straight from the buffer. Layout of a message:
+// [topiclen hi][topiclen lo][datalen hi][datalen lo][topic][0][data][0]
+// A topiclen of MQTT_RX_WRAP means the rest of the buffer is unused,
+// and so is a tail shorter than the message header.
+// Once drained, a message up to half of the buffer always fits.
+//
+#define MQTT_RX_BUFFER_MAX 4096
+#define MQTT_RX_HEADER 4
+#define MQTT_RX_WRAP 0xffff
+static unsigned char mqtt_rx_buffer[MQTT_RX_BUFFER_MAX];
+static volatile int mqtt_rx_buffer_head;
+static volatile int mqtt_rx_buffer_tail;
+
+// returns the offset where a message of given size can be stored,
+// or -1 if it does not fit now
+static int MQTT_RxReserve(int size) {
+	int head = mqtt_rx_buffer_head;
+	int tail = mqtt_rx_buffer_tail;
+
+	if (tail <= head) {
+		// head must never catch up with tail, that would look like empty buffer
+		if (head + size < MQTT_RX_BUFFER_MAX || (head + size == MQTT_RX_BUFFER_MAX && tail != 0)) {
+			return head;
+		}
+		// start again from the beginning
+		if (size < tail) {
+			if (MQTT_RX_BUFFER_MAX - head >= MQTT_RX_HEADER) {
+				mqtt_rx_buffer[head] = MQTT_RX_WRAP >> 8;
+				mqtt_rx_buffer[head + 1] = MQTT_RX_WRAP & 0xff;
+			}
+			return 0;
+		}
+		return -1;
+	}
+	if (head + size < tail) {
+		return head;
+	}
+	return -1;
+}
+
 // this is called from tcp_thread context to queue received mqtt,
 // and then we'll retrieve them from our own thread for processing.
 //
@@ -135,14 +124,29 @@ static void MQTT_Mutex_Free()
 // system can use it to spoof MQTT packets to check if MQTT commands
 // are working...
 int MQTT_Post_Received(const char *topic, int topiclen, const unsigned char *data, int datalen){
-	MQTT_Mutex_Take(100);
-	if ((MQTT_RX_BUFFER_MAX - 1 - mqtt_rx_buffer_count) < topiclen + datalen + 2 + 2){
+	unsigned char *p;
+	int at;
+
+	at = MQTT_RxReserve(MQTT_RX_HEADER + topiclen + 1 + datalen + 1);
+	if (at < 0) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_rx buffer overflow for topic %s", topic);
 	} else {
-		addLenData(topiclen, (unsigned char *)topic);
-		addLenData(datalen, data);
+		p = mqtt_rx_buffer + at;
+		p[0] = (topiclen >> 8) & 0xff;
+		p[1] = topiclen & 0xff;
+		p[2] = (datalen >> 8) & 0xff;
+		p[3] = datalen & 0xff;
+		p += MQTT_RX_HEADER;
+		memcpy(p, topic, topiclen);
+		p[topiclen] = 0;
+		p += topiclen + 1;
+		memcpy(p, data, datalen);
+		p[datalen] = 0;
+		p += datalen + 1;
+		at = p - mqtt_rx_buffer;
+		// publish only after the message is complete
+		mqtt_rx_buffer_head = (at == MQTT_RX_BUFFER_MAX) ? 0 : at;
 	}
-	MQTT_Mutex_Free();
 
 
 #ifdef PLATFORM_BEKEN
@@ -153,30 +157,169 @@ int MQTT_Post_Received(const char *topic, int topiclen, const unsigned char *dat
 int MQTT_Post_Received_Str(const char *topic, const char *data) {
 	return MQTT_Post_Received(topic, strlen(topic), (const unsigned char*)data, strlen(data));
 }
+// Returns the oldest message without removing it, both topic and data
+// are null terminated and stay valid until get_received_done is called.
 int get_received(char **topic, int *topiclen, unsigned char **data, int *datalen){
-	int res = 0;
-	MQTT_Mutex_Take(100);
-	if (mqtt_rx_buffer_tail != mqtt_rx_buffer_head){
-		getLenData(topiclen, temp_topic, sizeof(temp_topic)-1);
-		temp_topic[*topiclen] = 0;
-		getLenData(datalen, temp_data, sizeof(temp_data)-1);
-		temp_data[*datalen] = 0;
-		*topic = (char *)temp_topic;
-		*data = temp_data;
-		res = 1;
-	}
-	MQTT_Mutex_Free();
-	return res;
+	unsigned char *p;
+	int tail;
+
+	while (1) {
+		tail = mqtt_rx_buffer_tail;
+		if (tail == mqtt_rx_buffer_head) {
+			return 0;
+		}
+		p = mqtt_rx_buffer + tail;
+		if (MQTT_RX_BUFFER_MAX - tail < MQTT_RX_HEADER || ((p[0] << 8) | p[1]) == MQTT_RX_WRAP) {
+			mqtt_rx_buffer_tail = 0;
+			continue;
+		}
+		break;
+	}
+	*topiclen = (p[0] << 8) | p[1];
+	*datalen = (p[2] << 8) | p[3];
+	*topic = (char *)(p + MQTT_RX_HEADER);
+	*data = p + MQTT_RX_HEADER + *topiclen + 1;
+	return 1;
+}
+static void get_received_done(int topiclen, int datalen) {
+	int tail = mqtt_rx_buffer_tail + MQTT_RX_HEADER + topiclen + 1 + datalen + 1;
+	if (tail == MQTT_RX_BUFFER_MAX) {
+		tail = 0;
+	}
+	mqtt_rx_buffer_tail = tail;
 }
 //
 //////////////////////////////////////////////////////////////////////
 
-#define MQTT_QUEUE_ITEM_IS_REUSABLE(x)  (x->topic[0] == 0)
-#define MQTT_QUEUE_ITEM_SET_REUSABLE(x) (x->topic[0] = 0)
-
-MqttPublishItem_t* g_MqttPublishQueueHead = NULL;
-int g_MqttPublishItemsQueued = 0;   //Items in the queue waiting to be published. This is not the queue length.
+int g_MqttPublishItemsQueued = 0;   //Items in the queue waiting to be published.
 OBK_Publish_Result PublishQueuedItems();
+
+/////////////////////////////////////////////////////////////
+// Publish queue.
+// All queued publishes live in one arena, used as a ring of records:
+// [size hi][size lo][flags][command][topic][0][channel][0][value][0]
+// Records never wrap, if one does not fit before the arena end, the rest is
+// marked with a size of 0 (or is shorter than the header) and the record starts
+// at the arena beginning. Queueing only moves head and publishing only
+// moves tail. The arena is allocated on first use; its size is the byte limit.
+//
+#define MQTT_PUBLISH_RECORD_HEADER 4
+static unsigned char* g_publishQueue = 0;
+static int g_publishQueueSize = MQTT_PUBLISH_QUEUE_DEFAULT_BYTES;
+static volatile int g_publishQueueHead = 0;
+static volatile int g_publishQueueTail = 0;
+// last queued record, for MQTT_InvokeCommandAtEnd, -1 if none
+static int g_publishQueueLast = -1;
+// record being written by MQTT_QueuePublish_Begin/End, -1 if none
+static int g_publishQueueOpen = -1;
+static int g_publishQueueOpenValue = 0;
+static int g_publishQueueUsed = 0;
+static int g_publishQueueHighWater = 0;
+static int g_publishQueueHighWaterItems = 0;
+static int g_publishQueueRejected = 0;
+
+// returns the offset where a record of given size can be stored, or -1
+static int MQTT_PublishQueue_Reserve(int size) {
+	int head = g_publishQueueHead;
+	int tail = g_publishQueueTail;
+
+	if (tail <= head) {
+		// head must never catch up with tail, that would look like empty queue
+		if (head + size < g_publishQueueSize || (head + size == g_publishQueueSize && tail != 0)) {
+			return head;
+		}
+		if (tail == head && head != 0) {
+			// empty queue, but the free space is split in two. Start over from the
+			// arena beginning; head goes first, so a reader sees at most the wrap mark.
+			if (g_publishQueueSize - head >= MQTT_PUBLISH_RECORD_HEADER) {
+				g_publishQueue[head] = 0;
+				g_publishQueue[head + 1] = 0;
+			}
+			g_publishQueueHead = 0;
+			g_publishQueueTail = 0;
+			return (size < g_publishQueueSize) ? 0 : -1;
+		}
+		if (size < tail) {
+			if (g_publishQueueSize - head >= MQTT_PUBLISH_RECORD_HEADER) {
+				g_publishQueue[head] = 0;
+				g_publishQueue[head + 1] = 0;
+			}
+			return 0;
+		}
+		return -1;
+	}
+	if (head + size < tail) {
+		return head;
+	}
+	return -1;
+}
+// returns the oldest record, or NULL if queue is empty
+static unsigned char* MQTT_PublishQueue_Peek() {
+	unsigned char* p;
+	int tail;
+
+	while (1) {
+		tail = g_publishQueueTail;
+		if (tail == g_publishQueueHead) {
+			return NULL;
+		}
+		p = g_publishQueue + tail;
+		if (g_publishQueueSize - tail < MQTT_PUBLISH_RECORD_HEADER || (p[0] == 0 && p[1] == 0)) {
+			g_publishQueueTail = 0;
+			continue;
+		}
+		return p;
+	}
+}
+static void MQTT_PublishQueue_Pop(unsigned char* p) {
+	int size = (p[0] << 8) | p[1];
+	int tail = (p - g_publishQueue) + size;
+
+	if (tail == g_publishQueueSize) {
+		tail = 0;
+	}
+	if (g_publishQueueLast == p - g_publishQueue) {
+		g_publishQueueLast = -1;
+	}
+	g_publishQueueUsed -= size;
+	g_MqttPublishItemsQueued--;
+	g_publishQueueTail = tail;
+}
+static void MQTT_PublishQueue_Clear() {
+	g_publishQueueHead = g_publishQueueTail = 0;
+	g_publishQueueLast = -1;
+	g_publishQueueOpen = -1;
+	g_publishQueueUsed = 0;
+	g_MqttPublishItemsQueued = 0;
+}
+
+commandResult_t MQTT_PublishQueueCommand(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	int size;
+
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() >= 1) {
+		size = Tokenizer_GetArgInteger(0);
+		if (size < 2048 || size > 0xffff) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Queue size must be between 2048 and 65535 bytes");
+			return CMD_RES_BAD_ARGUMENT;
+		}
+		// queued publishes are dropped
+		MQTT_PublishQueue_Clear();
+		os_free(g_publishQueue);
+		g_publishQueue = 0;
+		g_publishQueueSize = size;
+		g_publishQueueHighWater = 0;
+		g_publishQueueHighWaterItems = 0;
+		g_publishQueueRejected = 0;
+	}
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Publish queue: %i items, %i/%i bytes, high water %i bytes %i items, rejected %i",
+		g_MqttPublishItemsQueued, g_publishQueueUsed, g_publishQueueSize,
+		g_publishQueueHighWater, g_publishQueueHighWaterItems, g_publishQueueRejected);
+
+	return CMD_RES_OK;
+}
 OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags);
 
 // from mqtt.c
@@ -207,6 +350,153 @@ typedef struct mqtt_callback_tag {
 #define MAX_MQTT_CALLBACKS 32
 static mqtt_callback_t* callbacks[MAX_MQTT_CALLBACKS];
 static int numCallbacks = 0;
+
+// Callback topics are prefixes of incoming topics. They are kept in a radix
+// trie, where each node has a bit set for every callback whose topic ends there.
+// Matching a topic walks it once and ORs the bits on the way.
+// The trie is rebuilt whenever callbacks change; there are two copies,
+// so tcp_thread can keep matching on one while the other one is built.
+// Trie keeps its own copy of the labels, callback strings may be freed any time.
+typedef struct mqtt_topicNode_s {
+	// part of callback topic, offset into text of the same trie
+	unsigned short label;
+	unsigned short len;
+	// node indices, 0 means none (root is never a child)
+	unsigned char child;
+	unsigned char next;
+	unsigned int callbackMask;
+} mqtt_topicNode_t;
+
+// each inserted topic adds at most a leaf and a split node
+#define MAX_MQTT_TOPIC_NODES (2 * MAX_MQTT_CALLBACKS + 1)
+// only the part of a topic that is not in the trie yet is stored
+#define MAX_MQTT_TOPIC_TEXT 512
+typedef struct mqtt_topicTrie_s {
+	mqtt_topicNode_t nodes[MAX_MQTT_TOPIC_NODES];
+	char text[MAX_MQTT_TOPIC_TEXT];
+	int nodeCount;
+	int textLen;
+} mqtt_topicTrie_t;
+static mqtt_topicTrie_t g_topicTries[2];
+static volatile int g_topicTrie = 0;
+// incremented before and after every rebuild, see MQTT_TopicTrie_Match
+static volatile unsigned int g_topicTrieGeneration = 0;
+
+static bool MQTT_TopicTrie_Insert(mqtt_topicTrie_t* t, const char* s, int len, unsigned int bit) {
+	mqtt_topicNode_t* nodes = t->nodes;
+	const char* label;
+	int node = 0;
+	int c, prev, mid, common;
+
+	while (len > 0) {
+		for (c = nodes[node].child; c; c = nodes[c].next) {
+			if (t->text[nodes[c].label] == *s) {
+				break;
+			}
+		}
+		if (c == 0) {
+			if (t->textLen + len > MAX_MQTT_TOPIC_TEXT) {
+				return false;
+			}
+			memcpy(t->text + t->textLen, s, len);
+			c = t->nodeCount++;
+			nodes[c].label = t->textLen;
+			nodes[c].len = len;
+			nodes[c].child = 0;
+			nodes[c].next = nodes[node].child;
+			nodes[c].callbackMask = bit;
+			nodes[node].child = c;
+			t->textLen += len;
+			return true;
+		}
+		label = t->text + nodes[c].label;
+		common = 1;
+		while (common < len && common < nodes[c].len && label[common] == s[common]) {
+			common++;
+		}
+		if (common < nodes[c].len) {
+			// split, new node takes the place of c and c becomes its child
+			mid = t->nodeCount++;
+			nodes[mid] = nodes[c];
+			nodes[mid].len = common;
+			nodes[mid].child = c;
+			nodes[mid].callbackMask = 0;
+			nodes[c].label += common;
+			nodes[c].len -= common;
+			nodes[c].next = 0;
+			if (nodes[node].child == c) {
+				nodes[node].child = mid;
+			}
+			else {
+				for (prev = nodes[node].child; nodes[prev].next != c; prev = nodes[prev].next) {
+				}
+				nodes[prev].next = mid;
+			}
+			c = mid;
+		}
+		node = c;
+		s += common;
+		len -= common;
+	}
+	nodes[node].callbackMask |= bit;
+	return true;
+}
+static void MQTT_TopicTrie_Rebuild() {
+	int next = !g_topicTrie;
+	mqtt_topicTrie_t* t = &g_topicTries[next];
+	int i;
+
+	g_topicTrieGeneration++;
+	memset(&t->nodes[0], 0, sizeof(t->nodes[0]));
+	t->nodeCount = 1;
+	t->textLen = 0;
+	for (i = 0; i < numCallbacks; i++) {
+		if (callbacks[i] && callbacks[i]->topic) {
+			if (!MQTT_TopicTrie_Insert(t, callbacks[i]->topic, strlen(callbacks[i]->topic), 1u << i)) {
+				addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT topic %s does not fit in topic table", callbacks[i]->topic);
+			}
+		}
+	}
+	g_topicTrie = next;
+	g_topicTrieGeneration++;
+}
+// walk of one trie copy, bounded so a copy rewritten meanwhile can't send it out of the arrays
+static unsigned int MQTT_TopicTrie_MatchIn(const mqtt_topicTrie_t* t, const char* topic) {
+	const mqtt_topicNode_t* n;
+	unsigned int mask = t->nodes[0].callbackMask;
+	int c = t->nodes[0].child;
+	int steps;
+
+	for (steps = 0; c && c < MAX_MQTT_TOPIC_NODES && steps < 2 * MAX_MQTT_TOPIC_NODES; steps++) {
+		n = &t->nodes[c];
+		if (n->label + n->len > MAX_MQTT_TOPIC_TEXT) {
+			break;
+		}
+		if (t->text[n->label] != *topic) {
+			c = n->next;
+			continue;
+		}
+		if (strncmp(t->text + n->label, topic, n->len)) {
+			break;
+		}
+		mask |= n->callbackMask;
+		topic += n->len;
+		c = n->child;
+	}
+	return mask;
+}
+// returns bit mask of callbacks which topic is a prefix of given topic
+static unsigned int MQTT_TopicTrie_Match(const char* topic) {
+	unsigned int generation, mask;
+
+	// called from tcp_thread, while callbacks may be changed in main thread;
+	// if a rebuild ran meanwhile, it may have rewritten the copy we walked
+	do {
+		generation = g_topicTrieGeneration;
+		mask = MQTT_TopicTrie_MatchIn(&g_topicTries[g_topicTrie], topic);
+	} while (generation != g_topicTrieGeneration);
+	return mask;
+}
 // note: only one incomming can be processed at a time.
 static obk_mqtt_request_t g_mqtt_request;
 static obk_mqtt_request_t g_mqtt_request_cb;
@@ -367,6 +657,7 @@ void MQTT_ClearCallbacks() {
 			callbacks[i] = 0;
 		}
 	}
+	MQTT_TopicTrie_Rebuild();
 }
 // this can REPLACE callbacks, since we MAY wish to change the root topic....
 // in which case we would re-resigster all callbacks?
@@ -449,10 +740,12 @@ int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic,
 		}
 	}
 
+	callbacks[index]->ID = ID;
 	callbacks[index]->callback = callback;
 	if (index == numCallbacks) {
 		numCallbacks++;
 	}
+	MQTT_TopicTrie_Rebuild();
 
 	if (subscribechange) {
 		mqtt_reconnect = 8;
@@ -463,20 +756,21 @@ int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic,
 
 int MQTT_RemoveCallback(int ID) {
 	int index;
+	mqtt_callback_t* cb;
 
 	for (index = 0; index < numCallbacks; index++) {
 		if (callbacks[index]) {
 			if (callbacks[index]->ID == ID) {
-				if (callbacks[index]->topic) {
-					os_free(callbacks[index]->topic);
-					callbacks[index]->topic = NULL;
+				cb = callbacks[index];
+				callbacks[index] = NULL;
+				MQTT_TopicTrie_Rebuild();
+				if (cb->topic) {
+					os_free(cb->topic);
 				}
-				if (callbacks[index]->subscriptionTopic) {
-					os_free(callbacks[index]->subscriptionTopic);
-					callbacks[index]->subscriptionTopic = NULL;
+				if (cb->subscriptionTopic) {
+					os_free(cb->subscriptionTopic);
 				}
-				os_free(callbacks[index]);
-				callbacks[index] = NULL;
+				os_free(cb);
 				mqtt_reconnect = 8;
 				return 1;
 			}
@@ -899,7 +1193,7 @@ OBK_Publish_Result MQTT_Publish(const char* sTopic, const char* sChannel, const
 }
 
 void MQTT_OBK_Printf(char* s) {
-	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, s);
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "%s", s);
 }
 
 ////////////////////////////////////////
@@ -907,7 +1201,6 @@ void MQTT_OBK_Printf(char* s) {
 // we should do callbacks from one of our threads?
 static void mqtt_incoming_data_cb(void* arg, const u8_t* data, u16_t len, u8_t flags)
 {
-	int i;
 	// unused - left here as example
 	//const struct mqtt_connect_client_info_t* client_info = (const struct mqtt_connect_client_info_t*)arg;
 
@@ -921,60 +1214,51 @@ static void mqtt_incoming_data_cb(void* arg, const u8_t* data, u16_t len, u8_t f
 		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT in topic %s", g_mqtt_request.topic);
 		mqtt_received_events++;
 
-		for (i = 0; i < numCallbacks; i++)
-		{
-			if (callbacks[i] == 0)
-				continue;
-			char* cbtopic = callbacks[i]->topic;
-			if (!strncmp(g_mqtt_request.topic, cbtopic, strlen(cbtopic)))
-			{
-				MQTT_Post_Received(g_mqtt_request.topic, strlen(g_mqtt_request.topic), data, len);
-				// if ANYONE is interested, store it.
-				break;
-				// note - callback must return 1 to say it ate the mqtt, else further processing can be performed.
-				// i.e. multiple people can get each topic if required.
-				//if (callbacks[i]->callback(&g_mqtt_request))
-				//{
-				//	return;
-				//}
-			}
-		}
-		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT topic not handled: %s", g_mqtt_request.topic);
+		// if ANYONE is interested, store it.
+		MQTT_Post_Received(g_mqtt_request.topic, strlen(g_mqtt_request.topic), data, len);
 	}
 }
 
 
 // run from userland (quicktick or wakeable thread)
 int MQTT_process_received(){
+	static bool bProcessing = false;
 	char *topic;
 	int topiclen;
 	unsigned char *data;
 	int datalen;
-	int found = 0;
+	unsigned int mask;
+	int i;
 	int count = 0;
-	do{
-		found = get_received(&topic, &topiclen, &data, &datalen);
-		if (found){
-			count++;
-			strncpy(g_mqtt_request_cb.topic, topic, sizeof(g_mqtt_request_cb.topic));
-			g_mqtt_request_cb.received = data;
-			g_mqtt_request_cb.receivedLen = datalen;
-			for (int i = 0; i < numCallbacks; i++)
+
+	// callbacks read the message straight from the receive buffer, so
+	// a nested call must not pick the same message again
+	if (bProcessing) {
+		return 0;
+	}
+	bProcessing = true;
+	while (get_received(&topic, &topiclen, &data, &datalen)) {
+		count++;
+		strncpy(g_mqtt_request_cb.topic, topic, sizeof(g_mqtt_request_cb.topic) - 1);
+		g_mqtt_request_cb.topic[sizeof(g_mqtt_request_cb.topic) - 1] = 0;
+		g_mqtt_request_cb.received = data;
+		g_mqtt_request_cb.receivedLen = datalen;
+		mask = MQTT_TopicTrie_Match(topic);
+		for (i = 0; mask; i++, mask >>= 1)
+		{
+			if ((mask & 1) == 0 || callbacks[i] == 0)
+				continue;
+			// note - callback must return 1 to say it ate the mqtt, else further processing can be performed.
+			// i.e. multiple people can get each topic if required.
+			if (callbacks[i]->callback(&g_mqtt_request_cb))
 			{
-				char* cbtopic = callbacks[i]->topic;
-				if (!strncmp(topic, cbtopic, strlen(cbtopic)))
-				{
-					// note - callback must return 1 to say it ate the mqtt, else further processing can be performed.
-					// i.e. multiple people can get each topic if required.
-					if (callbacks[i]->callback(&g_mqtt_request_cb))
-					{
-						// if no further processing, then break this loop.
-						break;
-					}
-				}
+				// if no further processing, then break this loop.
+				break;
 			}
 		}
-	} while (found);
+		get_received_done(topiclen, datalen);
+	}
+	bProcessing = false;
 
 	return count;
 }
@@ -985,21 +1269,19 @@ int MQTT_process_received(){
 static void mqtt_incoming_publish_cb(void* arg, const char* topic, u32_t tot_len)
 {
 	//const char *p;
-	int i;
 	// unused - left here as example
 	//const struct mqtt_connect_client_info_t* client_info = (const struct mqtt_connect_client_info_t*)arg;
 
-	// look for a callback with this URL and method, or HTTP_ANY
+	// look for a callback interested in this topic
 	g_mqtt_request.topic[0] = '\0';
-	for (i = 0; i < numCallbacks; i++)
+	if (MQTT_TopicTrie_Match(topic))
 	{
-		char* cbtopic = callbacks[i]->topic;
-		if (strncmp(topic, cbtopic, strlen(cbtopic)))
-		{
-			strncpy(g_mqtt_request.topic, topic, sizeof(g_mqtt_request.topic) - 1);
-			g_mqtt_request.topic[sizeof(g_mqtt_request.topic) - 1] = 0;
-			break;
-		}
+		strncpy(g_mqtt_request.topic, topic, sizeof(g_mqtt_request.topic) - 1);
+		g_mqtt_request.topic[sizeof(g_mqtt_request.topic) - 1] = 0;
+	}
+	else
+	{
+		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT topic not handled: %s", topic);
 	}
 	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT client in mqtt_incoming_publish_cb topic %s\n", topic);
 }
@@ -1404,7 +1686,7 @@ void MQTT_Test_Tick(void* param)
 					if (err == ERR_OK)
 					{
 						/* Report published */
-						addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, info->value);
+						addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "%s", info->value);
 						info->report_published = true;
 						/* Stop timer */
 					}
@@ -1626,6 +1908,11 @@ void MQTT_init()
 	//cmddetail:"fn":"MQTT_SetMaxBroadcastItemsPublishedPerSecond","file":"mqtt/new_mqtt.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("mqtt_broadcastItemsPerSec", NULL, MQTT_SetMaxBroadcastItemsPublishedPerSecond, NULL, NULL);
+	//cmddetail:{"name":"mqtt_publishQueue","args":"[OptionalSizeInBytes]",
+	//cmddetail:"descr":"Prints publish queue statistics (items, bytes used, high water mark, rejected publishes). With an argument, sets the queue size in bytes; publishes still in the queue are dropped. Default size is 8192 bytes.",
+	//cmddetail:"fn":"MQTT_PublishQueueCommand","file":"mqtt/new_mqtt.c","requires":"",
+	//cmddetail:"examples":"mqtt_publishQueue 4096"}
+	CMD_RegisterCommand("mqtt_publishQueue", NULL, MQTT_PublishQueueCommand, NULL, NULL);
 }
 
 OBK_Publish_Result MQTT_DoItemPublishString(const char* sChannel, const char* valueStr)
@@ -1971,23 +2258,95 @@ int MQTT_RunEverySecondUpdate()
 	return 1;
 }
 
-MqttPublishItem_t* get_queue_tail(MqttPublishItem_t* head) {
-	if (head == NULL) { return NULL; }
+/// @brief Starts a queued publish whose value is written in place, straight into the queue.
+/// Space for maxValueLen characters (plus terminator) is reserved, the caller writes the value
+/// into returned buffer and then calls MQTT_QueuePublish_End with the real length.
+/// Only one record can be open at a time.
+/// @param topic 
+/// @param channel 
+/// @param maxValueLen 
+/// @param flags
+/// @return Value buffer, or NULL if the queue has no room right now
+char* MQTT_QueuePublish_Begin(const char* topic, const char* channel, int maxValueLen, int flags) {
+	unsigned char* p;
+	int topicLen, channelLen;
+	int size, at;
+
+	topicLen = strlen(topic);
+	channelLen = strlen(channel);
+	if ((topicLen > MQTT_PUBLISH_ITEM_TOPIC_LENGTH) ||
+		(channelLen > MQTT_PUBLISH_ITEM_CHANNEL_LENGTH) ||
+		(maxValueLen > MQTT_PUBLISH_ITEM_VALUE_LENGTH)) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! Topic (%i), channel (%i) or value (%i) exceeds size limit\r\n",
+			topicLen, channelLen, maxValueLen);
+		return NULL;
+	}
+
+	if (g_publishQueue == 0) {
+		g_publishQueue = (unsigned char*)os_malloc(g_publishQueueSize);
+		if (g_publishQueue == 0) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! Out of memory\r\n");
+			return NULL;
+		}
+		MQTT_PublishQueue_Clear();
+	}
 
-	while (head->next != NULL) {
-		head = head->next;
+	size = MQTT_PUBLISH_RECORD_HEADER + topicLen + 1 + channelLen + 1 + maxValueLen + 1;
+	at = MQTT_PublishQueue_Reserve(size);
+	if (at < 0) {
+		g_publishQueueRejected++;
+		return NULL;
 	}
-	return head;
+
+	p = g_publishQueue + at;
+	p[2] = flags;
+	p[3] = None;
+	p += MQTT_PUBLISH_RECORD_HEADER;
+	memcpy(p, topic, topicLen + 1);
+	p += topicLen + 1;
+	memcpy(p, channel, channelLen + 1);
+	p += channelLen + 1;
+
+	g_publishQueueOpen = at;
+	g_publishQueueOpenValue = p - g_publishQueue;
+	return (char*)p;
 }
 
-MqttPublishItem_t* find_queue_reusable_item(MqttPublishItem_t* head) {
-	while (head != NULL) {
-		if (MQTT_QUEUE_ITEM_IS_REUSABLE(head)) {
-			return head;
-		}
-		head = head->next;
+/// @brief Finishes the record started with MQTT_QueuePublish_Begin.
+/// @param valueLen Length of value written, or -1 to drop the record
+void MQTT_QueuePublish_End(int valueLen) {
+	unsigned char* p;
+	int size, at;
+
+	at = g_publishQueueOpen;
+	if (at < 0) {
+		return;
+	}
+	g_publishQueueOpen = -1;
+	if (valueLen < 0) {
+		return;
 	}
-	return head;
+
+	size = g_publishQueueOpenValue + valueLen + 1 - at;
+	p = g_publishQueue + at;
+	p[0] = size >> 8;
+	p[1] = size & 0xff;
+	p[size - 1] = 0;
+
+	g_publishQueueLast = at;
+	at += size;
+	g_publishQueueHead = (at == g_publishQueueSize) ? 0 : at;
+
+	g_publishQueueUsed += size;
+	g_MqttPublishItemsQueued++;
+	if (g_publishQueueUsed > g_publishQueueHighWater) {
+		g_publishQueueHighWater = g_publishQueueUsed;
+	}
+	if (g_MqttPublishItemsQueued > g_publishQueueHighWaterItems) {
+		g_publishQueueHighWaterItems = g_MqttPublishItemsQueued;
+	}
+	p += MQTT_PUBLISH_RECORD_HEADER;
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Queued topic=%s/%s, %i items in queue", p, p + strlen((char*)p) + 1, g_MqttPublishItemsQueued);
 }
 
 /// @brief Queue an entry for publish and execute a command after the publish.
@@ -1997,57 +2356,31 @@ MqttPublishItem_t* find_queue_reusable_item(MqttPublishItem_t* head) {
 /// @param flags
 /// @param command Command to execute after the publish
 void MQTT_QueuePublishWithCommand(const char* topic, const char* channel, const char* value, int flags, PostPublishCommands command) {
-	MqttPublishItem_t* newItem;
-	if (g_MqttPublishItemsQueued >= MQTT_MAX_QUEUE_SIZE) {
-		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! %i items already present\r\n", g_MqttPublishItemsQueued);
-		return;
-	}
-
-	if ((strlen(topic) > MQTT_PUBLISH_ITEM_TOPIC_LENGTH) ||
-		(strlen(channel) > MQTT_PUBLISH_ITEM_CHANNEL_LENGTH) ||
-		(strlen(value) > MQTT_PUBLISH_ITEM_VALUE_LENGTH)) {
-		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! Topic (%i), channel (%i) or value (%i) exceeds size limit\r\n",
-			strlen(topic), strlen(channel), strlen(value));
-		return;
-	}
-
-	//Queue data for publish. This might be a new item in the queue or an existing item. This is done to prevent
-	//memory fragmentation. The total queue length is limited to MQTT_MAX_QUEUE_SIZE.
-
-	if (g_MqttPublishQueueHead == NULL) {
-		g_MqttPublishQueueHead = newItem = os_malloc(sizeof(MqttPublishItem_t));
-		newItem->next = NULL;
-	}
-	else {
-		newItem = find_queue_reusable_item(g_MqttPublishQueueHead);
+	char* p;
+	int valueLen;
+	int rejected = g_publishQueueRejected;
 
-		if (newItem == NULL) {
-			newItem = os_malloc(sizeof(MqttPublishItem_t));
-			newItem->next = NULL;
-			get_queue_tail(g_MqttPublishQueueHead)->next = newItem; //Append new item
+	valueLen = strlen(value);
+	p = MQTT_QueuePublish_Begin(topic, channel, valueLen, flags);
+	if (p == NULL) {
+		if (rejected != g_publishQueueRejected) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! %i items (%i bytes) already present\r\n", g_MqttPublishItemsQueued, g_publishQueueUsed);
 		}
+		return;
 	}
-
-	//os_strcpy does copy ending null character.
-	os_strcpy(newItem->topic, topic);
-	os_strcpy(newItem->channel, channel);
-	os_strcpy(newItem->value, value);
-	newItem->command = command;
-	newItem->flags = flags;
-
-	g_MqttPublishItemsQueued++;
-	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Queued topic=%s/%s, %i items in queue", newItem->topic, newItem->channel, g_MqttPublishItemsQueued);
+	memcpy(p, value, valueLen + 1);
+	MQTT_QueuePublish_End(valueLen);
+	g_publishQueue[g_publishQueueLast + 3] = command;
 }
 
 /// @brief Add the specified command to the last entry in the queue.
 /// @param command 
 void MQTT_InvokeCommandAtEnd(PostPublishCommands command) {
-	MqttPublishItem_t* tail = get_queue_tail(g_MqttPublishQueueHead);
-	if (tail == NULL){
+	if (g_publishQueueLast < 0){
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "InvokeCommandAtEnd invoked but queue is empty");
 	}
 	else {
-		tail->command = command;
+		g_publishQueue[g_publishQueueLast + 3] = command;
 	}
 }
 
@@ -2065,39 +2398,36 @@ void MQTT_QueuePublish(const char* topic, const char* channel, const char* value
 /// @return 
 OBK_Publish_Result PublishQueuedItems() {
 	OBK_Publish_Result result = OBK_PUBLISH_WAS_NOT_REQUIRED;
-
+	unsigned char* p;
+	const char* topic;
+	const char* channel;
+	const char* value;
 	int count = 0;
-	MqttPublishItem_t* head = g_MqttPublishQueueHead;
-
-	//The next actionable item might not be at the front. The queue size is limited to MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE
-	//so this traversal is fast.
-	//addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"PublishQueuedItems g_MqttPublishItemsQueued=%i",g_MqttPublishItemsQueued );
-	while ((head != NULL) && (count < MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE) && (g_MqttPublishItemsQueued > 0)) {
-		if (!MQTT_QUEUE_ITEM_IS_REUSABLE(head)) {  //Skip reusable entries
-			count++;
-			result = MQTT_PublishTopicToClient(mqtt_client, head->topic, head->channel, head->value, head->flags, false);
-			MQTT_QUEUE_ITEM_SET_REUSABLE(head); //Flag item as reusable
-			g_MqttPublishItemsQueued--;   //decrement queued count
-
-			//Stop if last publish failed
-			if (result != OBK_PUBLISH_OK) break;
-
-			switch (head->command) {
-			case None:
-				break;
-			case PublishAll:
-				MQTT_PublishWholeDeviceState_Internal(true);
-				break;
-			case PublishChannels:
-				MQTT_PublishOnlyDeviceChannelsIfPossible();
-				break;
-			}
-		}
-		else {
-			//addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"PublishQueuedItems item skipped reusable");
+	int command;
+
+	while ((count < MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE) && (p = MQTT_PublishQueue_Peek()) != NULL) {
+		count++;
+		topic = (const char*)p + MQTT_PUBLISH_RECORD_HEADER;
+		channel = topic + strlen(topic) + 1;
+		value = channel + strlen(channel) + 1;
+		// publish straight from the queue, the record is released afterwards
+		result = MQTT_PublishTopicToClient(mqtt_client, topic, channel, value, p[2], false);
+		command = p[3];
+		MQTT_PublishQueue_Pop(p);
+
+		//Stop if last publish failed
+		if (result != OBK_PUBLISH_OK) break;
+
+		switch (command) {
+		case None:
+			break;
+		case PublishAll:
+			MQTT_PublishWholeDeviceState_Internal(true);
+			break;
+		case PublishChannels:
+			MQTT_PublishOnlyDeviceChannelsIfPossible();
+			break;
 		}
-
-		head = head->next;
 	}
 
 	return result;
@@ -82,16 +82,9 @@ typedef enum PostPublishCommands_e {
 } PostPublishCommands;
 
 
-/// @brief Publish queue item
-typedef struct MqttPublishItem
-{
-	char topic[MQTT_PUBLISH_ITEM_TOPIC_LENGTH];
-	char channel[MQTT_PUBLISH_ITEM_CHANNEL_LENGTH];
-	char value[MQTT_PUBLISH_ITEM_VALUE_LENGTH];
-	int flags;
-	struct MqttPublishItem* next;
-	PostPublishCommands command;
-} MqttPublishItem_t;
+// Default size of the publish queue arena, can be changed with mqtt_publishQueue.
+// A queued publish takes its string lengths plus 7 bytes.
+#define MQTT_PUBLISH_QUEUE_DEFAULT_BYTES	8192
 
 
 // Maximum length to log data parameters
@@ -99,7 +92,6 @@ typedef struct MqttPublishItem
 
 // Count of queued items published at once.
 #define MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE	3
-#define MQTT_MAX_QUEUE_SIZE	                7
 
 // callback function for mqtt.
 // return 0 to allow the incoming topic/data to be processed by others/channel set.
@@ -140,6 +132,8 @@ OBK_Publish_Result MQTT_ChannelChangeCallback(int channel, int iVal);
 void MQTT_PublishOnlyDeviceChannelsIfPossible();
 void MQTT_QueuePublish(const char* topic, const char* channel, const char* value, int flags);
 void MQTT_QueuePublishWithCommand(const char* topic, const char* channel, const char* value, int flags, PostPublishCommands command);
+char* MQTT_QueuePublish_Begin(const char* topic, const char* channel, int maxValueLen, int flags);
+void MQTT_QueuePublish_End(int valueLen);
 OBK_Publish_Result MQTT_Publish(const char* sTopic, const char* sChannel, const char* value, int flags);
 OBK_Publish_Result MQTT_PublishStat(const char* statName, const char* statValue);
 OBK_Publish_Result MQTT_PublishTele(const char* teleName, const char* teleValue);
@@ -197,6 +197,7 @@ void CFG_SetDefaultConfig() {
 	CFG_SetDefaultLEDCorrectionTable();
 
 	g_cfg_pendingChanges++;
+	PIN_RebuildChannelIndex();
 }
 
 const char *CFG_GetWebappRoot(){
@@ -411,6 +412,7 @@ void CFG_SetMQTTPass(const char *s) {
 void CFG_ClearPins() {
 	memset(&g_cfg.pins,0,sizeof(g_cfg.pins));
 	g_cfg_pendingChanges++;
+	PIN_RebuildChannelIndex();
 }
 void CFG_IncrementOTACount() {
 	g_cfg.otaCounter++;
@@ -531,6 +533,7 @@ void PIN_SetPinChannelForPinIndex(int index, int ch) {
 	if(g_cfg.pins.channels[index] != ch) {
 		g_cfg_pendingChanges++;
 		g_cfg.pins.channels[index] = ch;
+		PIN_RebuildChannelIndex();
 	}
 }
 void PIN_SetPinChannel2ForPinIndex(int index, int ch) {
@@ -541,6 +544,7 @@ void PIN_SetPinChannel2ForPinIndex(int index, int ch) {
 	if(g_cfg.pins.channels2[index] != ch) {
 		g_cfg_pendingChanges++;
 		g_cfg.pins.channels2[index] = ch;
+		PIN_RebuildChannelIndex();
 	}
 }
 //void CFG_ApplyStartChannelValues() {
@@ -665,5 +669,6 @@ void CFG_InitAndLoad() {
 		CFG_SetDefaultLEDCorrectionTable();
 	}
 	g_configInitialized = 1;
+	PIN_RebuildChannelIndex();
 	CFG_Save_IfThereArePendingChanges();
 }
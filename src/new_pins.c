@@ -48,16 +48,15 @@ typedef enum {
 }BTN_PRESS_EVT;
 
 typedef struct pinButton_ {
-	uint16_t ticks;
-	uint16_t holdRepeatTicks;
+	// timestamps (ms) of entering current state and of last hold repeat
+	uint32_t stateTime;
+	uint32_t holdRepeatTime;
 	uint8_t  repeat : 4;
 	uint8_t  event : 4;
 	uint8_t  state : 3;
 	uint8_t  active_level : 1;
 	uint8_t  button_level : 1;
 
-	uint8_t  debounce_cnt; // make a full byte, so we can count ms
-	
 	uint8_t  (*hal_button_Level)(void *self);
 }pinButton_s;
 
@@ -74,10 +73,181 @@ pinButton_s g_buttons[PLATFORM_GPIO_MAX];
 
 void (*g_doubleClickCallback)(int pinIndex) = 0;
 
-static short g_times[PLATFORM_GPIO_MAX];
-static short g_times2[PLATFORM_GPIO_MAX];
+// Input debouncing works on timestamps (ms), not on per-tick counters.
+// g_pinStableTimes is the last time pin level was seen equal to its debounced state,
+// it is also set by edge interrupt, so a pin that was not polled for a while
+// still gets the real edge time.
+// g_pinToggleTimes is the time of last IOR_ToggleChannelOnToggle toggle.
+static uint32_t g_pinStableTimes[PLATFORM_GPIO_MAX];
+static uint32_t g_pinToggleTimes[PLATFORM_GPIO_MAX];
 static byte g_lastValidState[PLATFORM_GPIO_MAX];
 
+// Reverse index of g_cfg.pins, so channel code does not have to scan all pins.
+// For every channel, bit i of pins is set if pin i (with role other than IOR_None)
+// uses this channel, pins2 is the same for the second channel (DHT etc).
+// roles/roles2 have bit set for every role of these pins.
+// Rebuilt whenever pin role or channel changes and when config is loaded.
+typedef struct channelPins_s {
+	uint32_t pins;
+	uint32_t pins2;
+	uint64_t roles;
+	uint64_t roles2;
+} channelPins_t;
+
+static channelPins_t g_channelPins[CHANNEL_MAX];
+
+// IOR_Total_Options must stay below 64 for the role masks
+#define ROLE_BIT(role) (((uint64_t)1) << (role))
+#define ROLE_MASK_RELAY (ROLE_BIT(IOR_Relay) | ROLE_BIT(IOR_Relay_n))
+#define ROLE_MASK_RELAY_OR_LED (ROLE_MASK_RELAY | ROLE_BIT(IOR_LED) | ROLE_BIT(IOR_LED_n))
+#define ROLE_MASK_PWM (ROLE_BIT(IOR_PWM) | ROLE_BIT(IOR_PWM_n))
+#define ROLE_MASK_DIGITAL_INPUT (ROLE_BIT(IOR_DigitalInput) | ROLE_BIT(IOR_DigitalInput_n) \
+	| ROLE_BIT(IOR_DigitalInput_NoPup) | ROLE_BIT(IOR_DigitalInput_NoPup_n))
+#define ROLE_MASK_DHT (ROLE_BIT(IOR_DHT11) | ROLE_BIT(IOR_DHT12) | ROLE_BIT(IOR_DHT21) | ROLE_BIT(IOR_DHT22))
+#define ROLE_MASK_TEMP_HUM (ROLE_BIT(IOR_CHT8305_DAT) | ROLE_BIT(IOR_SHT3X_DAT))
+
+#define ROLE_MASK_BUTTON (ROLE_BIT(IOR_Button) | ROLE_BIT(IOR_Button_n) \
+	| ROLE_BIT(IOR_Button_ToggleAll) | ROLE_BIT(IOR_Button_ToggleAll_n) \
+	| ROLE_BIT(IOR_Button_NextColor) | ROLE_BIT(IOR_Button_NextColor_n) \
+	| ROLE_BIT(IOR_Button_NextDimmer) | ROLE_BIT(IOR_Button_NextDimmer_n) \
+	| ROLE_BIT(IOR_Button_NextTemperature) | ROLE_BIT(IOR_Button_NextTemperature_n) \
+	| ROLE_BIT(IOR_Button_ScriptOnly) | ROLE_BIT(IOR_Button_ScriptOnly_n))
+
+static uint64_t PIN_RoleBit(int role) {
+	if (role < 0 || role >= 64)
+		return 0;
+	return ROLE_BIT(role);
+}
+
+// PIN_ticks work is dispatched by role, each handler only gets pins that have one of its roles.
+// Handler returns non-zero while pin is busy (pressed, debouncing, etc) and must be polled again.
+typedef int (*pinTickHandler_t)(int index, uint32_t now);
+typedef struct pinTickRole_s {
+	uint64_t roles;
+	pinTickHandler_t handler;
+} pinTickRole_t;
+
+static int PIN_Tick_DigitalInput(int index, uint32_t now);
+static int PIN_Tick_ToggleChannelOnToggle(int index, uint32_t now);
+int PIN_Input_Handler(int pinIndex, uint32_t now);
+
+static const pinTickRole_t g_pinTickRoles[] = {
+	{ ROLE_MASK_BUTTON, PIN_Input_Handler },
+	{ ROLE_MASK_DIGITAL_INPUT, PIN_Tick_DigitalInput },
+	{ ROLE_BIT(IOR_ToggleChannelOnToggle), PIN_Tick_ToggleChannelOnToggle },
+};
+#define PIN_TICK_ROLES (sizeof(g_pinTickRoles) / sizeof(g_pinTickRoles[0]))
+
+// pins for each g_pinTickRoles entry
+static uint32_t g_pinTickPins[PIN_TICK_ROLES];
+// PWM pins, and PWM pins whose channel has changed since last PIN_ApplyDirtyPWM
+static uint32_t g_pwmPins;
+static volatile uint32_t g_pwmDirtyPins;
+
+// Input pins with edge interrupt are not polled while idle.
+// After an edge they are polled until handler reports them settled,
+// then interrupt is armed again for the edge away from current level.
+// Pins without interrupt support in HAL are polled on every tick.
+static uint32_t g_pinsEdgeMask;
+static uint32_t g_pinsBusy;
+static volatile uint32_t g_pinsWoken;
+
+// g_pinsWoken is set from edge ISR and g_pwmDirtyPins from HTTP/MQTT/command threads,
+// so read-modify-write of them from elsewhere must not be interrupted.
+// Beken is the only platform with pin interrupts; Windows simulator is single threaded.
+#if defined(PLATFORM_BEKEN)
+#define PIN_MASK_LOCK_DECLARATION()	GLOBAL_INT_DECLARATION()
+#define PIN_MASK_LOCK()				GLOBAL_INT_DISABLE()
+#define PIN_MASK_UNLOCK()			GLOBAL_INT_RESTORE()
+#elif defined(PLATFORM_BL602) || defined(PLATFORM_W600) || defined(PLATFORM_W800)
+#define PIN_MASK_LOCK_DECLARATION()
+#define PIN_MASK_LOCK()				taskENTER_CRITICAL()
+#define PIN_MASK_UNLOCK()			taskEXIT_CRITICAL()
+#else
+#define PIN_MASK_LOCK_DECLARATION()
+#define PIN_MASK_LOCK()
+#define PIN_MASK_UNLOCK()
+#endif
+
+static void PIN_SetMaskBits(volatile uint32_t *mask, uint32_t bits) {
+	PIN_MASK_LOCK_DECLARATION();
+
+	PIN_MASK_LOCK();
+	*mask |= bits;
+	PIN_MASK_UNLOCK();
+}
+// clears given bits and returns those of them that were set
+static uint32_t PIN_TakeMaskBits(volatile uint32_t *mask, uint32_t bits) {
+	uint32_t taken;
+	PIN_MASK_LOCK_DECLARATION();
+
+	PIN_MASK_LOCK();
+	taken = *mask & bits;
+	*mask &= ~taken;
+	PIN_MASK_UNLOCK();
+	return taken;
+}
+
+void PIN_RebuildChannelIndex() {
+	int i;
+	int h;
+	int ch;
+	int role;
+
+	memset(g_channelPins, 0, sizeof(g_channelPins));
+	memset(g_pinTickPins, 0, sizeof(g_pinTickPins));
+	g_pwmPins = 0;
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		role = g_cfg.pins.roles[i];
+		if (role == IOR_None)
+			continue;
+		ch = g_cfg.pins.channels[i];
+		if (ch >= 0 && ch < CHANNEL_MAX) {
+			g_channelPins[ch].pins |= (1 << i);
+			g_channelPins[ch].roles |= PIN_RoleBit(role);
+		}
+		ch = g_cfg.pins.channels2[i];
+		if (ch >= 0 && ch < CHANNEL_MAX) {
+			g_channelPins[ch].pins2 |= (1 << i);
+			g_channelPins[ch].roles2 |= PIN_RoleBit(role);
+		}
+		for (h = 0; h < PIN_TICK_ROLES; h++) {
+			if (g_pinTickRoles[h].roles & PIN_RoleBit(role)) {
+				g_pinTickPins[h] |= (1 << i);
+			}
+		}
+		if (ROLE_MASK_PWM & PIN_RoleBit(role)) {
+			g_pwmPins |= (1 << i);
+		}
+	}
+	// new PWM pins get their value on next tick
+	g_pwmDirtyPins = g_pwmPins;
+}
+
+// PWM is not pushed on every tick, only pins of changed channels are updated
+static void PIN_MarkChannelPWMDirty(int ch) {
+	PIN_SetMaskBits(&g_pwmDirtyPins, g_channelPins[ch].pins & g_pwmPins);
+}
+void PIN_ApplyDirtyPWM() {
+	uint32_t pins;
+	int i;
+
+	if (g_pwmDirtyPins == 0)
+		return;
+	pins = PIN_TakeMaskBits(&g_pwmDirtyPins, 0xFFFFFFFF);
+	for (i = 0; pins; i++, pins >>= 1) {
+		if ((pins & 1) == 0)
+			continue;
+		if (g_cfg.pins.roles[i] == IOR_PWM) {
+			HAL_PIN_PWM_Update(i, g_channelValuesFloats[g_cfg.pins.channels[i]]);
+		}
+		else if (g_cfg.pins.roles[i] == IOR_PWM_n) {
+			// invert PWM value
+			HAL_PIN_PWM_Update(i, 100 - g_channelValuesFloats[g_cfg.pins.channels[i]]);
+		}
+	}
+}
+
 
 // a bitfield indicating which GPI are inputs.
 // could be used to control edge triggered interrupts...
@@ -113,64 +283,79 @@ void setGPIActive(int index, int active, int falling){
 }
 
 
-#ifdef PLATFORM_BEKEN
-#ifdef BEKEN_PIN_GPI_INTERRUPTS
-	// TODO: EXAMPLE of edge based interrupt handling
-	// NOT YET ENABLED
+static uint32_t g_time = 0;
 
-	// this will be from hal_bk....
-	// causes button read.
-	extern void BUTTON_TriggerRead();
+static uint32_t PIN_GetTimeMs() {
+#if defined(PLATFORM_BEKEN) || defined(WINDOWS)
+	return rtos_get_time();
+#else
+	return g_time;
+#endif
+}
+
+#if defined(PLATFORM_BEKEN) && defined(BEKEN_PIN_GPI_INTERRUPTS)
+// from hal_main_bk7231.c
+// causes button read in 1ms, so we don't wait for next QuickTick
+extern void BUTTON_TriggerRead();
+#endif
 
+// NOTE: ISR!!!!
+static void PIN_OnEdgeInterrupt(int index) {
+	uint32_t bit = 1 << index;
 
-	// NOTE: ISR!!!!
-	// triggers one-shot timer to fire in 1ms
-	// from hal_main_bk7231.c
-	// THIS IS AN ISR.
-	void PIN_IntHandler(unsigned char index){
-		BUTTON_TriggerRead();
+	if (((g_pinsBusy | g_pinsWoken) & bit) == 0) {
+		// pin was idle, level was stable until now
+		g_pinStableTimes[index] = PIN_GetTimeMs();
 	}
+	g_pinsWoken |= bit;
+#if defined(PLATFORM_BEKEN) && defined(BEKEN_PIN_GPI_INTERRUPTS)
+	BUTTON_TriggerRead();
+#endif
+}
 
-	// this will be from hal_bk....
-	// ensures that we will get called in 50ms or less.
-	extern void BUTTON_TriggerRead_quick();
+// arm interrupt for edge away from current level, returns 0 if HAL has no interrupts
+static int PIN_ArmEdgeInterrupt(int index) {
+	int level;
 
-	// called in PIN_ticks to carry on polling for 20 polls after last button is active
-	void PIN_TriggerPoll(){
-		BUTTON_TriggerRead_quick();
+	level = HAL_PIN_ReadDigitalInput(index);
+	if (HAL_AttachInterrupt(index, level, PIN_OnEdgeInterrupt) == 0)
+		return 0;
+	// level may have changed before interrupt was armed
+	if (HAL_PIN_ReadDigitalInput(index) != level) {
+		PIN_SetMaskBits(&g_pinsWoken, 1 << index);
 	}
-#endif
-#endif
+	return 1;
+}
+static void PIN_SetupEdgeInterrupt(int index) {
+	uint32_t bit = 1 << index;
+
+	g_pinStableTimes[index] = PIN_GetTimeMs();
+	if (PIN_ArmEdgeInterrupt(index)) {
+		g_pinsEdgeMask |= bit;
+		// let first tick see the initial level
+		PIN_SetMaskBits(&g_pinsWoken, bit);
+	}
+}
+static void PIN_RemoveEdgeInterrupt(int index) {
+	uint32_t bit = 1 << index;
+
+	if (g_pinsEdgeMask & bit) {
+		HAL_DetachInterrupt(index);
+	}
+	g_pinsEdgeMask &= ~bit;
+	g_pinsBusy &= ~bit;
+	PIN_TakeMaskBits(&g_pinsWoken, bit);
+}
 
 
 void PIN_SetupPins() {
 	int i;
+
+	PIN_RebuildChannelIndex();
 	for(i = 0; i < PLATFORM_GPIO_MAX; i++) {
 		PIN_SetPinRoleForPinIndex(i,g_cfg.pins.roles[i]);
 	}
 
-#ifdef PLATFORM_BEKEN
-#ifdef BEKEN_PIN_GPI_INTERRUPTS
-	// TODO: EXAMPLE of edge based interrupt handling
-	// NOT YET ENABLED
-	for (int i = 0; i < 32; i++){
-		if (g_gpio_index_map & (1<<i)){
-			uint32_t mode = GPIO_INT_LEVEL_RISING;
-			if (g_gpio_edge_map & (1<<i)){
-				mode = GPIO_INT_LEVEL_FALLING;
-			}
-			if (g_cfg.pins.roles[i] == IOR_IRRecv){
-				// not yet implemented
-				//gpio_int_enable(i, mode, IR_GPI_IntHandler);
-			} else {
-				gpio_int_enable(i, mode, PIN_IntHandler);
-			}
-		} else {
-			gpio_int_disable(i);
-		}
-	}
-#endif
-#endif
 #if defined(PLATFORM_BEKEN) || defined(PLATFORM_BL602) || defined(PLATFORM_W600) || defined(WINDOWS)
 	// TODO: better place to call?
 	DHT_OnPinsConfigChanged();
@@ -410,7 +595,7 @@ static uint8_t button_generic_get_gpio_value(void *param)
 
 void NEW_button_init(pinButton_s* handle, uint8_t(*pin_level)(void *self), uint8_t active_level)
 {
-	memset(handle, sizeof(pinButton_s), 0);
+	memset(handle, 0, sizeof(pinButton_s));
 
 	handle->event = (uint8_t)BTN_NONE_PRESS;
 	handle->hal_button_Level = pin_level;
@@ -548,6 +733,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 
 		// remove from active inputs
 		setGPIActive(index, 0, 0);
+		PIN_RemoveEdgeInterrupt(index);
 
 		switch(g_cfg.pins.roles[index])
 		{
@@ -605,6 +791,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 		}
 		g_cfg.pins.roles[index] = role;
 		g_cfg_pendingChanges++;
+		PIN_RebuildChannelIndex();
 	}
 
 	if (g_enable_pins) {
@@ -638,6 +825,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 
 				// init button after initializing pin role
 				NEW_button_init(bt, button_generic_get_gpio_value, 0);
+				PIN_SetupEdgeInterrupt(index);
 			}
 			break;
 
@@ -657,6 +845,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 				HAL_PIN_Setup_Input_Pullup(index);
 				// otherwise we get a toggle on start
 				g_lastValidState[index] = PIN_ReadDigitalInputValue_WithInversionIncluded(index);
+				PIN_SetupEdgeInterrupt(index);
 			}
 			break;
 		case IOR_DigitalInput_n:
@@ -667,6 +856,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 				setGPIActive(index, 1, falling);
 				// digital input
 				HAL_PIN_Setup_Input_Pullup(index);
+				PIN_SetupEdgeInterrupt(index);
 			}
 			break;
 		case IOR_DigitalInput_NoPup_n:
@@ -678,6 +868,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 				//setGPIActive(index, 1, falling);
 				// digital input
 				HAL_PIN_Setup_Input(index);
+				// no edge interrupt either (it may enforce pullup/down too), this one is polled
 			}
 			break;
 		case IOR_LED:
@@ -770,6 +961,7 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 	int iVal;
 	int bOn;
 	int bCallCb = 0;
+	uint32_t pins;
 
 
 	//bOn = BIT_CHECK(g_channelStates,ch);
@@ -789,8 +981,10 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 	TuyaMCU_OnChannelChanged(ch, iVal);
 #endif
 
-	for(i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if(g_cfg.pins.channels[i] == ch) {
+	// only pins tied to this channel
+	pins = g_channelPins[ch].pins;
+	for(i = 0; pins; i++, pins >>= 1) {
+		if(pins & 1) {
 			if(g_cfg.pins.roles[i] == IOR_Relay || g_cfg.pins.roles[i] == IOR_LED) {
 				RAW_SetPinValue(i,bOn);
 				bCallCb = 1;
@@ -806,25 +1000,20 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 			else if(g_cfg.pins.roles[i] == IOR_ToggleChannelOnToggle) {
 				bCallCb = 1;
 			}
-			else if(g_cfg.pins.roles[i] == IOR_PWM) {
-				HAL_PIN_PWM_Update(i,iVal);
-				bCallCb = 1;
-			}
-			else if(g_cfg.pins.roles[i] == IOR_PWM_n) {
-				HAL_PIN_PWM_Update(i,100-iVal);
+			else if(g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_n) {
+				// applied by PIN_ApplyDirtyPWM
 				bCallCb = 1;
 			}
 			else if(IS_PIN_DHT_ROLE(g_cfg.pins.roles[i])) {
 				bCallCb = 1;
 			}
 		}
-		else if(g_cfg.pins.channels2[i] == ch) {
-			//DHT setup uses 2 channels
-			if(IS_PIN_DHT_ROLE(g_cfg.pins.roles[i])) {
-				bCallCb = 1;
-			}
-		}
 	}
+	//DHT setup uses 2 channels
+	if(g_channelPins[ch].roles2 & ROLE_MASK_DHT) {
+		bCallCb = 1;
+	}
+	PIN_MarkChannelPWMDirty(ch);
 	if(g_cfg.pins.channelTypes[ch] != ChType_Default) {
 		bCallCb = 1;
 	}
@@ -879,21 +1068,10 @@ void CHANNEL_ClearAllChannels() {
 }
 
 void CHANNEL_Set_FloatPWM(int ch, float fVal, int iFlags) {
-	int i;
-
 	g_channelValues[ch] = (int)fVal;
 	g_channelValuesFloats[ch] = fVal;
 
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			if (g_cfg.pins.roles[i] == IOR_PWM) {
-				HAL_PIN_PWM_Update(i, fVal);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_PWM_n) {
-				HAL_PIN_PWM_Update(i, 100.0f - fVal);
-			}
-		}
-	}
+	PIN_MarkChannelPWMDirty(ch);
 }
 void CHANNEL_Set(int ch, int iVal, int iFlags) {
 	int prevValue;
@@ -978,18 +1156,9 @@ void CHANNEL_Add(int ch, int iVal) {
 }
 
 int CHANNEL_FindMaxValueForChannel(int ch) {
-	int i;
-	for(i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		// is pin tied to this channel?
-		if(g_cfg.pins.channels[i] == ch) {
-			// is it PWM?
-			if(g_cfg.pins.roles[i] == IOR_PWM) {
-				return 100;
-			}
-			if(g_cfg.pins.roles[i] == IOR_PWM_n) {
-				return 100;
-			}
-		}
+	// is there PWM pin tied to this channel?
+	if(g_channelPins[ch].roles & ROLE_MASK_PWM) {
+		return 100;
 	}
 	if(g_cfg.pins.channelTypes[ch] == ChType_Dimmer)
 		return 100;
@@ -1022,35 +1191,21 @@ void CHANNEL_Toggle(int ch) {
 	Channel_OnChanged(ch,prev,0);
 }
 int CHANNEL_HasChannelPinWithRoleOrRole(int ch, int iorType, int iorType2) {
-	int i;
-
 	if(ch < 0 || ch >= CHANNEL_MAX) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL,"CHANNEL_HasChannelPinWithRole: Channel index %i is out of range <0,%i)\n\r",ch,CHANNEL_MAX);
 		return 0;
 	}
-	for(i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if(g_cfg.pins.channels[i] == ch) {
-			if(g_cfg.pins.roles[i] == iorType)
-				return 1;
-			else if(g_cfg.pins.roles[i] == iorType2)
-				return 1;
-		}
-	}
+	if(g_channelPins[ch].roles & (PIN_RoleBit(iorType) | PIN_RoleBit(iorType2)))
+		return 1;
 	return 0;
 }
 int CHANNEL_HasChannelPinWithRole(int ch, int iorType) {
-	int i;
-
 	if(ch < 0 || ch >= CHANNEL_MAX) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL,"CHANNEL_HasChannelPinWithRole: Channel index %i is out of range <0,%i)\n\r",ch,CHANNEL_MAX);
 		return 0;
 	}
-	for(i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if(g_cfg.pins.channels[i] == ch) {
-			if(g_cfg.pins.roles[i] == iorType)
-				return 1;
-		}
-	}
+	if(g_channelPins[ch].roles & PIN_RoleBit(iorType))
+		return 1;
 	return 0;
 }
 bool CHANNEL_Check(int ch) {
@@ -1067,69 +1222,43 @@ bool CHANNEL_Check(int ch) {
 }
 
 bool CHANNEL_IsInUse(int ch) {
-	int i;
-
 	if(g_cfg.pins.channelTypes[ch] != ChType_Default){
 		return true;
 	}
-
-	for(i = 0; i < PLATFORM_GPIO_MAX; i++){
-		if(g_cfg.pins.roles[i] != IOR_None) {
-			if(g_cfg.pins.channels[i] == ch) {
-				return true;
-			}
-			if (g_cfg.pins.channels2[i] == ch) {
-				return true;
-			}
-		}
+	if(g_channelPins[ch].pins | g_channelPins[ch].pins2) {
+		return true;
 	}
 	return false;
 }
 
 
 bool CHANNEL_IsPowerRelayChannel(int ch) {
-	int i;
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			int role = g_cfg.pins.roles[i];	if (role == IOR_Relay || role == IOR_Relay_n) {
-				return true;
-			}
-		}
-	}
-	return false;
+	if (ch < 0 || ch >= CHANNEL_MAX)
+		return false;
+	return (g_channelPins[ch].roles & ROLE_MASK_RELAY) != 0;
 }
 bool CHANNEL_HasRoleThatShouldBePublished(int ch) {
-	int i;
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		int role = g_cfg.pins.roles[i];	
-
-		if (g_cfg.pins.channels[i] == ch) {
-			if (role == IOR_Relay || role == IOR_Relay_n
-				|| role == IOR_LED || role == IOR_LED_n
-				|| role == IOR_ADC
-				|| role == IOR_CHT8305_DAT || role == IOR_SHT3X_DAT 
-				|| role == IOR_DigitalInput || role == IOR_DigitalInput_n
-				|| IS_PIN_DHT_ROLE(role)
-				|| role == IOR_DigitalInput_NoPup || role == IOR_DigitalInput_NoPup_n) {
-				return true;
-			}
-		}
-		else if (g_cfg.pins.channels2[i] == ch) {
-			if (IS_PIN_DHT_ROLE(role)) {
-				return true;
-			}
-			// CHT8305 and SHT3X uses secondary channel for humidity
-			if (role == IOR_CHT8305_DAT || role == IOR_SHT3X_DAT) {
-				return true;
-			}
-		}
+	if (ch < 0 || ch >= CHANNEL_MAX)
+		return false;
+	if (g_channelPins[ch].roles & (ROLE_MASK_RELAY_OR_LED | ROLE_BIT(IOR_ADC)
+		| ROLE_MASK_TEMP_HUM | ROLE_MASK_DIGITAL_INPUT | ROLE_MASK_DHT)) {
+		return true;
+	}
+	// CHT8305 and SHT3X uses secondary channel for humidity
+	if (g_channelPins[ch].roles2 & (ROLE_MASK_DHT | ROLE_MASK_TEMP_HUM)) {
+		return true;
 	}
 	return false;
 }
 int CHANNEL_GetRoleForOutputChannel(int ch){
 	int i;
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++){
-		if (g_cfg.pins.channels[i] == ch){
+	uint32_t pins;
+
+	if (ch < 0 || ch >= CHANNEL_MAX)
+		return IOR_None;
+	pins = g_channelPins[ch].pins;
+	for (i = 0; pins; i++, pins >>= 1){
+		if (pins & 1){
 			switch(g_cfg.pins.roles[i]){
 				case IOR_Relay:
 				case IOR_Relay_n:
@@ -1157,10 +1286,11 @@ int CHANNEL_GetRoleForOutputChannel(int ch){
 #define ADC_SAMPLING_TICK_COUNT PIN_TMR_LOOPS_PER_SECOND
 
 
-void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
+int PIN_Input_Handler(int pinIndex, uint32_t now)
 {
 	pinButton_s *handle;
 	uint8_t read_gpio_level;
+	uint32_t ticks;
 
 	handle = &g_buttons[pinIndex];
 	if(handle->hal_button_Level != 0) {
@@ -1169,21 +1299,18 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 		read_gpio_level = handle->button_level;
 	}
 
-	//ticks counter working..
-	if((handle->state) > 0)
-		handle->ticks += ms_since_last;
+	//time in current state
+	ticks = now - handle->stateTime;
 
 	/*------------button debounce handle---------------*/
 	if(read_gpio_level != handle->button_level) { //not equal to prev one
-		//continue read 3 times same new level change
-		handle->debounce_cnt += ms_since_last;
-
-		if(handle->debounce_cnt >= BTN_DEBOUNCE_MS) {
+		//new level must be there for BTN_DEBOUNCE_MS
+		if(now - g_pinStableTimes[pinIndex] >= BTN_DEBOUNCE_MS) {
 			handle->button_level = read_gpio_level;
-			handle->debounce_cnt = 0;
+			g_pinStableTimes[pinIndex] = now;
 		}
-	} else { //leved not change ,counter reset.
-		handle->debounce_cnt = 0;
+	} else { //leved not change
+		g_pinStableTimes[pinIndex] = now;
 	}
 
 	/*-----------------State machine-------------------*/
@@ -1193,7 +1320,7 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 			handle->event = (uint8_t)BTN_PRESS_DOWN;
 			EVENT_CB(BTN_PRESS_DOWN);
 			Button_OnInitialPressDown(pinIndex);
-			handle->ticks = 0;
+			handle->stateTime = now;
 			handle->repeat = 1;
 			handle->state = 1;
 		} else {
@@ -1206,13 +1333,14 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 			handle->event = (uint8_t)BTN_PRESS_UP;
 			EVENT_CB(BTN_PRESS_UP);
 			Button_OnPressRelease(pinIndex);
-			handle->ticks = 0;
+			handle->stateTime = now;
 			handle->state = 2;
 
-		} else if(handle->ticks > BTN_LONG_MS) {
+		} else if(ticks > BTN_LONG_MS) {
 			handle->event = (uint8_t)BTN_LONG_RRESS_START;
 			Button_OnLongPressHoldStart(pinIndex);
 			EVENT_CB(BTN_LONG_RRESS_START);
+			handle->holdRepeatTime = now;
 			handle->state = 5;
 		}
 		break;
@@ -1227,9 +1355,9 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 			//	Button_OnDoubleClick(pinIndex);
 			//}
 			EVENT_CB(BTN_PRESS_REPEAT); // repeat hit
-			handle->ticks = 0;
+			handle->stateTime = now;
 			handle->state = 3;
-		} else if(handle->ticks > BTN_SHORT_MS) { //released timeout
+		} else if(ticks > BTN_SHORT_MS) { //released timeout
 			if(handle->repeat == 1) {
 				handle->event = (uint8_t)BTN_SINGLE_CLICK;
 				EVENT_CB(BTN_SINGLE_CLICK);
@@ -1253,8 +1381,8 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 			handle->event = (uint8_t)BTN_PRESS_UP;
 			EVENT_CB(BTN_PRESS_UP);
 			Button_OnPressRelease(pinIndex);
-			if(handle->ticks < BTN_SHORT_MS) {
-				handle->ticks = 0;
+			if(ticks < BTN_SHORT_MS) {
+				handle->stateTime = now;
 				handle->state = 2; //repeat press
 			} else {
 				handle->state = 0;
@@ -1266,10 +1394,9 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 		if(handle->button_level == handle->active_level) {
 			//continue hold trigger
 			handle->event = (uint8_t)BTN_LONG_PRESS_HOLD;
-			handle->holdRepeatTicks += ms_since_last;
-			if(handle->holdRepeatTicks > BTN_HOLD_REPEAT_MS) {
+			if(now - handle->holdRepeatTime > BTN_HOLD_REPEAT_MS) {
 				Button_OnLongPressHold(pinIndex);
-				handle->holdRepeatTicks = 0;
+				handle->holdRepeatTime = now;
 			}
 			EVENT_CB(BTN_LONG_PRESS_HOLD);
 		} else { //releasd
@@ -1280,6 +1407,8 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 		}
 		break;
 	}
+	// idle when released and not debouncing
+	return handle->state != 0 || read_gpio_level != handle->button_level;
 }
 
 void PIN_set_wifi_led(int value){
@@ -1294,181 +1423,113 @@ void PIN_set_wifi_led(int value){
 	}
 }
 
-static uint32_t g_time = 0;
-static uint32_t g_last_time = 0;
-static int activepoll_time = 0; // time to keep polling active until
-
 //  background ticks, timer repeat invoking interval defined by PIN_TMR_DURATION.
+static int g_debounceMS;
+
+static int PIN_Tick_DigitalInput(int i, uint32_t now) {
+	int value;
+
+	// read pin digital value (and already invert it if needed)
+	value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
+
+	if (g_lastValidState[i] == value) {
+		g_pinStableTimes[i] = now;
+		return 0;
+	}
+	// debouncing, new value must be there for g_debounceMS
+	if (now - g_pinStableTimes[i] > g_debounceMS) {
+		// became up or down
+		g_lastValidState[i] = value;
+		g_pinStableTimes[i] = now;
+		CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
+		return 0;
+	}
+	return 1;
+}
+static int PIN_Tick_ToggleChannelOnToggle(int i, uint32_t now) {
+	int value;
+
+	// we must detect a toggle, but with debouncing
+	value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
+	// debouncing, locked for given time after toggle
+	if (now - g_pinToggleTimes[i] < g_debounceMS) {
+		return 1;
+	}
+	if (g_lastValidState[i] != value) {
+		// became up
+		g_lastValidState[i] = value;
+		CHANNEL_Toggle(g_cfg.pins.channels[i]);
+		// fire event - IOR_ToggleChannelOnToggle has been toggle
+		// Argument is a pin number (NOT channel)
+		EventHandlers_FireEvent(CMD_EVENT_PIN_ONTOGGLE, i);
+		// lock for given time
+		g_pinToggleTimes[i] = now;
+		return 1;
+	}
+	return 0;
+}
+
 void PIN_ticks(void *param)
 {
 	int i;
-	int value;
+	int h;
+	uint32_t pins;
+	uint32_t woken;
+	uint32_t busy;
 
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
 	g_time = rtos_get_time();
 #else
 	g_time += PIN_TMR_DURATION;
 #endif
-	uint32_t t_diff = g_time - g_last_time;
-	// cope with wrap
-	if (t_diff > 0x4000){
-		t_diff = ((g_time + 0x4000) - (g_last_time + 0x4000));
-	}
-	g_last_time = g_time;
 
 	BTN_SHORT_MS = (g_cfg.buttonShortPress * 100);
 	BTN_LONG_MS = (g_cfg.buttonLongPress * 100);
 	BTN_HOLD_REPEAT_MS = (g_cfg.buttonHoldRepeat * 100);
 
-	int debounceMS;
 	if (CFG_HasFlag(OBK_FLAG_BTN_INSTANTTOUCH)) {
-		debounceMS = 100;
+		g_debounceMS = 100;
 	}
 	else {
-		debounceMS = 250;
+		g_debounceMS = 250;
 	}
 
-	int activepins = 0;
-	uint32_t pinvalues = 0;
-	for(i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		// note pins which are active - i.e. would not trigger an edge interrupt on change.
-		// if we have any, then we must poll until none
-		// TODO: this will only be used when GPI interrupt triggeringis used.
-		// but it's useful info anyway...
-		if (g_gpio_index_map & (1<<i)){
-			uint32_t level = 1;
-			if (g_gpio_edge_map & (1<<i)){
-				level = 0;
-			}
-			int rawval = HAL_PIN_ReadDigitalInput(i);
-			if (rawval && level == 1){
-				activepins ++;
-				pinvalues |= (1 << i);
-			}
-			if (!rawval && level == 0){
-				activepins ++;
-				pinvalues |= (1 << i);
-			}
-		}
-		// activepins is count of pins which are 'active', i.e. match thier expected active level
-		if (activepins){
-			activepoll_time = 1000; //20 x 50ms = 1s of polls after button release
-		}
+	PIN_ApplyDirtyPWM();
 
-#if 1
-		if(g_cfg.pins.roles[i] == IOR_PWM) {
-			HAL_PIN_PWM_Update(i, g_channelValuesFloats[g_cfg.pins.channels[i]]);
-		} else if(g_cfg.pins.roles[i] == IOR_PWM_n) {
-			// invert PWM value
-			HAL_PIN_PWM_Update(i,100- g_channelValuesFloats[g_cfg.pins.channels[i]]);
-		} else
-#endif
-		if(g_cfg.pins.roles[i] == IOR_Button || g_cfg.pins.roles[i] == IOR_Button_n
-			|| g_cfg.pins.roles[i] == IOR_Button_ToggleAll || g_cfg.pins.roles[i] == IOR_Button_ToggleAll_n
-			|| g_cfg.pins.roles[i] == IOR_Button_NextColor || g_cfg.pins.roles[i] == IOR_Button_NextColor_n
-			|| g_cfg.pins.roles[i] == IOR_Button_NextDimmer || g_cfg.pins.roles[i] == IOR_Button_NextDimmer_n
-			|| g_cfg.pins.roles[i] == IOR_Button_NextTemperature || g_cfg.pins.roles[i] == IOR_Button_NextTemperature_n
-			|| g_cfg.pins.roles[i] == IOR_Button_ScriptOnly || g_cfg.pins.roles[i] == IOR_Button_ScriptOnly_n) {
-			//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL,"Test hold %i\r\n",i);
-			PIN_Input_Handler(i, t_diff);
-		}
-		else if(g_cfg.pins.roles[i] == IOR_DigitalInput || g_cfg.pins.roles[i] == IOR_DigitalInput_n
-			||
-			g_cfg.pins.roles[i] == IOR_DigitalInput_NoPup || g_cfg.pins.roles[i] == IOR_DigitalInput_NoPup_n) {
-			// read pin digital value (and already invert it if needed)
-			value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
+	woken = PIN_TakeMaskBits(&g_pinsWoken, 0xFFFFFFFF);
 
-#if 0
-			CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
-#else
-			// debouncing
-			if (value) {
-				if (g_times[i] > debounceMS) {
-					if (g_lastValidState[i] != value) {
-						// became up
-						g_lastValidState[i] = value;
-						CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
-					}
-				}
-				else {
-					g_times[i] += t_diff;
-				}
-				g_times2[i] = 0;
-			}
-			else {
-				if (g_times2[i] > debounceMS) {
-					if (g_lastValidState[i] != value) {
-						// became down
-						g_lastValidState[i] = value;
-						CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
-					}
-				}
-				else {
-					g_times2[i]+= t_diff;
-				}
-				g_times[i] = 0;
+	// pins with edge interrupt are visited only from an edge until they settle,
+	// pins without a polled role are never visited
+	busy = 0;
+	for (h = 0; h < PIN_TICK_ROLES; h++) {
+		pins = g_pinTickPins[h] & (~g_pinsEdgeMask | g_pinsBusy | woken);
+		for (i = 0; pins; i++, pins >>= 1) {
+			if ((pins & 1) && g_pinTickRoles[h].handler(i, g_time)) {
+				busy |= (1 << i);
 			}
+		}
+	}
 
-#endif
-		} else if(g_cfg.pins.roles[i] == IOR_ToggleChannelOnToggle) {
-			// we must detect a toggle, but with debouncing
-			value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
-			// debouncing
-			if (g_times[i] <= 0) {
-				if (g_lastValidState[i] != value) {
-					// became up
-					g_lastValidState[i] = value;
-					CHANNEL_Toggle(g_cfg.pins.channels[i]);
-					// fire event - IOR_ToggleChannelOnToggle has been toggle
-					// Argument is a pin number (NOT channel)
-					EventHandlers_FireEvent(CMD_EVENT_PIN_ONTOGGLE, i);
-					// lock for given time
-					g_times[i] = debounceMS;
-				}
-			}
-			else {
-				g_times[i] -= t_diff;
-			}
+	// settled pins wait for next edge
+	pins = (g_pinsBusy | woken) & g_pinsEdgeMask & ~busy;
+	for (i = 0; pins; i++, pins >>= 1) {
+		if (pins & 1) {
+			PIN_ArmEdgeInterrupt(i);
 		}
 	}
+	g_pinsBusy = busy & g_pinsEdgeMask;
 
 #ifdef PLATFORM_BEKEN
 #ifdef BEKEN_PIN_GPI_INTERRUPTS
-	// TODO: not implemented yet - this bit continues polling
-	// for a while after a GPI is fired, so that we can see long press, etc.
 	if (param){
-		addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL,"Pin intr at %d (+%d) (%x)", g_time, t_diff, pinvalues);
-	}
-#endif
-#endif
-
-	if (activepoll_time){
-		activepoll_time -= t_diff;
-		if (activepoll_time <= 0){
-			activepoll_time = 0;
-		}
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL,"Pin intr at %d (%x), busy %x", g_time, woken, g_pinsBusy);
 	}
-	if (activepoll_time){
-		// setup to poll in 50ms
-#ifdef PLATFORM_BEKEN
-#ifdef BEKEN_PIN_GPI_INTERRUPTS
-		PIN_TriggerPoll();
-		if (activepins){
-			addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL,"Pins active at %d (%x)", g_time, pinvalues);
-		} else {
-			addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL,"Pins ->inactive at %d (%x)", g_time, pinvalues);
-		}
 #endif
 #endif
-
-	} else {
-#ifdef PLATFORM_BEKEN
-#ifdef BEKEN_PIN_GPI_INTERRUPTS
-		addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL,"Pins inactive at %d", g_time, pinvalues);
-#endif		
-#endif		
-	}
-
+}
+// for selftests, pins with edge interrupt that are still polled
+uint32_t PIN_GetPolledEdgePins() {
+	return g_pinsBusy | g_pinsWoken;
 }
 // setChannelType 3 LowMidHigh
 int CHANNEL_ParseChannelType(const char *s) {
@@ -1661,50 +1722,19 @@ void get_Relay_PWM_Count(int* relayCount, int* pwmCount, int* dInputCount) {
 
 
 int h_isChannelPWM(int tg_ch){
-    int i;
-    int role;
-	int ch;
-
-    for(i = 0; i < PLATFORM_GPIO_MAX; i++) {
-        ch = PIN_GetPinChannelForPinIndex(i);
-		if(tg_ch != ch)
-			continue;
-        role = PIN_GetPinRoleForPinIndex(i);
-        if(role == IOR_PWM || role == IOR_PWM_n) {
-			return true;
-        }
-    }
-	return false;
+	if(tg_ch < 0 || tg_ch >= CHANNEL_MAX)
+		return false;
+	return (g_channelPins[tg_ch].roles & ROLE_MASK_PWM) != 0;
 }
 int h_isChannelRelay(int tg_ch) {
-    int i;
-	int role;
-
-    for(i = 0; i < PLATFORM_GPIO_MAX; i++) {
-        int ch = PIN_GetPinChannelForPinIndex(i);
-		if(tg_ch != ch)
-			continue;
-        role = PIN_GetPinRoleForPinIndex(i);
-        if(role == IOR_Relay || role == IOR_Relay_n || role == IOR_LED || role == IOR_LED_n) {
-			return true;
-        }
-    }
-	return false;
+	if(tg_ch < 0 || tg_ch >= CHANNEL_MAX)
+		return false;
+	return (g_channelPins[tg_ch].roles & ROLE_MASK_RELAY_OR_LED) != 0;
 }
 int h_isChannelDigitalInput(int tg_ch) {
-    int i;
-	int role;
-
-    for(i = 0; i < PLATFORM_GPIO_MAX; i++) {
-        int ch = PIN_GetPinChannelForPinIndex(i);
-		if(tg_ch != ch)
-			continue;
-        role = PIN_GetPinRoleForPinIndex(i);
-        if(role == IOR_DigitalInput || role == IOR_DigitalInput_n || role == IOR_DigitalInput_NoPup || role == IOR_DigitalInput_NoPup_n) {
-			return true;
-        }
-    }
-	return false;
+	if(tg_ch < 0 || tg_ch >= CHANNEL_MAX)
+		return false;
+	return (g_channelPins[tg_ch].roles & ROLE_MASK_DIGITAL_INPUT) != 0;
 }
 static commandResult_t showgpi(const void *context, const char *cmd, const char *args, int cmdFlags){
 	int i;
@@ -349,6 +349,9 @@ const char* PIN_GetPinNameAlias(int index);
 void PIN_SetPinRoleForPinIndex(int index, int role);
 void PIN_SetPinChannelForPinIndex(int index, int ch);
 void PIN_SetPinChannel2ForPinIndex(int index, int ch);
+void PIN_RebuildChannelIndex();
+void PIN_ApplyDirtyPWM();
+uint32_t PIN_GetPolledEdgePins();
 void CHANNEL_Toggle(int ch);
 void CHANNEL_DoSpecialToggleAll();
 bool CHANNEL_Check(int ch);
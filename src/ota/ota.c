@@ -14,6 +14,7 @@
 #include "../logging/logging.h"
 #include "../httpclient/http_client.h"
 #include "../driver/drv_public.h"
+#include "../hal/hal_flashVars.h"
 
 static unsigned char *sector = (void *)0;
 int sectorlen = 0;
@@ -188,6 +189,9 @@ void otarequest(const char *urlin){
 
   strncpy(url, urlin, sizeof(url));
 
+  // don't lose coalesced channel/energy values on the reboot after OTA
+  HAL_FlashVars_Flush();
+
   OTA_SetTotalBytes(0);
   memset(request, 0, sizeof(*request));
   httpclient_t *client = &request->client;
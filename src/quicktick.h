@@ -2,6 +2,7 @@
 
 #define QUICK_TMR_DURATION      25 // Delay (in ms) between button scan iterations
 
-// define this to use edge based GPI interrupts to drive Pin_ticks()
+// define this to use edge based GPI interrupts for input pins,
+// idle inputs are then not polled by Pin_ticks()
 //#define BEKEN_PIN_GPI_INTERRUPTS
 
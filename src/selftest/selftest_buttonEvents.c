@@ -2,6 +2,103 @@
 
 #include "selftest_local.h".
 
+// 5ms frames, default buttonShortPress 300ms, buttonLongPress 1000ms, buttonHoldRepeat 500ms
+static void Test_ButtonEvents_Timing(bool bInterrupts) {
+	int reads;
+
+	// reset whole device
+	SIM_ClearOBK();
+	SIM_SetPinInterruptsEnabled(bInterrupts);
+
+	// by default, we have a pull up resistor - so high level
+	SIM_SetSimulatedPinValue(9, true);
+	PIN_SetPinRoleForPinIndex(9, IOR_Button);
+	PIN_SetPinRoleForPinIndex(10, IOR_DigitalInput);
+	PIN_SetPinChannelForPinIndex(10, 5);
+	CMD_ExecuteCommand("addEventHandler OnClick 9 addChannel 12 1", 0);
+	CMD_ExecuteCommand("addEventHandler OnDblClick 9 addChannel 13 1", 0);
+	CMD_ExecuteCommand("addEventHandler OnHoldStart 9 addChannel 14 1", 0);
+	CMD_ExecuteCommand("addEventHandler OnHold 9 addChannel 15 1", 0);
+	Sim_RunFrames(20, false);
+
+	// idle inputs with edge interrupt are not read at all
+	reads = SIM_GetPinReadCount();
+	Sim_RunFrames(100, false);
+	if (bInterrupts) {
+		SELFTEST_ASSERT(SIM_GetPinReadCount() == reads);
+		SELFTEST_ASSERT(PIN_GetPolledEdgePins() == 0);
+	}
+	else {
+		SELFTEST_ASSERT(SIM_GetPinReadCount() > reads);
+	}
+
+	// click - press for 100ms
+	SIM_SetSimulatedPinValue(9, false);
+	Sim_RunFrames(20, false);
+	SIM_SetSimulatedPinValue(9, true);
+	// click is reported once no second press came within 300ms
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(12, 0);
+	Sim_RunFrames(20, false);
+	SELFTEST_ASSERT_CHANNEL(12, 1);
+	SELFTEST_ASSERT_CHANNEL(13, 0);
+	Sim_RunFrames(5, false);
+	if (bInterrupts) {
+		SELFTEST_ASSERT(PIN_GetPolledEdgePins() == 0);
+	}
+
+	// double click - two 50ms presses, 100ms apart
+	SIM_SetSimulatedPinValue(9, false);
+	Sim_RunFrames(10, false);
+	SIM_SetSimulatedPinValue(9, true);
+	Sim_RunFrames(20, false);
+	SIM_SetSimulatedPinValue(9, false);
+	Sim_RunFrames(10, false);
+	SIM_SetSimulatedPinValue(9, true);
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(13, 0);
+	Sim_RunFrames(20, false);
+	SELFTEST_ASSERT_CHANNEL(12, 1);
+	SELFTEST_ASSERT_CHANNEL(13, 1);
+
+	// hold - OnHoldStart after 1000ms, then OnHold every 500ms
+	SIM_SetSimulatedPinValue(9, false);
+	Sim_RunFrames(180, false);
+	SELFTEST_ASSERT_CHANNEL(14, 0);
+	Sim_RunFrames(40, false);
+	SELFTEST_ASSERT_CHANNEL(14, 1);
+	SELFTEST_ASSERT_CHANNEL(15, 0);
+	Sim_RunFrames(100, false);
+	SELFTEST_ASSERT_CHANNEL(15, 1);
+	Sim_RunFrames(100, false);
+	SELFTEST_ASSERT_CHANNEL(14, 1);
+	SELFTEST_ASSERT_CHANNEL(15, 2);
+	// release after hold is not a click
+	SIM_SetSimulatedPinValue(9, true);
+	Sim_RunFrames(100, false);
+	SELFTEST_ASSERT_CHANNEL(12, 1);
+	SELFTEST_ASSERT_CHANNEL(13, 1);
+	SELFTEST_ASSERT_CHANNEL(15, 2);
+
+	// digital input - new level must stay for 250ms
+	SIM_SetSimulatedPinValue(10, true);
+	Sim_RunFrames(40, false);
+	SELFTEST_ASSERT_CHANNEL(5, 0);
+	Sim_RunFrames(20, false);
+	SELFTEST_ASSERT_CHANNEL(5, 1);
+	// short glitch is ignored
+	SIM_SetSimulatedPinValue(10, false);
+	Sim_RunFrames(10, false);
+	SIM_SetSimulatedPinValue(10, true);
+	Sim_RunFrames(100, false);
+	SELFTEST_ASSERT_CHANNEL(5, 1);
+	if (bInterrupts) {
+		SELFTEST_ASSERT(PIN_GetPolledEdgePins() == 0);
+	}
+
+	SIM_SetPinInterruptsEnabled(true);
+}
+
 void Test_ButtonEvents() {
 	// reset whole device
 	SIM_ClearOBK();
@@ -95,6 +192,9 @@ void Test_ButtonEvents() {
 	SELFTEST_ASSERT_CHANNEL(11, (123 + 123 + 123));
 	SELFTEST_ASSERT_CHANNEL(12, 22);
 	SELFTEST_ASSERT_CHANNEL(13, 1201);
+
+	Test_ButtonEvents_Timing(true);
+	Test_ButtonEvents_Timing(false);
 }
 
 
@@ -2,6 +2,98 @@
 
 #include "selftest_local.h".
 
+// 242 handlers for different events and arguments
+static void Test_ChangeHandlers_AddMany() {
+	int i;
+
+	CMD_ExecuteCommand("loglevel 1", 0);
+	for (i = 0; i < 100; i++) {
+		CMD_ExecuteCommand(va("addEventHandler OnClick %i addChannel 10 %i", i, i + 1), 0);
+		CMD_ExecuteCommand(va("addEventHandler2 IR_Samsung 1799 %i setChannel 11 %i", i, i), 0);
+	}
+	for (i = 20; i < 60; i++) {
+		CMD_ExecuteCommand(va("addChangeHandler Channel%i == 5 addChannel 12 %i", i, i), 0);
+	}
+	CMD_ExecuteCommand("addEventHandler OnUART 55AA00FF setChannel 13 7", 0);
+	// command that does not exist yet
+	CMD_ExecuteCommand("addEventHandler OnClick 1000 myLateAlias", 0);
+	CMD_ExecuteCommand("loglevel 3", 0);
+}
+// Lots of handlers for different events and arguments,
+// only the matching ones may run
+void Test_ChangeHandlers_Many() {
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK();
+
+	Test_ChangeHandlers_AddMany();
+
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 57);
+	SELFTEST_ASSERT_CHANNEL(10, 58);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 0);
+	SELFTEST_ASSERT_CHANNEL(10, 59);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 100);
+	SELFTEST_ASSERT_CHANNEL(10, 59);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONHOLD, 57);
+	SELFTEST_ASSERT_CHANNEL(10, 59);
+
+	EventHandlers_FireEvent2(CMD_EVENT_IR_SAMSUNG, 1799, 33);
+	SELFTEST_ASSERT_CHANNEL(11, 33);
+	EventHandlers_FireEvent2(CMD_EVENT_IR_SAMSUNG, 1798, 44);
+	SELFTEST_ASSERT_CHANNEL(11, 33);
+	EventHandlers_FireEvent2(CMD_EVENT_IR_RC5, 1799, 44);
+	SELFTEST_ASSERT_CHANNEL(11, 33);
+
+	CMD_ExecuteCommand("setChannel 25 5", 0);
+	SELFTEST_ASSERT_CHANNEL(12, 25);
+	CMD_ExecuteCommand("setChannel 26 4", 0);
+	SELFTEST_ASSERT_CHANNEL(12, 25);
+	CMD_ExecuteCommand("setChannel 19 5", 0);
+	SELFTEST_ASSERT_CHANNEL(12, 25);
+
+	EventHandlers_FireEvent_String(CMD_EVENT_ON_UART, "55aa00ff");
+	SELFTEST_ASSERT_CHANNEL(13, 7);
+
+	CMD_ExecuteCommand("alias myLateAlias setChannel 14 3", 0);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 1000);
+	SELFTEST_ASSERT_CHANNEL(14, 3);
+
+	// events nobody listens for, the common case
+	for (i = 0; i < 64; i++) {
+		EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 200 + i);
+		EventHandlers_ProcessVariableChange_Integer(CMD_EVENT_CHANGE_CHANNEL0 + (i & 15), 0, 1);
+	}
+	SELFTEST_ASSERT_CHANNEL(10, 59);
+
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 57);
+	SELFTEST_ASSERT_CHANNEL(10, 59);
+}
+// cost of events nobody listens for, with many handlers registered
+void Test_ChangeHandlers_Benchmark() {
+	int i, events;
+	clock_t t;
+	double elapsed;
+
+	// reset whole device
+	SIM_ClearOBK();
+
+	Test_ChangeHandlers_AddMany();
+	events = 100000;
+	t = clock();
+	for (i = 0; i < events; i++) {
+		EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 200 + (i & 63));
+		EventHandlers_ProcessVariableChange_Integer(CMD_EVENT_CHANGE_CHANNEL0 + (i & 15), 0, 1);
+	}
+	elapsed = (double)(clock() - t) / CLOCKS_PER_SEC;
+	SELFTEST_ASSERT_CHANNEL(10, 0);
+	printf("Event handlers benchmark: %.1f ns per unhandled event with 242 handlers\n",
+		elapsed * 1e9 / (events * 2));
+
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+}
+
 void Test_ChangeHandlers() {
 	// reset whole device
 	SIM_ClearOBK();
@@ -48,6 +140,8 @@ void Test_ChangeHandlers() {
 	SELFTEST_ASSERT_CHANNEL(11, 22);
 
 	// 
+
+	Test_ChangeHandlers_Many();
 }
 
 
@@ -0,0 +1,116 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+
+#define MAX_LOOKUP_TEST_COMMANDS 1024
+
+typedef struct lookupTestList_s {
+	command_t *cmds[MAX_LOOKUP_TEST_COMMANDS];
+	int count;
+} lookupTestList_t;
+
+static void Test_Commands_Lookup_Collect(command_t *cmd, void *userData) {
+	lookupTestList_t *list = (lookupTestList_t*)userData;
+
+	if (list->count < MAX_LOOKUP_TEST_COMMANDS) {
+		list->cmds[list->count] = cmd;
+		list->count++;
+	}
+}
+static bool Test_HasDigit(const char *s) {
+	while (*s) {
+		if (*s >= '0' && *s <= '9')
+			return true;
+		s++;
+	}
+	return false;
+}
+
+static lookupTestList_t g_list;
+// every registered name in upper case, and with a numeric suffix
+static char g_upper[MAX_LOOKUP_TEST_COMMANDS][64];
+static char g_suffixed[MAX_LOOKUP_TEST_COMMANDS][64];
+
+static void Test_Commands_Lookup_Collect_All() {
+	int i, j;
+
+	g_list.count = 0;
+	CMD_ListAllCommands(&g_list, Test_Commands_Lookup_Collect);
+	for (i = 0; i < g_list.count; i++) {
+		const char *name = g_list.cmds[i]->name;
+
+		for (j = 0; name[j] && j < sizeof(g_upper[i]) - 1; j++) {
+			g_upper[i][j] = toupper((unsigned char)name[j]);
+		}
+		g_upper[i][j] = 0;
+		snprintf(g_suffixed[i], sizeof(g_suffixed[i]), "%s%i", name, 1 + (i % 9));
+	}
+}
+
+void Test_Commands_Lookup() {
+	command_t *found;
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK();
+
+	Test_Commands_Lookup_Collect_All();
+	SELFTEST_ASSERT(g_list.count > 100);
+	SELFTEST_ASSERT(g_list.count < MAX_LOOKUP_TEST_COMMANDS);
+
+	for (i = 0; i < g_list.count; i++) {
+		const char *name = g_list.cmds[i]->name;
+
+		SELFTEST_ASSERT(strlen(name) < 60);
+		SELFTEST_ASSERT(CMD_Find(name) == g_list.cmds[i]);
+		SELFTEST_ASSERT(CMD_Find(g_upper[i]) == g_list.cmds[i]);
+		SELFTEST_ASSERT(CMD_FindStrippingNumbers(name) == g_list.cmds[i]);
+		if (Test_HasDigit(name) == false && CMD_Find(g_suffixed[i]) == 0) {
+			SELFTEST_ASSERT(CMD_FindStrippingNumbers(g_suffixed[i]) == g_list.cmds[i]);
+		}
+	}
+	found = CMD_Find("POWER");
+	SELFTEST_ASSERT(found != 0);
+	SELFTEST_ASSERT(CMD_FindStrippingNumbers("Power1") == found);
+	SELFTEST_ASSERT(CMD_FindStrippingNumbers("power12") == found);
+	SELFTEST_ASSERT(CMD_Find("power1") == 0);
+	SELFTEST_ASSERT(CMD_Find("") == 0);
+	SELFTEST_ASSERT(CMD_FindStrippingNumbers("") == 0);
+	SELFTEST_ASSERT(CMD_FindStrippingNumbers("1") == 0);
+	SELFTEST_ASSERT(CMD_FindStrippingNumbers("noSuchCommand1") == 0);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("noSuchCommand1 2", 0) == CMD_RES_UNKNOWN_COMMAND);
+}
+// dispatch lookup for every registered name
+void Test_Commands_Lookup_Benchmark() {
+	int i, j, rounds, lookups;
+	clock_t t;
+	double plain, withSuffix;
+
+	// reset whole device
+	SIM_ClearOBK();
+
+	Test_Commands_Lookup_Collect_All();
+	rounds = 200;
+	lookups = rounds * g_list.count;
+	t = clock();
+	for (j = 0; j < rounds; j++) {
+		for (i = 0; i < g_list.count; i++) {
+			if (CMD_FindStrippingNumbers(g_upper[i]) == 0) {
+				SELFTEST_ASSERT(0);
+			}
+		}
+	}
+	plain = (double)(clock() - t) / CLOCKS_PER_SEC;
+	t = clock();
+	for (j = 0; j < rounds; j++) {
+		for (i = 0; i < g_list.count; i++) {
+			CMD_FindStrippingNumbers(g_suffixed[i]);
+		}
+	}
+	withSuffix = (double)(clock() - t) / CLOCKS_PER_SEC;
+
+	printf("Command lookup benchmark: %i commands, %.1f ns/lookup, %.1f ns/lookup with numeric suffix\n",
+		g_list.count, plain * 1e9 / lookups, withSuffix * 1e9 / lookups);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+
+static int Test_Drivers_QuickCalls(const char *name) {
+	return Test_GetJSONValue_Integer_Nested2(name, "quick", "calls");
+}
+
+void Test_Drivers() {
+	// reset whole device
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	CMD_ExecuteCommand("startDriver SSDP", 0);
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+
+	// 200 quick ticks of 5ms, TuyaMCU runs in each one, SSDP every 100ms
+	Sim_RunMiliseconds(1000, false);
+	Test_FakeHTTPClientPacket_JSON("api/drivers");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("TuyaMCU", "quick", "calls", 200);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("SSDP", "period", 100);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("SSDP", "phase", 50);
+	SELFTEST_ASSERT(Test_Drivers_QuickCalls("SSDP") >= 9);
+	SELFTEST_ASSERT(Test_Drivers_QuickCalls("SSDP") <= 10);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("TESTPOWER", "second", "calls", 1);
+	// no quick tick at all
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("TESTPOWER", "quick", "calls", 0);
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer_Nested2("TuyaMCU", "quick", "minUs") <= Test_GetJSONValue_Integer_Nested2("TuyaMCU", "quick", "avgUs"));
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer_Nested2("TuyaMCU", "quick", "avgUs") <= Test_GetJSONValue_Integer_Nested2("TuyaMCU", "quick", "maxUs"));
+	// stopped drivers are not listed
+	SELFTEST_ASSERT(Test_Drivers_QuickCalls("DGR") == -999999);
+	CMD_ExecuteCommand("driverStats", 0);
+
+	// throttle TuyaMCU, counters start again
+	CMD_ExecuteCommand("driverPeriod TuyaMCU 50 10", 0);
+	CMD_ExecuteCommand("driverStats reset", 0);
+	Sim_RunMiliseconds(1000, false);
+	Test_FakeHTTPClientPacket_JSON("api/drivers");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("TuyaMCU", "period", 50);
+	SELFTEST_ASSERT(Test_Drivers_QuickCalls("TuyaMCU") >= 19);
+	SELFTEST_ASSERT(Test_Drivers_QuickCalls("TuyaMCU") <= 20);
+	SELFTEST_ASSERT(Test_Drivers_QuickCalls("SSDP") >= 9);
+	SELFTEST_ASSERT(Test_Drivers_QuickCalls("SSDP") <= 10);
+
+	// back to every tick, so other tests see the usual TuyaMCU latency
+	CMD_ExecuteCommand("driverPeriod TuyaMCU 0 0", 0);
+	CMD_ExecuteCommand("driverStats reset", 0);
+	Sim_RunMiliseconds(100, false);
+	Test_FakeHTTPClientPacket_JSON("api/drivers");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("TuyaMCU", "quick", "calls", 20);
+}
+
+#endif
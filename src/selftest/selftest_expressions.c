@@ -2,6 +2,57 @@
 
 #include "selftest_local.h".
 
+// evaluates expression the way event handlers and script lines do
+float Test_EvaluateCompiledExpression(const char *s) {
+	cmdExpression_t *e;
+	float ret;
+
+	e = CMD_CompileExpression(s, 0);
+	if (e == 0) {
+		return CMD_EvaluateExpression(s, 0);
+	}
+	ret = CMD_EvaluateCompiledExpression(e);
+	free(e);
+	return ret;
+}
+
+static const char *g_testExps[] = {
+	"$CH5 > 2",
+	"-1+2 >= 10-10 || 5 >= 3+4",
+	"1000*$CH1+100*$CH1-10*$CH1+$CH1*1",
+	"!$CH1",
+	"$CH12*10.0 + $led_dimmer",
+	"MQTTOn && $CH5 <= 1",
+};
+#define NUM_TEST_EXPS (sizeof(g_testExps) / sizeof(g_testExps[0]))
+
+// compiled form gives the same results as parsing on every call
+static void Test_Expressions_Compiled() {
+	cmdExpression_t *compiled[NUM_TEST_EXPS];
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK();
+
+	CHANNEL_Set(1, 2, 0);
+	CHANNEL_Set(5, 1, 0);
+	CHANNEL_Set(12, 10, 0);
+	for (i = 0; i < NUM_TEST_EXPS; i++) {
+		compiled[i] = CMD_CompileExpression(g_testExps[i], 0);
+		SELFTEST_ASSERT(compiled[i] != 0);
+		SELFTEST_ASSERT(Float_Equals(CMD_EvaluateCompiledExpression(compiled[i]), CMD_EvaluateExpression(g_testExps[i], 0)));
+	}
+	// compiled form must follow changes of values
+	CHANNEL_Set(5, 7, 0);
+	SELFTEST_ASSERT(Float_Equals(CMD_EvaluateCompiledExpression(compiled[0]), 1));
+	CHANNEL_Set(5, 1, 0);
+	SELFTEST_ASSERT(Float_Equals(CMD_EvaluateCompiledExpression(compiled[0]), 0));
+
+	for (i = 0; i < NUM_TEST_EXPS; i++) {
+		free(compiled[i]);
+	}
+}
+
 void Test_Expressions_RunTests_Basic() {
 	// reset whole device
 	SIM_ClearOBK();
@@ -203,6 +254,52 @@ void Test_Expressions_RunTests_Basic() {
 	//SELFTEST_ASSERT_EXPRESSION("15.0+$CH18+1000\n\r", 30.0f + 1000);
 	//SELFTEST_ASSERT_EXPRESSION("15.0/$CH18+1000\n\r", 1.0f + 1000);
 	//SELFTEST_ASSERT_EXPRESSION("1.50/$CH18+1000\n\r", 0.1f + 1000);
+
+	Test_Expressions_Compiled();
+}
+
+// Compares parsing expression on every call with running its compiled form
+void Test_Expressions_Benchmark() {
+	cmdExpression_t *compiled[NUM_TEST_EXPS];
+	int i, j, runs;
+	clock_t t;
+	double interpreted, timeCompiled;
+	float sumA, sumB;
+
+	// reset whole device
+	SIM_ClearOBK();
+
+	CHANNEL_Set(1, 2, 0);
+	CHANNEL_Set(5, 1, 0);
+	CHANNEL_Set(12, 10, 0);
+	for (i = 0; i < NUM_TEST_EXPS; i++) {
+		compiled[i] = CMD_CompileExpression(g_testExps[i], 0);
+	}
+
+	runs = 20000;
+	sumA = 0;
+	t = clock();
+	for (j = 0; j < runs; j++) {
+		for (i = 0; i < NUM_TEST_EXPS; i++) {
+			sumA += CMD_EvaluateExpression(g_testExps[i], 0);
+		}
+	}
+	interpreted = (double)(clock() - t) / CLOCKS_PER_SEC;
+	sumB = 0;
+	t = clock();
+	for (j = 0; j < runs; j++) {
+		for (i = 0; i < NUM_TEST_EXPS; i++) {
+			sumB += CMD_EvaluateCompiledExpression(compiled[i]);
+		}
+	}
+	timeCompiled = (double)(clock() - t) / CLOCKS_PER_SEC;
+	SELFTEST_ASSERT(Float_Equals(sumA, sumB));
+
+	for (i = 0; i < NUM_TEST_EXPS; i++) {
+		free(compiled[i]);
+	}
+	printf("Expression benchmark: interpreted %.1f ns/eval, compiled %.1f ns/eval\n",
+		interpreted * 1e9 / (runs * NUM_TEST_EXPS), timeCompiled * 1e9 / (runs * NUM_TEST_EXPS));
 }
 
 #endif
@@ -0,0 +1,242 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../hal/hal_flashVars.h"
+
+int flash_vars_read(FLASH_VARS_STRUCTURE* data);
+void SIM_FlashVars_WriteLegacy(FLASH_VARS_STRUCTURE* data);
+void SIM_FlashVars_Reload();
+void SIM_FlashVars_CutPowerAfter(int ops);
+
+#define FLASHVARS_TEST_TOGGLES 20
+
+// old format (full structure per write) vs journal of deltas
+static void Test_FlashVars_Journal() {
+	flashVarsStats_t st, prev;
+	FLASH_VARS_STRUCTURE d, data;
+	int i, v;
+	int legacyBytes, legacyReadBytes, legacyReads;
+	int journalBytes, journalReadBytes, journalReads;
+
+	SIM_ClearFlashVars();
+	memset(&d, 0, sizeof(d));
+	d.boot_count = 5;
+	d.boot_success_count = 5;
+	d.savedValues[3] = -123;
+
+	// old format, as written by older builds
+	HAL_FlashVars_GetStats(&prev);
+	for (i = 0; i < FLASHVARS_TEST_TOGGLES; i++) {
+		d.savedValues[1] = !d.savedValues[1];
+		SIM_FlashVars_WriteLegacy(&d);
+	}
+	HAL_FlashVars_GetStats(&st);
+	legacyBytes = st.bytesWritten - prev.bytesWritten;
+	prev = st;
+	flash_vars_read(&data);
+	HAL_FlashVars_GetStats(&st);
+	legacyReadBytes = st.bytesRead - prev.bytesRead;
+	legacyReads = st.reads - prev.reads;
+	SELFTEST_ASSERT(data.boot_count == 5);
+	SELFTEST_ASSERT(data.savedValues[1] == d.savedValues[1]);
+	SELFTEST_ASSERT(data.savedValues[3] == -123);
+
+	// boot converts it
+	SIM_FlashVars_Reload();
+	HAL_FlashVars_IncreaseBootCount();
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 6);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(3) == -123);
+	flash_vars_read(&data);
+	SELFTEST_ASSERT(data.boot_count == 6);
+	SELFTEST_ASSERT(data.savedValues[1] == d.savedValues[1]);
+	SELFTEST_ASSERT(data.savedValues[3] == -123);
+
+	// same toggles in journal
+	v = d.savedValues[1];
+	HAL_FlashVars_GetStats(&prev);
+	for (i = 0; i < FLASHVARS_TEST_TOGGLES; i++) {
+		v = !v;
+		HAL_FlashVars_SaveChannel(1, v);
+		HAL_FlashVars_Flush();
+	}
+	HAL_FlashVars_GetStats(&st);
+	journalBytes = st.bytesWritten - prev.bytesWritten;
+	prev = st;
+	flash_vars_read(&data);
+	HAL_FlashVars_GetStats(&st);
+	journalReadBytes = st.bytesRead - prev.bytesRead;
+	journalReads = st.reads - prev.reads;
+	SELFTEST_ASSERT(data.boot_count == 6);
+	SELFTEST_ASSERT(data.savedValues[1] == v);
+	SELFTEST_ASSERT(data.savedValues[3] == -123);
+
+	printf("Flash vars: per toggle %i bytes written (old format %i), boot read %i bytes in %i reads (old format %i bytes in %i reads)\n",
+		journalBytes / FLASHVARS_TEST_TOGGLES, legacyBytes / FLASHVARS_TEST_TOGGLES,
+		journalReadBytes, journalReads, legacyReadBytes, legacyReads);
+	SELFTEST_ASSERT(journalBytes * 4 < legacyBytes);
+	SELFTEST_ASSERT(journalReadBytes < legacyReadBytes);
+	SELFTEST_ASSERT(journalReads * 10 < legacyReads);
+
+	// fill the sector, journal moves to the other one and back
+	HAL_FlashVars_GetStats(&prev);
+	for (i = 0; i < 1200; i++) {
+		HAL_FlashVars_SaveChannel(i % 4, i);
+		HAL_FlashVars_Flush();
+	}
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.sectorErases - prev.sectorErases >= 2);
+	// old format would erase both sectors every ~120 writes
+	SELFTEST_ASSERT(st.sectorErases - prev.sectorErases <= 6);
+	SIM_FlashVars_Reload();
+	flash_vars_read(&data);
+	for (i = 0; i < 4; i++) {
+		SELFTEST_ASSERT(data.savedValues[i] == 1196 + i);
+	}
+	SELFTEST_ASSERT(data.boot_count == 6);
+	// and boot sees it too
+	HAL_FlashVars_IncreaseBootCount();
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 7);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(2) == 1198);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(3) == 1199);
+}
+
+// power lost at any point of converting old format must leave either format readable,
+// both with last old format record whole in sector 1 and reaching back into sector 0
+static void Test_FlashVars_LegacyPowerCut() {
+	FLASH_VARS_STRUCTURE d, data;
+	int recLen, records, layout, cut, i;
+
+	recLen = (int)offsetof(FLASH_VARS_STRUCTURE, len) + 1;
+	for (layout = 0; layout < 2; layout++) {
+		// first record after magic at offset 4
+		records = (0x1000 - 4) / recLen + 1 + layout;
+		for (cut = 0; cut < 8; cut++) {
+			SIM_ClearFlashVars();
+			memset(&d, 0, sizeof(d));
+			d.boot_count = 5;
+			d.savedValues[3] = -123;
+			for (i = 1; i <= records; i++) {
+				d.savedValues[1] = i;
+				SIM_FlashVars_WriteLegacy(&d);
+			}
+			SIM_FlashVars_Reload();
+			SIM_FlashVars_CutPowerAfter(cut);
+			HAL_FlashVars_IncreaseBootCount();
+			SIM_FlashVars_CutPowerAfter(-1);
+
+			flash_vars_read(&data);
+			SELFTEST_ASSERT(data.boot_count == 5 || data.boot_count == 6);
+			SELFTEST_ASSERT(data.savedValues[1] == records);
+			SELFTEST_ASSERT(data.savedValues[3] == -123);
+		}
+		// and with power on it is converted
+		SIM_FlashVars_Reload();
+		HAL_FlashVars_IncreaseBootCount();
+		SIM_FlashVars_Reload();
+		SELFTEST_ASSERT(flash_vars_read(&data) == 1);
+		SELFTEST_ASSERT(data.savedValues[1] == records);
+		SELFTEST_ASSERT(data.savedValues[3] == -123);
+	}
+}
+
+void Test_FlashVars() {
+	flashVarsStats_t st;
+	FLASH_VARS_STRUCTURE data;
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("setPinRole 9 Rel", 0);
+	CMD_ExecuteCommand("setPinChannel 9 1", 0);
+	// remember last state
+	CMD_ExecuteCommand("SetStartValue 1 -1", 0);
+	// get past boot complete write
+	Sim_RunSeconds(BOOT_COMPLETE_SECONDS + 5, false);
+
+	HAL_FlashVars_GetStats(&st);
+	int writesAtStart = st.writes;
+	SELFTEST_ASSERT(st.pending == 0);
+	SELFTEST_ASSERT(HAL_FlashVars_GetFlushInterval() == 10);
+
+	// a burst of toggles is only kept in RAM
+	for (i = 0; i < 9; i++) {
+		CMD_ExecuteCommand("toggleChannel 1", 0);
+	}
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.writes == writesAtStart);
+	SELFTEST_ASSERT(st.saveRequests == 9);
+	SELFTEST_ASSERT(st.pending);
+	// but reads see the cached value
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(1) == 1);
+	flash_vars_read(&data);
+	SELFTEST_ASSERT(data.savedValues[1] == 0);
+
+	// not yet...
+	Sim_RunSeconds(5, false);
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.writes == writesAtStart);
+	// ...and after the flush interval, a single record is written
+	// (each record is two flash writes, used units bitmap and the record)
+	Sim_RunSeconds(7, false);
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.writes == writesAtStart + 2);
+	SELFTEST_ASSERT(st.pending == 0);
+	flash_vars_read(&data);
+	SELFTEST_ASSERT(data.savedValues[1] == 1);
+
+	// setting the same value again is not a change
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+	Sim_RunSeconds(12, false);
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.writes == writesAtStart + 2);
+	SELFTEST_ASSERT(st.pending == 0);
+
+	// energy total alone does not cause periodic writes
+	HAL_FlashVars_SaveTotalConsumption(123.5f);
+	Sim_RunSeconds(30, false);
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.writes == writesAtStart + 2);
+	SELFTEST_ASSERT(st.pending);
+	// but goes out on explicit flush (reboot, OTA)
+	HAL_FlashVars_Flush();
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.writes == writesAtStart + 4);
+	SELFTEST_ASSERT(st.pending == 0);
+	flash_vars_read(&data);
+	SELFTEST_ASSERT(Float_Equals(data.emetering.TotalConsumption, 123.5f));
+
+	// pending energy total goes out along with a channel change
+	HAL_FlashVars_SaveTotalConsumption(124.5f);
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	Sim_RunSeconds(12, false);
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.writes == writesAtStart + 8);
+	flash_vars_read(&data);
+	SELFTEST_ASSERT(data.savedValues[1] == 0);
+	SELFTEST_ASSERT(Float_Equals(data.emetering.TotalConsumption, 124.5f));
+
+	// interval 0 - write-through, like before
+	CMD_ExecuteCommand("flashVars_flushInterval 0", 0);
+	SELFTEST_ASSERT(HAL_FlashVars_GetFlushInterval() == 0);
+	CMD_ExecuteCommand("toggleChannel 1", 0);
+	CMD_ExecuteCommand("toggleChannel 1", 0);
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.writes == writesAtStart + 12);
+	SELFTEST_ASSERT(st.pending == 0);
+
+	// cached value survives the reboot path
+	CMD_ExecuteCommand("flashVars_flushInterval 10", 0);
+	CMD_ExecuteCommand("toggleChannel 1", 0);
+	HAL_FlashVars_GetStats(&st);
+	SELFTEST_ASSERT(st.pending);
+	HAL_FlashVars_Flush();
+	flash_vars_read(&data);
+	SELFTEST_ASSERT(data.savedValues[1] == 1);
+	CMD_ExecuteCommand("flashVars_stats", 0);
+
+	Test_FlashVars_Journal();
+	Test_FlashVars_LegacyPowerCut();
+}
+
+#endif
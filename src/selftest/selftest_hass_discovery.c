@@ -1,6 +1,7 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h".
+#include "../driver/drv_public.h"
 
 void Test_HassDiscovery_Relay_1x() {
 	const char *shortName = "WinRelTest1x";
@@ -35,6 +36,40 @@ void Test_HassDiscovery_Relay_1x() {
 void Test_HassDiscovery_Relay_2x() {
 	// TODO
 }
+void Test_HassDiscovery_Relay_4x_Power() {
+	const char *shortName = "WinRelPow4x";
+	const char *fullName = "Windows Relay Power 4x";
+	int i;
+
+	SIM_ClearOBK(shortName);
+	SIM_ClearAndPrepareForMQTTTesting("testDevicePower");
+
+	CFG_SetShortDeviceName(shortName);
+	CFG_SetDeviceName(fullName);
+
+	for (i = 0; i < 4; i++) {
+		PIN_SetPinRoleForPinIndex(6 + i, IOR_Relay);
+		PIN_SetPinChannelForPinIndex(6 + i, i + 1);
+	}
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+	// small queue can hold only a few entities, discovery has to resume on later ticks
+	CMD_ExecuteCommand("mqtt_publishQueue 2048", 0);
+
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("scheduleHADiscovery 1", 0);
+	Sim_RunSeconds(25, false);
+
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT(va("homeassistant/switch/%s_relay_1/config", fullName), false);
+	SELFTEST_ASSERT_JSON_VALUE_STRING(NULL, "stat_t", "~/1/get");
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT(va("homeassistant/switch/%s_relay_4/config", fullName), false);
+	SELFTEST_ASSERT_JSON_VALUE_STRING(NULL, "cmd_t", "~/4/set");
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT(va("homeassistant/sensor/%s_sensor_0/config", fullName), false);
+	SELFTEST_ASSERT_JSON_VALUE_STRING(NULL, "dev_cla", "voltage");
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT(va("homeassistant/sensor/%s_sensor_%i/config", fullName, OBK_NUM_SENSOR_COUNT - 1), false);
+	SELFTEST_ASSERT_JSON_VALUE_STRING("dev", "name", shortName);
+
+	CMD_ExecuteCommand("mqtt_publishQueue 8192", 0);
+}
 
 
 void Test_HassDiscovery_LED_CW() {
@@ -94,6 +129,7 @@ void Test_HassDiscovery_DHT11() {
 void Test_HassDiscovery() {
 	Test_HassDiscovery_Relay_1x();
 	Test_HassDiscovery_Relay_2x();
+	Test_HassDiscovery_Relay_4x_Power();
 	Test_HassDiscovery_LED_CW();
 	Test_HassDiscovery_LED_RGB();
 	Test_HassDiscovery_LED_RGBCW();
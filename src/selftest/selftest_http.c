@@ -2,6 +2,7 @@
 
 #include "selftest_local.h"
 #include "../httpserver/new_http.h"
+#include "../logging/logging.h"
 //#define JSMN_HEADER
 ///#include "../jsmn/jsmn.h"
 #include "../cJSON/cJSON.h"
@@ -59,6 +60,10 @@ const char *Helper_GetPastHTTPHeader(const char *s) {
 static char outbuf[8192];
 static char buffer[8192];
 static const char *replyAt;
+// benchmark sends thousands of requests, don't print each one
+static bool http_quiet = false;
+// fake client asks for a keep-alive connection
+static bool http_keepAlive = false;
 //static jsmntok_t tokens[256]; /* We expect no more than qq JSON tokens */
 
 void Test_FakeHTTPClientPacket_Generic() {
@@ -76,16 +81,23 @@ void Test_FakeHTTPClientPacket_Generic() {
 	request.fd = 0;
 	request.received = buffer;
 	request.receivedLen = iResult;
+	request.receivedLenmax = sizeof(buffer) - 1;
 	outbuf[0] = '\0';
 	request.reply = outbuf;
 	request.replylen = 0;
 
 	request.replymaxlen = sizeof(outbuf);
+	request.keepAlive = http_keepAlive;
 
-	printf("Test_FakeHTTPClientPacket_GET fake bytes sent: %d \n", iResult);
+	if (!http_quiet)
+		printf("Test_FakeHTTPClientPacket_GET fake bytes sent: %d \n", iResult);
  	len = HTTP_ProcessPacket(&request);
+	if (request.chunked) {
+		http_endReply(&request);
+	}
 	outbuf[request.replylen] = 0;
-	printf("Test_FakeHTTPClientPacket_GET fake bytes received: %d \n", len);
+	if (!http_quiet)
+		printf("Test_FakeHTTPClientPacket_GET fake bytes received: %d \n", len);
 
 	replyAt = Helper_GetPastHTTPHeader(outbuf);
 
@@ -107,6 +119,43 @@ void Test_FakeHTTPClientPacket_POST(const char *tg, const char *data) {
 	sprintf(buffer, http_post_template1, tg, dataLen, data);
 	Test_FakeHTTPClientPacket_Generic();
 }
+void SIM_HTTP_SetPendingData(const char *data, int len, int segmentSize);
+// POST with only the headers and start of the body in the first segment,
+// rest of the body arrives later in segments, as from a real socket
+void Test_FakeHTTPClientPacket_POST_Stream(const char *tg, const char *data, int firstLen, int segmentSize, bool bChunked) {
+	static char encoded[80 * 1024];
+	const char *body;
+	int dataLen = strlen(data);
+	int bodyLen, i, len;
+
+	body = data;
+	bodyLen = dataLen;
+	if (bChunked) {
+		// chunks of odd sizes, to cross segments at any place
+		bodyLen = 0;
+		for (i = 0; i < dataLen; i += len) {
+			len = 1000 + (i % 7) * 37;
+			if (len > dataLen - i)
+				len = dataLen - i;
+			bodyLen += sprintf(encoded + bodyLen, "%x\r\n", len);
+			memcpy(encoded + bodyLen, data + i, len);
+			bodyLen += len;
+			bodyLen += sprintf(encoded + bodyLen, "\r\n");
+		}
+		bodyLen += sprintf(encoded + bodyLen, "0\r\n\r\n");
+		body = encoded;
+		sprintf(buffer, "POST /%s HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n", tg);
+	}
+	else {
+		sprintf(buffer, "POST /%s HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: %i\r\n\r\n", tg, dataLen);
+	}
+	if (firstLen > bodyLen)
+		firstLen = bodyLen;
+	strncat(buffer, body, firstLen);
+	SIM_HTTP_SetPendingData(body + firstLen, bodyLen - firstLen, segmentSize);
+	Test_FakeHTTPClientPacket_Generic();
+	SIM_HTTP_SetPendingData(0, 0, 0);
+}
 void Test_GetJSONValue_Setup(const char *text) {
 	if (g_json) {
 		cJSON_Delete(g_json);
@@ -892,6 +941,364 @@ void Test_Http_LED_RGB() {
 	*/
 
 }
+void Test_Http_LogRing() {
+	const char *reply;
+	int i;
+
+	// drain whatever earlier tests left for the HTTP reader
+	Test_FakeHTTPClientPacket_GET("lograw");
+
+	// much more than fits in the ring, so the HTTP reader gets overrun
+	for (i = 0; i < 200; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "LogRingTest line %i of the test", i);
+	}
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strlen(reply) <= 4096);
+	SELFTEST_ASSERT(strstr(reply, "LogRingTest line 0 of") == 0);
+	SELFTEST_ASSERT(strstr(reply, "Info:GEN:LogRingTest line 199 of the test\r\n") != 0);
+	SELFTEST_ASSERT(strstr(reply, "Info:GEN:LogRingTest line 150 of the test\r\n") != 0);
+
+	// nothing new since last read
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, "LogRingTest") == 0);
+
+	// a line that does not fit is cut, but still terminated
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "LogRingTest %01500i", 5);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, "Info:GEN:LogRingTest 0000") != 0);
+	SELFTEST_ASSERT(strstr(reply, "5\r\n") == 0);
+	SELFTEST_ASSERT(strstr(reply, "0\r\n") != 0);
+
+	// binary records must read back exactly like text lines
+	CMD_ExecuteCommand("logbinary 1", 0);
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "LogRingTest %i, %05.2f, [%-6s] %x %lu %c %% %*i %s", -12, 3.14159f, "ab", 255, 77ul, 'Q', 4, 9, "tail\n");
+	addLogAdv(LOG_INFO, LOG_FEATURE_RAW, "LogRingTest raw %s", "value");
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "LogRingTest no args");
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, "Info:GEN:LogRingTest -12, 03.14, [ab    ] ff 77 Q %    9 tail\r\n") != 0);
+	SELFTEST_ASSERT(strstr(reply, "\nLogRingTest raw value\r\n") != 0);
+	SELFTEST_ASSERT(strstr(reply, "Info:MQTT:LogRingTest no args\r\n") != 0);
+
+	// records are much smaller than the text, so more history fits
+	for (i = 0; i < 150; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "LogRingTest line %i of the test", i);
+	}
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strlen(reply) > 4096);
+	SELFTEST_ASSERT(strstr(reply, "Info:GEN:LogRingTest line 0 of the test\r\n") != 0);
+	SELFTEST_ASSERT(strstr(reply, "Info:GEN:LogRingTest line 149 of the test\r\n") != 0);
+	CMD_ExecuteCommand("logbinary 0", 0);
+}
+static int Test_Http_ExtraPage(http_request_t *request) {
+	http_setup(request, httpMimeTypeText);
+	poststr(request, "Extra page");
+	poststr(request, NULL);
+	return 0;
+}
+// registered urls are prefixes of each other, first registered one wins
+static void Test_Http_OverlappingRoutes() {
+	HTTP_RegisterCallback("/api/a", HTTP_GET, Test_Http_ExtraPage);
+	HTTP_RegisterCallback("/api/b", HTTP_GET, Test_Http_ExtraPage);
+	HTTP_RegisterCallback("/api/extra", HTTP_GET, Test_Http_ExtraPage);
+	HTTP_RegisterCallback("/apix", HTTP_GET, Test_Http_ExtraPage);
+	HTTP_RegisterCallback("/zz_extra", HTTP_POST, Test_Http_ExtraPage);
+
+	Test_FakeHTTPClientPacket_GET("api/info");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "\"uptime_s\"") != 0);
+	// "/api/" was registered earlier and takes it
+	Test_FakeHTTPClientPacket_GET("api/extra");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Extra page") == 0);
+	Test_FakeHTTPClientPacket_GET("apix?a=1");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Extra page") != 0);
+	Test_FakeHTTPClientPacket_GET("app");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Extra page") == 0);
+	Test_FakeHTTPClientPacket_GET("logs");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") == 0);
+	// method must match too
+	Test_FakeHTTPClientPacket_GET("zz_extra");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") != 0);
+	Test_FakeHTTPClientPacket_POST("zz_extra", "x");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Extra page") != 0);
+
+	// don't leave them for other tests
+	SELFTEST_ASSERT(HTTP_UnregisterCallback("/api/a", HTTP_GET, Test_Http_ExtraPage) == 0);
+	SELFTEST_ASSERT(HTTP_UnregisterCallback("/api/b", HTTP_GET, Test_Http_ExtraPage) == 0);
+	SELFTEST_ASSERT(HTTP_UnregisterCallback("/api/extra", HTTP_GET, Test_Http_ExtraPage) == 0);
+	SELFTEST_ASSERT(HTTP_UnregisterCallback("/apix", HTTP_GET, Test_Http_ExtraPage) == 0);
+	SELFTEST_ASSERT(HTTP_UnregisterCallback("/zz_extra", HTTP_POST, Test_Http_ExtraPage) == 0);
+	SELFTEST_ASSERT(HTTP_UnregisterCallback("/zz_extra", HTTP_POST, Test_Http_ExtraPage) == -1);
+	Test_FakeHTTPClientPacket_GET("apix?a=1");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") != 0);
+	Test_FakeHTTPClientPacket_GET("api/info");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "\"uptime_s\"") != 0);
+}
+static const char *g_routeUrls[] = {
+	"cm?cmnd=POWER",
+	"cm?a=1&b=2&c&cmnd=Dimmer&d=4",
+	"about",
+	"cfg_ping",
+	"nothing_here?x=1",
+	"logs",
+	"api/info",
+};
+static const char *g_routeExpected[] = {
+	"\"POWER\":\"ON\"",
+	"\"Dimmer\":",
+	"About",
+	"Ping watchdog",
+	"Not found",
+	"",
+	"\"uptime_s\"",
+};
+#define NUM_ROUTE_URLS (sizeof(g_routeUrls) / sizeof(g_routeUrls[0]))
+
+void Test_Http_Routes() {
+	int i;
+
+	SIM_ClearOBK();
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+
+	for (i = 0; i < NUM_ROUTE_URLS; i++) {
+		Test_FakeHTTPClientPacket_GET(g_routeUrls[i]);
+		SELFTEST_ASSERT(Test_GetLastHTMLReply() != 0);
+		SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), g_routeExpected[i]) != 0);
+	}
+	// built-in pages match whole name only
+	Test_FakeHTTPClientPacket_GET("cfgx");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") != 0);
+	Test_FakeHTTPClientPacket_GET("cfg_pingx?a=b");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "Not found") != 0);
+	Test_Http_OverlappingRoutes();
+}
+// routing of common pages
+void Test_Http_Routes_Benchmark() {
+	int i, requests;
+	clock_t t;
+	double elapsed;
+
+	SIM_ClearOBK();
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+
+	requests = 3000;
+	http_quiet = true;
+	t = clock();
+	for (i = 0; i < requests; i++) {
+		Test_FakeHTTPClientPacket_GET(g_routeUrls[i % NUM_ROUTE_URLS]);
+	}
+	elapsed = (double)(clock() - t) / CLOCKS_PER_SEC;
+	http_quiet = false;
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), g_routeExpected[(requests - 1) % NUM_ROUTE_URLS]) != 0);
+	printf("HTTP benchmark: %i requests, %.1f us per request\n", requests, elapsed * 1e6 / requests);
+}
+// joins the chunks of a chunked body, returns its length or -1 if malformed
+static int Test_Http_Dechunk(const char *s, char *o, int maxLen) {
+	int len, total;
+	char *end;
+
+	total = 0;
+	while (1) {
+		len = strtol(s, &end, 16);
+		if (end == s || strncmp(end, "\r\n", 2))
+			return -1;
+		s = end + 2;
+		if (len == 0)
+			break;
+		if (total + len >= maxLen || strlen(s) < len + 2 || strncmp(s + len, "\r\n", 2))
+			return -1;
+		memcpy(o + total, s, len);
+		total += len;
+		s += len + 2;
+	}
+	o[total] = 0;
+	if (strcmp(s, "\r\n"))
+		return -1;
+	return total;
+}
+void Test_Http_KeepAlive() {
+	static char plain[8192];
+	static char joined[8192];
+	static char poolReply[2048];
+	static char poolIncoming[1024];
+	http_request_t request;
+	int i, len;
+
+	SIM_ClearOBK();
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+
+	// chunks are framed in place on every flush
+	memset(&request, 0, sizeof(request));
+	request.reply = outbuf;
+	request.replymaxlen = sizeof(outbuf);
+	request.keepAlive = 1;
+	http_setup(&request, httpMimeTypeText);
+	SELFTEST_ASSERT(request.chunked);
+	poststr(&request, "hello");
+	poststr(&request, NULL);
+	// empty flush doesn't end the reply
+	poststr(&request, NULL);
+	poststr(&request, "world!");
+	SELFTEST_ASSERT(http_endReply(&request) == 1);
+	outbuf[request.replylen] = 0;
+	SELFTEST_ASSERT(strstr(outbuf, "Connection: keep-alive\r\nTransfer-Encoding: chunked\r\n\r\n") != 0);
+	SELFTEST_ASSERT(!strcmp(Helper_GetPastHTTPHeader(outbuf), "0005\r\nhello\r\n0006\r\nworld!\r\n0\r\n\r\n"));
+
+	// same page, once closed and once kept alive
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT(strstr(outbuf, "Connection: close") != 0);
+	strcpy(plain, replyAt);
+	http_keepAlive = true;
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT(strstr(outbuf, "Transfer-Encoding: chunked") != 0);
+	len = Test_Http_Dechunk(replyAt, joined, sizeof(joined));
+	SELFTEST_ASSERT(len > 1000);
+	SELFTEST_ASSERT(!strcmp(joined, plain));
+
+	// client doesn't want it
+	sprintf(buffer, "GET /index HTTP/1.1\r\nConnection: close\r\n\r\n");
+	Test_FakeHTTPClientPacket_Generic();
+	SELFTEST_ASSERT(strstr(outbuf, "Connection: close") != 0);
+	SELFTEST_ASSERT(strstr(outbuf, "chunked") == 0);
+	// or can't have it
+	sprintf(buffer, "GET /index HTTP/1.0\r\n\r\n");
+	Test_FakeHTTPClientPacket_Generic();
+	SELFTEST_ASSERT(strstr(outbuf, "chunked") == 0);
+	http_keepAlive = false;
+
+	// pooled worker reuses its buffers for each request on the connection
+	for (i = 0; i < 3; i++) {
+		sprintf(poolIncoming, http_get_template1, "index?state=1");
+		memset(&request, 0, sizeof(request));
+		request.received = poolIncoming;
+		request.receivedLen = strlen(poolIncoming);
+		request.reply = poolReply;
+		request.replymaxlen = sizeof(poolReply) - 1;
+		request.keepAlive = 1;
+		HTTP_ProcessPacket(&request);
+		SELFTEST_ASSERT(http_endReply(&request));
+	}
+	poolReply[request.replylen] = 0;
+	SELFTEST_ASSERT(Test_Http_Dechunk(Helper_GetPastHTTPHeader(poolReply), joined, sizeof(joined)) > 0);
+	SELFTEST_ASSERT(strstr(joined, "ON") != 0);
+}
+// the status poll browsers send every few seconds, served as
+// thread per request used to (two buffers malloc'ed per request)
+// and as pooled worker does (buffers reused, connection kept)
+void Test_Http_KeepAlive_Benchmark() {
+	static char joined[8192];
+	static char poolReply[2048];
+	static char poolIncoming[1024];
+	http_request_t request;
+	char *reply, *incoming;
+	int i, requests;
+	clock_t t;
+	double perRequest, pooled;
+
+	SIM_ClearOBK();
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+
+	requests = 3000;
+	http_quiet = true;
+	t = clock();
+	for (i = 0; i < requests; i++) {
+		reply = malloc(2048);
+		incoming = malloc(1024);
+		sprintf(incoming, http_get_template1, "index?state=1");
+		memset(&request, 0, sizeof(request));
+		request.received = incoming;
+		request.receivedLen = strlen(incoming);
+		request.reply = reply;
+		request.replymaxlen = 2048 - 1;
+		HTTP_ProcessPacket(&request);
+		free(incoming);
+		free(reply);
+	}
+	perRequest = (double)(clock() - t) / CLOCKS_PER_SEC;
+	t = clock();
+	for (i = 0; i < requests; i++) {
+		sprintf(poolIncoming, http_get_template1, "index?state=1");
+		memset(&request, 0, sizeof(request));
+		request.received = poolIncoming;
+		request.receivedLen = strlen(poolIncoming);
+		request.reply = poolReply;
+		request.replymaxlen = sizeof(poolReply) - 1;
+		request.keepAlive = 1;
+		HTTP_ProcessPacket(&request);
+		SELFTEST_ASSERT(http_endReply(&request));
+	}
+	pooled = (double)(clock() - t) / CLOCKS_PER_SEC;
+	http_quiet = false;
+	poolReply[request.replylen] = 0;
+	SELFTEST_ASSERT(Test_Http_Dechunk(Helper_GetPastHTTPHeader(poolReply), joined, sizeof(joined)) > 0);
+	SELFTEST_ASSERT(strstr(joined, "ON") != 0);
+	printf("HTTP keep-alive benchmark: %.0f requests/s pooled and kept alive, %.0f requests/s with buffers per request\n",
+		requests / pooled, requests / perRequest);
+}
+void SIM_HTTP_SetStalled(int bStalled);
+// client that connects and sends nothing, worker has to get it back after the receive timeout
+void Test_Http_IdleClient() {
+	http_request_t request;
+	int start;
+
+	SIM_ClearOBK();
+	memset(&request, 0, sizeof(request));
+	request.received = buffer;
+	request.receivedLenmax = sizeof(buffer) - 1;
+	SIM_HTTP_SetPendingData("", 0, 1460);
+	SIM_HTTP_SetStalled(1);
+	start = rtos_get_time();
+	SELFTEST_ASSERT(HTTP_ReadRequest(&request) <= 0);
+	SELFTEST_ASSERT(rtos_get_time() - start <= HTTP_CLIENT_RECV_TIMEOUT_MS);
+	SIM_HTTP_SetStalled(0);
+	SIM_HTTP_SetPendingData(0, 0, 0);
+
+	// and the next client is served
+	Test_FakeHTTPClientPacket_GET("api/info");
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "\"uptime_s\"") != 0);
+}
+void SIM_HTTP_SetSegmentDelay(int ms);
+int SIM_HTTP_GetRecvCalls();
+// client that sends its headers one byte per second, worker must not wait for them forever
+void Test_Http_SlowClient() {
+	http_request_t request;
+	const char *slow = "GET /api/info HTTP/1.1\r\nHost: 192.168.0.5\r\nUser-Agent: slow\r\nX-a: b\r\n";
+	int start;
+
+	SIM_ClearOBK();
+	memset(&request, 0, sizeof(request));
+	request.received = buffer;
+	request.receivedLenmax = sizeof(buffer) - 1;
+	SIM_HTTP_SetPendingData(slow, strlen(slow), 1);
+	SIM_HTTP_SetSegmentDelay(1000);
+	start = rtos_get_time();
+	SELFTEST_ASSERT(HTTP_ReadRequest(&request) <= 0);
+	SELFTEST_ASSERT(rtos_get_time() - start <= HTTP_HEADER_TIMEOUT_MS);
+	SELFTEST_ASSERT(SIM_HTTP_GetRecvCalls() == HTTP_HEADER_TIMEOUT_MS / 1000);
+	SIM_HTTP_SetSegmentDelay(0);
+	SIM_HTTP_SetPendingData(0, 0, 0);
+
+	// headers that arrive in time, even in small pieces, are fine
+	memset(&request, 0, sizeof(request));
+	request.received = buffer;
+	request.receivedLenmax = sizeof(buffer) - 1;
+	SIM_HTTP_SetPendingData("GET /api/info HTTP/1.1\r\n\r\n", 26, 4);
+	SIM_HTTP_SetSegmentDelay(100);
+	SELFTEST_ASSERT(HTTP_ReadRequest(&request) == 26);
+	SIM_HTTP_SetSegmentDelay(0);
+	SIM_HTTP_SetPendingData(0, 0, 0);
+}
 void Test_Http() {
 	Test_Http_SingleRelayOnChannel1();
 	Test_Http_TwoRelays();
@@ -901,6 +1308,12 @@ void Test_Http() {
 	Test_Http_LED_SingleChannel();
 	Test_Http_LED_CW();
 	Test_Http_LED_RGB();
+
+	Test_Http_LogRing();
+	Test_Http_Routes();
+	Test_Http_KeepAlive();
+	Test_Http_IdleClient();
+	Test_Http_SlowClient();
 }
 
 
@@ -71,6 +71,47 @@ void Test_Command_If_Else() {
 	SELFTEST_ASSERT_CHANNEL(12, 1111);//keeps old val
 	SELFTEST_ASSERT_CHANNEL(13, 4444);
 
+	// event handler keeps its condition compiled, it must still see current values
+	CMD_ExecuteCommand("addEventHandler OnClick 5 if $CH11>$CH12 then \"setChannel 14 1\" else \"setChannel 14 2\"", 0);
+	CMD_ExecuteCommand("addEventHandler OnClick 6 if \"$CH11 == 7\" then \"addChannel 15 1\"", 0);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 5);
+	SELFTEST_ASSERT_CHANNEL(14, 2);
+	CMD_ExecuteCommand("setChannel 11 5000", 0);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 5);
+	SELFTEST_ASSERT_CHANNEL(14, 1);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 6);
+	SELFTEST_ASSERT_CHANNEL(15, 0);
+	CMD_ExecuteCommand("setChannel 11 7", 0);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 6);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 6);
+	SELFTEST_ASSERT_CHANNEL(15, 2);
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 6);
+	SELFTEST_ASSERT_CHANNEL(15, 2);
+
+	// nested if, through an alias
+	CMD_ExecuteCommand("alias innerIf if $CH20 then \"setChannel 21 1\" else \"setChannel 21 2\"", 0);
+	CMD_ExecuteCommand("if 1 then innerIf", 0);
+	SELFTEST_ASSERT_CHANNEL(21, 2);
+	CMD_ExecuteCommand("setChannel 20 1", 0);
+	CMD_ExecuteCommand("if $CH20 then \"innerIf\" else \"setChannel 21 3\"", 0);
+	SELFTEST_ASSERT_CHANNEL(21, 1);
+
+	// then/else commands longer than the copy kept on stack
+	CMD_ExecuteCommand("if $CH20 then \"backlog setChannel 22 1; setChannel 23 2; setChannel 24 3; setChannel 25 4; setChannel 26 5; setChannel 27 6\" "
+		"else \"backlog setChannel 22 11; setChannel 23 12; setChannel 24 13; setChannel 25 14; setChannel 26 15; setChannel 27 16\"", 0);
+	SELFTEST_ASSERT_CHANNEL(22, 1);
+	SELFTEST_ASSERT_CHANNEL(27, 6);
+	CMD_ExecuteCommand("if !$CH20 then \"backlog setChannel 22 1; setChannel 23 2; setChannel 24 3; setChannel 25 4; setChannel 26 5; setChannel 27 6\" "
+		"else \"backlog setChannel 22 11; setChannel 23 12; setChannel 24 13; setChannel 25 14; setChannel 26 15; setChannel 27 16\"", 0);
+	SELFTEST_ASSERT_CHANNEL(22, 11);
+	SELFTEST_ASSERT_CHANNEL(27, 16);
+	// wrong keywords are rejected
+	CMD_ExecuteCommand("if 1 thenx \"setChannel 22 99\"", 0);
+	SELFTEST_ASSERT_CHANNEL(22, 11);
+	CMD_ExecuteCommand("if 1 then \"setChannel 22 99\" elsex \"setChannel 22 98\"", 0);
+	SELFTEST_ASSERT_CHANNEL(22, 11);
+
 	// cause error
 	//SELFTEST_ASSERT_CHANNEL(1, 666);
 
@@ -257,11 +257,133 @@ void Test_LEDDriver_RGB() {
 	// make error
 	//SELFTEST_ASSERT_CHANNEL(3, 666);
 }
+
+extern float baseColors[5];
+extern float g_brightness0to100;
+float led_gamma_correction(int color, float iVal);
+
+// float gamma and RGB correction as it was done before the lookup table
+static float Test_LEDDriver_GammaReference(int color, float iVal) {
+	float ch_bright_min = g_cfg.led_corr.rgb_bright_min / 100;
+	if (color > 2) {
+		ch_bright_min = g_cfg.led_corr.cw_bright_min / 100;
+	}
+	float brightnessNormalized0to1 = g_brightness0to100 * 0.01f;
+	float oVal = (powf(brightnessNormalized0to1, g_cfg.led_corr.led_gamma) * (1 - ch_bright_min) + ch_bright_min) * iVal;
+	if (color < 3) {
+		float corr = g_cfg.led_corr.rgb_cal[color];
+		float sum_other_colors = baseColors[0] + baseColors[1] + baseColors[2] - baseColors[color];
+		if (baseColors[color] > sum_other_colors) {
+			corr += (1.0f - corr) * (1.0f - sum_other_colors / baseColors[color]);
+		}
+		oVal *= corr;
+	}
+	if (oVal > 255.0f) {
+		oVal = 255.0f;
+	}
+	return oVal;
+}
+// lookup table path against float reference over the whole RGBCW range,
+// must stay within one step of 0-255 output
+void Test_LEDDriver_Gamma() {
+	static const float gammas[] = { 1.0f, 1.8f, 2.2f, 3.0f };
+	static const float mins[] = { 0.0f, 0.1f, 10.0f };
+	static const float others[] = { 0.0f, 64.0f, 255.0f };
+	int g, m, cal, o, v, b, i;
+	float diff, maxDiff;
+	led_corr_t saved;
+
+	SIM_ClearOBK();
+	saved = g_cfg.led_corr;
+	maxDiff = 0;
+	for (g = 0; g < sizeof(gammas) / sizeof(gammas[0]); g++) {
+		for (m = 0; m < sizeof(mins) / sizeof(mins[0]); m++) {
+			for (cal = 0; cal < 2; cal++) {
+				g_cfg.led_corr.led_gamma = gammas[g];
+				g_cfg.led_corr.rgb_bright_min = mins[m];
+				g_cfg.led_corr.cw_bright_min = mins[sizeof(mins) / sizeof(mins[0]) - 1 - m];
+				g_cfg.led_corr.rgb_cal[0] = 1.0f;
+				g_cfg.led_corr.rgb_cal[1] = cal ? 0.8f : 1.0f;
+				g_cfg.led_corr.rgb_cal[2] = cal ? 0.55f : 1.0f;
+				for (o = 0; o < sizeof(others) / sizeof(others[0]); o++) {
+					for (v = 0; v <= 255; v += 3) {
+						baseColors[0] = v;
+						baseColors[1] = others[o];
+						baseColors[2] = others[sizeof(others) / sizeof(others[0]) - 1 - o] * 0.5f;
+						baseColors[3] = v;
+						baseColors[4] = 255 - v;
+						for (b = 0; b <= 200; b++) {
+							g_brightness0to100 = b * 0.5f;
+							for (i = 0; i < 5; i++) {
+								diff = fabsf(led_gamma_correction(i, baseColors[i]) - Test_LEDDriver_GammaReference(i, baseColors[i]));
+								if (diff > maxDiff)
+									maxDiff = diff;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	printf("LED gamma: max difference from float reference is %f\n", maxDiff);
+	SELFTEST_ASSERT(maxDiff <= 1.0f);
+
+	g_cfg.led_corr = saved;
+	LED_ResetGlobalVariablesToDefaults();
+}
+// smooth transitions end at the same values as direct apply
+void Test_LEDDriver_Lerp() {
+	float direct[3];
+	int i;
+
+	SIM_ClearOBK();
+	PIN_SetPinRoleForPinIndex(24, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(24, 1);
+	PIN_SetPinRoleForPinIndex(26, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(26, 2);
+	PIN_SetPinRoleForPinIndex(9, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(9, 3);
+
+	CMD_ExecuteCommand("led_enableAll 1", 0);
+	CMD_ExecuteCommand("led_dimmer 70", 0);
+	CMD_ExecuteCommand("led_basecolor_rgb FF8020", 0);
+	for (i = 0; i < 3; i++) {
+		direct[i] = CHANNEL_GetFloat(1 + i);
+	}
+	SELFTEST_ASSERT(direct[0] > 0);
+
+	CMD_ExecuteCommand("led_enableAll 0", 0);
+	CMD_ExecuteCommand("SetFlag 18 1", 0);
+	// run lerp down to 0
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	CMD_ExecuteCommand("led_enableAll 1", 0);
+	// 200 units per second, so not there yet
+	Sim_RunMiliseconds(100, false);
+	SELFTEST_ASSERT(CHANNEL_GetFloat(1) > 0);
+	SELFTEST_ASSERT(CHANNEL_GetFloat(1) < direct[0]);
+	Sim_RunSeconds(2, false);
+	for (i = 0; i < 3; i++) {
+		SELFTEST_ASSERT(Float_Equals(CHANNEL_GetFloat(1 + i), direct[i]));
+	}
+	// with smooth transitions, apply only sets the target,
+	// and led_finishFullLerp jumps straight there
+	CMD_ExecuteCommand("led_dimmer 20", 0);
+	SELFTEST_ASSERT(Float_Equals(CHANNEL_GetFloat(1), direct[0]));
+	CMD_ExecuteCommand("led_finishFullLerp", 0);
+	SELFTEST_ASSERT(CHANNEL_GetFloat(1) < direct[0]);
+	direct[0] = CHANNEL_GetFloat(1);
+	Sim_RunMiliseconds(100, false);
+	SELFTEST_ASSERT(Float_Equals(CHANNEL_GetFloat(1), direct[0]));
+	CMD_ExecuteCommand("SetFlag 18 0", 0);
+}
 void Test_LEDDriver() {
 
 	Test_LEDDriver_CW();
 	Test_LEDDriver_RGB();
 	Test_LEDDriver_RGBCW();
+	Test_LEDDriver_Gamma();
+	Test_LEDDriver_Lerp();
 }
 
 #endif
@@ -2,6 +2,44 @@
 
 #include "selftest_local.h".
 
+int SIM_HTTP_GetRecvCalls();
+
+// upload larger than one TCP segment and than the incoming buffer
+static void Test_LFS_Stream() {
+	static char script[64 * 1024 + 1];
+	const char *line = "addChannel 11 1\n";
+	char *read;
+	int i, len, bChunked;
+
+	len = strlen(line);
+	for (i = 0; i + len <= sizeof(script) - 1; i += len) {
+		memcpy(script + i, line, len);
+	}
+	script[i] = 0;
+	SELFTEST_ASSERT(strlen(script) == 64 * 1024);
+	// default size is too small for it
+	CMD_ExecuteCommand("lfs_format 0x40000", 0);
+
+	for (bChunked = 0; bChunked < 2; bChunked++) {
+		Test_FakeHTTPClientPacket_POST_Stream("api/lfs/big.txt", script, 300, 1460, bChunked);
+		SELFTEST_ASSERT(strstr(Test_GetLastHTMLReply(), "\"size\":65536") != 0);
+		printf("LFS streamed upload%s: 64 KB in %i recv calls\n",
+			bChunked ? " (chunked)" : "", SIM_HTTP_GetRecvCalls());
+		read = (char*)LFS_ReadFile("big.txt");
+		SELFTEST_ASSERT(read != 0);
+		SELFTEST_ASSERT(!strcmp(read, script));
+		free(read);
+	}
+	CMD_ExecuteCommand("exec big.txt", 0);
+	SELFTEST_ASSERT_CHANNEL(11, 4096);
+
+	// command body split between segments
+	Test_FakeHTTPClientPacket_POST_Stream("api/cmnd", "backlog setChannel 12 5; addChannel 12 7", 10, 4, false);
+	SELFTEST_ASSERT_CHANNEL(12, 12);
+	Test_FakeHTTPClientPacket_POST_Stream("api/cmnd", "addChannel 12 30", 3, 5, true);
+	SELFTEST_ASSERT_CHANNEL(12, 42);
+}
+
 void Test_LFS() {
 	char buffer[64];
 	
@@ -111,6 +149,8 @@ void Test_LFS() {
 	// get this file 
 	Test_FakeHTTPClientPacket_GET("api/lfs/command_file_2.txt");
 	SELFTEST_ASSERT_HTML_REPLY("this string has spaces really");
+
+	Test_LFS_Stream();
 }
 
 #endif
@@ -14,7 +14,7 @@ void SelfTest_Failed(const char *file, const char *function, int line, const cha
 	SelfTest_Failed(__FILE__, __FUNCTION__, __LINE__, #expr)
 
 #define SELFTEST_ASSERT_FLOATCOMPARE(exp, res) SELFTEST_ASSERT(Float_Equals(exp, res));
-#define SELFTEST_ASSERT_EXPRESSION(exp, res) SELFTEST_ASSERT(Float_Equals(CMD_EvaluateExpression(exp,0), res));
+#define SELFTEST_ASSERT_EXPRESSION(exp, res) SELFTEST_ASSERT(Float_Equals(CMD_EvaluateExpression(exp,0), res)); SELFTEST_ASSERT(Float_Equals(Test_EvaluateCompiledExpression(exp), res));
 #define SELFTEST_ASSERT_CHANNEL(channelIndex, res) SELFTEST_ASSERT(Float_Equals(CHANNEL_Get(channelIndex), res));
 #define SELFTEST_ASSERT_PIN_BOOLEAN(pinIndex, res) SELFTEST_ASSERT((SIM_GetSimulatedPinValue(pinIndex)== res));
 #define SELFTEST_ASSERT_ARGUMENT(argumentIndex, res) SELFTEST_ASSERT(!strcmp(Tokenizer_GetArg(argumentIndex), res));
@@ -22,7 +22,7 @@ void SelfTest_Failed(const char *file, const char *function, int line, const cha
 #define SELFTEST_ASSERT_ARGUMENTS_COUNT(wantedCount) SELFTEST_ASSERT((Tokenizer_GetArgsCount()==wantedCount));
 #define SELFTEST_ASSERT_JSON_VALUE_STRING(obj, varName, res) SELFTEST_ASSERT(!strcmp(Test_GetJSONValue_String(varName,obj), res));
 #define SELFTEST_ASSERT_JSON_VALUE_EXISTS(obj, varName) SELFTEST_ASSERT(Test_GetJSONValue_Generic(varName,obj));
-#define SELFTEST_ASSERT_JSON_VALUE_INTEGER(obj, varName, res) SELFTEST_ASSERT((Test_GetJSONValue_Integer(varName,obj) == res));
+#define SELFTEST_ASSERT_JSON_VALUE_INTEGER(obj, varName, res) SELFTEST_ASSERT((Test_GetJSONValue_Integer(varName,obj) == (res)));
 #define SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2(par1, par2, varName, res) SELFTEST_ASSERT((Test_GetJSONValue_Integer_Nested2(par1, par2,varName) == res));
 #define SELFTEST_ASSERT_JSON_VALUE_FLOAT_NESTED2(par1, par2, varName, res) SELFTEST_ASSERT((Float_Equals(Test_GetJSONValue_Float_Nested2(par1, par2,varName),res)));
 #define SELFTEST_ASSERT_JSON_VALUE_STRING_NESTED2(par1, par2, varName, res) SELFTEST_ASSERT((!strcmp(Test_GetJSONValue_String_Nested2(par1, par2,varName),res)));
@@ -67,6 +67,7 @@ void Test_Command_If_Else();
 void Test_LFS();
 void Test_Tokenizer();
 void Test_Commands_Alias();
+void Test_Commands_Lookup();
 void Test_ExpandConstant();
 void Test_Scripting();
 void Test_RepeatingEvents();
@@ -85,12 +86,30 @@ void Test_MapRanges();
 void Test_Demo_MapFanSpeedToRelays();
 void Test_Demo_FanCyclingRelays();
 void Test_Role_ToggleAll();
+void Test_FlashVars();
+void Test_UART();
+void Test_Drivers();
+
+// see Win_DoBenchmarks
+void Test_UART_Benchmark();
+void Test_Scripting_Benchmark();
+void Test_Scripting_Labels_Benchmark();
+void Test_Scripting_Scheduler_Benchmark();
+void Test_Commands_Lookup_Benchmark();
+void Test_ChangeHandlers_Benchmark();
+void Test_Expressions_Benchmark();
+void Test_Tasmota_Benchmark();
+void Test_Http_Routes_Benchmark();
+void Test_Http_KeepAlive_Benchmark();
+void Test_TuyaMCU_Benchmark();
 
 void Test_GetJSONValue_Setup(const char *text);
 void Test_FakeHTTPClientPacket_GET(const char *tg);
 void Test_FakeHTTPClientPacket_POST(const char *tg, const char *data);
+void Test_FakeHTTPClientPacket_POST_Stream(const char *tg, const char *data, int firstLen, int segmentSize, bool bChunked);
 void Test_FakeHTTPClientPacket_JSON(const char *tg);
 const char *Test_GetLastHTMLReply();
+float Test_EvaluateCompiledExpression(const char *s);
 
 // TODO: move elsewhere?
 void Sim_RunMiliseconds(int ms, bool bApplyRealtimeWait);
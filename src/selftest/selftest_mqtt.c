@@ -2,6 +2,7 @@
 
 #include "selftest_local.h"
 #include "../hal/hal_wifi.h"
+#include "../mqtt/new_mqtt.h"
 
 void SIM_ClearAndPrepareForMQTTTesting(const char *clientName) {
 	SIM_ClearOBK();
@@ -279,12 +280,143 @@ void Test_MQTT_Misc() {
 	//SELFTEST_ASSERT_HAD_MQTT_PUBLISH_FLOAT("miscDevice/thirdTest/get", (314*0.01f+100), false);
 	//SIM_ClearMQTTHistory();
 }
+static int g_countingCallbackHits;
+static int Test_MQTT_CountingCallback(obk_mqtt_request_t* request) {
+	g_countingCallbackHits++;
+	return 0;
+}
+void Test_MQTT_ReceiveBurst() {
+	char topic[64];
+	char args[64];
+	int i;
+
+	SIM_ClearOBK();
+	SIM_ClearAndPrepareForMQTTTesting("burstDevice");
+	CFG_SetMQTTGroupTopic("burstGroup");
+	MQTT_init();
+
+	// queue many messages before anything is processed,
+	// both device and group topic, and some nobody listens to
+	for (i = 0; i < 40; i++) {
+		sprintf(topic, "cmnd/%s/setChannel", (i % 2) ? "burstGroup" : "burstDevice");
+		sprintf(args, "%i %i", 10 + (i % 20), i);
+		MQTT_Post_Received_Str(topic, args);
+		MQTT_Post_Received_Str("cmnd/otherDevice/setChannel", "30 1");
+		MQTT_Post_Received_Str("burstDevice/31/set", "7");
+	}
+	Sim_RunFrames(1, false);
+	for (i = 0; i < 20; i++) {
+		SELFTEST_ASSERT_CHANNEL(10 + i, 20 + i);
+	}
+	SELFTEST_ASSERT_CHANNEL(30, 0);
+	SELFTEST_ASSERT_CHANNEL(31, 7);
+
+	// long payload is delivered whole, without a second copy
+	{
+		static char big[2000];
+		int at = 0;
+		at += sprintf(big + at, "setChannel 1 0");
+		for (i = 1; at < sizeof(big) - 64; i++) {
+			at += sprintf(big + at, "; addChannel 1 1");
+		}
+		MQTT_Post_Received_Str("cmnd/burstDevice/backlog", big);
+		Sim_RunFrames(1, false);
+		SELFTEST_ASSERT_CHANNEL(1, i - 1);
+	}
+
+	// callbacks with overlapping topics
+	MQTT_RegisterCallback("burstDev", "burstDev/#", 50, Test_MQTT_CountingCallback);
+	MQTT_RegisterCallback("burstDevX/3", "burstDevX/3/#", 51, Test_MQTT_CountingCallback);
+	g_countingCallbackHits = 0;
+	SIM_SendFakeMQTT("burstDevice/3/set", "55");
+	SELFTEST_ASSERT_CHANNEL(3, 55);
+	// channelSet has eaten it
+	SELFTEST_ASSERT(g_countingCallbackHits == 0);
+	SIM_SendFakeMQTT("burstDevX/3/other", "1");
+	SELFTEST_ASSERT(g_countingCallbackHits == 2);
+	SIM_SendFakeMQTT("burstDevX/4/other", "1");
+	SELFTEST_ASSERT(g_countingCallbackHits == 3);
+	SIM_SendFakeMQTT("burstDe", "1");
+	SELFTEST_ASSERT(g_countingCallbackHits == 3);
+	MQTT_RemoveCallback(50);
+	SIM_SendFakeMQTT("burstDevX/3/other", "1");
+	SELFTEST_ASSERT(g_countingCallbackHits == 4);
+	// same ID with a new topic, old topic string is freed
+	MQTT_RegisterCallback("burstDevY", "burstDevY/#", 51, Test_MQTT_CountingCallback);
+	SIM_SendFakeMQTT("burstDevX/3/other", "1");
+	SELFTEST_ASSERT(g_countingCallbackHits == 4);
+	SIM_SendFakeMQTT("burstDevY/1", "1");
+	SELFTEST_ASSERT(g_countingCallbackHits == 5);
+	MQTT_RemoveCallback(51);
+	SIM_SendFakeMQTT("burstDevY/1", "1");
+	SELFTEST_ASSERT(g_countingCallbackHits == 5);
+
+	CFG_SetMQTTGroupTopic("");
+}
+void Test_MQTT_PublishQueue() {
+	extern int g_MqttPublishItemsQueued;
+	char channel[32];
+	int i;
+
+	SIM_ClearOBK();
+	SIM_ClearAndPrepareForMQTTTesting("queueDevice");
+	SIM_ClearMQTTHistory();
+
+	// a few hundreds of short values fit into default queue
+	for (i = 0; i < 300; i++) {
+		sprintf(channel, "q%i", i);
+		MQTT_QueuePublish("queueDevice", channel, (i % 2) ? "1" : "0", 0);
+	}
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 300);
+	MQTT_InvokeCommandAtEnd(PublishChannels);
+
+	// then go out in order, a few per second
+	for (i = 0; i < 50; i++) {
+		MQTT_RunEverySecondUpdate();
+	}
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 150);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("queueDevice/q149", "1", false);
+	SIM_ClearMQTTHistory();
+	for (i = 0; i < 50; i++) {
+		MQTT_RunEverySecondUpdate();
+	}
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("queueDevice/q299", "1", false);
+
+	// large values, like HASS discovery, still work after the queue wrapped
+	for (i = 0; i < 12; i++) {
+		char value[600];
+		memset(value, 'a' + i, sizeof(value) - 1);
+		value[sizeof(value) - 1] = 0;
+		sprintf(channel, "big%i", i);
+		MQTT_QueuePublish("queueDevice", channel, value, OBK_PUBLISH_FLAG_RETAIN);
+	}
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 12);
+	SIM_ClearMQTTHistory();
+	for (i = 0; i < 10; i++) {
+		MQTT_RunEverySecondUpdate();
+	}
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+
+	// smaller limit, excess is rejected
+	CMD_ExecuteCommand("mqtt_publishQueue 2048", 0);
+	for (i = 0; i < 300; i++) {
+		sprintf(channel, "q%i", i);
+		MQTT_QueuePublish("queueDevice", channel, "1", 0);
+	}
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued < 300);
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued > 50);
+	CMD_ExecuteCommand("mqtt_publishQueue 8192", 0);
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+}
 void Test_MQTT(){
 	Test_MQTT_Get_And_Reply();
 	Test_MQTT_Misc();
 	Test_MQTT_Channels();
 	Test_MQTT_LED_CW();
 	Test_MQTT_LED_RGB();
+	Test_MQTT_ReceiveBurst();
+	Test_MQTT_PublishQueue();
 }
 
 #endif
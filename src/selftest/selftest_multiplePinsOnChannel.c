@@ -23,6 +23,37 @@ static void Test_MultiplePins_SimulateButtonClick() {
 	Sim_RunFrames(15, false);
 	Sim_RunFrames(100, false);
 }
+static void Test_MultiplePinsOnChannel_PWM() {
+	SIM_ClearOBK();
+
+	PIN_SetPinRoleForPinIndex(24, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(24, 2);
+	PIN_SetPinRoleForPinIndex(26, IOR_PWM_n);
+	PIN_SetPinChannelForPinIndex(26, 2);
+	PIN_SetPinRoleForPinIndex(6, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(6, 3);
+
+	CMD_ExecuteCommand("setChannel 2 30", 0);
+	CMD_ExecuteCommand("setChannel 3 70", 0);
+	// PWM pins are updated on next pin tick
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT(SIM_GetPWMValue(24) == 30);
+	SELFTEST_ASSERT(SIM_GetPWMValue(26) == 70);
+	SELFTEST_ASSERT(SIM_GetPWMValue(6) == 70);
+
+	// only channel 2 pins are touched
+	CMD_ExecuteCommand("setChannel 2 55", 0);
+	CMD_ExecuteCommand("setChannel 2 90", 0);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT(SIM_GetPWMValue(24) == 90);
+	SELFTEST_ASSERT(SIM_GetPWMValue(26) == 10);
+	SELFTEST_ASSERT(SIM_GetPWMValue(6) == 70);
+
+	// pin moved to other channel gets its value
+	PIN_SetPinChannelForPinIndex(6, 2);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT(SIM_GetPWMValue(6) == 90);
+}
 void Test_MultiplePinsOnChannel() {
 	// reset whole device
 	SIM_ClearOBK();
@@ -84,6 +115,8 @@ void Test_MultiplePinsOnChannel() {
 	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_LED_n, false);
 	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_RELAY, true);
 	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_RELAY_n, false);
+
+	Test_MultiplePinsOnChannel_PWM();
 }
 
 
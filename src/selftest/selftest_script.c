@@ -28,6 +28,41 @@ const char *demo_loop_3 =
 "    if $CH20>0 then goto again\r\n"
 "    setChannel 0 0\r\n";
 
+const char *demo_loop_4 =
+"// comments, blank lines and labels are stripped at load time\r\n"
+"\r\n"
+"\tsetChannel 10 0\r\n"
+"  // indented comment\r\n"
+"again:\r\n"
+"\taddChannel 10 1   \r\n"
+"\tif $CH10<5 then goto again\r\n"
+"\tgoto skip\r\n"
+"\tsetChannel 11 999\r\n"
+"skip:\r\n"
+"\tsetChannel 11 $CH10*2";
+
+const char *demo_bench =
+"bench:\r\n"
+"    setChannel 10 1\r\n"
+"    addChannel 10 1\r\n"
+"    setChannel 11 $CH10\r\n"
+"    addChannel 11 -1\r\n"
+"    setChannel 12 2\r\n"
+"    addChannel 12 3\r\n"
+"    setChannel 13 $CH12\r\n"
+"    addChannel 13 -5\r\n"
+"    setChannel 14 0\r\n"
+"    goto bench\r\n";
+
+const char *demo_sleepers =
+"short:\r\n"
+"\tdelay_ms 500\r\n"
+"\taddChannel 12 1\r\n"
+"\treturn\r\n"
+"long:\r\n"
+"\tdelay_s 2\r\n"
+"\taddChannel 13 1\r\n";
+
 void Test_Scripting_Loop1() {
 	char buffer[64];
 
@@ -108,10 +143,225 @@ void Test_Scripting_Loop3() {
 	SELFTEST_ASSERT_CHANNEL(20, 0);
 	//system("pause");
 }
+void Test_Scripting_Loop4() {
+	// reset whole device
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/demo_loop_4.txt", demo_loop_4);
+
+	CMD_ExecuteCommand("startScript demo_loop_4.txt", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 1);
+	Sim_RunFrames(15, false);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_CHANNEL(10, 5);
+	SELFTEST_ASSERT_CHANNEL(11, 10);
+}
+// Compares the old way of running script lines (copy line, then parse it
+// with CMD_ExecuteCommand) against the lines precompiled by SVM_RegisterFile.
+void Test_Scripting_Benchmark() {
+	const char *lines[] = {
+		"setChannel 10 1",
+		"addChannel 10 1",
+		"setChannel 11 $CH10",
+		"addChannel 11 -1",
+		"setChannel 12 2",
+		"addChannel 12 3",
+		"setChannel 13 $CH12",
+		"addChannel 13 -5",
+		"setChannel 14 0",
+	};
+	char buffer[128];
+	int i, runs, numLines;
+	clock_t t;
+	double interpreted, compiled;
+
+	// reset whole device
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	// don't measure console output
+	CMD_ExecuteCommand("loglevel 1", 0);
+
+	runs = 20000;
+	numLines = sizeof(lines) / sizeof(lines[0]);
+	t = clock();
+	for (i = 0; i < runs; i++) {
+		const char *l = lines[i % numLines];
+		strcpy(buffer, l);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	interpreted = (double)(clock() - t) / CLOCKS_PER_SEC;
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/demo_bench.txt", demo_bench);
+	CMD_ExecuteCommand("startScript demo_bench.txt", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 1);
+	t = clock();
+	// every call runs up to 10 lines
+	for (i = 0; i < runs / 10; i++) {
+		SVM_RunThreads(0);
+	}
+	compiled = (double)(clock() - t) / CLOCKS_PER_SEC;
+	CMD_ExecuteCommand("stopAllScripts", 0);
+	CMD_ExecuteCommand("loglevel 3", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_CHANNEL(13, 0);
+
+	printf("Script benchmark: interpreted %.1f ns/line, compiled %.1f ns/line\n",
+		interpreted * 1e9 / runs, compiled * 1e9 / runs);
+}
+// 1000 labels and a loop at the very bottom, which is the worst case
+// for a label search that scans the file from the top
+static void Test_Scripting_StartManyLabels() {
+	char *script, *p;
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	script = malloc(16 * 1024);
+	p = script;
+	for (i = 0; i < 999; i++) {
+		p += sprintf(p, "l%i:\r\n", i);
+	}
+	p += sprintf(p, "l999:\r\n");
+	p += sprintf(p, "\taddChannel 10 1\r\n");
+	p += sprintf(p, "\tif $CH10<2000 then goto l999\r\n");
+	p += sprintf(p, "\tsetChannel 11 $CH10\r\n");
+	Test_FakeHTTPClientPacket_POST("api/lfs/labels.txt", script);
+	free(script);
+
+	// start in the middle and fall through to the loop
+	CMD_ExecuteCommand("startScript labels.txt l500", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 1);
+}
+static void Test_Scripting_RunManyLabels() {
+	int loops;
+
+	CMD_ExecuteCommand("loglevel 1", 0);
+	loops = 0;
+	while (CMD_GetCountActiveScriptThreads() && loops < 100000) {
+		SVM_RunThreads(0);
+		loops++;
+	}
+	CMD_ExecuteCommand("loglevel 3", 0);
+
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_CHANNEL(10, 2000);
+	SELFTEST_ASSERT_CHANNEL(11, 2000);
+}
+void Test_Scripting_ManyLabels() {
+	Test_Scripting_StartManyLabels();
+	Test_Scripting_RunManyLabels();
+}
+// cost of goto with a label at the end of a long file
+void Test_Scripting_Labels_Benchmark() {
+	clock_t t;
+	double elapsed;
+
+	Test_Scripting_StartManyLabels();
+	t = clock();
+	Test_Scripting_RunManyLabels();
+	elapsed = (double)(clock() - t) / CLOCKS_PER_SEC;
+
+	printf("Script labels benchmark: 2000 iterations with goto over 1000 labels took %.2f ms\n",
+		elapsed * 1000.0);
+}
+// Many threads sleeping at once; they should wake up exactly when due
+// and not cost anything per tick until then.
+void Test_Scripting_ManyThreads() {
+	char buffer[64];
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/sleepers.txt", demo_sleepers);
+
+	SELFTEST_ASSERT_INTEGER(SVM_GetNextWakeUpMS(), -1);
+	CMD_ExecuteCommand("loglevel 1", 0);
+	for (i = 0; i < 100; i++) {
+		CMD_ExecuteCommand("startScript sleepers.txt short 1", 0);
+		sprintf(buffer, "startScript sleepers.txt long %i", 2 + (i % 2));
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	CMD_ExecuteCommand("loglevel 3", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 200);
+	// fresh threads want to run right away
+	SELFTEST_ASSERT_INTEGER(SVM_GetNextWakeUpMS(), 0);
+	SVM_RunThreads(0);
+	SELFTEST_ASSERT_INTEGER(SVM_GetNextWakeUpMS(), 500);
+	SVM_RunThreads(499);
+	SELFTEST_ASSERT_CHANNEL(12, 0);
+	SELFTEST_ASSERT_INTEGER(SVM_GetNextWakeUpMS(), 1);
+	SVM_RunThreads(1);
+	SELFTEST_ASSERT_CHANNEL(12, 100);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 100);
+	SELFTEST_ASSERT_INTEGER(SVM_GetNextWakeUpMS(), 1500);
+	// stopping sleeping threads must take them out of the schedule
+	CMD_ExecuteCommand("stopScript 3", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 50);
+	SVM_RunThreads(1499);
+	SELFTEST_ASSERT_CHANNEL(13, 0);
+	SVM_RunThreads(1);
+	SELFTEST_ASSERT_CHANNEL(13, 50);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_INTEGER(SVM_GetNextWakeUpMS(), -1);
+
+	// ticks with 1000 sleeping threads
+	CMD_ExecuteCommand("loglevel 1", 0);
+	for (i = 0; i < 1000; i++) {
+		CMD_ExecuteCommand("startScript sleepers.txt long 4", 0);
+	}
+	SVM_RunThreads(0);
+	for (i = 0; i < 1000; i++) {
+		SVM_RunThreads(1);
+	}
+	CMD_ExecuteCommand("loglevel 3", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 1000);
+	SELFTEST_ASSERT_INTEGER(SVM_GetNextWakeUpMS(), 1000);
+	CMD_ExecuteCommand("stopAllScripts", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_INTEGER(SVM_GetNextWakeUpMS(), -1);
+}
+// per-tick cost with 1000 sleeping threads
+void Test_Scripting_Scheduler_Benchmark() {
+	int i;
+	clock_t t;
+	double elapsed;
+
+	// reset whole device
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/sleepers.txt", demo_sleepers);
+
+	CMD_ExecuteCommand("loglevel 1", 0);
+	for (i = 0; i < 1000; i++) {
+		CMD_ExecuteCommand("startScript sleepers.txt long 4", 0);
+	}
+	SVM_RunThreads(0);
+	t = clock();
+	for (i = 0; i < 1000; i++) {
+		SVM_RunThreads(1);
+	}
+	elapsed = (double)(clock() - t) / CLOCKS_PER_SEC;
+	CMD_ExecuteCommand("loglevel 3", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 1000);
+	CMD_ExecuteCommand("stopAllScripts", 0);
+
+	printf("Script scheduler benchmark: %.1f ns per tick with 1000 sleeping threads\n",
+		elapsed * 1e9 / 1000);
+}
 void Test_Scripting() {
 	Test_Scripting_Loop1();
 	Test_Scripting_Loop2();
 	Test_Scripting_Loop3();
+	Test_Scripting_Loop4();
+	Test_Scripting_ManyLabels();
+	Test_Scripting_ManyThreads();
 }
 
 #endif
@@ -615,9 +615,128 @@ void Test_Tasmota_MQTT_RGBCW() {
 	SELFTEST_ASSERT_JSON_VALUE_STRING(0, "POWER", "ON");
 	SIM_ClearMQTTHistory();
 }
+// the way channel roles were checked before the per-channel pin index, kept for comparison
+static int Test_Tasmota_ScanChannelPinWithRoleOrRole(int ch, int role, int role2) {
+	int i;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (PIN_GetPinChannelForPinIndex(i) == ch) {
+			if (PIN_GetPinRoleForPinIndex(i) == role || PIN_GetPinRoleForPinIndex(i) == role2)
+				return 1;
+		}
+	}
+	return 0;
+}
+void Test_Tasmota_PowerStatus_64Channels() {
+	int i, ch;
+	int found;
+
+	SIM_ClearOBK();
+	SIM_ClearAndPrepareForMQTTTesting("powerDevice");
+
+	for (i = 0; i < 8; i++) {
+		PIN_SetPinRoleForPinIndex(6 + i, IOR_Relay);
+		PIN_SetPinChannelForPinIndex(6 + i, 1 + i);
+	}
+	PIN_SetPinRoleForPinIndex(20, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(20, 20);
+	PIN_SetPinRoleForPinIndex(21, IOR_DHT11);
+	PIN_SetPinChannelForPinIndex(21, 30);
+	PIN_SetPinChannel2ForPinIndex(21, 31);
+
+	// moving a pin must move its role to the new channel
+	PIN_SetPinChannelForPinIndex(13, 12);
+	SELFTEST_ASSERT(CHANNEL_HasChannelPinWithRole(8, IOR_Relay) == 0);
+	SELFTEST_ASSERT(CHANNEL_HasChannelPinWithRole(12, IOR_Relay));
+	SELFTEST_ASSERT(h_isChannelRelay(12));
+	SELFTEST_ASSERT(h_isChannelPWM(20));
+	SELFTEST_ASSERT(h_isChannelRelay(20) == 0);
+	SELFTEST_ASSERT(CHANNEL_IsInUse(31));
+	SELFTEST_ASSERT(CHANNEL_HasRoleThatShouldBePublished(31));
+	SELFTEST_ASSERT(CHANNEL_FindMaxValueForChannel(20) == 100);
+	// and changing role must drop it
+	PIN_SetPinRoleForPinIndex(11, IOR_None);
+	SELFTEST_ASSERT(CHANNEL_IsInUse(6) == 0);
+	PIN_SetPinRoleForPinIndex(11, IOR_Relay_n);
+	SELFTEST_ASSERT(CHANNEL_IsPowerRelayChannel(6));
+
+	for (ch = 0; ch < CHANNEL_MAX; ch++) {
+		SELFTEST_ASSERT(CHANNEL_HasChannelPinWithRoleOrRole(ch, IOR_Relay, IOR_Relay_n)
+			== Test_Tasmota_ScanChannelPinWithRoleOrRole(ch, IOR_Relay, IOR_Relay_n));
+		SELFTEST_ASSERT(CHANNEL_HasChannelPinWithRoleOrRole(ch, IOR_PWM, IOR_PWM_n)
+			== Test_Tasmota_ScanChannelPinWithRoleOrRole(ch, IOR_PWM, IOR_PWM_n));
+		SELFTEST_ASSERT(CHANNEL_HasChannelPinWithRole(ch, IOR_DHT11)
+			== Test_Tasmota_ScanChannelPinWithRoleOrRole(ch, IOR_DHT11, IOR_DHT11));
+	}
+
+	// with a PWM pin STATUS reports the LED state, not the relays
+	PIN_SetPinRoleForPinIndex(20, IOR_None);
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+	CMD_ExecuteCommand("setChannel 3 1", 0);
+	CMD_ExecuteCommand("setChannel 12 1", 0);
+	Test_FakeHTTPClientPacket_JSON("cm?cmnd=STATUS");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("Status", "Power", ((1 << 0) | (1 << 2) | (1 << 11)));
+
+	// what POWER/STATUS does for every channel
+	found = 0;
+	for (ch = 0; ch < CHANNEL_MAX; ch++) {
+		found += CHANNEL_HasChannelPinWithRoleOrRole(ch, IOR_Relay, IOR_Relay_n);
+	}
+	SELFTEST_ASSERT(found == 8);
+}
+// relay query for every channel, with the pin index and with a scan of all pins
+void Test_Tasmota_Benchmark() {
+	int i, j, ch;
+	int rounds;
+	int found, foundScan;
+	clock_t t;
+	double indexed, scanned, status;
+
+	SIM_ClearOBK();
+	SIM_ClearAndPrepareForMQTTTesting("powerDevice");
+
+	for (i = 0; i < 8; i++) {
+		PIN_SetPinRoleForPinIndex(6 + i, IOR_Relay);
+		PIN_SetPinChannelForPinIndex(6 + i, 1 + i);
+	}
+	PIN_SetPinRoleForPinIndex(20, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(20, 20);
+
+	rounds = 2000;
+	t = clock();
+	for (j = 0; j < rounds; j++) {
+		found = 0;
+		for (ch = 0; ch < CHANNEL_MAX; ch++) {
+			found += CHANNEL_HasChannelPinWithRoleOrRole(ch, IOR_Relay, IOR_Relay_n);
+		}
+	}
+	indexed = (double)(clock() - t) / CLOCKS_PER_SEC;
+	t = clock();
+	for (j = 0; j < rounds; j++) {
+		foundScan = 0;
+		for (ch = 0; ch < CHANNEL_MAX; ch++) {
+			foundScan += Test_Tasmota_ScanChannelPinWithRoleOrRole(ch, IOR_Relay, IOR_Relay_n);
+		}
+	}
+	scanned = (double)(clock() - t) / CLOCKS_PER_SEC;
+	SELFTEST_ASSERT(found == 8);
+	SELFTEST_ASSERT(found == foundScan);
+
+	rounds = 100;
+	t = clock();
+	for (j = 0; j < rounds; j++) {
+		Test_FakeHTTPClientPacket_GET("cm?cmnd=POWER");
+	}
+	status = (double)(clock() - t) / CLOCKS_PER_SEC;
+
+	printf("64-channel relay query: %.1f ns with pin index, %.1f ns with pin scan, POWER status %.1f us\n",
+		indexed * 1e9 / 2000, scanned * 1e9 / 2000, status * 1e6 / rounds);
+}
+
 void Test_Tasmota() {
 	Test_Tasmota_MQTT_Switch();
 	Test_Tasmota_MQTT_Switch_Double();
 	Test_Tasmota_MQTT_RGBCW();
+	Test_Tasmota_PowerStatus_64Channels();
 }
 #endif
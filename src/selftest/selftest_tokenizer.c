@@ -2,6 +2,44 @@
 
 #include "selftest_local.h".
 
+// caller-owned tokenizers must not disturb each other or the global one
+void Test_Tokenizer_Context() {
+	tokenizer_t a, b;
+
+	// reset whole device
+	SIM_ClearOBK();
+
+	TokenizerCtx_TokenizeString(&a, "first 1 2", 0);
+	Tokenizer_TokenizeString("global 5", 0);
+	TokenizerCtx_TokenizeString(&b, "second \"x y\" 0x10 3*4", TOKENIZER_ALLOW_QUOTES);
+
+	SELFTEST_ASSERT_INTEGER(TokenizerCtx_GetArgsCount(&a), 3);
+	SELFTEST_ASSERT_STRING(TokenizerCtx_GetArg(&a, 0), "first");
+	SELFTEST_ASSERT_INTEGER(TokenizerCtx_GetArgInteger(&a, 2), 2);
+	SELFTEST_ASSERT_STRING(TokenizerCtx_GetArgFrom(&a, 1), "1 2");
+	SELFTEST_ASSERT(TokenizerCtx_GetArg(&a, 3) == 0);
+	SELFTEST_ASSERT(TokenizerCtx_GetArgFrom(&a, 3) == 0);
+	SELFTEST_ASSERT_INTEGER(TokenizerCtx_GetArgInteger(&a, 3), 0);
+
+	SELFTEST_ASSERT_INTEGER(TokenizerCtx_GetArgsCount(&b), 4);
+	SELFTEST_ASSERT_STRING(TokenizerCtx_GetArg(&b, 1), "x y");
+	SELFTEST_ASSERT_INTEGER(TokenizerCtx_GetArgInteger(&b, 2), 16);
+	SELFTEST_ASSERT_INTEGER(TokenizerCtx_GetArgInteger(&b, 3), 12);
+
+	SELFTEST_ASSERT_ARGUMENTS_COUNT(2);
+	SELFTEST_ASSERT_ARGUMENT(0, "global");
+	SELFTEST_ASSERT_ARGUMENT_INTEGER(1, 5);
+
+	// if keeps its own arguments while the chosen command tokenizes again
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+	CMD_ExecuteCommand("if $CH1 then \"setChannel 2 20\" else \"setChannel 2 30\"", 0);
+	SELFTEST_ASSERT_CHANNEL(2, 20);
+	CMD_ExecuteCommand("if !$CH1 then \"setChannel 2 20\" else \"setChannel 2 30\"", 0);
+	SELFTEST_ASSERT_CHANNEL(2, 30);
+	CMD_ExecuteCommand("if $CH1 then \"backlog setChannel 3 7; addChannel 3 1\"", 0);
+	SELFTEST_ASSERT_CHANNEL(3, 8);
+}
+
 void Test_Tokenizer() {
 	// reset whole device
 	SIM_ClearOBK();
@@ -109,6 +147,8 @@ void Test_Tokenizer() {
 
 
 	//system("pause");
+
+	Test_Tokenizer_Context();
 }
 
 
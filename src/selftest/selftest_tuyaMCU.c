@@ -1,6 +1,204 @@
 #ifdef WINDOWS
 
-#include "selftest_local.h".
+#include "selftest_local.h"
+#include "../logging/logging.h"
+
+// frames (5 ms each) until channel has given value, -1 if never
+static int Test_TuyaMCU_FramesUntilChannel(int ch, int value, int maxFrames) {
+	int frames;
+
+	for (frames = 0; frames < maxFrames; frames++) {
+		if (CHANNEL_Get(ch) == value)
+			return frames;
+		Sim_RunFrames(1, false);
+	}
+	return -1;
+}
+
+// time from bytes arriving in UART ring to channel update
+static void Test_TuyaMCU_Latency() {
+	int frames;
+
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 2 val 15", 0);
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 3 val 16", 0);
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 101 bool 17", 0);
+
+	// fnID 2 set to 100 - applied on next quick tick, not next second
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 55AA0307000802020004000000647D", 0);
+	frames = Test_TuyaMCU_FramesUntilChannel(15, 100, 400);
+	printf("TuyaMCU latency: %i ms from bytes to channel\n", frames * 5);
+	SELFTEST_ASSERT(frames == 1);
+
+	// packet split between two UART reads is framed once it's complete
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 55AA03070008020200", 0);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_CHANNEL(15, 100);
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 040000005A73", 0);
+	SELFTEST_ASSERT(Test_TuyaMCU_FramesUntilChannel(15, 90, 400) == 1);
+
+	// burst of packets, all applied in the same tick
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 55AA03070008020200040000006E87"
+		"55AA0307000803020004000000324C"
+		"55AA03070005650100010176", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(15, 110);
+	SELFTEST_ASSERT_CHANNEL(16, 50);
+	SELFTEST_ASSERT_CHANNEL(17, 1);
+
+	// unmapped dpId is ignored, mapped ones still work
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 55AA0307000804020004000000324D", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(16, 50);
+}
+
+// header with a corrupted length must not stall the receiver
+static void Test_TuyaMCU_BogusLength() {
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 2 val 15", 0);
+
+	// length 0xFFFF can never fit in the ring, valid packet follows
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 55AA0307FFFF"
+		"55AA0307000802020004000000647D", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(15, 100);
+
+	// length fits in the ring, but not in the packet buffer
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 55AA030700C8", 0);
+	Sim_RunFrames(10, false);
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 55AA03070008020200040000005A73", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(15, 90);
+
+	// and receiver keeps working after that
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 55AA03070008020200040000006E87", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(15, 110);
+}
+
+// hex dump as drivers did it before packet traces: "%02X " per byte
+static void Test_TuyaMCU_OldHex(char *out, int outSize, const byte *data, int len) {
+	char buffer2[4];
+	int i;
+
+	out[0] = 0;
+	for (i = 0; i < len; i++) {
+		snprintf(buffer2, sizeof(buffer2), "%02X ", data[i]);
+		strcat_safe(out, buffer2, outSize);
+	}
+}
+
+// received packets are logged as raw bytes and printed as hex by log readers
+static void Test_TuyaMCU_PacketTrace() {
+	byte packet[256];
+	char hex[1024];
+	char expected[1100];
+	const char *reply;
+	int i;
+
+	for (i = 0; i < sizeof(packet); i++) {
+		packet[i] = i;
+	}
+	// same text as snprintf, with and without spaces, also when cut
+	LOG_FormatHex(hex, sizeof(hex), packet, 256, 1);
+	Test_TuyaMCU_OldHex(expected, sizeof(expected), packet, 256);
+	SELFTEST_ASSERT_STRING(hex, expected);
+	LOG_FormatHex(hex, 11, packet + 250, 6, 1);
+	SELFTEST_ASSERT_STRING(hex, "FA FB FC F");
+	LOG_FormatHex(hex, 6, packet + 0xA0, 3, 0);
+	SELFTEST_ASSERT_STRING(hex, "A0A1A");
+
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 2 val 15", 0);
+	CMD_ExecuteCommand("addEventHandler OnUART 55AA0307000802020004000000647D setChannel 5 1", 0);
+	// drain the HTTP log reader
+	Test_FakeHTTPClientPacket_GET("lograw");
+
+	CMD_ExecuteCommand("tuyaMcu_fakeHex 55AA0307000802020004000000647D", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(15, 100);
+	// OnUART still gets hex without spaces
+	SELFTEST_ASSERT_CHANNEL(5, 1);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, "Info:TuyaMCU:TUYAMCU received: 55 AA 03 07 00 08 02 02 00 04 00 00 00 64 7D \r\n") != 0);
+
+	// longer packet, byte for byte the same as the old format
+	memcpy(packet, "\x55\xAA\x03\x07\x00\x3A", 6);
+	for (i = 6; i < 64; i++) {
+		packet[i] = i * 7;
+	}
+	strcpy(expected, "Info:TuyaMCU:TUYAMCU received: ");
+	Test_TuyaMCU_OldHex(hex, sizeof(hex), packet, 64);
+	strcat(expected, hex);
+	strcat(expected, "\r\n");
+	addLogPacketAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TUYAMCU received: ", packet, 64);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, expected) != 0);
+	// nothing stored when level filters it out
+	CMD_ExecuteCommand("loglevel 2", 0);
+	addLogPacketAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TUYAMCU received: ", packet, 64);
+	CMD_ExecuteCommand("loglevel 3", 0);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, "TUYAMCU received") == 0);
+
+	// full 256 byte packet, read back over HTTP
+	for (i = 0; i < sizeof(packet); i++) {
+		packet[i] = i;
+	}
+	addLogPacketAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TUYAMCU received: ", packet, sizeof(packet));
+	Test_FakeHTTPClientPacket_GET("lograw");
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, "received: 00 01 02 03") != 0);
+	SELFTEST_ASSERT(strstr(reply, "FD FE FF \r\n") != 0);
+}
+// 256 byte packets: old way formats at log time, new one only stores bytes
+void Test_TuyaMCU_Benchmark() {
+	byte packet[256];
+	char hex[1024];
+	const char *reply;
+	int i, runs;
+	clock_t t;
+	double oldTime, newTime, readTime;
+
+	SIM_ClearOBK();
+	// drain the HTTP log reader
+	Test_FakeHTTPClientPacket_GET("lograw");
+
+	for (i = 0; i < sizeof(packet); i++) {
+		packet[i] = i;
+	}
+	runs = 2000;
+	t = clock();
+	for (i = 0; i < runs; i++) {
+		Test_TuyaMCU_OldHex(hex, sizeof(hex), packet, sizeof(packet));
+	}
+	oldTime = (double)(clock() - t) / CLOCKS_PER_SEC;
+	t = clock();
+	for (i = 0; i < runs; i++) {
+		addLogPacketAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TUYAMCU received: ", packet, sizeof(packet));
+	}
+	newTime = (double)(clock() - t) / CLOCKS_PER_SEC;
+	// and the cost moved to the reader
+	t = clock();
+	for (i = 0; i < runs / 10; i++) {
+		int j;
+		for (j = 0; j < 10; j++) {
+			addLogPacketAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TUYAMCU received: ", packet, sizeof(packet));
+		}
+		Test_FakeHTTPClientPacket_GET("lograw");
+	}
+	readTime = (double)(clock() - t) / CLOCKS_PER_SEC;
+	reply = Test_GetLastHTMLReply();
+	SELFTEST_ASSERT(strstr(reply, "FD FE FF \r\n") != 0);
+	printf("Packet trace, 256 byte packet: old hex at log time %.2f us, now %.2f us at log time, %.2f us stored and read over HTTP\n",
+		oldTime * 1000000 / runs, newTime * 1000000 / runs, readTime * 1000000 / runs);
+}
 
 void Test_TuyaMCU_Basic() {
 	// reset whole device
@@ -41,6 +239,10 @@ void Test_TuyaMCU_Basic() {
 
 	// cause error
 	//SELFTEST_ASSERT_CHANNEL(15, 666);
+
+	Test_TuyaMCU_Latency();
+	Test_TuyaMCU_BogusLength();
+	Test_TuyaMCU_PacketTrace();
 }
 
 #endif
@@ -0,0 +1,227 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../logging/logging.h"
+#include "../driver/drv_public.h"
+#include "../driver/drv_uart.h"
+
+int UART_TryToGetNextTuyaPacket(byte *out, int maxSize);
+int BL0942_TryToGetNextBL0942Packet();
+int CSE7766_TryToGetNextCSE7766Packet();
+
+#define UART_TEST_BL0942_LEN 23
+#define UART_TEST_CSE7766_LEN 24
+
+static void Test_UART_MakeBL0942Packet(byte *p, int rawVoltage) {
+	byte checksum;
+	int i;
+
+	memset(p, 0, UART_TEST_BL0942_LEN);
+	p[0] = 0x55;
+	p[4] = rawVoltage;
+	p[5] = rawVoltage >> 8;
+	p[6] = rawVoltage >> 16;
+	// read command is part of checksum
+	checksum = 0x58;
+	for (i = 0; i < UART_TEST_BL0942_LEN - 1; i++) {
+		checksum += p[i];
+	}
+	p[UART_TEST_BL0942_LEN - 1] = checksum ^ 0xFF;
+}
+static void Test_UART_MakeCSE7766Packet(byte *p, int rawVoltage) {
+	byte checksum;
+	int i;
+
+	memset(p, 0, UART_TEST_CSE7766_LEN);
+	p[0] = 0x55;
+	p[1] = 0x5A;
+	p[5] = rawVoltage >> 16;
+	p[6] = rawVoltage >> 8;
+	p[7] = rawVoltage;
+	// voltage valid
+	p[20] = 0x40;
+	checksum = 0;
+	for (i = 2; i < UART_TEST_CSE7766_LEN - 1; i++) {
+		checksum += p[i];
+	}
+	p[UART_TEST_CSE7766_LEN - 1] = checksum;
+}
+static int Test_UART_FromHex(const char *hex, byte *out) {
+	int n = 0;
+
+	while (*hex) {
+		out[n++] = hexbyte(hex);
+		hex += 2;
+	}
+	return n;
+}
+static int Test_UART_ParseTuya() {
+	byte out[64];
+
+	return UART_TryToGetNextTuyaPacket(out, sizeof(out));
+}
+// Pushes totalBytes of repeated stream through the ring in odd sized pieces
+// and runs parser on it, returns number of packets parsed
+static int Test_UART_Pump(const char *name, const byte *stream, int streamLen, int packetLen, int totalBytes, int(*parse)()) {
+	int done, pos, n, packets, prevLogLevel;
+	clock_t t;
+	double secs;
+
+	// packets are logged at info level, keep that out of the numbers
+	prevLogLevel = loglevel;
+	loglevel = LOG_NONE;
+	packets = 0;
+	pos = 0;
+	t = clock();
+	for (done = 0; done < totalBytes; done += n) {
+		// like a HAL callback with a few bytes from the FIFO
+		n = 37;
+		if (n > streamLen - pos)
+			n = streamLen - pos;
+		n = UART_AppendBytesToCircularBuffer(stream + pos, n);
+		pos += n;
+		if (pos == streamLen)
+			pos = 0;
+		while (parse() == packetLen) {
+			packets++;
+		}
+	}
+	secs = (double)(clock() - t) / CLOCKS_PER_SEC;
+	loglevel = prevLogLevel;
+	if (secs <= 0)
+		secs = 0.001;
+	printf("UART %s: %i bytes, %i packets, %.1f MB/s\n", name, totalBytes, packets, totalBytes / secs / (1024 * 1024));
+	return packets;
+}
+
+// span API on a small ring, including data wrapping around the end
+static void Test_UART_Spans() {
+	uartSpans_t s;
+	byte data[32];
+	byte tmp[32];
+	const byte *p;
+	int i;
+
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = i + 1;
+	}
+	UART_InitReceiveRingBuffer(16);
+	SELFTEST_ASSERT(UART_GetSpans(&s) == 0);
+	SELFTEST_ASSERT(UART_FindByte(1, 0) == -1);
+
+	// one slot is kept free
+	SELFTEST_ASSERT(UART_AppendBytesToCircularBuffer(data, 32) == 15);
+	SELFTEST_ASSERT(UART_GetDataSize() == 15);
+	SELFTEST_ASSERT(UART_AppendBytesToCircularBuffer(data, 1) == 0);
+	UART_ConsumeBytes(12);
+	SELFTEST_ASSERT(UART_GetNextByte(0) == 13);
+
+	// 13 14 15 1 | 2 3 4 5 6
+	SELFTEST_ASSERT(UART_AppendBytesToCircularBuffer(data, 6) == 6);
+	SELFTEST_ASSERT(UART_GetSpans(&s) == 9);
+	SELFTEST_ASSERT(s.firstLen == 4);
+	SELFTEST_ASSERT(s.secondLen == 5);
+	SELFTEST_ASSERT(s.first[0] == 13);
+	SELFTEST_ASSERT(s.second[0] == 2);
+	SELFTEST_ASSERT(UART_GetNextByte(3) == 1);
+	SELFTEST_ASSERT(UART_GetNextByte(4) == 2);
+	SELFTEST_ASSERT(UART_FindByte(14, 0) == 1);
+	SELFTEST_ASSERT(UART_FindByte(1, 0) == 3);
+	SELFTEST_ASSERT(UART_FindByte(5, 0) == 7);
+	SELFTEST_ASSERT(UART_FindByte(5, 7) == 7);
+	SELFTEST_ASSERT(UART_FindByte(5, 8) == -1);
+	SELFTEST_ASSERT(UART_FindByte(13, 1) == -1);
+
+	SELFTEST_ASSERT(UART_CopyBytes(tmp, 2, 100) == 7);
+	SELFTEST_ASSERT(tmp[0] == 15);
+	SELFTEST_ASSERT(tmp[1] == 1);
+	SELFTEST_ASSERT(tmp[2] == 2);
+	SELFTEST_ASSERT(tmp[6] == 6);
+	SELFTEST_ASSERT(UART_CopyBytes(tmp, 9, 1) == 0);
+
+	// no copy while it fits, scratch when it wraps
+	p = UART_GetContiguousBytes(tmp, 4);
+	SELFTEST_ASSERT(p == s.first);
+	p = UART_GetContiguousBytes(tmp, 6);
+	SELFTEST_ASSERT(p == tmp);
+	SELFTEST_ASSERT(p[2] == 15);
+	SELFTEST_ASSERT(p[3] == 1);
+	SELFTEST_ASSERT(p[5] == 3);
+
+	UART_ConsumeBytes(9);
+	SELFTEST_ASSERT(UART_GetDataSize() == 0);
+	SELFTEST_ASSERT(UART_GetSpans(&s) == 0);
+}
+
+void Test_UART() {
+	byte stream[UART_TEST_CSE7766_LEN * 2 + 3];
+
+	Test_UART_Spans();
+
+	// BL0942 packet after garbage, split across end of ring
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("startDriver BL0942", 0);
+	memset(stream, 0, sizeof(stream));
+	Test_UART_MakeBL0942Packet(stream, 3493240);
+	// 230V with default reference
+	UART_AppendBytesToCircularBuffer((const byte*)"\x11\x22", 2);
+	UART_AppendBytesToCircularBuffer(stream, UART_TEST_BL0942_LEN - 5);
+	SELFTEST_ASSERT(BL0942_TryToGetNextBL0942Packet() == 0);
+	UART_AppendBytesToCircularBuffer(stream + UART_TEST_BL0942_LEN - 5, 5);
+	SELFTEST_ASSERT(BL0942_TryToGetNextBL0942Packet() == UART_TEST_BL0942_LEN);
+	SELFTEST_ASSERT(UART_GetDataSize() == 0);
+	SELFTEST_ASSERT(Float_Equals(DRV_GetReading(OBK_VOLTAGE), 230.0f));
+	// bad checksum is skipped
+	stream[5]++;
+	UART_AppendBytesToCircularBuffer(stream, UART_TEST_BL0942_LEN);
+	SELFTEST_ASSERT(BL0942_TryToGetNextBL0942Packet() == 1);
+	SELFTEST_ASSERT(UART_GetDataSize() == 0);
+	SELFTEST_ASSERT(Float_Equals(DRV_GetReading(OBK_VOLTAGE), 230.0f));
+
+	// CSE7766, garbage with a stray 0x5A before it
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("startDriver CSE7766", 0);
+	CMD_ExecuteCommand("VREF 1449000", 0);
+	stream[0] = 0x5A;
+	stream[1] = 0x01;
+	stream[2] = 0x02;
+	Test_UART_MakeCSE7766Packet(stream + 3, 1449);
+	UART_AppendBytesToCircularBuffer(stream, 3 + UART_TEST_CSE7766_LEN);
+	SELFTEST_ASSERT(CSE7766_TryToGetNextCSE7766Packet() == UART_TEST_CSE7766_LEN);
+	SELFTEST_ASSERT(UART_GetDataSize() == 0);
+	SELFTEST_ASSERT(Float_Equals(DRV_GetReading(OBK_VOLTAGE), 1000.0f));
+}
+
+// megabytes of synthetic traffic through the ring and each protocol parser
+void Test_UART_Benchmark() {
+	byte stream[256];
+	int len, i, totalBytes;
+
+	totalBytes = 1024 * 1024;
+
+	// TuyaMCU state reports, with some noise that has to be skipped
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	len = 0;
+	for (i = 0; i < 8; i++) {
+		len += Test_UART_FromHex("55AA0307000802020004000000647D", stream + len);
+	}
+	len += Test_UART_FromHex("00FF55", stream + len);
+	i = Test_UART_Pump("TuyaMCU", stream, len, 15, totalBytes, Test_UART_ParseTuya);
+	SELFTEST_ASSERT(i >= (totalBytes / len - 1) * 8);
+
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("startDriver BL0942", 0);
+	Test_UART_MakeBL0942Packet(stream, 3493240);
+	i = Test_UART_Pump("BL0942", stream, UART_TEST_BL0942_LEN, UART_TEST_BL0942_LEN, totalBytes, BL0942_TryToGetNextBL0942Packet);
+	SELFTEST_ASSERT(i >= totalBytes / UART_TEST_BL0942_LEN - 1);
+	SELFTEST_ASSERT(Float_Equals(DRV_GetReading(OBK_VOLTAGE), 230.0f));
+
+	SIM_ClearOBK();
+	CMD_ExecuteCommand("startDriver CSE7766", 0);
+	Test_UART_MakeCSE7766Packet(stream, 1449);
+	i = Test_UART_Pump("CSE7766", stream, UART_TEST_CSE7766_LEN, UART_TEST_CSE7766_LEN, totalBytes, CSE7766_TryToGetNextCSE7766Packet);
+	SELFTEST_ASSERT(i >= totalBytes / UART_TEST_CSE7766_LEN - 1);
+}
+
+#endif
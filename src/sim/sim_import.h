@@ -10,6 +10,8 @@ extern "C" {
 	bool SIM_IsPinADC(int index);
 	void SIM_SetVoltageOnADCPin(int index, float v);
 	int SIM_GetPWMValue(int index);
+	void SIM_SetPinInterruptsEnabled(bool bEnabled);
+	int SIM_GetPinReadCount();
 	// flash control simulation
 	void SIM_SetupFlashFileReading(const char *flashPath);
 	void SIM_SaveFlashData(const char *flashPath);
@@ -17,6 +19,7 @@ extern "C" {
 	void SIM_SetupEmptyFlashModeNoFile();
 	void SIM_DoFreshOBKBoot();
 	void SIM_ClearOBK();
+	void SIM_ClearFlashVars();
 	bool SIM_IsFlashModified();
 	float SIM_GetDeltaTimeSeconds();
 #ifdef __cplusplus
@@ -342,6 +342,7 @@ void Main_OnEverySecond()
 #endif
 
 	// run_adc_test();
+	HAL_FlashVars_RunEverySecond();
 	newMQTTState = MQTT_RunEverySecondUpdate();
 	if(newMQTTState != bMQTTconnected) {
 		bMQTTconnected = newMQTTState;
@@ -505,6 +506,8 @@ void Main_OnEverySecond()
 			ADDLOGF_INFO("HA discovery is scheduled, but MQTT connection is not present yet\n");
 		}
 	}
+	// resumes discovery that did not fit in MQTT queue at once
+	doHomeAssistantDiscoveryStep();
 	if (g_openAP)
     {
 		g_openAP--;
@@ -589,6 +592,8 @@ void Main_OnEverySecond()
                 BL09XX_SaveEmeteringStatistics();
             }
 #endif            
+			// write back any coalesced channel/energy values
+			HAL_FlashVars_Flush();
 			ADDLOGF_INFO("Going to call HAL_RebootModule\r\n");
 			HAL_RebootModule();
 		} else {
@@ -624,23 +629,28 @@ static int g_wifiLedToggleTime = 0;
 static int g_wifi_ledState = 0;
 static uint32_t g_time = 0;
 static uint32_t g_last_time = 0;
+#if (defined WINDOWS) || (defined PLATFORM_BEKEN)
+// time not yet given to SVM_RunThreads
+static int g_scriptPendingMS = 0;
+#endif
 int g_bWantDeepSleep;
 
 /////////////////////////////////////////////////////
 // this is what we do in a qucik tick
 void QuickTick(void *param)
 {
+#if (defined WINDOWS) || (defined PLATFORM_BEKEN)
+	int scriptWakeUp;
+#endif
+
 	if (g_bWantDeepSleep) {
 		PINS_BeginDeepSleep();
 		g_bWantDeepSleep = 0;
 		return;
 	}
 
-#if defined(PLATFORM_BEKEN) && defined(BEKEN_PIN_GPI_INTERRUPTS)
-	// if using interrupt driven GPI for pins, don't call PIN_ticks() in QuickTick
-#else
+	// with edge interrupts, idle input pins are skipped here and not read at all
 	PIN_ticks(param);
-#endif
 
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
 	g_time = rtos_get_time();
@@ -656,7 +666,16 @@ void QuickTick(void *param)
 
 
 #if (defined WINDOWS) || (defined PLATFORM_BEKEN)
-	SVM_RunThreads(t_diff);
+	// scripts are not visited at all until some thread is due
+	g_scriptPendingMS += t_diff;
+	scriptWakeUp = SVM_GetNextWakeUpMS();
+	if (scriptWakeUp < 0) {
+		g_scriptPendingMS = 0;
+	}
+	else if (g_scriptPendingMS >= scriptWakeUp) {
+		SVM_RunThreads(g_scriptPendingMS);
+		g_scriptPendingMS = 0;
+	}
 #endif
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	DRV_RunQuickTick();
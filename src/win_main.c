@@ -28,6 +28,7 @@ int win_frameNum = 0;
 // this time counter is simulated, I need this for unit tests to work
 int g_simulatedTimeNow = 0;
 extern int g_port;
+void SIM_ClearFlashVars();
 #define DEFAULT_FRAME_TIME 5
 
 
@@ -109,13 +110,16 @@ void SIM_Hack_ClearSimulatedPinRoles();
 void SIM_ClearOBK() {
 	if (bObkStarted) {
 		DRV_ShutdownAllDrivers();
-		LOG_DeInit();
 		release_lfs();
 		SIM_Hack_ClearSimulatedPinRoles();
 		WIN_ResetMQTT();
 		CMD_ExecuteCommand("clearAll", 0);
 		CMD_ExecuteCommand("led_expoMode", 0);
+		SIM_ClearFlashVars();
 		Main_Init();
+		// Main_Init has dropped all commands, next log call will
+		// register log commands again
+		LOG_DeInit();
 	}
 }
 void SIM_DoFreshOBKBoot() {
@@ -123,6 +127,9 @@ void SIM_DoFreshOBKBoot() {
 	Main_Init();
 }
 void Win_DoUnitTests() {
+	Test_UART();
+	Test_FlashVars();
+	Test_Drivers();
 	Test_Role_ToggleAll();
 	Test_Demo_FanCyclingRelays();
 	Test_Demo_MapFanSpeedToRelays();
@@ -142,6 +149,7 @@ void Win_DoUnitTests() {
 	Test_RepeatingEvents();
 	Test_ButtonEvents();
 	Test_Commands_Alias();
+	Test_Commands_Lookup();
 	Test_Expressions_RunTests_Basic();
 	Test_LEDDriver();
 	Test_LFS();
@@ -164,6 +172,23 @@ void Win_DoUnitTests() {
 	// reset whole device
 	SIM_ClearOBK();
 }
+// Timing of hot paths, not run with unit tests because it takes a while.
+// Run simulator with "-runBenchmarks 1" to get them printed.
+void Win_DoBenchmarks() {
+	Test_UART_Benchmark();
+	Test_Scripting_Benchmark();
+	Test_Scripting_Labels_Benchmark();
+	Test_Scripting_Scheduler_Benchmark();
+	Test_Commands_Lookup_Benchmark();
+	Test_ChangeHandlers_Benchmark();
+	Test_Expressions_Benchmark();
+	Test_Tasmota_Benchmark();
+	Test_Http_Routes_Benchmark();
+	Test_Http_KeepAlive_Benchmark();
+	Test_TuyaMCU_Benchmark();
+
+	SIM_ClearOBK();
+}
 long g_delta;
 float SIM_GetDeltaTimeSeconds() {
 	return g_delta * 0.001f;
@@ -188,6 +213,7 @@ int g_bDoingUnitTestsNow = 0;
 int __cdecl main(int argc, char **argv)
 {
 	bool bWantsUnitTests = 1;
+	bool bWantsBenchmarks = 0;
 
 	if (argc > 1) {
 		int value;
@@ -206,6 +232,12 @@ int __cdecl main(int argc, char **argv)
 					if (i < argc && sscanf(argv[i], "%d", &value) == 1) {
 						bWantsUnitTests = value != 0;
 					}
+				} else if (wal_strnicmp(argv[i] + 1, "runBenchmarks", 13) == 0) {
+					i++;
+
+					if (i < argc && sscanf(argv[i], "%d", &value) == 1) {
+						bWantsBenchmarks = value != 0;
+					}
 				}
 			}
 		}
@@ -282,6 +314,14 @@ int __cdecl main(int argc, char **argv)
 		Sim_RunFrames(50, false);
 		g_bDoingUnitTestsNow = 0;
 	}
+	if (bWantsBenchmarks) {
+		g_bDoingUnitTestsNow = 1;
+		if (bWantsUnitTests == false) {
+			SIM_DoFreshOBKBoot();
+		}
+		Win_DoBenchmarks();
+		g_bDoingUnitTestsNow = 0;
+	}
 
 
 	SIM_CreateWindow(argc, argv);